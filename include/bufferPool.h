@@ -0,0 +1,104 @@
+/**
+ * @file bufferPool.h
+ * @author Lukas Grando
+ * @brief Fichier d'en-tête de la réserve de buffers d'entrée/sortie.
+ * @details Les buffers des messages (buffer_t, writers qui grandissent, messages reçus) sont empruntés à une réserve
+ * rangée par classes de taille (puissances de 2 de BUFFER_POOL_MIN_SIZE à BUFFER_POOL_MAX_SIZE) puis rendus : le
+ * serveur réutilise les mêmes buffers d'une requête à l'autre au lieu d'allouer et libérer des centaines de Ko à
+ * chaque message. Chaque thread garde quelques petits buffers (BUFFER_POOL_THREAD_KEEP par classe, jusqu'à
+ * 1 << BUFFER_POOL_THREAD_MAX_SHIFT octets) qu'il reprend et rend sans verrou : un client du serveur qui
+ * enchaîne les requêtes ne croise pas les autres threads. Derrière, la réserve partagée, protégée par un verrou,
+ * garde au plus BUFFER_POOL_KEEP buffers par classe et BUFFER_POOL_MAX_HELD octets en tout, le reste est libéré.
+ * Le cache d'un thread qui se termine est rendu à la réserve partagée.
+ * @version 1.0
+ * @author Lukas Grando
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common.h"
+
+#define BUFFER_POOL_MIN_SHIFT 12 //!< Plus petite classe : 4 Ko
+#define BUFFER_POOL_MAX_SHIFT 25 //!< Plus grande classe : 32 Mo (un message de MESSAGE_MAX_SIZE octets et son '\0')
+#define BUFFER_POOL_MIN_SIZE ((size_t) 1 << BUFFER_POOL_MIN_SHIFT) //!< Taille de la plus petite classe
+#define BUFFER_POOL_MAX_SIZE ((size_t) 1 << BUFFER_POOL_MAX_SHIFT) //!< Taille de la plus grande classe
+#define BUFFER_POOL_CLASSES (BUFFER_POOL_MAX_SHIFT - BUFFER_POOL_MIN_SHIFT + 1) //!< Nombre de classes de taille
+#define BUFFER_POOL_KEEP 8 //!< Nombre maximum de buffers gardés par classe
+#define BUFFER_POOL_MAX_HELD ((size_t) 64 << 20) //!< Mémoire maximum gardée par la réserve partagée (64 Mo)
+#define BUFFER_POOL_THREAD_KEEP 2 //!< Nombre maximum de buffers gardés par classe dans le cache d'un thread
+#define BUFFER_POOL_THREAD_MAX_SHIFT 20 //!< Plus grande classe gardée dans le cache d'un thread : 1 Mo
+
+/**
+ * @struct buffer_pool_stats_t
+ * @brief Compteurs de la réserve depuis le démarrage
+ */
+typedef struct {
+    unsigned long allocations; /*!< Buffers alloués avec malloc (la réserve n'en avait pas de la bonne classe) */
+    unsigned long reuses; /*!< Buffers repris dans la réserve sans allocation */
+    unsigned long releases; /*!< Buffers rendus */
+    unsigned long frees; /*!< Buffers libérés avec free (réserve pleine, trop grands ou buffer_pool_trim) */
+    size_t held; /*!< Nombre de buffers gardés dans la réserve et les caches des threads */
+    size_t heldBytes; /*!< Octets gardés dans la réserve et les caches des threads */
+    size_t usedBytes; /*!< Octets des buffers empruntés et pas encore rendus */
+    size_t peakBytes; /*!< Plus grande valeur de usedBytes */
+} buffer_pool_stats_t;
+
+/**
+ * @fn char *buffer_pool_get(size_t size)
+ * @brief Emprunte un buffer d'au moins size octets
+ * @param size La taille demandée
+ * @return Le buffer, de la taille de sa classe (voir buffer_pool_capacity), à rendre avec buffer_pool_release
+ * @note Le contenu du buffer n'est pas initialisé
+ */
+char *buffer_pool_get(size_t size);
+
+/**
+ * @fn char *buffer_pool_resize(char *buffer, size_t size)
+ * @brief Agrandit un buffer emprunté en gardant son contenu
+ * @param buffer Le buffer (NULL pour en emprunter un nouveau)
+ * @param size La nouvelle taille
+ * @return Le buffer, déplacé dans une classe plus grande si nécessaire (l'ancien est alors rendu)
+ */
+char *buffer_pool_resize(char *buffer, size_t size);
+
+/**
+ * @fn size_t buffer_pool_capacity(const char *buffer)
+ * @brief Taille utilisable d'un buffer emprunté
+ * @param buffer Le buffer
+ * @return La taille de sa classe, ou la taille demandée pour un buffer plus grand que BUFFER_POOL_MAX_SIZE
+ */
+size_t buffer_pool_capacity(const char *buffer);
+
+/**
+ * @fn void buffer_pool_release(char *buffer)
+ * @brief Rend un buffer à la réserve
+ * @param buffer Le buffer (NULL accepté)
+ */
+void buffer_pool_release(char *buffer);
+
+/**
+ * @fn void buffer_pool_trim()
+ * @brief Libère tous les buffers gardés par la réserve partagée et par le cache du thread appelant
+ */
+void buffer_pool_trim();
+
+/**
+ * @fn void get_buffer_pool_stats(buffer_pool_stats_t *stats)
+ * @brief Lit les compteurs de la réserve
+ * @param stats Reçoit les compteurs
+ * @note Les compteurs sont lus un par un, sans verrou : ils peuvent venir de deux instants proches
+ */
+void get_buffer_pool_stats(buffer_pool_stats_t *stats);
+
+/**
+ * @fn void print_buffer_pool_stats(FILE *stream)
+ * @brief Ecrit les compteurs de la réserve sur une ligne
+ * @param stream Le flux de sortie
+ */
+void print_buffer_pool_stats(FILE *stream);
+
+#endif
@@ -0,0 +1,308 @@
+/**
+ * @file codec.h
+ * @brief Ecriture et lecture séquentielles des messages sérialisés
+ * @details Un writer ajoute les données à la suite d'un curseur, sans jamais relire ce qui est déjà écrit :
+ * sérialiser un message coûte un temps proportionnel à sa taille. Le stockage est soit un buffer fixe fourni par
+ * l'appelant (un buffer_t par exemple), soit un buffer emprunté à la réserve (voir bufferPool.h) qui grandit à la demande.
+ * Une écriture qui ne tient pas dans un buffer fixe n'est pas faite et lève l'indicateur overflow :
+ * le message n'est jamais tronqué au milieu d'un champ ni écrit hors du buffer.
+ * Un reader décode les champs directement dans le buffer reçu, en une passe et sans copie. La première erreur
+ * rencontrée est gardée (codec_error_t) et fait échouer toutes les lectures suivantes : l'appelant la teste
+ * une fois à la fin du message.
+ * Les messages binaires commencent par un en-tête de CODEC_HEADER_SIZE octets (magic, version, type, taille du
+ * contenu en big endian) et leurs champs entiers sont des varints : 7 bits par octet, le bit de poids fort indique
+ * qu'un octet suit. Le premier octet du magic n'est pas du texte, un message binaire ne se confond jamais avec un
+ * message texte.
+ * @version 1.0
+ * @author Lukas Grando
+ */
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include "common.h"
+#include "bufferPool.h"
+
+#define WRITER_DEFAULT_CAPACITY 4096 /*!< Taille initiale d'un writer qui grandit */
+#define CODEC_MAGIC "\x89MPP" /*!< Premiers octets d'un message binaire */
+#define CODEC_MAGIC_SIZE 4 /*!< Taille du magic */
+#define CODEC_HEADER_SIZE (CODEC_MAGIC_SIZE + 6) /*!< Taille de l'en-tête : magic, version, type, taille sur 4 octets */
+#define CODEC_MAX_PAYLOAD 0x7FFFFFFFUL /*!< Plus grand contenu d'un message binaire */
+
+/**
+ * @struct writer_t
+ * @brief Curseur d'écriture dans un buffer
+ * @note Le contenu reste terminé par '\0', le texte écrit peut être utilisé comme une chaîne
+ */
+typedef struct {
+    char *data; /*!< Début du buffer */
+    size_t length; /*!< Nombre d'octets écrits (position du curseur) */
+    size_t capacity; /*!< Taille du buffer, '\0' final compris */
+    int growable; /*!< 1 si le buffer appartient au writer et peut être agrandi */
+    int overflow; /*!< 1 si une écriture n'a pas tenu dans le buffer */
+} writer_t;
+
+/**
+ * @enum codec_error_t
+ * @brief Erreur de lecture d'un message
+ */
+typedef enum {
+    CODEC_OK = 0, /*!< Pas d'erreur */
+    CODEC_ERROR_TRUNCATED, /*!< Le message s'arrête avant la fin d'un champ */
+    CODEC_ERROR_SYNTAX, /*!< Caractère inattendu */
+    CODEC_ERROR_RANGE, /*!< Valeur hors des bornes du champ */
+} codec_error_t;
+
+/**
+ * @struct reader_t
+ * @brief Curseur de lecture dans un buffer reçu
+ * @note Le buffer n'est jamais modifié. Un message texte s'arrête à length octets ou au premier '\0', un message
+ * binaire seulement à length octets
+ */
+typedef struct {
+    const char *data; /*!< Début du buffer */
+    size_t length; /*!< Taille du buffer */
+    size_t position; /*!< Position du curseur */
+    codec_error_t error; /*!< Première erreur rencontrée */
+} reader_t;
+
+/**
+ * @fn void init_writer(writer_t *writer, char *storage, size_t capacity)
+ * @brief Initialise un writer vide
+ * @param writer Le writer
+ * @param storage Le buffer fixe dans lequel écrire, NULL pour un buffer alloué qui grandit
+ * @param capacity La taille du buffer fixe ou la taille initiale du buffer emprunté (WRITER_DEFAULT_CAPACITY si 0)
+ * @note Un writer qui grandit se libère avec free_writer
+ */
+void init_writer(writer_t *writer, char *storage, size_t capacity);
+
+/**
+ * @fn void free_writer(writer_t *writer)
+ * @brief Rend à la réserve le buffer d'un writer qui grandit (sans effet sur un buffer fixe)
+ * @param writer Le writer
+ */
+void free_writer(writer_t *writer);
+
+/**
+ * @fn int writer_reserve(writer_t *writer, size_t size)
+ * @brief S'assure que size octets peuvent encore être écrits
+ * @param writer Le writer
+ * @param size Le nombre d'octets
+ * @return 0 si la place est disponible, -1 sinon (overflow est alors levé)
+ */
+int writer_reserve(writer_t *writer, size_t size);
+
+/**
+ * @fn void writer_put_bytes(writer_t *writer, const void *bytes, size_t size)
+ * @brief Ecrit des octets au curseur
+ * @param writer Le writer
+ * @param bytes Les octets
+ * @param size Le nombre d'octets
+ */
+void writer_put_bytes(writer_t *writer, const void *bytes, size_t size);
+
+/**
+ * @fn void writer_put_char(writer_t *writer, char c)
+ * @brief Ecrit un caractère au curseur
+ * @param writer Le writer
+ * @param c Le caractère
+ */
+void writer_put_char(writer_t *writer, char c);
+
+/**
+ * @fn void writer_put_string(writer_t *writer, const char *string)
+ * @brief Ecrit une chaîne (sans son '\0') au curseur
+ * @param writer Le writer
+ * @param string La chaîne
+ */
+void writer_put_string(writer_t *writer, const char *string);
+
+/**
+ * @fn void writer_put_int(writer_t *writer, long value)
+ * @brief Ecrit un entier en décimal au curseur
+ * @param writer Le writer
+ * @param value L'entier
+ * @note Plus rapide que writer_printf pour les champs numériques des messages
+ */
+void writer_put_int(writer_t *writer, long value);
+
+/**
+ * @fn void writer_printf(writer_t *writer, const char *format, ...)
+ * @brief Ecrit du texte formaté au curseur
+ * @param writer Le writer
+ * @param format Le format (voir printf)
+ * @param ... Les arguments du format
+ */
+void writer_printf(writer_t *writer, const char *format, ...);
+
+/**
+ * @fn void init_reader(reader_t *reader, const char *data, size_t length)
+ * @brief Initialise un reader au début d'un buffer
+ * @param reader Le reader
+ * @param data Le buffer (non copié, il doit rester valable pendant la lecture)
+ * @param length La taille du buffer
+ */
+void init_reader(reader_t *reader, const char *data, size_t length);
+
+/**
+ * @fn int reader_peek(reader_t *reader)
+ * @brief Saute les espaces et renvoie le caractère suivant sans le consommer
+ * @param reader Le reader
+ * @return Le caractère, -1 à la fin du message ou après une erreur
+ */
+int reader_peek(reader_t *reader);
+
+/**
+ * @fn int reader_at_end(reader_t *reader)
+ * @brief Saute les espaces et les lignes vides et indique si le message est terminé
+ * @param reader Le reader
+ * @return 1 s'il ne reste rien à lire (ou après une erreur), 0 sinon
+ */
+int reader_at_end(reader_t *reader);
+
+/**
+ * @fn codec_error_t reader_get_int(reader_t *reader, long min, long max, long *value)
+ * @brief Lit un entier décimal
+ * @param reader Le reader
+ * @param min La plus petite valeur acceptée
+ * @param max La plus grande valeur acceptée
+ * @param value Reçoit l'entier (inchangé en cas d'erreur)
+ * @return L'erreur du reader (CODEC_OK si l'entier est lu)
+ */
+codec_error_t reader_get_int(reader_t *reader, long min, long max, long *value);
+
+/**
+ * @fn codec_error_t reader_get_word(reader_t *reader, char *word, size_t size)
+ * @brief Lit un mot (jusqu'au prochain espace ou retour à la ligne), éventuellement vide
+ * @note Le mot commence juste après le séparateur du champ précédent
+ * @param reader Le reader
+ * @param word Reçoit le mot terminé par '\0'
+ * @param size La taille de word, '\0' compris
+ * @return L'erreur du reader (CODEC_ERROR_RANGE si le mot est trop long)
+ */
+codec_error_t reader_get_word(reader_t *reader, char *word, size_t size);
+
+/**
+ * @fn codec_error_t reader_end_line(reader_t *reader)
+ * @brief Termine une ligne : seuls des espaces peuvent rester avant le retour à la ligne
+ * @param reader Le reader
+ * @return L'erreur du reader (CODEC_ERROR_SYNTAX s'il reste un champ sur la ligne)
+ * @note Les lignes vides qui suivent sont sautées, la fin du message termine aussi la ligne
+ */
+codec_error_t reader_end_line(reader_t *reader);
+
+/**
+ * @fn void writer_put_varint(writer_t *writer, unsigned long value)
+ * @brief Ecrit un entier positif en varint au curseur
+ * @param writer Le writer
+ * @param value L'entier (1 octet jusqu'à 127, 2 jusqu'à 16383...)
+ */
+void writer_put_varint(writer_t *writer, unsigned long value);
+
+/**
+ * @fn void writer_put_svarint(writer_t *writer, long value)
+ * @brief Ecrit un entier signé en varint au curseur
+ * @param writer Le writer
+ * @param value L'entier, codé en zigzag (0, -1, 1, -2... deviennent 0, 1, 2, 3...) pour que les petites valeurs
+ * négatives restent courtes
+ */
+void writer_put_svarint(writer_t *writer, long value);
+
+/**
+ * @fn void writer_put_lstring(writer_t *writer, const char *string)
+ * @brief Ecrit une chaîne précédée de sa taille en varint
+ * @param writer Le writer
+ * @param string La chaîne
+ */
+void writer_put_lstring(writer_t *writer, const char *string);
+
+/**
+ * @fn size_t writer_begin_message(writer_t *writer, int version, int type)
+ * @brief Ecrit l'en-tête d'un message binaire, dont la taille est complétée par writer_end_message
+ * @param writer Le writer
+ * @param version La version du format
+ * @param type Le type du message
+ * @return La position de l'en-tête, à passer à writer_end_message
+ */
+size_t writer_begin_message(writer_t *writer, int version, int type);
+
+/**
+ * @fn void writer_end_message(writer_t *writer, size_t header)
+ * @brief Termine un message binaire : la taille du contenu écrit depuis l'en-tête est reportée dans l'en-tête
+ * @param writer Le writer
+ * @param header La position de l'en-tête (voir writer_begin_message)
+ */
+void writer_end_message(writer_t *writer, size_t header);
+
+/**
+ * @fn int codec_is_binary(const char *data, size_t length)
+ * @brief Indique si un buffer commence par un message binaire
+ * @param data Le buffer
+ * @param length La taille du buffer
+ * @return 1 si le buffer commence par le magic, 0 sinon
+ */
+int codec_is_binary(const char *data, size_t length);
+
+/**
+ * @fn size_t codec_message_length(const char *data, size_t capacity)
+ * @brief Calcule la taille d'un message à envoyer
+ * @param data Le buffer contenant le message
+ * @param capacity La taille du buffer
+ * @return En-tête et contenu pour un message binaire, texte et '\0' final pour un message texte (au plus capacity)
+ */
+size_t codec_message_length(const char *data, size_t capacity);
+
+/**
+ * @fn codec_error_t reader_get_header(reader_t *reader, int *version, int *type)
+ * @brief Lit l'en-tête d'un message binaire et limite le reader à son contenu
+ * @param reader Le reader, placé au début du message
+ * @param version Reçoit la version du format
+ * @param type Reçoit le type du message
+ * @return L'erreur du reader (CODEC_ERROR_SYNTAX sans magic, CODEC_ERROR_TRUNCATED si le contenu dépasse le buffer)
+ */
+codec_error_t reader_get_header(reader_t *reader, int *version, int *type);
+
+/**
+ * @fn codec_error_t reader_get_varint(reader_t *reader, unsigned long max, unsigned long *value)
+ * @brief Lit un entier positif codé en varint
+ * @param reader Le reader
+ * @param max La plus grande valeur acceptée
+ * @param value Reçoit l'entier (inchangé en cas d'erreur)
+ * @return L'erreur du reader (CODEC_OK si l'entier est lu)
+ */
+codec_error_t reader_get_varint(reader_t *reader, unsigned long max, unsigned long *value);
+
+/**
+ * @fn codec_error_t reader_get_svarint(reader_t *reader, long min, long max, long *value)
+ * @brief Lit un entier signé codé en varint (voir writer_put_svarint)
+ * @param reader Le reader
+ * @param min La plus petite valeur acceptée
+ * @param max La plus grande valeur acceptée
+ * @param value Reçoit l'entier (inchangé en cas d'erreur)
+ * @return L'erreur du reader (CODEC_OK si l'entier est lu)
+ */
+codec_error_t reader_get_svarint(reader_t *reader, long min, long max, long *value);
+
+/**
+ * @fn codec_error_t reader_get_lstring(reader_t *reader, char *string, size_t size)
+ * @brief Lit une chaîne précédée de sa taille en varint
+ * @param reader Le reader
+ * @param string Reçoit la chaîne terminée par '\0'
+ * @param size La taille de string, '\0' compris
+ * @return L'erreur du reader (CODEC_ERROR_RANGE si la chaîne est trop longue)
+ */
+codec_error_t reader_get_lstring(reader_t *reader, char *string, size_t size);
+
+/**
+ * @fn const char *codec_error2str(codec_error_t error)
+ * @brief Convertit une erreur de lecture en chaîne de caractères
+ * @param error L'erreur
+ * @return La chaîne (statique, à ne pas libérer)
+ */
+const char *codec_error2str(codec_error_t error);
+
+#endif // CODEC_H
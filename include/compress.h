@@ -0,0 +1,130 @@
+/**
+ * @file compress.h
+ * @author Lukas Grando
+ * @brief Fichier d'en-tête de la compression des messages, sans dépendance externe.
+ * @details Deux étages, pensés pour les suites de notes :
+ * - les colonnes RLE : une colonne garde un champ (instrument, octave, durée...) de toutes les notes d'un channel, les
+ * valeurs répétées y sont écrites une fois avec leur nombre de répétitions ;
+ * - le bloc LZ : les octets répétés à moins de LZ_WINDOW octets sont remplacés par une référence (distance, taille)
+ * vers leur première occurrence. Le décodage ne fait que des copies, sans table ni entropie : il va bien plus vite
+ * que le réseau et le disque.
+ * @version 1.0
+ * @author Lukas Grando
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "codec.h"
+
+#define LZ_MIN_MATCH 4 //!< Plus petite répétition remplacée par une référence
+#define LZ_WINDOW 65535 //!< Plus grande distance d'une référence
+#define LZ_HASH_BITS 14 //!< Taille de la table des positions (2^14 entrées) utilisée par la compression
+#define LZ_TOKEN_MAX 15 //!< Valeur d'un champ du jeton au-delà de laquelle la taille continue en varint
+
+/**
+ * @struct rle_writer_t
+ * @brief Colonne de valeurs en cours d'écriture
+ */
+typedef struct {
+    writer_t writer; /*!< Valeurs écrites, chacune suivie de son nombre de répétitions moins un */
+    unsigned long value; /*!< Valeur en cours de répétition */
+    unsigned long run; /*!< Nombre de répétitions de value pas encore écrites */
+} rle_writer_t;
+
+/**
+ * @struct rle_reader_t
+ * @brief Colonne de valeurs en cours de lecture
+ */
+typedef struct {
+    reader_t reader; /*!< Valeurs et répétitions */
+    unsigned long value; /*!< Valeur en cours de répétition */
+    unsigned long remaining; /*!< Répétitions de value pas encore lues */
+} rle_reader_t;
+
+/**
+ * @fn void init_rle_writer(rle_writer_t *rle)
+ * @brief Initialise une colonne vide, dans un buffer qui grandit
+ * @param rle La colonne
+ * @note La colonne se libère avec free_rle_writer
+ */
+void init_rle_writer(rle_writer_t *rle);
+
+/**
+ * @fn void rle_put(rle_writer_t *rle, unsigned long value)
+ * @brief Ajoute une valeur à la colonne
+ * @param rle La colonne
+ * @param value La valeur
+ */
+void rle_put(rle_writer_t *rle, unsigned long value);
+
+/**
+ * @fn void rle_flush(rle_writer_t *rle)
+ * @brief Ecrit la dernière suite de valeurs, avant de lire rle->writer
+ * @param rle La colonne
+ */
+void rle_flush(rle_writer_t *rle);
+
+/**
+ * @fn void free_rle_writer(rle_writer_t *rle)
+ * @brief Libère le buffer d'une colonne
+ * @param rle La colonne
+ */
+void free_rle_writer(rle_writer_t *rle);
+
+/**
+ * @fn void init_rle_reader(rle_reader_t *rle, const char *data, size_t length)
+ * @brief Initialise la lecture d'une colonne
+ * @param rle La colonne
+ * @param data Les octets de la colonne (voir rle_flush)
+ * @param length Le nombre d'octets
+ */
+void init_rle_reader(rle_reader_t *rle, const char *data, size_t length);
+
+/**
+ * @fn codec_error_t rle_get(rle_reader_t *rle, unsigned long max, unsigned long *value)
+ * @brief Lit la valeur suivante d'une colonne
+ * @param rle La colonne
+ * @param max La plus grande valeur acceptée
+ * @param value Reçoit la valeur (inchangée en cas d'erreur)
+ * @return L'erreur du reader de la colonne (CODEC_OK si la valeur est lue)
+ */
+codec_error_t rle_get(rle_reader_t *rle, unsigned long max, unsigned long *value);
+
+/**
+ * @def RLE_GET(rle, max, out)
+ * @brief Lit la valeur suivante d'une colonne comme rle_get, sans appel de fonction tant que la suite en cours continue
+ * @note Une colonne de musique se lit une fois par note : l'appel ne se fait qu'au début de chaque suite
+ */
+#define RLE_GET(rle, max, out) ((rle)->remaining > 0 && (rle)->value <= (max) \
+    ? ((rle)->remaining--, *(out) = (rle)->value, CODEC_OK) : rle_get((rle), (max), (out)))
+
+/**
+ * @fn void writer_put_lz(writer_t *writer, const char *data, size_t length)
+ * @brief Ecrit un bloc d'octets compressé au curseur
+ * @param writer Le writer
+ * @param data Les octets à compresser
+ * @param length Le nombre d'octets
+ * @note Le bloc est écrit ainsi : <taille décompressée en varint> puis des séquences <jeton> [<littéraux en varint>]
+ * <littéraux> [<distance en varint> [<taille en varint>]]. Les 4 bits de poids fort du jeton donnent le nombre
+ * de littéraux, les 4 bits de poids faible la taille de la référence moins LZ_MIN_MATCH ; LZ_TOKEN_MAX annonce un
+ * varint à ajouter. La dernière séquence n'a pas de référence.
+ */
+void writer_put_lz(writer_t *writer, const char *data, size_t length);
+
+/**
+ * @fn codec_error_t reader_get_lz(reader_t *reader, size_t max, char **data, size_t *length)
+ * @brief Lit et décompresse un bloc écrit par writer_put_lz
+ * @param reader Le reader, placé au début du bloc
+ * @param max La plus grande taille décompressée acceptée
+ * @param data Reçoit les octets décompressés, suivis d'un '\0', dans un buffer de la réserve (à rendre avec
+ * buffer_pool_release), NULL en cas d'erreur
+ * @param length Reçoit le nombre d'octets décompressés
+ * @return L'erreur du reader (CODEC_ERROR_RANGE si une référence sort du bloc ou si le bloc dépasse max)
+ */
+codec_error_t reader_get_lz(reader_t *reader, size_t max, char **data, size_t *length);
+
+#endif
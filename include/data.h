@@ -2,6 +2,10 @@
  * @file data.h
  * @author Lukas Grando
  * @brief Fichier d'en-tête pour la bliothèque data.
+ * @details En mode stream, chaque message est précédé d'un en-tête de MESSAGE_HEADER_SIZE octets qui donne sa taille :
+ * le récepteur lit exactement le message, quel que soit le découpage des lectures, et le contenu peut contenir des
+ * '\0'. Un message sans en-tête (pair MPP 1.0) commence par un octet non nul : il est reconnu et lu jusqu'à sa fin,
+ * et la réponse est envoyée sans en-tête elle aussi.
  * @version 1.0
  * @author Lukas Grando
  */
@@ -10,6 +14,7 @@
 #define DATA_H
 
 #include "session.h"
+#include "codec.h"
 #include <stdarg.h>
 
 #ifdef DATA_DEBUG /*!< Si DATA_DEBUG est défini */
@@ -26,6 +31,11 @@ typedef char buffer_t[MAX_BUFF]; //!< Type de buffer
 typedef void* generic_t; //!< Type de donnée générique
 
 typedef void (*serialize_t)(generic_t, generic_t); //!< Fonction de sérialisation prenant en paramètre un pointeur vers une donnée générique et un pointeur vers un buffer.
+typedef int (*encode_t)(writer_t *, generic_t); //!< Fonction d'encodage à la suite d'un writer (0 si la donnée est écrite en entier, -1 sinon).
+typedef codec_error_t (*decode_t)(reader_t *, generic_t); //!< Fonction de décodage depuis un reader.
+
+#define MESSAGE_HEADER_SIZE 4 //!< Taille de l'en-tête d'un message en mode stream : la taille du contenu en big endian
+#define MESSAGE_MAX_SIZE (1 << 24) //!< Plus grand message accepté (16 Mo) : le premier octet d'un en-tête est toujours nul
 
 /**
  * @fn void send_data(socket_t *socket, generic_t data, serialize_t serializeFunc, ...)
@@ -54,4 +64,26 @@ void send_data(socket_t *socket, generic_t data, serialize_t serializeFunc, ...)
  */
 void recv_data(socket_t *socket, generic_t data, serialize_t dserializeFunc, ...);
 
+/**
+ * @fn int send_message(socket_t *socket, generic_t data, encode_t encodeFunc)
+ * @brief Encode une donnée dans un buffer de la taille exacte du message et l'envoie en mode stream
+ * @param socket La socket sur laquelle envoyer le message.
+ * @param data La donnée à envoyer.
+ * @param encodeFunc La fonction d'encodage (encode_mpp_request par exemple).
+ * @return 0 si le message est envoyé, -1 s'il atteint MESSAGE_MAX_SIZE (rien n'est alors envoyé)
+ * @note L'en-tête et le contenu partent en un seul appel à writev
+ */
+int send_message(socket_t *socket, generic_t data, encode_t encodeFunc);
+
+/**
+ * @fn codec_error_t recv_message(socket_t *socket, generic_t data, decode_t decodeFunc)
+ * @brief Reçoit un message entier en mode stream et le décode
+ * @param socket La socket sur laquelle recevoir le message.
+ * @param data La donnée à remplir.
+ * @param decodeFunc La fonction de décodage (decode_mpp_request par exemple).
+ * @return L'erreur de décodage, CODEC_ERROR_TRUNCATED si la connexion est fermée avant la fin du message
+ * @note socket->framed indique ensuite si le pair encadre ses messages
+ */
+codec_error_t recv_message(socket_t *socket, generic_t data, decode_t decodeFunc);
+
 #endif // DATA_H
\ No newline at end of file
@@ -0,0 +1,150 @@
+/**
+ * \file engine.h
+ * \brief Surveillance de la charge du moteur audio et adaptation de la qualité de synthèse
+ * \details Chaque bloc rendu est chronométré et comparé au temps réel qu'il représente.
+ * Quand la marge diminue, le moteur passe sur des chemins moins coûteux (moins de partiels,
+ * interpolation plus simple, saturation approchée) puis remonte quand la charge redescend.
+ * Chaque changement de qualité et chaque sous-alimentation du pcm est enregistré dans un journal.
+ * Le moteur porte aussi la fréquence d'échantillonnage, choisie au démarrage parmi ENGINE_SUPPORTED_RATES.
+ * \version 1.0
+ * \author Tomas Salvado Robalo & Lukas Grando
+ */
+#ifndef ENGINE_H
+#define ENGINE_H
+
+/* ------------------------------------------------------------------------ */
+/*                   E N T Ê T E S    S T A N D A R D S                     */
+/* ------------------------------------------------------------------------ */
+#include <time.h>
+#include <pthread.h>
+#include "common.h"
+#include "resampler.h"
+
+/* ------------------------------------------------------------------------ */
+/*              C O N S T A N T E S     S Y M B O L I Q U E S               */
+/* ------------------------------------------------------------------------ */
+#define ENGINE_DEFAULT_RATE 48000 /*!< Fréquence d'échantillonnage par défaut */
+#define ENGINE_SUPPORTED_RATES {22050, 32000, 44100, 48000} /*!< Fréquences d'échantillonnage acceptées */
+#define ENGINE_BLOCK_FRAMES 1024 /*!< Nombre d'échantillons rendus et écrits à la fois */
+#define ENGINE_LOAD_DOWN 0.70 /*!< Charge (temps de rendu / durée du bloc) au delà de laquelle on dégrade */
+#define ENGINE_LOAD_UP 0.30 /*!< Charge en deçà de laquelle on peut remonter la qualité */
+#define ENGINE_UP_BLOCKS 64 /*!< Nombre de blocs consécutifs sous ENGINE_LOAD_UP avant de remonter */
+#define ENGINE_LOAD_SMOOTHING 0.2 /*!< Coefficient de la moyenne glissante de la charge */
+#define ENGINE_EVENTS_MAX 64 /*!< Taille du journal des événements */
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \enum engine_quality_t
+ * \brief Niveau de qualité de la synthèse, du plus cher au moins cher
+ */
+typedef enum {
+    ENGINE_QUALITY_HIGH = 0, /*!< Tous les partiels, interpolation sinc, tanh exacte */
+    ENGINE_QUALITY_MEDIUM, /*!< Partiels réduits, interpolation cubique, tanh approchée */
+    ENGINE_QUALITY_LOW, /*!< Partiels minimum, interpolation linéaire, tanh approchée */
+    ENGINE_QUALITY_NB /*!< Nombre de niveaux */
+} engine_quality_t;
+
+/**
+ * \enum engine_event_type_t
+ * \brief Type d'un événement du journal
+ */
+typedef enum {
+    ENGINE_EVENT_DEGRADE = 0, /*!< La qualité a baissé */
+    ENGINE_EVENT_RESTORE, /*!< La qualité est remontée */
+    ENGINE_EVENT_UNDERRUN /*!< Le pcm n'a pas été alimenté à temps */
+} engine_event_type_t;
+
+/**
+ * \struct engine_event_t
+ * \brief Un événement du journal
+ */
+typedef struct {
+    struct timespec date; /*!< Date de l'événement (horloge monotone) */
+    engine_event_type_t type; /*!< Type de l'événement */
+    engine_quality_t quality; /*!< Qualité après l'événement */
+    double load; /*!< Charge moyenne au moment de l'événement */
+} engine_event_t;
+
+/* ------------------------------------------------------------------------ */
+/*            P R O T O T Y P E S    D E    F O N C T I O N S               */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn int engine_set_sample_rate(int rate)
+ * \brief Choisit la fréquence d'échantillonnage du moteur
+ * \param rate La fréquence, parmi ENGINE_SUPPORTED_RATES
+ * \return 0 si la fréquence est acceptée, -1 sinon (la fréquence courante est conservée)
+ * \note A appeler avant d'ouvrir un pcm : toute la synthèse et les durées suivent cette fréquence
+ */
+int engine_set_sample_rate(int rate);
+
+/**
+ * \fn int engine_get_sample_rate()
+ * \brief Récupère la fréquence d'échantillonnage du moteur
+ * \return La fréquence en Hz
+ */
+int engine_get_sample_rate();
+
+/**
+ * \fn int engine_get_oversampling(int targetRate)
+ * \brief Calcule le facteur de suréchantillonnage d'un étage non linéaire
+ * \param targetRate La fréquence à laquelle l'étage voudrait travailler
+ * \return Le facteur (au moins 1), réduit quand la qualité baisse
+ */
+int engine_get_oversampling(int targetRate);
+
+/**
+ * \fn engine_quality_t engine_get_quality()
+ * \brief Récupère la qualité de synthèse courante
+ * \return La qualité
+ */
+engine_quality_t engine_get_quality();
+
+/**
+ * \fn double engine_get_load()
+ * \brief Récupère la charge moyenne du moteur
+ * \return La charge (1.0 = le rendu prend exactement le temps réel)
+ */
+double engine_get_load();
+
+/**
+ * \fn struct timespec engine_block_begin()
+ * \brief Débute le chronométrage du rendu d'un bloc
+ * \return La date de début du rendu
+ */
+struct timespec engine_block_begin();
+
+/**
+ * \fn void engine_block_end(struct timespec start, size_t frames, int rate)
+ * \brief Termine le chronométrage d'un bloc et adapte la qualité
+ * \param start La date de début du rendu
+ * \param frames Le nombre d'échantillons rendus
+ * \param rate La fréquence d'échantillonnage du bloc
+ */
+void engine_block_end(struct timespec start, size_t frames, int rate);
+
+/**
+ * \fn void engine_report_underrun()
+ * \brief Signale une sous-alimentation du pcm et dégrade la qualité
+ */
+void engine_report_underrun();
+
+/**
+ * \fn int engine_get_events(engine_event_t *out, int max)
+ * \brief Copie les derniers événements du journal, du plus ancien au plus récent
+ * \param out Le tableau à remplir
+ * \param max La taille du tableau
+ * \return Le nombre d'événements copiés
+ */
+int engine_get_events(engine_event_t *out, int max);
+
+/**
+ * \fn void engine_reset()
+ * \brief Remet le moteur en qualité maximale et vide le journal
+ */
+void engine_reset();
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * \file instrument.h
+ * \brief Instruments décrits par fichier et compilés en tables de partiels
+ * \details Un fichier .inst décrit un instrument ligne par ligne :
+ * \code
+ * # commentaire
+ * id 12                          # identifiant de l'instrument, enregistré dans chaque note (obligatoire)
+ * name BELL                       # nom affiché (4 caractères)
+ * osc saw 12                      # série harmonique (sine, saw, square, triangle) et nombre d'harmoniques
+ * partial 2.76 0.4                # partiel sinusoïdal isolé : rapport à la fondamentale et amplitude
+ * effect fuzz                     # chaîne d'effets (fuzz, compression), appliquée dans l'ordre
+ * envelope 0.01 0.3 0.5 0.2       # attaque (s), déclin (s), maintien (niveau), relâchement (s)
+ * gain 1.0                        # gain global
+ * \endcode
+ * Au chargement, chaque oscillateur est développé en partiels sinusoïdaux, triés par fréquence et rangés
+ * en tableaux contigus (rapports, amplitudes). Tous les instruments sont ensuite rendus par le même noyau
+ * de rotation de phase, sans aucun test sur le type d'instrument pendant le rendu.
+ * L'identifiant d'un instrument est déclaré dans son fichier, entre INSTRUMENT_NB et INSTRUMENT_PLUGIN_FIRST exclu :
+ * ajouter ou renommer un fichier ne change donc pas les instruments des morceaux enregistrés. Deux fichiers ne
+ * peuvent pas déclarer le même identifiant. Les plugins prennent les identifiants à partir de INSTRUMENT_PLUGIN_FIRST
+ * (voir plugin.h).
+ * \version 1.0
+ * \author Tomas Salvado Robalo & Lukas Grando
+ */
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+/* ------------------------------------------------------------------------ */
+/*                   E N T Ê T E S    S T A N D A R D S                     */
+/* ------------------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include "common.h"
+#include "note.h"
+#include "plugin.h"
+
+/* ------------------------------------------------------------------------ */
+/*              C O N S T A N T E S     S Y M B O L I Q U E S               */
+/* ------------------------------------------------------------------------ */
+#define INSTRUMENT_FOLDER "ressources/instruments" /*!< Dossier par défaut des définitions d'instruments */
+#define INSTRUMENT_DEFS_MAX 32 /*!< Nombre maximum d'instruments chargés */
+#define INSTRUMENT_ID_MAX 256 /*!< Nombre d'identifiants d'instruments (codés sur 8 bits dans une note) */
+#define INSTRUMENT_PLUGIN_FIRST (INSTRUMENT_ID_MAX - PLUGIN_MAX) /*!< Identifiant du premier plugin, les fichiers déclarent les identifiants précédents */
+#define INSTRUMENT_NAME_SIZE 5 /*!< Taille du nom d'un instrument (4 caractères affichés) */
+#define INSTRUMENT_LANES 8 /*!< Nombre de partiels traités ensemble par le noyau (largeur vectorielle) */
+#define INSTRUMENT_MAX_PARTIALS 64 /*!< Nombre maximum de partiels d'un instrument (multiple de INSTRUMENT_LANES) */
+#define INSTRUMENT_OSC_HARMONICS 16 /*!< Nombre d'harmoniques par défaut d'un oscillateur */
+#define INSTRUMENT_MAX_EFFECTS 3 /*!< Longueur maximale de la chaîne d'effets */
+#define INSTRUMENT_LINE_SIZE 256 /*!< Taille maximale d'une ligne de fichier */
+
+// Effets (même codification que l'effet du séquenceur)
+#define EFFECT_NONE 0 /*!< Pas d'effet */
+#define EFFECT_FUZZ 1 /*!< Saturation tanh */
+#define EFFECT_COMPRESSION 2 /*!< Compression au dessus de la moitié de l'amplitude */
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \struct instrument_def_t
+ * \brief Instrument compilé : partiels triés par fréquence, en tableaux contigus
+ * \note Les partiels inutilisés jusqu'au multiple de INSTRUMENT_LANES ont une amplitude nulle
+ */
+typedef struct {
+    char name[INSTRUMENT_NAME_SIZE]; /*!< Nom affiché */
+    int nbPartials; /*!< Nombre de partiels réels */
+    float ratios[INSTRUMENT_MAX_PARTIALS]; /*!< Rapport de fréquence de chaque partiel à la fondamentale */
+    float amplitudes[INSTRUMENT_MAX_PARTIALS]; /*!< Amplitude de chaque partiel (somme des valeurs absolues = gain) */
+    double attack; /*!< Durée de l'attaque en secondes */
+    double decay; /*!< Durée du déclin en secondes */
+    double sustain; /*!< Niveau de maintien (0 à 1) */
+    double release; /*!< Durée du relâchement en secondes (prise sur la fin de la note) */
+    short effects[INSTRUMENT_MAX_EFFECTS]; /*!< Chaîne d'effets */
+    int nbEffects; /*!< Nombre d'effets de la chaîne */
+} instrument_def_t;
+
+/* ------------------------------------------------------------------------ */
+/*            P R O T O T Y P E S    D E    F O N C T I O N S               */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn int load_instruments(const char *folder)
+ * \brief Charge et compile toutes les définitions .inst d'un dossier
+ * \param folder Le dossier à charger
+ * \return Le nombre d'instruments chargés
+ * \note Les fichiers invalides sont ignorés avec un message d'erreur
+ */
+int load_instruments(const char *folder);
+
+/**
+ * \fn void free_instruments()
+ * \brief Oublie les instruments chargés
+ */
+void free_instruments();
+
+/**
+ * \fn instrument_t next_instrument(instrument_t instrument, int isUp)
+ * \brief Donne l'instrument disponible suivant ou précédent, en boucle
+ * \param instrument L'identifiant de départ
+ * \param isUp 1 pour le suivant, 0 pour le précédent
+ * \return L'identifiant de l'instrument disponible le plus proche (les identifiants libres sont sautés)
+ */
+instrument_t next_instrument(instrument_t instrument, int isUp);
+
+/**
+ * \fn const instrument_def_t *get_instrument_def(instrument_t instrument)
+ * \brief Récupère la définition compilée d'un instrument chargé
+ * \param instrument L'identifiant de l'instrument
+ * \return La définition ou NULL pour un instrument intégré ou inconnu
+ */
+const instrument_def_t *get_instrument_def(instrument_t instrument);
+
+/**
+ * \fn int get_instrument_plugin(instrument_t instrument)
+ * \brief Récupère le plugin qui joue un instrument
+ * \param instrument L'identifiant de l'instrument
+ * \return L'indice du plugin ou -1 si l'instrument n'est pas un plugin
+ */
+int get_instrument_plugin(instrument_t instrument);
+
+/**
+ * \fn const char *get_instrument_name(instrument_t instrument)
+ * \brief Récupère le nom d'un instrument chargé (fichier ou plugin)
+ * \param instrument L'identifiant de l'instrument
+ * \return Le nom ou NULL pour un instrument intégré ou inconnu
+ */
+const char *get_instrument_name(instrument_t instrument);
+
+/**
+ * \fn void render_instrument(const instrument_def_t *def, float *out, size_t offset, size_t count, double freq, size_t length, int rate, int maxPartials)
+ * \brief Rend un bloc d'une note avec un instrument compilé
+ * \param def L'instrument
+ * \param out Le buffer de sortie (amplitude entre -1 et 1)
+ * \param offset Indice dans la note du premier échantillon du bloc
+ * \param count Nombre d'échantillons du bloc
+ * \param freq Fréquence de la note
+ * \param length Durée totale de la note en échantillons (pour le relâchement)
+ * \param rate Fréquence d'échantillonnage
+ * \param maxPartials Nombre maximum de partiels à jouer (les plus aigus sont ignorés)
+ */
+void render_instrument(const instrument_def_t *def, float *out, size_t offset, size_t count, double freq, size_t length, int rate, int maxPartials);
+
+#endif
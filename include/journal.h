@@ -0,0 +1,244 @@
+/**
+ * \file journal.h
+ * \brief Journal des éditions du séquenceur, pour annuler et rétablir
+ * \details Chaque modification d'une note est gardée sous forme de delta (channel, ligne, note avant, note après),
+ * soit quelques octets au lieu d'une copie de la musique. Les deltas d'une même action (une touche, une opération
+ * sur une région) forment un groupe annulé et rétabli d'un coup, en un temps proportionnel au nombre de notes
+ * modifiées. Les deltas sont rangés dans un tampon circulaire de taille fixe alloué une fois : quand il est plein,
+ * les groupes les plus anciens sont oubliés, la mémoire de l'historique ne grandit jamais pendant l'édition.
+ * Le journal garde aussi les lignes modifiées depuis la dernière sauvegarde (un bit par ligne, même oubliées de
+ * l'historique) : une sauvegarde n'envoie qu'elles au serveur (voir MPP_PATCH_MUSIC).
+ * \version 1.0
+ * \author Tomas Salvado Robalo & Lukas Grando
+ */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+/* ------------------------------------------------------------------------ */
+/*                   E N T Ê T E S    S T A N D A R D S                     */
+/* ------------------------------------------------------------------------ */
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "note.h"
+
+/* ------------------------------------------------------------------------ */
+/*              C O N S T A N T E S     S Y M B O L I Q U E S               */
+/* ------------------------------------------------------------------------ */
+#define JOURNAL_DEFAULT_DELTAS 4096 /*!< Nombre de deltas gardés par défaut (64 Ko) */
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \struct journal_delta_t
+ * \brief Modification d'une note
+ */
+typedef struct {
+    packed_note_t before; /*!< Note avant la modification */
+    packed_note_t after; /*!< Note après la modification */
+    int index; /*!< Ligne de la note */
+    short channel; /*!< Channel de la note */
+    short first; /*!< 1 pour le premier delta d'un groupe */
+} journal_delta_t;
+
+/**
+ * \struct journal_t
+ * \brief Historique des éditions, dans un tampon circulaire
+ */
+typedef struct {
+    journal_delta_t *deltas; /*!< Tampon circulaire */
+    int capacity; /*!< Nombre de deltas du tampon */
+    int oldest; /*!< Position du plus ancien delta gardé */
+    int count; /*!< Nombre de deltas gardés (annulables puis rétablissables) */
+    int applied; /*!< Nombre de deltas appliqués, les suivants peuvent être rétablis */
+    int newGroup; /*!< 1 si le prochain delta commence un groupe */
+    int groupSize; /*!< Nombre de deltas du groupe en cours */
+    int overflow; /*!< 1 si le groupe en cours ne tient pas dans le tampon et n'est plus gardé */
+    uint64_t *dirty[MUSIC_MAX_CHANNELS]; /*!< Lignes modifiées depuis la dernière sauvegarde, un mot par bloc de NOTE_BLOCK_SIZE lignes */
+    int dirtyWords[MUSIC_MAX_CHANNELS]; /*!< Nombre de mots de chaque ensemble de lignes modifiées */
+    int nbDirty; /*!< Nombre de lignes modifiées depuis la dernière sauvegarde */
+} journal_t;
+
+/**
+ * \struct note_clipboard_t
+ * \brief Région copiée du séquenceur
+ */
+typedef struct {
+    int channels; /*!< Nombre de channels copiés */
+    int lines; /*!< Nombre de lignes copiées par channel */
+    packed_note_t *notes; /*!< Notes encodées, channel par channel (channels * lines mots) */
+} note_clipboard_t;
+
+/* ------------------------------------------------------------------------ */
+/*            P R O T O T Y P E S    D E    F O N C T I O N S               */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn journal_t *create_journal(int capacity)
+ * \brief Crée un journal vide
+ * \param capacity Le nombre de deltas gardés (JOURNAL_DEFAULT_DELTAS si <= 0)
+ * \return Le journal, à libérer avec free_journal
+ */
+journal_t *create_journal(int capacity);
+
+/**
+ * \fn void free_journal(journal_t *journal)
+ * \brief Libère un journal
+ * \param journal Le journal (NULL accepté)
+ */
+void free_journal(journal_t *journal);
+
+/**
+ * \fn void clear_journal(journal_t *journal)
+ * \brief Oublie tout l'historique
+ * \param journal Le journal
+ */
+void clear_journal(journal_t *journal);
+
+/**
+ * \fn int journal_next_dirty(const journal_t *journal, short channel, int index)
+ * \brief Cherche la prochaine ligne modifiée depuis la dernière sauvegarde
+ * \param journal Le journal
+ * \param channel Le channel
+ * \param index La première ligne cherchée
+ * \return La première ligne modifiée à partir de index, -1 s'il n'y en a pas
+ */
+int journal_next_dirty(const journal_t *journal, short channel, int index);
+
+/**
+ * \fn void journal_mark_saved(journal_t *journal)
+ * \brief Oublie les lignes modifiées : la musique vient d'être sauvegardée
+ * \param journal Le journal
+ * \note L'historique est gardé, une annulation après la sauvegarde marque à nouveau ses lignes
+ */
+void journal_mark_saved(journal_t *journal);
+
+/**
+ * \fn void journal_begin(journal_t *journal)
+ * \brief Commence une nouvelle action : les notes modifiées ensuite seront annulées ensemble
+ * \param journal Le journal
+ * \note Une action qui ne modifie aucune note ne laisse rien dans le journal
+ */
+void journal_begin(journal_t *journal);
+
+/**
+ * \fn void journal_set_note(journal_t *journal, music_t *music, short channel, int index, note_t note)
+ * \brief Modifie une note de la musique et garde le delta dans l'action en cours
+ * \param journal Le journal
+ * \param music La musique
+ * \param channel Le channel de la note
+ * \param index La ligne de la note
+ * \param note La nouvelle note
+ * \note Les actions annulées qui n'ont pas été rétablies sont oubliées
+ */
+void journal_set_note(journal_t *journal, music_t *music, short channel, int index, note_t note);
+
+/**
+ * \fn int journal_link_pattern(journal_t *journal, music_t *music, short channel, int dest, int src)
+ * \brief Fait répéter à un bloc le motif d'un autre bloc (voir link_channel_pattern) et garde les deltas
+ * \param journal Le journal
+ * \param music La musique
+ * \param channel Le channel
+ * \param dest Une ligne du bloc qui devient une répétition
+ * \param src Une ligne du bloc répété
+ * \return Le nombre de lignes modifiées
+ * \note Annuler remet les anciennes notes dans un bloc à part
+ */
+int journal_link_pattern(journal_t *journal, music_t *music, short channel, int dest, int src);
+
+/**
+ * \fn int journal_set_range(journal_t *journal, music_t *music, short channel, int start, int count, const packed_note_t *notes)
+ * \brief Remplace des lignes consécutives d'un channel (voir set_channel_range) et garde les deltas
+ * \param journal Le journal
+ * \param music La musique
+ * \param channel Le channel
+ * \param start La première ligne
+ * \param count Le nombre de lignes
+ * \param notes Les notes encodées (count mots)
+ * \return Le nombre de lignes modifiées
+ * \note Une action qui modifie plus de lignes que le journal n'en garde ne peut pas être annulée
+ */
+int journal_set_range(journal_t *journal, music_t *music, short channel, int start, int count, const packed_note_t *notes);
+
+/**
+ * \fn int journal_transform_range(journal_t *journal, music_t *music, short chFirst, short chLast, int start, int end, note_range_op_t op, int value)
+ * \brief Applique une transformation (voir transform_notes) à une région et garde les deltas
+ * \param journal Le journal
+ * \param music La musique
+ * \param chFirst Le premier channel
+ * \param chLast Le dernier channel (inclus)
+ * \param start La première ligne
+ * \param end La dernière ligne (incluse)
+ * \param op La transformation
+ * \param value Le paramètre de la transformation
+ * \return Le nombre de lignes modifiées
+ */
+int journal_transform_range(journal_t *journal, music_t *music, short chFirst, short chLast, int start, int end, note_range_op_t op, int value);
+
+/**
+ * \fn int journal_shift_range(journal_t *journal, music_t *music, short chFirst, short chLast, int start, int count)
+ * \brief Insère (count > 0) ou supprime (count < 0) des lignes dans des channels en décalant les suivantes
+ * \param journal Le journal
+ * \param music La musique
+ * \param chFirst Le premier channel
+ * \param chLast Le dernier channel (inclus)
+ * \param start La ligne où insérer des lignes vides ou la première ligne supprimée
+ * \param count Le nombre de lignes insérées ou supprimées
+ * \return Le nombre de lignes modifiées
+ */
+int journal_shift_range(journal_t *journal, music_t *music, short chFirst, short chLast, int start, int count);
+
+/**
+ * \fn int copy_range(const music_t *music, short chFirst, short chLast, int start, int end, note_clipboard_t *clip)
+ * \brief Copie une région de la musique
+ * \param music La musique
+ * \param chFirst Le premier channel
+ * \param chLast Le dernier channel (inclus)
+ * \param start La première ligne
+ * \param end La dernière ligne (incluse)
+ * \param clip Reçoit la région (l'ancien contenu est libéré)
+ * \return 0 si la région est copiée, -1 si elle est invalide
+ */
+int copy_range(const music_t *music, short chFirst, short chLast, int start, int end, note_clipboard_t *clip);
+
+/**
+ * \fn int journal_paste_range(journal_t *journal, music_t *music, const note_clipboard_t *clip, short channel, int start)
+ * \brief Colle une région copiée et garde les deltas
+ * \param journal Le journal
+ * \param music La musique
+ * \param clip La région copiée
+ * \param channel Le channel qui reçoit le premier channel copié
+ * \param start La ligne qui reçoit la première ligne copiée
+ * \return Le nombre de lignes modifiées
+ * \note Les channels qui dépassent la musique sont ignorés
+ */
+int journal_paste_range(journal_t *journal, music_t *music, const note_clipboard_t *clip, short channel, int start);
+
+/**
+ * \fn void free_clipboard(note_clipboard_t *clip)
+ * \brief Libère le contenu d'une région copiée et la vide
+ * \param clip La région copiée
+ */
+void free_clipboard(note_clipboard_t *clip);
+
+/**
+ * \fn int journal_undo(journal_t *journal, music_t *music)
+ * \brief Annule la dernière action
+ * \param journal Le journal
+ * \param music La musique
+ * \return Le nombre de notes remises dans leur état précédent, 0 s'il n'y a rien à annuler
+ */
+int journal_undo(journal_t *journal, music_t *music);
+
+/**
+ * \fn int journal_redo(journal_t *journal, music_t *music)
+ * \brief Rétablit la dernière action annulée
+ * \param journal Le journal
+ * \param music La musique
+ * \return Le nombre de notes modifiées à nouveau, 0 s'il n'y a rien à rétablir
+ */
+int journal_redo(journal_t *journal, music_t *music);
+
+#endif
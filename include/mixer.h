@@ -0,0 +1,137 @@
+/**
+ * \file mixer.h
+ * \brief Mixage des channels et lecture en boucle d'une région du séquenceur
+ * \details Le mixeur rend chaque note d'une région (lignes start à end de chaque channel) en passant
+ * par le cache de rendu puis additionne les channels dans un seul buffer. La boucle joue ce buffer
+ * sans interruption dans un thread, sans aucune synthèse tant que la région ne change pas.
+ * La boucle mixe une version figée de la musique (voir snapshot.h) : après une édition, le séquenceur lui
+ * transmet la nouvelle version (publish_loop) et un second thread mixe à nouveau la région en ne synthétisant
+ * que les notes modifiées. Le thread audio passe au nouveau mix au tour suivant par un échange atomique de
+ * pointeur : il ne prend aucun verrou et ne fait aucune allocation ni libération.
+ * Un flux de mixage (mixer_stream_t) rend une musique entière au fil de la lecture, bloc par bloc,
+ * sans passer par le cache (utilisé par la liste de lecture, voir playlist.h).
+ * \version 1.0
+ * \author Tomas Salvado Robalo & Lukas Grando
+ */
+#ifndef MIXER_H
+#define MIXER_H
+
+/* ------------------------------------------------------------------------ */
+/*                   E N T Ê T E S    S T A N D A R D S                     */
+/* ------------------------------------------------------------------------ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "common.h"
+#include "note.h"
+#include "sound.h"
+#include "renderCache.h"
+#include "snapshot.h"
+
+/* ------------------------------------------------------------------------ */
+/*              C O N S T A N T E S     S Y M B O L I Q U E S               */
+/* ------------------------------------------------------------------------ */
+#define MIXER_EFFECT EFFECT_NONE /*!< Effet appliqué aux notes mixées (le même que pour la lecture des channels) */
+#define MIXER_SAMPLE_MAX 32767 /*!< Valeur maximale d'un échantillon mixé */
+#define MIXER_WATCH_MS 100 /*!< Intervalle de surveillance du cache de rendu par le thread de mixage de la boucle */
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \struct mixer_track_t
+ * \brief Position de lecture d'un channel dans un flux de mixage
+ */
+typedef struct {
+    short *buffer; /*!< Rendu de la note courante */
+    size_t capacity; /*!< Taille allouée du buffer */
+    size_t frames; /*!< Nombre d'échantillons de la note courante */
+    size_t position; /*!< Prochain échantillon à lire dans la note courante */
+    int line; /*!< Prochaine ligne à rendre */
+} mixer_track_t;
+
+/**
+ * \struct mixer_stream_t
+ * \brief Flux de mixage d'une musique entière
+ */
+typedef struct {
+    const music_t *music; /*!< Musique rendue (doit rester valable pendant toute la vie du flux) */
+    mixer_track_t tracks[MUSIC_MAX_CHANNELS]; /*!< Position de chaque channel */
+    int acc[ENGINE_BLOCK_FRAMES]; /*!< Accumulateur du mixage d'un bloc */
+} mixer_stream_t;
+
+/* ------------------------------------------------------------------------ */
+/*            P R O T O T Y P E S    D E    F O N C T I O N S               */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn short *mix_region(music_t *music, int start, int end, size_t *frames)
+ * \brief Rend et mixe les lignes start à end (incluses) de tous les channels
+ * \param music La musique
+ * \param start La première ligne
+ * \param end La dernière ligne
+ * \param frames Reçoit le nombre d'échantillons du mix (celui du channel le plus long)
+ * \return Le mix, à libérer par l'appelant, ou NULL en cas d'erreur
+ */
+short *mix_region(music_t *music, int start, int end, size_t *frames);
+
+/**
+ * \fn mixer_stream_t *create_mixer_stream(const music_t *music)
+ * \brief Crée un flux de mixage qui rend une musique du début à la fin
+ * \param music La musique (doit rester valable pendant toute la vie du flux)
+ * \return Le flux, à libérer avec free_mixer_stream
+ */
+mixer_stream_t *create_mixer_stream(const music_t *music);
+
+/**
+ * \fn size_t read_mixer_stream(mixer_stream_t *stream, short *out, size_t frames)
+ * \brief Rend et mixe les échantillons suivants du flux
+ * \param stream Le flux
+ * \param out Le buffer de sortie
+ * \param frames Nombre d'échantillons demandés (au plus ENGINE_BLOCK_FRAMES)
+ * \return Le nombre d'échantillons rendus, inférieur à frames à la fin de la musique
+ */
+size_t read_mixer_stream(mixer_stream_t *stream, short *out, size_t frames);
+
+/**
+ * \fn void free_mixer_stream(mixer_stream_t *stream)
+ * \brief Libère un flux de mixage
+ * \param stream Le flux
+ */
+void free_mixer_stream(mixer_stream_t *stream);
+
+/**
+ * \fn int start_loop(music_t *music, int start, int end)
+ * \brief Lance la lecture en boucle d'une région
+ * \param music La musique (une version figée en est prise, voir publish_loop)
+ * \param start La première ligne
+ * \param end La dernière ligne
+ * \return 0 si la boucle est lancée, -1 sinon
+ * \note Une boucle déjà lancée est d'abord arrêtée
+ */
+int start_loop(music_t *music, int start, int end);
+
+/**
+ * \fn void stop_loop()
+ * \brief Arrête la lecture en boucle et attend la fin des threads
+ */
+void stop_loop();
+
+/**
+ * \fn void publish_loop(const music_t *music)
+ * \brief Transmet l'état courant de la musique à la boucle en cours
+ * \param music La musique éditée
+ * \note Sans effet si aucune boucle n'est jouée
+ */
+void publish_loop(const music_t *music);
+
+/**
+ * \fn int is_looping()
+ * \brief Indique si une boucle est en cours de lecture
+ * \return 1 si une boucle est jouée, 0 sinon
+ */
+int is_looping();
+
+#endif
@@ -13,10 +13,42 @@
 
 #include "note.h"
 #include "data.h"
+#include "codec.h"
+#include "compress.h"
 
 #define USERNAME_SIZE 15 /*!< Taille du nom d'utilisateur */
 #define REALLLOC_SIZE 10 /*!< Taille de réallouement de la liste d'identifiants de musiques */
 #define NO_MUSIC_ID -1 /*!< Identifiant de musique non défini */
+#define MPP_MAX_LINE (1 << 24) /*!< Plus grande ligne acceptée dans une musique reçue */
+
+#define MPP_VERSION_TEXT 1 /*!< MPP 1.0 : texte, une ligne par note */
+#define MPP_VERSION_BINARY 2 /*!< MPP 2.0 : binaire, en-tête et varints (voir codec.h) */
+#define MPP_VERSION_COMPRESSED 3 /*!< MPP 2.1 : MPP 2.0 dont les musiques sont en colonnes compressées (voir compress.h) */
+#define MPP_VERSION_DELTA 4 /*!< MPP 2.2 : MPP 2.1 avec les révisions des musiques et les requêtes MPP_PATCH_MUSIC */
+#define MPP_VERSION MPP_VERSION_DELTA /*!< Version utilisée par défaut pour les nouveaux messages */
+#define MPP_MESSAGE_REQUEST 1 /*!< Type d'un message binaire contenant une requête */
+#define MPP_MESSAGE_RESPONSE 2 /*!< Type d'un message binaire contenant une réponse */
+#define MPP_RECORD_BITS 2 /*!< Bits de poids faible du varint qui commence un enregistrement de musique binaire */
+#define MPP_RECORD_NOTE 0 /*!< Enregistrement d'une note sans accord fin */
+#define MPP_RECORD_FINETUNE 1 /*!< Enregistrement d'une note suivie de son accord fin */
+#define MPP_RECORD_PATTERN 2 /*!< Enregistrement d'un bloc qui répète un motif */
+#define MPP_RECORD_END 3 /*!< Fin d'un channel */
+#define MPP_DECODE_RUN (4 * NOTE_BLOCK_SIZE) /*!< Lignes d'une musique binaire décodées avant d'être écrites d'un coup dans le channel */
+#define MPP_COLUMN_RECORDS 0 /*!< Colonne des enregistrements d'une musique compressée : (écart << MPP_RECORD_BITS) | type */
+#define MPP_COLUMN_IDS 1 /*!< Colonne des identifiants des notes */
+#define MPP_COLUMN_OCTAVES 2 /*!< Colonne des octaves */
+#define MPP_COLUMN_INSTRUMENTS 3 /*!< Colonne des instruments */
+#define MPP_COLUMN_TIMES 4 /*!< Colonne des durées */
+#define MPP_COLUMN_FINETUNES 5 /*!< Colonne des accords fins non nuls */
+#define MPP_COLUMN_PATTERNS 6 /*!< Colonne des blocs répétés */
+#define MPP_COLUMNS 7 /*!< Nombre de colonnes d'un channel compressé */
+#define MPP_MAX_COMPRESSED (1 << 26) /*!< Plus grande musique compressée acceptée, une fois décompressée */
+#define MPP_MAX_PATCH_NOTES (1 << 16) /*!< Plus grand nombre de lignes d'un patch, au-delà la musique est envoyée en entier */
+
+#define MPP_FILE_MAGIC "\x89MPF" /*!< Premiers octets d'un fichier .mipi compressé (les anciens fichiers sont en texte) */
+#define MPP_FILE_MAGIC_SIZE 4 /*!< Taille du magic d'un fichier */
+#define MPP_FILE_COMPRESSED 1 /*!< Octet qui suit le magic : musique compressée (voir encode_compressed_music) */
+#define MPP_FILE_REVISED 2 /*!< Octet qui suit le magic : révision en varint puis musique compressée */
 
 #define MPP_DEFAULT_PORT 12345 /*!< Port par défaut du serveur MPP */
 #define MPP_DEFAULT_IP "127.0.0.1" /*!< Adresse IP par défaut du serveur MPP */
@@ -32,10 +64,12 @@
 #define BAD_REQUEST(requestPtr) (requestPtr->code == MPP_RESPONSE_BAD_REQUEST) /*!< Vérifie si la requête est incorrecte */
 #define NOK_REQUEST(requestPtr) (requestPtr->code == MPP_RESPONSE_NOK) /*!< Vérifie si la réponse est NOK */
 #define NOT_FOUND(requestPtr) (requestPtr->code == MPP_RESPONSE_NOT_FOUND) /*!< Vérifie si la musique n'a pas été trouvée */
+#define CONFLICT(requestPtr) (requestPtr->code == MPP_RESPONSE_CONFLICT) /*!< Vérifie si la musique a changé depuis la révision du patch */
 
 #define CREATE_BAD_REQUEST(responsePtr) responsePtr->code = MPP_RESPONSE_BAD_REQUEST /*!< Crée une réponse BAD_REQUEST */
 #define CREATE_NOK(responsePtr) responsePtr->code = MPP_RESPONSE_NOK /*!< Crée une réponse NOK */
 #define CREATE_NOT_FOUND(responsePtr) responsePtr->code = MPP_RESPONSE_NOT_FOUND /*!< Crée une réponse NOT_FOUND */
+#define CREATE_CONFLICT(responsePtr) responsePtr->code = MPP_RESPONSE_CONFLICT /*!< Crée une réponse CONFLICT */
 
 
 /**
@@ -43,11 +77,13 @@
  * \brief Code de requête MPP
 */
 typedef enum {
+    MPP_INVALID = 0, /*!< Requête illisible (voir decode_mpp_request) */
     MPP_CONNECT = 200, /*!< Requête de connexion */
     MPP_LIST_MUSIC = 300, /*!< Requête pour lister les musiques */
     MPP_GET_MUSIC, /*!< Requête pour récupérer une musique */
     MPP_ADD_MUSIC, /*!< Requête pour ajouter une musique */
     MPP_DELETE_MUSIC, /*!< Requête pour supprimer une musique */
+    MPP_PATCH_MUSIC, /*!< Requête pour modifier quelques lignes d'une musique enregistrée (MPP 2.2) */
 } mpp_request_code_t;
 
 /**
@@ -61,6 +97,7 @@ typedef enum {
     MPP_RESPONSE_NOK = 400, /*!< Réponse NOK */
     MPP_RESPONSE_BAD_REQUEST = 401, /*!< Réponse pour indiquer que la requête est incorrecte */
     MPP_RESPONSE_NOT_FOUND = 404, /*!< Réponse pour indiquer que la musique n'a pas été trouvée */
+    MPP_RESPONSE_CONFLICT = 409, /*!< Réponse pour indiquer que la musique a changé depuis la révision du patch */
 } mpp_response_code_t;
 
 /**
@@ -73,6 +110,31 @@ typedef struct {
     int size;       /*!< Taille de la liste */
 } musicId_list_t;
 
+/**
+ * \struct music_patch_note_t
+ * \brief Ligne modifiée d'une musique
+ */
+typedef struct {
+    int line; /*!< Ligne de la note */
+    short channel; /*!< Channel de la note */
+    packed_note_t note; /*!< Nouvelle note encodée, PACKED_NOTE_EMPTY pour une ligne vidée */
+} music_patch_note_t;
+
+/**
+ * \struct music_patch_t
+ * \brief Modifications d'une musique depuis sa dernière sauvegarde
+ * \details Le patch ne s'applique qu'à la révision sur laquelle il a été fait : le serveur le refuse si la musique
+ * enregistrée a changé entre temps (MPP_RESPONSE_CONFLICT)
+ */
+typedef struct {
+    unsigned long base; /*!< Révision de la musique modifiée */
+    short bpm; /*!< Bpm de la musique */
+    int nbNotes[MUSIC_MAX_CHANNELS]; /*!< Nombre de lignes de chaque channel après le patch, vérifié par le serveur */
+    music_patch_note_t *notes; /*!< Lignes modifiées, par channel puis par ligne */
+    int size; /*!< Nombre de lignes modifiées */
+    int capacity; /*!< Nombre de lignes allouées */
+} music_patch_t;
+
 /**
  * \struct mpp_request_t
  * \brief Structure de representant une requête MPP
@@ -82,7 +144,10 @@ typedef struct {
     mpp_request_code_t code; /*!< Code de la requête */
     char rfidId[10]; /*!< Nom d'utilisateur */
     music_t *music ; /*!< Musique à envoyer */
+    music_patch_t *patch; /*!< Modifications à appliquer à la musique musicId (MPP_PATCH_MUSIC) */
+    int overwrite; /*!< 1 pour remplacer la musique enregistrée même si elle a changé depuis music->revision (MPP_ADD_MUSIC) */
     time_t musicId; /*!< Identifiant de la musique selectionnée (timestamp) */
+    int version; /*!< Version du format de la requête (de MPP_VERSION_TEXT à MPP_VERSION_DELTA) */
 } mpp_request_t;
 
 
@@ -96,6 +161,8 @@ typedef struct {
     char username[USERNAME_SIZE]; /*!< Nom de l'utilisateur */
     music_t *music ; /*!< Musique à envoyer */
     musicId_list_t *musicIds ; /*!< Liste des identifiants de musiques */
+    unsigned long revision; /*!< Révision de la musique enregistrée ou envoyée (MPP 2.2) */
+    int version; /*!< Version du format de la réponse, celle de la requête à laquelle elle répond */
 } mpp_response_t;
 
 /**
@@ -106,6 +173,7 @@ typedef struct {
  * \param music La musique
  * \param musicId L'identifiant de la musique
  * \return mpp_request_t 
+ * \note La requête est au format MPP_VERSION
  */
 mpp_request_t create_mpp_request(mpp_request_code_t code, char *rfidId, music_t *music, time_t musicId);
 
@@ -117,6 +185,7 @@ mpp_request_t create_mpp_request(mpp_request_code_t code, char *rfidId, music_t
  * @param music Le pointeur vers la musique
  * @param musicIds La liste des identifiants de musiques
  * @return mpp_response_t 
+ * @note La réponse est au format MPP_VERSION
  */
 mpp_response_t create_mpp_response(mpp_response_code_t code, char *username, music_t *music, musicId_list_t *musicIds);
 
@@ -136,44 +205,57 @@ void print_mpp_request(mpp_request_t *request);
 void print_mpp_response(mpp_response_t *response);
 
 /**
- * @fn void serialize_music(music_t *music, buffer_t buffer);
- * @brief Sérialise une requête MPP
+ * @fn int encode_mpp_request(writer_t *writer, mpp_request_t *request);
+ * @brief Sérialise une requête MPP à la suite d'un writer
  * La requête est sérialisée de la manière suivante :
  * <code> <rfidId>
  * <music>
- * @param request 
- * @param buffer 
+ * En MPP 2.0, un message binaire de type MPP_MESSAGE_REQUEST contient code, rfidId et musicId en varints puis la
+ * musique éventuelle
+ * En MPP 2.2, la révision sur laquelle la musique a été modifiée et 0 ou 1 pour l'écraser quand même suivent la
+ * musique, puis le patch éventuel (voir encode_music_patch)
+ * @param writer Le writer
+ * @param request La requête MPP
+ * @return 0 si la requête est écrite en entier, -1 si elle ne tient pas dans le buffer du writer
+ * @note Le format est choisi d'après request->version
  */
-void serialize_mpp_request(mpp_request_t *request, buffer_t buffer);
+int encode_mpp_request(writer_t *writer, mpp_request_t *request);
 
 /**
- * @fn void deserialize_mpp_request(buffer_t buffer, mpp_request_t *request);
- * @brief Désérialise une requête MPP
- * @param buffer Le buffer ou se trouve la requête sérialisée
+ * @fn codec_error_t decode_mpp_request(reader_t *reader, mpp_request_t *request);
+ * @brief Désérialise une requête MPP directement depuis le buffer d'un reader
+ * @param reader Le reader, placé au début de la requête
  * @param request La requête MPP à remplir
- * @see serialize_mpp_request
+ * @return CODEC_OK si la requête est lue en entier, l'erreur sinon
+ * @note Les deux versions sont acceptées, request->version indique celle du message
+ * @note En cas d'erreur, la requête reçoit le code MPP_INVALID et aucun autre champ
  */
-void deserialize_mpp_request(buffer_t buffer, mpp_request_t *request);
+codec_error_t decode_mpp_request(reader_t *reader, mpp_request_t *request);
 
 /**
- * @fn void serialize_music(music_t *music, buffer_t buffer);
- * @brief Sérialise une reponse MPP
+ * @fn int encode_mpp_response(writer_t *writer, mpp_response_t *response);
+ * @brief Sérialise une réponse MPP à la suite d'un writer
  * La réponse est sérialisée de la manière suivante :
  * <code> <username>
  * <list_size> <musicId> <musicId> <musicId> ...
  * <music> (même format que pour la requête)
+ * @param writer Le writer
  * @param response La réponse MPP
- * @param buffer Le buffer dans lequel sérialiser la réponse
+ * @return 0 si la réponse est écrite en entier, -1 si elle ne tient pas dans le buffer du writer
+ * @note Le format est choisi d'après response->version
  */
-void serialize_mpp_response(mpp_response_t *response, buffer_t buffer);
+int encode_mpp_response(writer_t *writer, mpp_response_t *response);
 
 /**
- * @fn void deserialize_mpp_response(buffer_t buffer, mpp_response_t *response);
- * @brief Désérialise une réponse MPP
- * @param buffer Le buffer ou se trouve la réponse sérialisée
+ * @fn codec_error_t decode_mpp_response(reader_t *reader, mpp_response_t *response);
+ * @brief Désérialise une réponse MPP directement depuis le buffer d'un reader
+ * @param reader Le reader, placé au début de la réponse
  * @param response La réponse MPP à remplir
+ * @return CODEC_OK si la réponse est lue en entier, l'erreur sinon
+ * @note Les deux versions sont acceptées, response->version indique celle du message
+ * @note En cas d'erreur, la réponse reçoit le code MPP_RESPONSE_BAD_REQUEST et aucun autre champ
  */
-void deserialize_mpp_response(buffer_t buffer, mpp_response_t *response);
+codec_error_t decode_mpp_response(reader_t *reader, mpp_response_t *response);
 
 /**
  * @fn void serialize_music(music_t *music, buffer_t buffer);
@@ -238,13 +320,32 @@ void free_music_list(musicId_list_t *list);
 void get_music_list_from_db(musicId_list_t *list, char *rfidId);
 
 /**
- * @fn int add_music_to_db(music_t *music, char *rfidId);
+ * @fn mpp_response_code_t add_music_to_db(music_t *music, char *rfidId, int overwrite, unsigned long *revision);
  * @brief Ajoute une musique à la base de données
- * @param music La musique à ajouter
+ * @param music La musique à ajouter, modifiée depuis music->revision, qui reçoit sa nouvelle révision une fois écrite
  * @param rfidId L'identifiant RFID de l'utilisateur
- * @return int 
+ * @param overwrite 1 pour remplacer la musique enregistrée même si elle a changé depuis music->revision
+ * @param revision Reçoit la nouvelle révision de la musique, ou sa révision enregistrée en cas de conflit
+ * @return MPP_RESPONSE_MUSIC_CREATED si la musique est enregistrée, MPP_RESPONSE_CONFLICT si elle a changé depuis
+ * music->revision sans overwrite, MPP_RESPONSE_NOT_FOUND si elle a été supprimée depuis sans overwrite et
+ * MPP_RESPONSE_NOK si son fichier ou la liste de l'utilisateur ne peuvent pas être écrits
+ * @note Si son fichier n'est pas écrit, la révision de la musique n'est pas modifiée
  */
-int add_music_to_db(music_t *music, char *rfidId);
+mpp_response_code_t add_music_to_db(music_t *music, char *rfidId, int overwrite, unsigned long *revision);
+
+/**
+ * @fn mpp_response_code_t patch_music_in_db(music_patch_t *patch, time_t musicId, char *rfidId, unsigned long *revision);
+ * @brief Applique un patch à une musique de la base de données
+ * @param patch Le patch
+ * @param musicId L'identifiant de la musique
+ * @param rfidId L'identifiant RFID de l'utilisateur
+ * @param revision Reçoit la nouvelle révision de la musique, ou sa révision enregistrée en cas de conflit
+ * @return MPP_RESPONSE_MUSIC_UPDATED si le patch est appliqué, MPP_RESPONSE_NOT_FOUND si la musique n'existe pas,
+ * MPP_RESPONSE_CONFLICT si elle a changé depuis patch->base, MPP_RESPONSE_BAD_REQUEST si le patch ne correspond pas
+ * à la musique et MPP_RESPONSE_NOK si le fichier ne peut pas être écrit
+ * @note Le fichier est remplacé d'un coup : en cas d'erreur, la musique enregistrée n'est pas modifiée
+ */
+mpp_response_code_t patch_music_in_db(music_patch_t *patch, time_t musicId, char *rfidId, unsigned long *revision);
 
 /**
  * @fn void get_music_from_db(music_t *music, time_t musicId, char *rfidId);
@@ -310,11 +411,22 @@ void list_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *re
  * @param sd Socket du client
  * @param request requête MPP reçue
  * @param response reponse MPP à envoyer
- * @note Un fichier est crée pour chaque musique dans le dossier de l'utilisateur
+ * @note Un fichier est crée pour chaque musique dans le dossier de l'utilisateur. Une musique enregistrée depuis la
+ * révision du client reçoit une réponse CONFLICT, sauf si la requête demande de l'écraser
  * @warning Si l'utilisateur n'existe pas, une reponse BAD_REQUEST est envoyée
  */
 void add_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *response);
 
+/**
+ * @fn void patch_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *response);
+ * @brief Gère une requête pour modifier quelques lignes d'une musique
+ * @param sd Socket du client
+ * @param request requête MPP reçue
+ * @param response reponse MPP à envoyer, avec la nouvelle révision de la musique
+ * @warning Si l'utilisateur n'existe pas, une reponse BAD_REQUEST est envoyée
+ */
+void patch_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *response);
+
 /**
  * @fn void get_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *response);
  * @brief Gère une requête pour récupérer une musique
@@ -333,6 +445,41 @@ void get_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *res
  */
 void delete_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *response);
 
+/**
+ * @fn void init_music_patch(music_patch_t *patch, music_t *music);
+ * @brief Initialise un patch vide sur la révision d'une musique
+ * @param patch Le patch
+ * @param music La musique modifiée, dont le bpm et le nombre de lignes sont repris
+ * @note Le patch se libère avec free_music_patch
+ */
+void init_music_patch(music_patch_t *patch, music_t *music);
+
+/**
+ * @fn void add_music_patch_note(music_patch_t *patch, short channel, int line, packed_note_t note);
+ * @brief Ajoute une ligne modifiée à un patch
+ * @param patch Le patch
+ * @param channel Le channel
+ * @param line La ligne, après celles du même channel déjà ajoutées
+ * @param note La nouvelle note encodée
+ */
+void add_music_patch_note(music_patch_t *patch, short channel, int line, packed_note_t note);
+
+/**
+ * @fn int apply_music_patch(music_t *music, music_patch_t *patch);
+ * @brief Applique un patch à une musique
+ * @param music La musique
+ * @param patch Le patch
+ * @return 0 si la musique correspond au patch une fois modifiée, -1 sinon
+ */
+int apply_music_patch(music_t *music, music_patch_t *patch);
+
+/**
+ * @fn void free_music_patch(music_patch_t *patch);
+ * @brief Libère les lignes d'un patch
+ * @param patch Le patch
+ */
+void free_music_patch(music_patch_t *patch);
+
 /**
  * @fn void free_request(mpp_request_t *request);
  * @brief Libère une requête MPP
@@ -347,6 +494,13 @@ void free_request(mpp_request_t *request);
  */
 void free_response(mpp_response_t *response);
 
+/**
+ * @fn void clear_response(mpp_response_t *response);
+ * @brief Libère la musique et la liste d'une réponse MPP, sans la structure
+ * @param response Réponse MPP, reçue par exemple dans une variable locale
+ */
+void clear_response(mpp_response_t *response);
+
 /**
  * @fn void create_user_directories();
  * @brief Crée un répertoire pour les utilisateurs
@@ -10,14 +10,33 @@
 /* ------------------------------------------------------------------------ */
 /*                   E N T Ê T E S    S T A N D A R D S                     */
 /* ------------------------------------------------------------------------ */
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
 #include <sys/time.h>
 /* ------------------------------------------------------------------------ */
 /*              C O N S T A N T E S     S Y M B O L I Q U E S               */
 /* ------------------------------------------------------------------------ */
-#define CHANNEL_MAX_NOTES 4096 /*!< Nombre de notes maximum dans un channel doit tenir sur n symboles hexadécimaux */
+#define NOTE_BLOCK_SIZE 64 /*!< Nombre de lignes d'un bloc de notes alloué à la demande (une par bit du mot d'occupation) */
+#define NOTE_TIME_CLASSES 5 /*!< Nombre de durées de note, de la double croche (1 << 0) à la ronde (1 << 4) */
 #define MUSIC_MAX_CHANNELS 3 /*!< Nombre de channels maximum dans une musique */
 
+// Encodage d'une note sur 32 bits : identifiant, octave, durée et instrument
+#define PACKED_NOTE_ID_SHIFT 0 /*!< Position de l'identifiant (4 bits) */
+#define PACKED_NOTE_ID_MASK 0xF /*!< Masque de l'identifiant */
+#define PACKED_NOTE_OCTAVE_SHIFT 4 /*!< Position de l'octave (4 bits) */
+#define PACKED_NOTE_OCTAVE_MASK 0xF /*!< Masque de l'octave */
+#define PACKED_NOTE_TIME_SHIFT 8 /*!< Position de la durée (8 bits) */
+#define PACKED_NOTE_TIME_MASK 0xFF /*!< Masque de la durée */
+#define PACKED_NOTE_INSTRUMENT_SHIFT 16 /*!< Position de l'instrument (8 bits) */
+#define PACKED_NOTE_INSTRUMENT_MASK 0xFF /*!< Masque de l'instrument */
+#define PACKED_NOTE_FINETUNE_SHIFT 24 /*!< Position de l'accord fin (8 bits signés) */
+#define PACKED_NOTE_FINETUNE_MASK 0xFF /*!< Masque de l'accord fin */
+#define PACKED_NOTE_EMPTY 0x430 /*!< Ligne vide : pas de note, octave de référence, noire, pas d'instrument */
+#define NOTE_OCTAVE_MAX 8 /*!< Octave la plus haute proposée par le séquenceur */
+
 //Fréquences des notes
 #define REF_OCTAVE 3 /*!< Octave de référence */
 #define NOTE_C_FQ 261.63 /*!< Fréquence du DO à l’octave de référence */
@@ -34,6 +53,11 @@
 #define NOTE_B_FQ 493.88 /*!< Fréquence du SI à l’octave de référence */
 #define NOTE_NA_FQ 0 /*!< Fréquence d’une non note */
 
+// Table des hauteurs
+#define NOTE_OCTAVE_NB 16 /*!< Nombre d'octaves de la table (toutes celles que peut encoder une note) */
+#define NOTE_FINETUNE_STEPS 16 /*!< Nombre de pas d'accord fin par demi-ton */
+#define NOTE_FINETUNE_MAX 16 /*!< Accord fin maximal, en pas (un demi-ton de chaque côté) */
+
 //Noms des notes
 #define NOTE_C_NAME "C-" /*!< Nom du DO à l’octave de référence */
 #define NOTE_CS_NAME "C#"/*!< Nom du DO# à l’octave de référence */
@@ -79,6 +103,10 @@ typedef enum {
 #define INSTRUMENT_ORGAN_NAME "ORGN" /*!< Nom de l'instrument orgue */
 #define INSTRUMENT_PIANO_NAME "PIAN" /*!< Nom de l'instrument piano */
 #define INSTRUMENT_SINPHASER_NAME "SPHS" /*!< Nom de l'instrument signal sinusoïdale avec phaser */
+#define INSTRUMENT_SAMPLE1_NAME "SMP1" /*!< Nom de l'instrument utilisant le 1er sample de la banque */
+#define INSTRUMENT_SAMPLE2_NAME "SMP2" /*!< Nom de l'instrument utilisant le 2ème sample de la banque */
+#define INSTRUMENT_SAMPLE3_NAME "SMP3" /*!< Nom de l'instrument utilisant le 3ème sample de la banque */
+#define INSTRUMENT_SAMPLE4_NAME "SMP4" /*!< Nom de l'instrument utilisant le 4ème sample de la banque */
 #define INSTRUMENT_NA_NAME " -- " /*!< Nom de l'instrument non disponible */
 
 /* ------------------------------------------------------------------------ */
@@ -99,6 +127,10 @@ typedef enum {
 	INSTRUMENT_ORGAN,  /*!< Utilisation d’un orgue */
 	INSTRUMENT_PIANO,  /*!< Utilisation d’un piano */
 	INSTRUMENT_SINPHASER, /*!< Utilisation d’un signal sinusoïdale avec phaser */
+	INSTRUMENT_SAMPLE1, /*!< Utilisation du 1er sample de la banque */
+	INSTRUMENT_SAMPLE2, /*!< Utilisation du 2ème sample de la banque */
+	INSTRUMENT_SAMPLE3, /*!< Utilisation du 3ème sample de la banque */
+	INSTRUMENT_SAMPLE4, /*!< Utilisation du 4ème sample de la banque */
 	INSTRUMENT_NB /*!< Nombre d’instruments disponibles */
 }instrument_t;
 
@@ -121,15 +153,36 @@ typedef enum {
 /**
  * \struct note_t
  * \brief Structure des notes
+ * \note C'est la forme de travail d'une note, les channels la stockent encodée (voir packed_note_t).
+ * La fréquence n'est pas stockée, elle se déduit de l'identifiant et de l'octave (voir noteToFreq)
  */
 typedef struct {
 	short id; /*!< Identifiant de la note (position dans la gamme)*/
-	double frequency; /*!< Fréquence en Hz à l’octave de référence*/
 	short octave;/*!< octave de la note*/
 	instrument_t instrument; /*!< Instrument sur lequel la jouer*/
 	time_duration_t time;/*!<  Durée de la note */
+	short fineTune;/*!< Accord fin en 1/NOTE_FINETUNE_STEPS de demi-ton (-NOTE_FINETUNE_MAX à NOTE_FINETUNE_MAX)*/
 }note_t;
 
+/**
+ * \typedef packed_note_t
+ * \brief Note encodée sur 32 bits, telle que stockée dans un channel
+ * \see pack_note
+ */
+typedef uint32_t packed_note_t;
+
+/**
+ * \enum note_range_op_t
+ * \brief Transformations appliquées d'un coup aux notes d'une région (voir transform_notes)
+ * \note Les lignes vides ne sont pas modifiées
+ */
+typedef enum {
+	NOTE_RANGE_TRANSPOSE, /*!< Décale les notes de value demi-tons, bornées de C-0 à B-8 */
+	NOTE_RANGE_OCTAVE, /*!< Décale les notes de value octaves, bornées de 0 à 8 */
+	NOTE_RANGE_INSTRUMENT, /*!< Décale l'instrument des notes de value, en boucle sur les instruments disponibles */
+	NOTE_RANGE_TIME /*!< Multiplie (value > 0) ou divise (value < 0) la durée des notes par 2^|value|, bornée à la double croche et la ronde */
+} note_range_op_t;
+
 /**
  * \struct scale_t
  * \brief Structure representant une gamme
@@ -139,14 +192,35 @@ typedef struct {
 }scale_t;
 
 
+/**
+ * \struct note_block_t
+ * \brief Bloc de NOTE_BLOCK_SIZE lignes consécutives d'un channel, c'est aussi un motif
+ */
+typedef struct {
+	packed_note_t notes[NOTE_BLOCK_SIZE];/*!< Notes encodées, une par ligne*/
+	uint64_t used;/*!< Occupation : bit i à 1 si la ligne i contient une note (identifiant autre que NOTE_NA_ID)*/
+	int refs;/*!< Nombre de positions qui désignent le bloc, dans la musique et ses copies (voir share_music)*/
+}note_block_t;
+
 /**
  * \struct channel_t
  * \brief Structure pour jouer les notes dans les channels
+ * \note Les notes sont rangées encodées, un mot de 32 bits par ligne, par blocs de NOTE_BLOCK_SIZE lignes.
+ * Un bloc n'est alloué qu'à la première écriture d'une de ses lignes : une région vide ne coûte qu'un
+ * pointeur NULL dans l'index et la longueur d'un channel n'est pas bornée.
+ * L'index est aussi la liste d'ordre des motifs du channel : plusieurs positions peuvent désigner le même bloc
+ * (voir link_channel_pattern). Une mesure répétée n'est alors rangée, transmise et rendue qu'une fois.
+ * Modifier une répétition la copie d'abord : elle devient une variante et les autres ne changent pas.
+ * On y accède avec get_channel_note, set_channel_note et next_channel_note, qui présentent le channel à plat
  */
 typedef struct {
 	short id ; /*!< Identifiant du channel*/ 
-	note_t notes[CHANNEL_MAX_NOTES];/*!< Nombre de note (dernière note non vide)*/
-	int nbNotes;/*!< Fréquence en Hz à l’octave de référence*/
+	note_block_t **blocks;/*!< Index des blocs, NULL pour un bloc jamais écrit*/
+	int nbBlocks;/*!< Taille de l'index*/
+	int *patterns;/*!< Pour chaque bloc de l'index, premier bloc qui désigne le même motif (lui-même s'il est le premier)*/
+	int *repeats;/*!< Pour la première occurrence d'un motif, nombre de blocs qui le répètent plus loin dans l'index*/
+	int (*timeline)[NOTE_TIME_CLASSES];/*!< Arbre de Fenwick du nombre de lignes de chaque durée, sur les lignes de l'index*/
+	int nbNotes;/*!< Nombre de note (dernière note non vide)*/
 }channel_t;
 
 /**
@@ -157,6 +231,7 @@ typedef struct {
 	struct timeval date;/*!< Date de création de la musique*/
 	channel_t channels [MUSIC_MAX_CHANNELS];/*!< Les canaux disponibles */
 	short bpm;/*!< Le bpm de la musique*/
+	unsigned long revision;/*!< Révision de la musique enregistrée sur le serveur, 0 si elle n'y est pas (voir MPP_PATCH_MUSIC)*/
 }music_t;
 
 
@@ -164,28 +239,208 @@ typedef struct {
 /*            P R O T O T Y P E S    D E    F O N C T I O N S               */
 /* ------------------------------------------------------------------------ */
 /**
- * \fn note_t create_note(short id, double frequency, short octave,instrument_t instrument, time_t time);
+ * \fn note_t create_note(short id, short octave,instrument_t instrument, time_t time);
  * \brief Créé une note avec les param donnés
  * \param id identifiant de la note
- * \param frequency Fréquence en Hz à l’octave de référence
  * \param octave octave de la note
  * \param instrument Istrument sur lequel la jouer
  * \param time Durée de la note
  */
-note_t create_note(short id, double frequency, short octave,instrument_t instrument, time_duration_t time);
+note_t create_note(short id, short octave,instrument_t instrument, time_duration_t time);
 
 /**
- * \fn note_t *mod_note(note_t *noteModif,char note[3], double frequency, short octave,instrument_t instrument, time_duration_t time);
+ * \fn note_t *mod_note(note_t *noteModif, short id, short octave,instrument_t instrument, time_duration_t time);
  * \brief modifie la note avec les param donnés
  * \param noteModif note à modifier
  * \param id identifiant de la note
- * \param frequency Fréquence en Hz à l’octave de référence
  * \param octave octave de la note
  * \param instrument Istrument sur lequel la jouer
  * \param time Durée de la note
  */
-note_t *mod_note(note_t *noteModif, short id, double frequency, short octave,instrument_t instrument, time_duration_t time);
+note_t *mod_note(note_t *noteModif, short id, short octave,instrument_t instrument, time_duration_t time);
+
+/**
+ * \fn packed_note_t pack_note(note_t note);
+ * \brief Encode une note sur 32 bits
+ * \param note la note à encoder
+ * \return la note encodée
+ */
+packed_note_t pack_note(note_t note);
+
+/**
+ * \fn note_t unpack_note(packed_note_t packed);
+ * \brief Décode une note encodée
+ * \param packed la note encodée
+ * \return la note
+ */
+note_t unpack_note(packed_note_t packed);
+
+/**
+ * \fn note_t get_channel_note(const channel_t *channel, int index);
+ * \brief Récupère une note d'un channel
+ * \param channel le channel
+ * \param index la ligne de la note
+ * \return la note, une note vide si la ligne n'a jamais été écrite
+ */
+note_t get_channel_note(const channel_t *channel, int index);
+
+/**
+ * \fn void set_channel_note(channel_t *channel, int index, note_t note);
+ * \brief Modifie une note d'un channel
+ * \param channel le channel
+ * \param index la ligne de la note (positive, sans limite)
+ * \param note la nouvelle note
+ * \note Alloue le bloc de la ligne s'il n'existe pas encore
+ */
+void set_channel_note(channel_t *channel, int index, note_t note);
+
+/**
+ * \fn int get_channel_notes(const channel_t *channel, int start, int count, note_t *notes);
+ * \brief Récupère des lignes consécutives d'un channel
+ * \param channel le channel
+ * \param start la première ligne
+ * \param count le nombre de lignes
+ * \param notes reçoit les notes (count notes)
+ * \return le nombre de lignes lues dans des blocs alloués, les autres sont des notes vides
+ */
+int get_channel_notes(const channel_t *channel, int start, int count, note_t *notes);
+
+/**
+ * \fn void get_channel_range(const channel_t *channel, int start, int count, packed_note_t *notes)
+ * \brief Copie des lignes consécutives d'un channel, encodées
+ * \param channel le channel
+ * \param start la première ligne
+ * \param count le nombre de lignes
+ * \param notes reçoit les notes encodées (count mots)
+ * \note Copie bloc par bloc, les blocs absents donnent des lignes vides
+ */
+void get_channel_range(const channel_t *channel, int start, int count, packed_note_t *notes);
+
+/**
+ * \fn int set_channel_range(channel_t *channel, int start, int count, const packed_note_t *notes)
+ * \brief Remplace des lignes consécutives d'un channel en une passe
+ * \param channel le channel
+ * \param start la première ligne
+ * \param count le nombre de lignes
+ * \param notes les notes encodées (count mots)
+ * \return le nombre de lignes modifiées
+ * \note Tient à jour l'occupation, l'index des durées, nbNotes et le cache de rendu (pas besoin d'update_channel_nbNotes)
+ */
+int set_channel_range(channel_t *channel, int start, int count, const packed_note_t *notes);
+
+/**
+ * \fn void transform_notes(packed_note_t *notes, int count, note_range_op_t op, int value)
+ * \brief Applique une transformation à des notes encodées
+ * \param notes les notes
+ * \param count le nombre de notes
+ * \param op la transformation
+ * \param value le paramètre de la transformation
+ * \note Travaille directement sur les mots, sans décoder les notes
+ */
+void transform_notes(packed_note_t *notes, int count, note_range_op_t op, int value);
+
+/**
+ * \fn int next_channel_note(const channel_t *channel, int from);
+ * \brief Cherche la prochaine ligne non vide d'un channel
+ * \param channel le channel
+ * \param from la ligne à partir de laquelle chercher (incluse)
+ * \return l'indice de la ligne, -1 s'il n'y en a plus
+ * \note Les blocs jamais écrits sont sautés d'un coup, les lignes vides d'un bloc un mot à la fois
+ */
+int next_channel_note(const channel_t *channel, int from);
+
+/**
+ * \fn int prev_channel_note(const channel_t *channel, int from)
+ * \brief Cherche la ligne non vide précédente d'un channel
+ * \param channel le channel
+ * \param from la ligne à partir de laquelle chercher vers le début (incluse)
+ * \return l'indice de la ligne, -1 s'il n'y en a pas
+ */
+int prev_channel_note(const channel_t *channel, int from);
+
+/**
+ * \fn int count_channel_notes(const channel_t *channel)
+ * \brief Compte les lignes non vides d'un channel
+ * \param channel le channel
+ * \return le nombre de notes
+ * \note Compte les bits d'occupation de chaque bloc, sans lire les notes
+ */
+int count_channel_notes(const channel_t *channel);
+
+/**
+ * \fn void get_channel_time_counts(const channel_t *channel, int line, int counts[NOTE_TIME_CLASSES]);
+ * \brief Compte les lignes de chaque durée avant une ligne, en temps logarithmique
+ * \param channel le channel
+ * \param line la ligne (les lignes 0 à line - 1 sont comptées)
+ * \param counts reçoit le nombre de lignes de chaque durée
+ * \note counts[i] compte les lignes de durée 1 << i (voir time_duration_t). Le début d'une ligne en échantillons
+ * s'en déduit sans parcourir les notes (voir line_to_frame)
+ */
+void get_channel_time_counts(const channel_t *channel, int line, int counts[NOTE_TIME_CLASSES]);
 
+/**
+ * \fn int find_channel_line(const channel_t *channel, size_t frame, const size_t classFrames[NOTE_TIME_CLASSES], size_t *lineStart);
+ * \brief Cherche la ligne jouée à un instant donné, en temps logarithmique
+ * \param channel le channel
+ * \param frame l'instant, en échantillons depuis le début du channel
+ * \param classFrames la durée en échantillons de chaque durée de note
+ * \param lineStart reçoit le début de la ligne trouvée, en échantillons
+ * \return la ligne
+ */
+int find_channel_line(const channel_t *channel, size_t frame, const size_t classFrames[NOTE_TIME_CLASSES], size_t *lineStart);
+
+/**
+ * \fn int link_channel_pattern(channel_t *channel, int dest, int src)
+ * \brief Fait répéter à un bloc du channel le motif d'un autre bloc
+ * \param channel le channel
+ * \param dest une ligne du bloc qui devient une répétition
+ * \param src une ligne du bloc répété
+ * \return le nombre de lignes modifiées, -1 si les lignes sont invalides ou dans le même bloc
+ * \note Les anciennes notes du bloc dest sont remplacées, sans copie des notes du motif
+ */
+int link_channel_pattern(channel_t *channel, int dest, int src);
+
+/**
+ * \fn int get_channel_pattern_line(const channel_t *channel, int index)
+ * \brief Ligne qui joue la même note dans la première occurrence du motif d'une ligne
+ * \param channel le channel
+ * \param index la ligne
+ * \return la ligne équivalente de la première occurrence, index si le motif n'est pas répété plus tôt
+ * \note Permet de ne rendre et de ne transmettre qu'une fois les notes d'un motif répété. En temps constant :
+ * la première occurrence de chaque bloc est tenue à jour à chaque changement de l'index
+ */
+int get_channel_pattern_line(const channel_t *channel, int index);
+
+/**
+ * \fn void reserve_channel_lines(channel_t *channel, int lines);
+ * \brief Agrandit d'avance l'index des blocs d'un channel pour qu'il contienne des lignes
+ * \param channel le channel
+ * \param lines le nombre de lignes
+ * \note Un channel rempli de proche en proche reconstruit son index des durées à chaque agrandissement :
+ * réserver sa taille finale évite ces reconstructions
+ */
+void reserve_channel_lines(channel_t *channel, int lines);
+
+/**
+ * \fn int is_channel_note_empty(const channel_t *channel, int index);
+ * \brief Indique si une ligne d'un channel est vide, sans décoder la note
+ * \param channel le channel
+ * \param index la ligne
+ * \return 1 si la ligne est vide, 0 sinon
+ */
+int is_channel_note_empty(const channel_t *channel, int index);
+
+
+/**
+ * \fn double get_note_pitch(short id, short octave, short fineTune);
+ * \brief Fréquence d'une note, lue dans la table des hauteurs
+ * \param id identifiant de la note
+ * \param octave octave de la note
+ * \param fineTune accord fin en pas (borné à NOTE_FINETUNE_MAX)
+ * \return la fréquence en Hz, NOTE_NA_FQ pour une non note
+ * \note La table est construite une seule fois, au premier appel, à partir de init_scale
+ */
+double get_note_pitch(short id, short octave, short fineTune);
 
 /**
  * \fn scale_t init_scale()
@@ -237,6 +492,13 @@ note_t *cp_note(note_t *dest, note_t src);
  */
 void init_channel(channel_t *channel, int id);
 
+/**
+ * \fn void free_channel(channel_t *channel);
+ * \brief Libère les blocs d'un channel, qui redevient vide
+ * \param channel le channel
+ */
+void free_channel(channel_t *channel);
+
 /**
  * \fn init_music(music_t *music, short bpm);
  * \brief Initialiser une musique avec des channels vides
@@ -245,6 +507,25 @@ void init_channel(channel_t *channel, int id);
 */
 void init_music(music_t *music, short bpm);
 
+/**
+ * \fn void share_music(music_t *dest, const music_t *src);
+ * \brief Copie une musique en partageant ses blocs de notes
+ * \param dest la copie (non initialisée)
+ * \param src la musique copiée
+ * \note Seuls les index des blocs sont copiés. Une écriture dans l'une des deux musiques duplique le bloc
+ * modifié avant de l'écrire, l'autre n'est jamais modifiée. La copie n'a pas d'index des durées.
+ * Elle se libère avec free_music
+ */
+void share_music(music_t *dest, const music_t *src);
+
+/**
+ * \fn void free_music(music_t *music);
+ * \brief Libère les notes d'une musique, qui redevient vide
+ * \param music la musique
+ * \note La structure elle-même n'est pas libérée
+ */
+void free_music(music_t *music);
+
 /**
  * \fn void instrument2str(instrument_t instrument, char *str);
  * \brief Convertir un instrument en chaine de caractère
@@ -0,0 +1,55 @@
+/**
+ * \file pimusiic_plugin.h
+ * \brief ABI des instruments en plugin (bibliothèques partagées chargées au démarrage)
+ * \details Ce fichier est le seul en-tête dont un plugin a besoin, il ne dépend d'aucun autre fichier du projet.
+ * Un plugin est un .so placé dans le dossier des plugins qui exporte la fonction PIMUSIIC_PLUGIN_ENTRY :
+ * \code
+ * const pimusiic_plugin_t *pimusiic_plugin_descriptor(void) {
+ *     static const pimusiic_plugin_t plugin = { PIMUSIIC_PLUGIN_ABI_VERSION, "MYPL", my_create, my_note_on, my_process, my_destroy };
+ *     return &plugin;
+ * }
+ * \endcode
+ * Le moteur crée au chargement une instance par thread de rendu (create), la prévient de chaque nouvelle note (note_on)
+ * puis lui demande des blocs d'au plus maxFrames échantillons (process). process est appelée dans le thread
+ * audio : elle ne doit ni allouer, ni bloquer, ni faire d'entrée/sortie.
+ * \version 1.0
+ * \author Tomas Salvado Robalo & Lukas Grando
+ */
+#ifndef PIMUSIIC_PLUGIN_H
+#define PIMUSIIC_PLUGIN_H
+
+/* ------------------------------------------------------------------------ */
+/*                   E N T Ê T E S    S T A N D A R D S                     */
+/* ------------------------------------------------------------------------ */
+#include <stddef.h>
+
+/* ------------------------------------------------------------------------ */
+/*              C O N S T A N T E S     S Y M B O L I Q U E S               */
+/* ------------------------------------------------------------------------ */
+#define PIMUSIIC_PLUGIN_ABI_VERSION 1 /*!< Version de l'ABI, à incrémenter à chaque changement incompatible */
+#define PIMUSIIC_PLUGIN_ENTRY "pimusiic_plugin_descriptor" /*!< Symbole exporté par chaque plugin */
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \struct pimusiic_plugin_t
+ * \brief Descripteur d'un plugin, renvoyé par PIMUSIIC_PLUGIN_ENTRY
+ */
+typedef struct {
+    int abiVersion; /*!< PIMUSIIC_PLUGIN_ABI_VERSION au moment de la compilation du plugin */
+    const char *name; /*!< Nom affiché dans le séquenceur (4 caractères) */
+    void *(*create)(int sampleRate, size_t maxFrames); /*!< Crée une instance, peut allouer. NULL en cas d'erreur */
+    void (*note_on)(void *instance, double freq, size_t length); /*!< Début d'une note de length échantillons */
+    void (*process)(void *instance, float *out, size_t frames); /*!< Ecrit les frames échantillons suivants (entre -1 et 1), sans allouer */
+    void (*destroy)(void *instance); /*!< Libère une instance */
+} pimusiic_plugin_t;
+
+/**
+ * \typedef pimusiic_plugin_entry_t
+ * \brief Type de la fonction exportée par un plugin
+ */
+typedef const pimusiic_plugin_t *(*pimusiic_plugin_entry_t)(void);
+
+#endif
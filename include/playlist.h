@@ -0,0 +1,80 @@
+/**
+ * \file playlist.h
+ * \brief Lecture enchaînée des musiques de la bibliothèque de l'utilisateur
+ * \details Pendant qu'une musique est jouée, un thread récupère les suivantes par MPP et rend leurs
+ * premières secondes à l'avance. Le lecteur écrit toutes les musiques dans le même flux, sans le vider :
+ * le passage d'une musique à l'autre se fait sans silence et sans attendre le réseau.
+ * Le nombre de musiques récupérées à l'avance et la mémoire réservée aux débuts pré-rendus sont réglables.
+ * \version 1.0
+ * \author Tomas Salvado Robalo & Lukas Grando
+ */
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+/* ------------------------------------------------------------------------ */
+/*                   E N T Ê T E S    S T A N D A R D S                     */
+/* ------------------------------------------------------------------------ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "common.h"
+#include "note.h"
+#include "mixer.h"
+#include "request.h"
+
+/* ------------------------------------------------------------------------ */
+/*              C O N S T A N T E S     S Y M B O L I Q U E S               */
+/* ------------------------------------------------------------------------ */
+#define PLAYLIST_MAX_PREFETCH 8 /*!< Nombre maximum de musiques récupérées à l'avance */
+#define PLAYLIST_DEFAULT_PREFETCH 1 /*!< Nombre de musiques récupérées à l'avance par défaut */
+#define PLAYLIST_DEFAULT_CACHE_BYTES (4 * 1024 * 1024) /*!< Mémoire par défaut des débuts pré-rendus */
+#define PLAYLIST_INTRO_SECONDS 5 /*!< Durée maximale pré-rendue au début de chaque musique */
+#define PLAYLIST_RFID_SIZE 20 /*!< Taille du rfid de l'utilisateur */
+
+/* ------------------------------------------------------------------------ */
+/*            P R O T O T Y P E S    D E    F O N C T I O N S               */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn int set_playlist_prefetch(int depth)
+ * \brief Règle le nombre de musiques récupérées et pré-rendues à l'avance
+ * \param depth Le nombre de musiques (0 à PLAYLIST_MAX_PREFETCH)
+ * \return 0 si la valeur est acceptée, -1 sinon
+ * \note Prend effet au prochain lancement de la liste
+ */
+int set_playlist_prefetch(int depth);
+
+/**
+ * \fn void set_playlist_cache_size(size_t bytes)
+ * \brief Règle la mémoire partagée par les débuts pré-rendus des musiques suivantes
+ * \param bytes Le nombre d'octets (0 pour ne rien pré-rendre)
+ * \note Prend effet au prochain lancement de la liste
+ */
+void set_playlist_cache_size(size_t bytes);
+
+/**
+ * \fn int start_playlist(char *rfid, const musicId_list_t *musicIds, int first)
+ * \brief Lance la lecture enchaînée d'une liste de musiques
+ * \param rfid Le rfid de l'utilisateur
+ * \param musicIds Les identifiants des musiques (copiés)
+ * \param first L'indice de la première musique jouée
+ * \return 0 si la lecture est lancée, -1 sinon
+ * \note Une liste déjà lancée est d'abord arrêtée
+ */
+int start_playlist(char *rfid, const musicId_list_t *musicIds, int first);
+
+/**
+ * \fn void stop_playlist()
+ * \brief Arrête la lecture de la liste et attend la fin des threads
+ */
+void stop_playlist();
+
+/**
+ * \fn int get_playlist_current()
+ * \brief Indique la musique en cours de lecture
+ * \return L'indice de la musique dans la liste, -1 si la liste n'est pas jouée
+ */
+int get_playlist_current();
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * \file plugin.h
+ * \brief Chargement des instruments en plugin et comptabilité de leur temps de calcul
+ * \details Les plugins (voir pimusiic_plugin.h) sont chargés avec dlopen depuis un dossier au démarrage.
+ * PLUGIN_INSTANCE_SLOTS jeux d'instances sont créés au chargement. A sa première note, chaque thread de rendu
+ * prend un jeu libre, sans verrou ni allocation, et le rend à la fin du thread.
+ * Le temps CPU passé dans chaque plugin est mesuré pour savoir lequel consomme le budget audio.
+ * \version 1.0
+ * \author Tomas Salvado Robalo & Lukas Grando
+ */
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+/* ------------------------------------------------------------------------ */
+/*                   E N T Ê T E S    S T A N D A R D S                     */
+/* ------------------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include "common.h"
+#include "pimusiic_plugin.h"
+
+/* ------------------------------------------------------------------------ */
+/*              C O N S T A N T E S     S Y M B O L I Q U E S               */
+/* ------------------------------------------------------------------------ */
+#define PLUGIN_FOLDER "plugins" /*!< Dossier par défaut des plugins */
+#define PLUGIN_MAX 16 /*!< Nombre maximum de plugins chargés */
+#define PLUGIN_NAME_SIZE 5 /*!< Taille du nom d'un plugin (4 caractères affichés) */
+#define PLUGIN_MAX_FRAMES 1024 /*!< Nombre maximum d'échantillons demandés à process en un appel */
+#define PLUGIN_INSTANCE_SLOTS 8 /*!< Nombre de threads qui peuvent rendre des plugins en même temps */
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \struct plugin_stats_t
+ * \brief Temps de calcul cumulé d'un plugin
+ */
+typedef struct {
+    char name[PLUGIN_NAME_SIZE]; /*!< Nom du plugin */
+    uint64_t cpuNs; /*!< Temps CPU passé dans process (ns) */
+    uint64_t frames; /*!< Nombre d'échantillons produits */
+    uint64_t calls; /*!< Nombre de blocs rendus */
+    double load; /*!< Part du temps réel consommée (cpuNs / durée des échantillons produits) */
+} plugin_stats_t;
+
+/* ------------------------------------------------------------------------ */
+/*            P R O T O T Y P E S    D E    F O N C T I O N S               */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn int load_plugins(const char *folder, int rate)
+ * \brief Charge tous les plugins .so d'un dossier et crée leurs instances
+ * \param folder Le dossier à charger
+ * \param rate La fréquence d'échantillonnage du moteur
+ * \return Le nombre de plugins chargés
+ * \note Les plugins invalides ou d'une autre version d'ABI sont ignorés avec un message d'erreur
+ */
+int load_plugins(const char *folder, int rate);
+
+/**
+ * \fn void unload_plugins()
+ * \brief Décharge tous les plugins
+ * \note Les threads de rendu doivent être terminés
+ */
+void unload_plugins();
+
+/**
+ * \fn int get_plugin_count()
+ * \brief Récupère le nombre de plugins chargés
+ * \return Le nombre de plugins
+ */
+int get_plugin_count();
+
+/**
+ * \fn const char *get_plugin_name(int index)
+ * \brief Récupère le nom d'un plugin
+ * \param index L'indice du plugin
+ * \return Le nom ou NULL si l'indice n'est pas chargé
+ */
+const char *get_plugin_name(int index);
+
+/**
+ * \fn int render_plugin(int index, float *out, size_t offset, size_t count, double freq, size_t length, int rate)
+ * \brief Rend un bloc d'une note avec un plugin
+ * \param index L'indice du plugin
+ * \param out Le buffer de sortie
+ * \param offset Indice dans la note du premier échantillon du bloc (0 déclenche note_on)
+ * \param count Nombre d'échantillons du bloc
+ * \param freq Fréquence de la note
+ * \param length Durée totale de la note en échantillons
+ * \param rate Fréquence d'échantillonnage
+ * \return 0 si le bloc est rendu, -1 sinon (le buffer est alors rempli de silence)
+ */
+int render_plugin(int index, float *out, size_t offset, size_t count, double freq, size_t length, int rate);
+
+/**
+ * \fn int get_plugin_stats(plugin_stats_t *out, int max, int rate)
+ * \brief Copie le temps de calcul cumulé de chaque plugin
+ * \param out Le tableau à remplir
+ * \param max La taille du tableau
+ * \param rate Fréquence d'échantillonnage (pour convertir les échantillons en temps réel)
+ * \return Le nombre de plugins copiés
+ */
+int get_plugin_stats(plugin_stats_t *out, int max, int rate);
+
+#endif
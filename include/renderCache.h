@@ -0,0 +1,98 @@
+/**
+ * \file renderCache.h
+ * \brief Cache du rendu de la musique, note par note et channel par channel
+ * \details Chaque note jouée est gardée rendue, avec la clé qui a servi à la rendre (note, bpm, effet,
+ * fréquence d'échantillonnage, qualité). A la lecture suivante, une note dont la clé n'a pas changé est
+ * écrite directement depuis le cache, seules les notes modifiées sont synthétisées à nouveau.
+ * Les éditions du séquenceur marquent la note touchée comme sale (voir update_channel_nbNotes) ce qui
+ * libère tout de suite son rendu. Un changement de bpm ou de fréquence change la clé de toutes les notes.
+ * \note Les entrées sont protégées par un verrou pour que le séquenceur puisse éditer pendant une boucle
+ * (voir mixer.h). Un rendu est toujours copié sous le verrou, aucun pointeur sur une entrée n'est rendu.
+ * \version 1.0
+ * \author Tomas Salvado Robalo & Lukas Grando
+ */
+#ifndef RENDER_CACHE_H
+#define RENDER_CACHE_H
+
+/* ------------------------------------------------------------------------ */
+/*                   E N T Ê T E S    S T A N D A R D S                     */
+/* ------------------------------------------------------------------------ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common.h"
+#include "note.h"
+#include "engine.h"
+
+/* ------------------------------------------------------------------------ */
+/*              C O N S T A N T E S     S Y M B O L I Q U E S               */
+/* ------------------------------------------------------------------------ */
+#define RENDER_CACHE_MAX_BYTES (64 * 1024 * 1024) /*!< Mémoire maximum occupée par les rendus gardés */
+
+/* ------------------------------------------------------------------------ */
+/*            P R O T O T Y P E S    D E    F O N C T I O N S               */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn size_t render_cache_read(short channel, int index, note_t note, short bpm, short effect, short *out, size_t max)
+ * \brief Copie le rendu d'une note s'il est valable
+ * \param channel L'identifiant du channel
+ * \param index L'indice de la note dans le channel
+ * \param note La note à jouer
+ * \param bpm Le bpm de la musique
+ * \param effect L'effet appliqué à la note
+ * \param out Le buffer qui reçoit le rendu
+ * \param max La taille du buffer
+ * \return Le nombre d'échantillons copiés, 0 si le rendu est absent, sale, périmé ou trop grand
+ * \note Un rendu fait à une qualité inférieure à la qualité courante du moteur est considéré périmé
+ */
+size_t render_cache_read(short channel, int index, note_t note, short bpm, short effect, short *out, size_t max);
+
+/**
+ * \fn void render_cache_store(short channel, int index, note_t note, short bpm, short effect, const short *samples, size_t frames, engine_quality_t quality)
+ * \brief Garde une copie du rendu complet d'une note
+ * \param channel L'identifiant du channel
+ * \param index L'indice de la note dans le channel
+ * \param note La note rendue
+ * \param bpm Le bpm de la musique
+ * \param effect L'effet appliqué à la note
+ * \param samples Les échantillons rendus
+ * \param frames Le nombre d'échantillons
+ * \param quality La plus basse qualité utilisée pendant le rendu
+ * \note Rien n'est gardé si la mémoire du cache est épuisée
+ */
+void render_cache_store(short channel, int index, note_t note, short bpm, short effect, const short *samples, size_t frames, engine_quality_t quality);
+
+/**
+ * \fn void render_cache_mark_dirty(short channel, int index)
+ * \brief Marque une note comme modifiée et libère son rendu
+ * \param channel L'identifiant du channel
+ * \param index L'indice de la note dans le channel
+ */
+void render_cache_mark_dirty(short channel, int index);
+
+/**
+ * \fn void render_cache_mark_range_dirty(short channel, int start, int count)
+ * \brief Marque des notes consécutives comme modifiées et libère leurs rendus
+ * \param channel L'identifiant du channel
+ * \param start L'indice de la première note
+ * \param count Le nombre de notes
+ * \note Le verrou n'est pris qu'une fois pour toute la région
+ */
+void render_cache_mark_range_dirty(short channel, int start, int count);
+
+/**
+ * \fn void render_cache_clear()
+ * \brief Libère tous les rendus
+ */
+void render_cache_clear();
+
+/**
+ * \fn unsigned long render_cache_epoch()
+ * \brief Compteur incrémenté à chaque note marquée sale
+ * \return La valeur du compteur
+ * \note Permet de savoir sans parcourir les notes si un rendu construit à partir du cache est encore à jour
+ */
+unsigned long render_cache_epoch();
+
+#endif
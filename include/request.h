@@ -29,14 +29,26 @@ mpp_response_t send_connection_request(socket_t *socket, char *rfid);
 mpp_response_t send_list_music_request(socket_t *socket, char *rfid);
 
 /**
- * @fn mpp_response_t send_save_music_request(socket_t *socket, char *rfid, music_t *music)
+ * @fn mpp_response_t send_save_music_request(socket_t *socket, char *rfid, music_t *music, int overwrite)
  * @brief Envoie une requête pour sauvegarder une musique
  * @param socket La socket de connexion au serveur
  * @param rfid Le rfid de l'utilisateur
- * @param music La musique à sauvegarder
+ * @param music La musique à sauvegarder, modifiée depuis music->revision
+ * @param overwrite 1 pour écraser la musique enregistrée même si elle a changé depuis music->revision
  * @return mpp_response_t 
  */
-mpp_response_t send_save_music_request(socket_t *socket, char *rfid, music_t *music);
+mpp_response_t send_save_music_request(socket_t *socket, char *rfid, music_t *music, int overwrite);
+
+/**
+ * @fn mpp_response_t send_patch_music_request(socket_t *socket, char *rfid, time_t musicId, music_patch_t *patch)
+ * @brief Envoie une requête pour modifier quelques lignes d'une musique enregistrée
+ * @param socket La socket de connexion au serveur
+ * @param rfid Le rfid de l'utilisateur
+ * @param musicId L'identifiant de la musique
+ * @param patch Les lignes modifiées depuis la révision patch->base
+ * @return mpp_response_t 
+ */
+mpp_response_t send_patch_music_request(socket_t *socket, char *rfid, time_t musicId, music_patch_t *patch);
 
 /**
  * @fn mpp_response_t send_delete_music_request(socket_t *socket, char *rfid, time_t musicId)
@@ -70,5 +82,20 @@ mpp_response_t send_get_music_request(socket_t *socket, char *rfid, time_t music
 */
 mpp_response_t client_request_handler(mpp_request_code_t code , char *rfid, music_t *music, time_t musicId);
 
+/**
+ * @fn mpp_response_t client_save_request_handler(char *rfid, music_t *music, music_patch_t *patch, int overwrite)
+ * @brief Sauvegarde une musique sur le serveur, en n'envoyant que ses lignes modifiées si possible
+ * @param rfid Le rfid de l'utilisateur
+ * @param music La musique à sauvegarder, sa révision est mise à jour si la sauvegarde réussit
+ * @param patch Les lignes modifiées depuis la révision de la musique (NULL pour envoyer la musique entière)
+ * @param overwrite 1 pour que la musique entière écrase celle du serveur même si elle a changé depuis sa révision
+ * @return mpp_response_t La réponse du serveur
+ * @note La musique est envoyée en entier (MPP_ADD_MUSIC) si elle n'a pas encore de révision ou si le serveur ne
+ * connaît pas MPP 2.2. Elle porte sa révision : comme un patch, elle est refusée (MPP_RESPONSE_CONFLICT) si la
+ * musique a changé sur le serveur. Une sauvegarde refusée n'est jamais refaite avec overwrite : c'est à
+ * l'utilisateur de choisir entre la version du serveur et la sienne
+*/
+mpp_response_t client_save_request_handler(char *rfid, music_t *music, music_patch_t *patch, int overwrite);
+
 
 #endif
\ No newline at end of file
@@ -0,0 +1,98 @@
+/**
+ * \file resampler.h
+ * \brief Rééchantillonneur polyphase pour la lecture des samples à une hauteur quelconque
+ * \details Les trois qualités (linéaire, cubique et sinus cardinal fenêtré) sont des filtres RIF polyphase
+ * dont les coefficients sont précalculés en virgule fixe Q14. Seul le nombre de coefficients par phase change,
+ * la boucle interne est la même produit scalaire entier (vectorisable) pour les trois qualités.
+ * \version 1.0
+ * \author Tomas Salvado Robalo & Lukas Grando
+ */
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+/* ------------------------------------------------------------------------ */
+/*                   E N T Ê T E S    S T A N D A R D S                     */
+/* ------------------------------------------------------------------------ */
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include "sample.h"
+
+/* ------------------------------------------------------------------------ */
+/*              C O N S T A N T E S     S Y M B O L I Q U E S               */
+/* ------------------------------------------------------------------------ */
+#define RESAMPLER_FRAC_BITS 32 /*!< Nombre de bits de la partie fractionnaire des positions */
+#define RESAMPLER_ONE ((uint64_t)1 << RESAMPLER_FRAC_BITS) /*!< Pas de lecture à la hauteur d'origine */
+#define RESAMPLER_PHASE_BITS 8 /*!< Nombre de bits de phase */
+#define RESAMPLER_PHASES (1 << RESAMPLER_PHASE_BITS) /*!< Nombre de phases des tables */
+#define RESAMPLER_COEF_BITS 14 /*!< Précision des coefficients (Q14) */
+#define RESAMPLER_SINC_TAPS 8 /*!< Nombre de coefficients du sinus cardinal sans décimation */
+#define RESAMPLER_SINC_TABLES 3 /*!< Nombre de tables de sinus cardinal (coupure 1, 1/2 et 1/4) */
+#define RESAMPLER_MAX_TAPS (RESAMPLER_SINC_TAPS << (RESAMPLER_SINC_TABLES - 1)) /*!< Nombre maximum de coefficients */
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \enum resampler_quality_t
+ * \brief Qualité d'interpolation, de la moins chère à la meilleure
+ */
+typedef enum {
+    RESAMPLER_LINEAR = 0, /*!< Interpolation linéaire (2 coefficients) */
+    RESAMPLER_CUBIC, /*!< Interpolation cubique Catmull-Rom (4 coefficients) */
+    RESAMPLER_SINC, /*!< Sinus cardinal fenêtré (8 à 32 coefficients selon la transposition) */
+} resampler_quality_t;
+
+/* ------------------------------------------------------------------------ */
+/*            P R O T O T Y P E S    D E    F O N C T I O N S               */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn void init_resampler()
+ * \brief Précalcule les tables de coefficients
+ * \note Peut être appelée plusieurs fois, les tables ne sont calculées qu'une fois
+ */
+void init_resampler();
+
+/**
+ * \fn void set_resampler_quality(resampler_quality_t quality)
+ * \brief Change la qualité d'interpolation utilisée par toutes les voix
+ * \param quality La qualité
+ */
+void set_resampler_quality(resampler_quality_t quality);
+
+/**
+ * \fn resampler_quality_t get_resampler_quality()
+ * \brief Récupère la qualité d'interpolation courante
+ * \return La qualité
+ */
+resampler_quality_t get_resampler_quality();
+
+/**
+ * \fn uint64_t resampler_step(double freq, double rootFreq, int sampleRate, int outputRate)
+ * \brief Calcule le pas de lecture en virgule fixe 32.32
+ * \param freq La fréquence à jouer
+ * \param rootFreq La fréquence d'origine du sample
+ * \param sampleRate La fréquence d'échantillonnage du sample
+ * \param outputRate La fréquence d'échantillonnage de sortie
+ * \return Le pas de lecture
+ */
+uint64_t resampler_step(double freq, double rootFreq, int sampleRate, int outputRate);
+
+/**
+ * \fn size_t resample(const sample_t *sample, uint64_t *position, uint64_t step, short *buffer, size_t count, resampler_quality_t quality)
+ * \brief Lit un sample à une vitesse quelconque
+ * \param sample Le sample
+ * \param position La position de lecture en virgule fixe 32.32 (mise à jour)
+ * \param step Le pas de lecture en virgule fixe 32.32
+ * \param buffer Le buffer à remplir
+ * \param count Le nombre d'échantillons à produire
+ * \param quality La qualité d'interpolation
+ * \return Le nombre d'échantillons produits avant la fin du sample (le reste n'est pas écrit)
+ * \note La boucle du sample est respectée
+ */
+size_t resample(const sample_t *sample, uint64_t *position, uint64_t step, short *buffer, size_t count, resampler_quality_t quality);
+
+#endif
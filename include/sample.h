@@ -0,0 +1,134 @@
+/**
+ * \file sample.h
+ * \brief Banque de samples chargée une seule fois au démarrage
+ * \details Les fichiers RAW (PCM 16 bits mono) et WAV du dossier de la banque sont projetés en mémoire avec mmap.
+ * Les voix lisent directement dans la mémoire projetée : déclencher un sample ne fait ni E/S ni allocation.
+ * \version 1.0
+ * \author Tomas Salvado Robalo & Lukas Grando
+ */
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+/* ------------------------------------------------------------------------ */
+/*                   E N T Ê T E S    S T A N D A R D S                     */
+/* ------------------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <math.h>
+#include "common.h"
+#include "note.h"
+
+/* ------------------------------------------------------------------------ */
+/*              C O N S T A N T E S     S Y M B O L I Q U E S               */
+/* ------------------------------------------------------------------------ */
+#define SAMPLE_BANK_FOLDER "ressources/samples" /*!< Dossier par défaut de la banque de samples */
+#define SAMPLE_BANK_MAX 16 /*!< Nombre maximum de samples dans la banque */
+#define SAMPLE_NAME_SIZE 64 /*!< Taille maximale du nom d'un sample */
+#define SAMPLE_RAW_RATE 48000 /*!< Fréquence d'échantillonnage supposée des fichiers RAW */
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \struct sample_t
+ * \brief Un sample projeté en mémoire
+ * \note data pointe directement dans la projection du fichier, il ne faut pas le libérer
+ */
+typedef struct {
+    char name[SAMPLE_NAME_SIZE]; /*!< Nom du fichier (sans le dossier) */
+    const short *data; /*!< Echantillons PCM 16 bits mono */
+    size_t frames; /*!< Nombre d'échantillons */
+    size_t loopStart; /*!< Début de la boucle (inclus) */
+    size_t loopEnd; /*!< Fin de la boucle (exclue) */
+    int looped; /*!< Le sample boucle entre loopStart et loopEnd */
+    int rate; /*!< Fréquence d'échantillonnage du fichier */
+    double rootFreq; /*!< Fréquence jouée par le sample à sa vitesse d'origine */
+    void *map; /*!< Début de la projection mémoire */
+    size_t mapSize; /*!< Taille de la projection mémoire */
+} sample_t;
+
+/**
+ * \struct sample_bank_t
+ * \brief Banque de samples
+ */
+typedef struct {
+    sample_t samples[SAMPLE_BANK_MAX]; /*!< Samples chargés (triés par nom de fichier) */
+    int size; /*!< Nombre de samples chargés */
+} sample_bank_t;
+
+/**
+ * \struct sample_voice_t
+ * \brief Tête de lecture sur un sample
+ */
+typedef struct {
+    const sample_t *sample; /*!< Sample lu (NULL pour une voix muette) */
+    uint64_t position; /*!< Position de lecture en virgule fixe 32.32 */
+    uint64_t step; /*!< Pas de lecture en virgule fixe 32.32 */
+} sample_voice_t;
+
+/* ------------------------------------------------------------------------ */
+/*            P R O T O T Y P E S    D E    F O N C T I O N S               */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn int init_sample_bank(const char *folder)
+ * \brief Charge tous les fichiers .wav et .raw d'un dossier dans la banque globale
+ * \param folder Le dossier à charger
+ * \return Le nombre de samples chargés
+ * \note Les fichiers invalides sont ignorés, un dossier absent donne une banque vide
+ */
+int init_sample_bank(const char *folder);
+
+/**
+ * \fn void free_sample_bank()
+ * \brief Libère les projections mémoire de la banque globale
+ */
+void free_sample_bank();
+
+/**
+ * \fn const sample_t *get_sample(int index)
+ * \brief Récupère un sample de la banque par son indice
+ * \param index L'indice du sample
+ * \return Le sample ou NULL si l'indice n'est pas chargé
+ */
+const sample_t *get_sample(int index);
+
+/**
+ * \fn const sample_t *find_sample(const char *name)
+ * \brief Récupère un sample de la banque par son nom de fichier
+ * \param name Le nom du fichier (sans le dossier)
+ * \return Le sample ou NULL s'il n'est pas chargé
+ */
+const sample_t *find_sample(const char *name);
+
+/**
+ * \fn sample_voice_t create_sample_voice(const sample_t *sample, double freq, int outputRate)
+ * \brief Crée une voix qui lit un sample depuis le début à une hauteur donnée
+ * \param sample Le sample à lire (peut être NULL)
+ * \param freq La fréquence à jouer (0 pour la hauteur d'origine)
+ * \param outputRate La fréquence d'échantillonnage de sortie
+ * \return La voix
+ */
+sample_voice_t create_sample_voice(const sample_t *sample, double freq, int outputRate);
+
+/**
+ * \fn size_t render_sample_voice(sample_voice_t *voice, short *buffer, size_t count)
+ * \brief Produit les prochains échantillons de la voix dans un buffer
+ * \param voice La voix
+ * \param buffer Le buffer à remplir
+ * \param count Le nombre d'échantillons à écrire
+ * \return Le nombre d'échantillons réellement issus du sample (le reste est du silence)
+ * \note La boucle du sample est respectée, sans boucle la fin du buffer est complétée par du silence.
+ * A la hauteur d'origine les échantillons sont copiés, sinon ils passent par le rééchantillonneur.
+ */
+size_t render_sample_voice(sample_voice_t *voice, short *buffer, size_t count);
+
+#endif
@@ -15,6 +15,8 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
 
 /**
  * \struct socket_t
@@ -27,6 +29,7 @@ typedef struct {
     short mode; /*!< mode de la socket (SOCK_STREAM/SOCK_DGRAM) */
     struct sockaddr_in localAddr; /*!< structure sockaddr_in contenant l'adresse locale */
     struct sockaddr_in remoteAddr; /*!< structure sockaddr_in contenant l'adresse distante */
+    short framed; /*!< 1 si les messages sont précédés de leur taille, 0 pour un pair qui ne les encadre pas */
 } socket_t;
 
 /**
@@ -132,6 +135,47 @@ char *recvFromSocket(socket_t *sock, int size, char *buff);
 */
 void writeToSocket(socket_t *sock, char *buff);
 
+/**
+ * \fn     void writeBytesToSocket(socket_t *sock, char *buff, int size);
+ * \brief  Ecriture d'un message de taille connue sur une socket
+ * \param  sock : la structure socket_t contenant la socket
+ * \param  buff : message à envoyer, qui peut contenir des '\0' (message binaire)
+ * \param  size : taille du message
+*/
+void writeBytesToSocket(socket_t *sock, char *buff, int size);
+
+/**
+ * \fn     void writeVectorToSocket(socket_t *sock, struct iovec *iov, int count);
+ * \brief  Ecriture d'un message en plusieurs morceaux (en-tête et contenu par exemple) avec writev
+ * \param  sock : la structure socket_t contenant la socket
+ * \param  iov : les morceaux du message, modifiés pendant l'écriture
+ * \param  count : le nombre de morceaux
+ * \note   Les écritures partielles sont reprises jusqu'à ce que tout le message soit écrit
+*/
+void writeVectorToSocket(socket_t *sock, struct iovec *iov, int count);
+
+/**
+ * \fn     int readAllFromSocket(socket_t *sock, char *buff, int size);
+ * \brief  Lecture d'exactement size octets sur une socket
+ * \param  sock : la structure socket_t contenant la socket
+ * \param  buff : buffer dans lequel on va stocker les octets
+ * \param  size : nombre d'octets à lire
+ * \return Le nombre d'octets lus, moins de size si la connexion est fermée avant
+ * \note   Les lectures partielles sont reprises jusqu'à ce que les size octets soient lus
+*/
+int readAllFromSocket(socket_t *sock, char *buff, int size);
+
+/**
+ * \fn     int peekSocket(socket_t *sock, char *buff, int size);
+ * \brief  Copie les octets déjà arrivés sur une socket sans les consommer
+ * \param  sock : la structure socket_t contenant la socket
+ * \param  buff : buffer dans lequel on va copier les octets
+ * \param  size : nombre maximum d'octets à copier
+ * \return Le nombre d'octets copiés (au moins 1, on attend qu'il en arrive), 0 si la connexion est fermée
+ * \note   Les octets copiés restent à lire : on peut regarder où finit un message avant de le lire
+*/
+int peekSocket(socket_t *sock, char *buff, int size);
+
 
 /**
  * \fn void sendToSocket(socket_t *sock, char *buff, char *ip, int port);
@@ -145,6 +189,18 @@ void writeToSocket(socket_t *sock, char *buff);
 */
 void sendToSocket(socket_t *sock, char *buff, char *ip, int port);
 
+/**
+ * \fn void sendBytesToSocket(socket_t *sock, char *buff, int size, char *ip, int port);
+ * \brief Envoi d'un message de taille connue à une adresse IP et un port donnés pour une socket UDP
+ * \param sock : file descriptor de la socket
+ * \param buff : message à envoyer, qui peut contenir des '\0' (message binaire)
+ * \param size : taille du message
+ * \param ip : adresse ip du destinataire
+ * \param port : port du destinataire
+ * \note Cette fonction est utilisée pour les sockets UDP
+*/
+void sendBytesToSocket(socket_t *sock, char *buff, int size, char *ip, int port);
+
 /**
  * \fn    int acceptClient(int sock);
  * \brief Acceptation d'un client
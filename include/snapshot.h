@@ -0,0 +1,97 @@
+/**
+ * \file snapshot.h
+ * \brief Versions figées d'une musique, pour jouer pendant que le séquenceur édite
+ * \details Une version partage les blocs de notes de la musique éditée (voir share_music) : la créer ne copie
+ * que les index des blocs, et une édition ne duplique que le bloc qu'elle modifie. Une version n'est jamais
+ * modifiée et reste valable tant qu'un lecteur en garde une référence.
+ * Le séquenceur dépose chaque nouvelle version dans la boîte de chaque lecteur. Le lecteur prend la dernière
+ * version déposée entre deux notes, sans verrou ni copie : un échange atomique de pointeur suffit.
+ * \version 1.0
+ * \author Tomas Salvado Robalo & Lukas Grando
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/* ------------------------------------------------------------------------ */
+/*                   E N T Ê T E S    S T A N D A R D S                     */
+/* ------------------------------------------------------------------------ */
+#include <stdlib.h>
+#include "common.h"
+#include "note.h"
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \struct music_snapshot_t
+ * \brief Version figée d'une musique, comptée par référence
+ */
+typedef struct {
+    int refs; /*!< Nombre de références (atomique) */
+    music_t music; /*!< La musique, à ne pas modifier */
+} music_snapshot_t;
+
+/**
+ * \struct snapshot_mailbox_t
+ * \brief Boîte où le séquenceur dépose la dernière version pour un lecteur
+ */
+typedef struct {
+    music_snapshot_t *latest; /*!< Dernière version déposée et pas encore prise, NULL sinon (atomique) */
+} snapshot_mailbox_t;
+
+/* ------------------------------------------------------------------------ */
+/*            P R O T O T Y P E S    D E    F O N C T I O N S               */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn music_snapshot_t *create_snapshot(const music_t *music)
+ * \brief Fige l'état courant d'une musique
+ * \param music La musique éditée
+ * \return La version, avec une référence pour l'appelant
+ * \note Ne copie que les index des blocs de notes
+ */
+music_snapshot_t *create_snapshot(const music_t *music);
+
+/**
+ * \fn music_snapshot_t *retain_snapshot(music_snapshot_t *snapshot)
+ * \brief Prend une référence de plus sur une version
+ * \param snapshot La version
+ * \return La version
+ */
+music_snapshot_t *retain_snapshot(music_snapshot_t *snapshot);
+
+/**
+ * \fn void release_snapshot(music_snapshot_t *snapshot)
+ * \brief Rend une référence sur une version, la libère à la dernière
+ * \param snapshot La version (NULL accepté)
+ */
+void release_snapshot(music_snapshot_t *snapshot);
+
+/**
+ * \fn void publish_snapshot(snapshot_mailbox_t *mailbox, music_snapshot_t *snapshot)
+ * \brief Dépose une version dans la boîte d'un lecteur
+ * \param mailbox La boîte
+ * \param snapshot La version, dont la référence est donnée à la boîte
+ * \note Une version déposée que le lecteur n'a pas encore prise est remplacée et rendue
+ */
+void publish_snapshot(snapshot_mailbox_t *mailbox, music_snapshot_t *snapshot);
+
+/**
+ * \fn music_snapshot_t *update_snapshot(snapshot_mailbox_t *mailbox, music_snapshot_t *current)
+ * \brief Passe à la dernière version déposée, s'il y en a une
+ * \param mailbox La boîte du lecteur
+ * \param current La version utilisée jusque là (NULL accepté)
+ * \return La version à utiliser : la nouvelle (current est alors rendue) ou current
+ * \note Sans verrou : appelée par le thread audio entre deux notes
+ */
+music_snapshot_t *update_snapshot(snapshot_mailbox_t *mailbox, music_snapshot_t *current);
+
+/**
+ * \fn void clear_mailbox(snapshot_mailbox_t *mailbox)
+ * \brief Rend la version déposée et pas encore prise
+ * \param mailbox La boîte
+ */
+void clear_mailbox(snapshot_mailbox_t *mailbox);
+
+#endif
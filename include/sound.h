@@ -14,17 +14,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <errno.h>
 #include <alsa/asoundlib.h>
 #include <unistd.h> 
 #include <pthread.h>
 #include "note.h"
+#include "sample.h"
+#include "engine.h"
+#include "instrument.h"
+#include "renderCache.h"
 
 /* ------------------------------------------------------------------------ */
 /*              C O N S T A N T E S     S Y M B O L I Q U E S               */
 /* ------------------------------------------------------------------------ */
 
-#define SAMPLE_RATE 48000
 #define BASE_AMPLITUDE 10000
+#define FUZZ_OVERSAMPLED_RATE 96000 /*!< Fréquence de travail visée par le fuzz (suréchantillonnage local) */
+#define COMPRESSION_OVERSAMPLED_RATE 48000 /*!< Fréquence de travail visée par la compression */
+#define RENDER_MAX_STAGES (1 + INSTRUMENT_MAX_EFFECTS) /*!< Nombre d'effets en série sur une note (effet de la note + chaîne de l'instrument) */
 
 /* ------------------------------------------------------------------------ */
 /*                    M A C R O    F O N C T I O N S                        */
@@ -34,6 +41,14 @@
 /*              D É F I N I T I O N S   D E   T Y P E S                     */
 /* ------------------------------------------------------------------------ */
 
+/**
+ * \struct render_state_t
+ * \brief Etat du rendu d'une note conservé d'un bloc à l'autre
+ */
+typedef struct {
+    size_t length; /*!< Durée totale de la note en échantillons */
+    short previous[RENDER_MAX_STAGES]; /*!< Dernier échantillon du bloc précédent avant chaque effet */
+} render_state_t;
 
 
 /* ------------------------------------------------------------------------ */
@@ -55,6 +70,81 @@ void init_sound(snd_pcm_t **pcm);
  */
 void play_note(note_t note,short bpm,snd_pcm_t *pcm,short effect);
 
+/**
+ * \fn void play_channel_note(short channel, int index, note_t note, short bpm, snd_pcm_t *pcm, short effect);
+ * \brief joue une note d'un channel en passant par le cache de rendu
+ * \param channel l'identifiant du channel
+ * \param index l'indice de la note dans le channel
+ * \param note la note à jouer
+ * \param bpm le bpm de la musique
+ * \note une note inchangée depuis la dernière lecture est écrite depuis le cache sans être synthétisée
+ * \see play_channel_note_from
+ */
+void play_channel_note(short channel, int index, note_t note, short bpm, snd_pcm_t *pcm, short effect);
+
+/**
+ * \fn void play_channel_note_from(short channel, int index, note_t note, short bpm, snd_pcm_t *pcm, short effect, size_t skip);
+ * \brief joue la fin d'une note d'un channel en passant par le cache de rendu
+ * \param channel l'identifiant du channel
+ * \param index l'indice de la note dans le channel
+ * \param note la note à jouer
+ * \param bpm le bpm de la musique
+ * \param skip nombre d'échantillons du début de la note à ne pas jouer
+ * \note sert à reprendre la lecture au milieu d'une note (voir frame_to_line).
+ * Le rendu est copié hors du cache : le séquenceur peut éditer la note (et libérer son rendu) pendant qu'elle est jouée
+ */
+void play_channel_note_from(short channel, int index, note_t note, short bpm, snd_pcm_t *pcm, short effect, size_t skip);
+
+/**
+ * \fn engine_quality_t render_note_buffer(note_t note, short bpm, short effect, short *out);
+ * \brief rend une note entière dans un buffer, sans la jouer
+ * \param note la note à rendre
+ * \param bpm le bpm de la musique
+ * \param effect l'effet appliqué à la note
+ * \param out buffer de noteToTime(note, bpm) échantillons
+ * \return la plus basse qualité utilisée pendant le rendu
+ */
+engine_quality_t render_note_buffer(note_t note, short bpm, short effect, short *out);
+
+/**
+ * \fn size_t noteToTime(note_t note, short bpm);
+ * \brief transforme une note en nombre d'échantillons
+ * \param note la note
+ * \param bpm le bpm de la musique
+ * \return la durée de la note en échantillons
+ */
+size_t noteToTime(note_t note, short bpm);
+
+/**
+ * \fn size_t line_to_frame(const channel_t *channel, int line, short bpm);
+ * \brief position d'une ligne dans le channel, en temps logarithmique
+ * \param channel le channel
+ * \param line la ligne
+ * \param bpm le bpm de la musique
+ * \return le début de la ligne, en échantillons depuis le début du channel
+ */
+size_t line_to_frame(const channel_t *channel, int line, short bpm);
+
+/**
+ * \fn int frame_to_line(const channel_t *channel, size_t frame, short bpm, size_t *offset);
+ * \brief ligne jouée à un instant donné, en temps logarithmique
+ * \param channel le channel
+ * \param frame l'instant, en échantillons depuis le début du channel
+ * \param bpm le bpm de la musique
+ * \param offset reçoit la position de l'instant dans la ligne, en échantillons
+ * \return la ligne
+ */
+int frame_to_line(const channel_t *channel, size_t frame, short bpm, size_t *offset);
+
+/**
+ * \fn void write_block(snd_pcm_t *pcm, const short *buffer, size_t count);
+ * \brief écrit un bloc dans le flux, en relançant le flux s'il n'a pas été alimenté à temps
+ * \param pcm le flux
+ * \param buffer les échantillons
+ * \param count le nombre d'échantillons
+ */
+void write_block(snd_pcm_t *pcm, const short *buffer, size_t count);
+
 /**
  * \fn void end_sound(snd_pcm_t *pcm);
  * \brief termine le pcm
@@ -63,8 +153,11 @@ void end_sound(snd_pcm_t *pcm);
 
 
 /**
- * \fn  play_sample(FILE *f,snd_pcm_t *pcm);
- * \brief joue un sample
+ * \fn  play_sample(char *fic, snd_pcm_t *pcm);
+ * \brief joue un sample de la banque
+ * \param fic nom du fichier du sample dans la banque
+ * \note le sample est écrit directement depuis la mémoire projetée, sans lecture de fichier
+ * \see init_sample_bank
  */
 void play_sample(char * fic,snd_pcm_t *pcm);
 
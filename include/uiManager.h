@@ -15,6 +15,10 @@
 #include "request.h"
 #include "mysyscall.h"
 #include "sound.h"
+#include "mixer.h"
+#include "playlist.h"
+#include "snapshot.h"
+#include "journal.h"
 #include <time.h>   
 
 #define RPI_COLS 106 /*!< Nombre de colonnes de la fenêtre sur le RPI */
@@ -57,6 +61,19 @@
 #define KEY_BUTTON_CH1NSAVE 'z'
 #define KEY_BUTTON_LINEDOWN 'c'
 #define KEY_BUTTON_LINEUP 'v'
+#define KEY_BUTTON_LOOP 'l' /*!< Début puis fin de la région à jouer en boucle, arrêt de la boucle */
+#define KEY_BUTTON_PLAYLIST 'p' /*!< Joue la liste à partir de la musique sélectionnée, ou l'arrête */
+#define KEY_BUTTON_PLAYFROM 'k' /*!< Joue la musique à partir de la ligne sélectionnée */
+#define KEY_BUTTON_PATTERN 'o' /*!< La mesure sous le curseur répète la précédente */
+#define KEY_BUTTON_NEXTNOTE 'n' /*!< Saute à la note suivante du channel */
+#define KEY_BUTTON_PREVNOTE 'b' /*!< Saute à la note précédente du channel */
+#define KEY_BUTTON_UNDO 'u' /*!< Annule la dernière édition */
+#define KEY_BUTTON_REDO 'y' /*!< Rétablit la dernière édition annulée */
+#define KEY_BUTTON_MARK 'm' /*!< Pose (ou enlève) le coin de la région sélectionnée, l'autre coin suit le curseur */
+#define KEY_BUTTON_COPY 'w' /*!< Copie la région sélectionnée (ou la ligne du curseur) */
+#define KEY_BUTTON_PASTE 'x' /*!< Colle la région copiée au curseur */
+#define KEY_BUTTON_INSERT 'i' /*!< Insère autant de lignes vides que la région sélectionnée en compte (ou une) */
+#define KEY_BUTTON_DELETE 'd' /*!< Supprime les lignes de la région sélectionnée (ou celle du curseur) */
 
 
 
@@ -151,6 +168,10 @@ typedef struct
     int lines[SEQUENCER_NAV_CH_MAX];   /*!< Ligne [ch] */
     //int line;
     int playMode;                    /*!< Mode de lecture */
+    int played[SEQUENCER_NAV_CH_MAX]; /*!< Ligne jouée [ch] pendant l'édition, -1 hors lecture */
+    int marked;                       /*!< 1 si un coin de la région sélectionnée est posé, 0 sans sélection */
+    sequencer_nav_ch_t markCh;        /*!< Channel du coin posé de la région sélectionnée */
+    int markLine;                     /*!< Ligne du coin posé de la région sélectionnée */
 } sequencer_nav_t;
 
 
@@ -160,10 +181,31 @@ typedef struct {
     sem_t *syncSem;
     sem_t *finishSem;
     sequencer_nav_t *seqNav;
-    music_t *music;
+    snapshot_mailbox_t *mailbox; /*!< Versions de la musique déposées par le séquenceur */
+    int *stop; /*!< Passe à 1 pour arrêter la lecture (atomique) */
     int channel;
+    int startLine; /*!< Première ligne jouée */
+    size_t skip; /*!< Echantillons de la première ligne à ne pas jouer */
 } channel_thread_args_t;
 
+/**
+ * \struct playback_t
+ * \brief Lecture de la musique en arrière-plan, pendant que le séquenceur édite
+ * \details Chaque channel est joué par un thread à partir d'une version figée de la musique (voir snapshot.h).
+ * Après une édition, publish_playback dépose la nouvelle version que les threads prennent à la note suivante.
+ */
+typedef struct {
+    pthread_t threads[MUSIC_MAX_CHANNELS]; /*!< Un thread par channel */
+    sem_t showSem[MUSIC_MAX_CHANNELS]; /*!< Posté par un channel à chaque ligne jouée */
+    sem_t syncSem; /*!< Départ commun des channels */
+    sem_t finishSem; /*!< Posté par un channel à la fin de sa lecture */
+    snapshot_mailbox_t mailboxes[MUSIC_MAX_CHANNELS]; /*!< Versions déposées pour chaque channel */
+    sequencer_nav_t nav; /*!< Lignes jouées */
+    int stop; /*!< 1 pour arrêter les channels (atomique) */
+    int finished; /*!< Nombre de channels terminés */
+    int running; /*!< 1 tant que les threads n'ont pas été attendus */
+} playback_t;
+
 /**
  * \fn void init_ncurses()
  * \brief Initialisation de ncurses et de la fenêtre
@@ -248,6 +290,15 @@ void sequencer_nav_up(sequencer_nav_t *nav, int channelId);
  */
 void sequencer_nav_down(sequencer_nav_t *nav, int channelId);
 
+/**
+ * @fn void sequencer_nav_goto(sequencer_nav_t *nav, int channelId, int line)
+ * @brief Place le curseur d'un channel sur une ligne, en faisant défiler le channel si besoin
+ * @param nav la structure de navigation
+ * @param channelId le channel (-1 pour le channel sélectionné)
+ * @param line la ligne
+ */
+void sequencer_nav_goto(sequencer_nav_t *nav, int channelId, int line);
+
 /**
  * @fn void sequencer_nav_left(sequencer_nav_t *nav)
  * @brief La fonction qui permet de passer d'une colonne à une autre dans le séquenceur (vers la gauche)
@@ -288,10 +339,38 @@ choices_t show_sequencer(music_t *music, char *connected);
 int getchr_wiringpi();
 
 /**
- * @fn void play_music(music_t *music)
- * @brief Joue la musique et affiche les lignes jouées
+ * @fn void start_playback(playback_t *playback, const music_t *music, size_t frame)
+ * @brief Lance la lecture de la musique en arrière-plan à partir d'un instant
+ * @param playback La lecture (arrêtée)
+ * @param music La musique (une version figée en est prise)
+ * @param frame L'instant de départ, en échantillons depuis le début de la musique
+ * @note Chaque channel reprend au milieu de la note jouée à cet instant, tous restent alignés
+ */
+void start_playback(playback_t *playback, const music_t *music, size_t frame);
+
+/**
+ * @fn int poll_playback(playback_t *playback)
+ * @brief Relève les lignes jouées depuis le dernier appel et attend les threads à la fin de la lecture
+ * @param playback La lecture
+ * @return Les channels dont la ligne jouée a changé (bit i pour le channel i)
+ */
+int poll_playback(playback_t *playback);
+
+/**
+ * @fn void publish_playback(playback_t *playback, const music_t *music)
+ * @brief Transmet l'état courant de la musique à la lecture en cours
+ * @param playback La lecture
+ * @param music La musique éditée
+ * @note Sans effet si la lecture est arrêtée. Les channels passent à la nouvelle version à leur note suivante
+ */
+void publish_playback(playback_t *playback, const music_t *music);
+
+/**
+ * @fn void stop_playback(playback_t *playback)
+ * @brief Arrête la lecture à la fin des notes en cours et attend les threads
+ * @param playback La lecture
  */
-void play_music(WINDOW **channelWin, music_t *music);
+void stop_playback(playback_t *playback);
 
 /**
  * @brief play_channel(void *channelId)
@@ -300,12 +379,12 @@ void play_music(WINDOW **channelWin, music_t *music);
 void *play_channel(void *channelId);
 
 /**
- * @brief create_channel_thread_args(sem_t *syncSem, sem_t *finishSem, sequencer_nav_t *seqNav, music_t *music, int channel)
+ * @brief create_channel_thread_args(sem_t *syncSem, sem_t *finishSem, sequencer_nav_t *seqNav, snapshot_mailbox_t *mailbox, int *stop, int channel)
  * @brief Crée les arguments pour le thread de channel
  * @return channel_thread_args_t 
  * @note Les arguments doivent être libérés après utilisation
  */
-channel_thread_args_t *create_channel_thread_args(sem_t *showSem, sem_t *syncSem, sem_t *finishSem, sequencer_nav_t *seqNav, music_t *music, int channel);
+channel_thread_args_t *create_channel_thread_args(sem_t *showSem, sem_t *syncSem, sem_t *finishSem, sequencer_nav_t *seqNav, snapshot_mailbox_t *mailbox, int *stop, int channel);
 
 #endif // GRAPHIC_SEQ_H
 
@@ -0,0 +1,305 @@
+/**
+ * @file bufferPool.c
+ * @brief Fichier source de la réserve de buffers d'entrée/sortie.
+ * @version 1.0
+ * @author Lukas Grando
+ */
+
+#include "bufferPool.h"
+
+/**
+ * @union pool_header_t
+ * @brief En-tête caché devant chaque buffer emprunté
+ * @note L'union garde le buffer aligné comme un retour de malloc
+ */
+typedef union pool_header_u {
+    struct {
+        union pool_header_u *next; /*!< Buffer suivant de la classe quand le buffer est dans la réserve */
+        size_t capacity; /*!< Taille utilisable du buffer */
+        int sizeClass; /*!< Classe du buffer, -1 pour un buffer trop grand qui n'est jamais gardé */
+    } info;
+    long double align; /*!< Alignement */
+} pool_header_t;
+
+/**
+ * @struct pool_cache_t
+ * @brief Buffers gardés par un thread, repris et rendus sans prendre le verrou
+ */
+typedef struct {
+    pool_header_t *lists[BUFFER_POOL_CLASSES]; /*!< Buffers gardés, par classe */
+    int nbFree[BUFFER_POOL_CLASSES]; /*!< Nombre de buffers gardés par classe */
+    int registered; /*!< 1 si le cache sera vidé dans la réserve partagée à la fin du thread */
+} pool_cache_t;
+
+static pool_header_t *freeLists[BUFFER_POOL_CLASSES]; /*!< Buffers gardés par la réserve partagée, par classe */
+static int nbFree[BUFFER_POOL_CLASSES]; /*!< Nombre de buffers gardés par classe dans la réserve partagée */
+static size_t sharedBytes; /*!< Octets gardés par la réserve partagée */
+static buffer_pool_stats_t poolStats; /*!< Compteurs (atomiques) */
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER; /*!< Protège la réserve partagée */
+static __thread pool_cache_t threadCache; /*!< Cache du thread courant, devant la réserve partagée */
+static pthread_key_t cacheKey; /*!< Vide le cache d'un thread qui se termine */
+static pthread_once_t cacheKeyOnce = PTHREAD_ONCE_INIT; /*!< Création de cacheKey */
+/**
+ * @fn static int size_class(size_t size)
+ * @brief Classe de taille d'une demande
+ * @param size La taille demandée
+ * @return La plus petite classe qui contient size octets, -1 si size dépasse BUFFER_POOL_MAX_SIZE
+ */
+static int size_class(size_t size) {
+    int sizeClass = 0;
+    if(size > BUFFER_POOL_MAX_SIZE) return -1;
+    while((BUFFER_POOL_MIN_SIZE << sizeClass) < size) sizeClass++;
+    return sizeClass;
+}
+
+/**
+ * @fn static pool_header_t *header_of(const char *buffer)
+ * @brief Retrouve l'en-tête d'un buffer emprunté
+ * @param buffer Le buffer
+ * @return Son en-tête
+ */
+static pool_header_t *header_of(const char *buffer) {
+    return (pool_header_t *) buffer - 1;
+}
+
+/**
+ * @fn static void count_used(size_t capacity)
+ * @brief Compte un buffer emprunté et met à jour le pic
+ * @param capacity La taille du buffer
+ */
+static void count_used(size_t capacity) {
+    size_t used = __atomic_add_fetch(&poolStats.usedBytes, capacity, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&poolStats.peakBytes, __ATOMIC_RELAXED);
+    while(used > peak && !__atomic_compare_exchange_n(&poolStats.peakBytes, &peak, used, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/**
+ * @fn static void count_held(size_t capacity, int delta)
+ * @brief Compte un buffer qui entre dans la réserve (delta à 1) ou en sort (delta à -1)
+ * @param capacity La taille du buffer
+ * @param delta 1 ou -1
+ */
+static void count_held(size_t capacity, int delta) {
+    __atomic_add_fetch(&poolStats.held, (size_t) delta, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&poolStats.heldBytes, (size_t) delta * capacity, __ATOMIC_RELAXED);
+}
+
+/**
+ * @fn static void release_shared(pool_header_t *header)
+ * @brief Rend un buffer à la réserve partagée, ou le libère si elle est pleine
+ * @param header L'en-tête du buffer
+ */
+static void release_shared(pool_header_t *header) {
+    size_t capacity = header->info.capacity;
+    int sizeClass = header->info.sizeClass, keep;
+    pthread_mutex_lock(&poolMutex);
+    keep = sizeClass >= 0 && nbFree[sizeClass] < BUFFER_POOL_KEEP && sharedBytes + capacity <= BUFFER_POOL_MAX_HELD;
+    if(keep) {
+        header->info.next = freeLists[sizeClass];
+        freeLists[sizeClass] = header;
+        nbFree[sizeClass]++;
+        sharedBytes += capacity;
+    }
+    pthread_mutex_unlock(&poolMutex);
+    // Un buffer rendu peut déjà avoir été repris par un autre thread : on ne relit plus son en-tête
+    if(keep) {
+        count_held(capacity, 1);
+    } else {
+        __atomic_add_fetch(&poolStats.frees, 1, __ATOMIC_RELAXED);
+        free(header);
+    }
+}
+
+/**
+ * @fn static void flush_cache(void *cache)
+ * @brief Vide le cache d'un thread dans la réserve partagée
+ * @param cache Le cache
+ * @note Appelée à la fin de chaque thread qui a utilisé la réserve
+ */
+static void flush_cache(void *cache) {
+    pool_cache_t *owner = cache;
+    pool_header_t *header;
+    int i;
+    for(i = 0; i < BUFFER_POOL_CLASSES; i++) {
+        while((header = owner->lists[i]) != NULL) {
+            owner->lists[i] = header->info.next;
+            count_held(header->info.capacity, -1);
+            release_shared(header);
+        }
+        owner->nbFree[i] = 0;
+    }
+    owner->registered = 0;
+}
+
+/**
+ * @fn static void create_cache_key()
+ * @brief Crée la clé qui vide le cache des threads qui se terminent
+ */
+static void create_cache_key() {
+    pthread_key_create(&cacheKey, flush_cache);
+}
+
+/**
+ * @fn static pool_cache_t *thread_cache()
+ * @brief Cache du thread courant
+ * @return Le cache, inscrit pour être vidé à la fin du thread
+ */
+static pool_cache_t *thread_cache() {
+    if(!threadCache.registered) {
+        pthread_once(&cacheKeyOnce, create_cache_key);
+        pthread_setspecific(cacheKey, &threadCache);
+        threadCache.registered = 1;
+    }
+    return &threadCache;
+}
+
+/**
+ * @fn char *buffer_pool_get(size_t size)
+ * @brief Emprunte un buffer d'au moins size octets
+ * @param size La taille demandée
+ * @return Le buffer, de la taille de sa classe (voir buffer_pool_capacity), à rendre avec buffer_pool_release
+ * @note Le contenu du buffer n'est pas initialisé
+ */
+char *buffer_pool_get(size_t size) {
+    int sizeClass = size_class(size);
+    size_t capacity = sizeClass >= 0 ? BUFFER_POOL_MIN_SIZE << sizeClass : size;
+    pool_cache_t *cache = thread_cache();
+    pool_header_t *header = NULL;
+    // Le cache du thread d'abord, sans verrou, puis la réserve partagée
+    if(sizeClass >= 0 && (header = cache->lists[sizeClass]) != NULL) {
+        cache->lists[sizeClass] = header->info.next;
+        cache->nbFree[sizeClass]--;
+    } else if(sizeClass >= 0) {
+        pthread_mutex_lock(&poolMutex);
+        if((header = freeLists[sizeClass]) != NULL) {
+            freeLists[sizeClass] = header->info.next;
+            nbFree[sizeClass]--;
+            sharedBytes -= capacity;
+        }
+        pthread_mutex_unlock(&poolMutex);
+    }
+    count_used(capacity);
+    if(header != NULL) {
+        count_held(header->info.capacity, -1);
+        __atomic_add_fetch(&poolStats.reuses, 1, __ATOMIC_RELAXED);
+    } else {
+        // L'allocation se fait hors du verrou : les autres threads ne l'attendent pas
+        __atomic_add_fetch(&poolStats.allocations, 1, __ATOMIC_RELAXED);
+        header = (pool_header_t *) malloc(sizeof(pool_header_t) + capacity);
+        CHECK_ALLOC(header);
+        header->info.capacity = capacity;
+        header->info.sizeClass = sizeClass;
+    }
+    header->info.next = NULL;
+    return (char *) (header + 1);
+}
+
+/**
+ * @fn char *buffer_pool_resize(char *buffer, size_t size)
+ * @brief Agrandit un buffer emprunté en gardant son contenu
+ * @param buffer Le buffer (NULL pour en emprunter un nouveau)
+ * @param size La nouvelle taille
+ * @return Le buffer, déplacé dans une classe plus grande si nécessaire (l'ancien est alors rendu)
+ */
+char *buffer_pool_resize(char *buffer, size_t size) {
+    char *resized;
+    if(buffer == NULL) return buffer_pool_get(size);
+    if(size <= header_of(buffer)->info.capacity) return buffer;
+    resized = buffer_pool_get(size);
+    memcpy(resized, buffer, header_of(buffer)->info.capacity);
+    buffer_pool_release(buffer);
+    return resized;
+}
+
+/**
+ * @fn size_t buffer_pool_capacity(const char *buffer)
+ * @brief Taille utilisable d'un buffer emprunté
+ * @param buffer Le buffer
+ * @return La taille de sa classe, ou la taille demandée pour un buffer plus grand que BUFFER_POOL_MAX_SIZE
+ */
+size_t buffer_pool_capacity(const char *buffer) {
+    return header_of(buffer)->info.capacity;
+}
+
+/**
+ * @fn void buffer_pool_release(char *buffer)
+ * @brief Rend un buffer à la réserve
+ * @param buffer Le buffer (NULL accepté)
+ */
+void buffer_pool_release(char *buffer) {
+    pool_header_t *header;
+    pool_cache_t *cache;
+    int sizeClass;
+    if(buffer == NULL) return;
+    header = header_of(buffer);
+    sizeClass = header->info.sizeClass;
+    __atomic_add_fetch(&poolStats.releases, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&poolStats.usedBytes, header->info.capacity, __ATOMIC_RELAXED);
+    cache = thread_cache();
+    // Les petites classes restent dans le cache du thread, qui les reprendra sans verrou
+    if(sizeClass >= 0 && sizeClass <= BUFFER_POOL_THREAD_MAX_SHIFT - BUFFER_POOL_MIN_SHIFT && cache->nbFree[sizeClass] < BUFFER_POOL_THREAD_KEEP) {
+        header->info.next = cache->lists[sizeClass];
+        cache->lists[sizeClass] = header;
+        cache->nbFree[sizeClass]++;
+        count_held(header->info.capacity, 1);
+        return;
+    }
+    release_shared(header);
+}
+
+/**
+ * @fn void buffer_pool_trim()
+ * @brief Libère tous les buffers gardés par la réserve partagée et par le cache du thread appelant
+ */
+void buffer_pool_trim() {
+    pool_header_t *lists[BUFFER_POOL_CLASSES], *header;
+    int i;
+    flush_cache(&threadCache);
+    pthread_mutex_lock(&poolMutex);
+    for(i = 0; i < BUFFER_POOL_CLASSES; i++) {
+        lists[i] = freeLists[i];
+        freeLists[i] = NULL;
+        nbFree[i] = 0;
+    }
+    sharedBytes = 0;
+    pthread_mutex_unlock(&poolMutex);
+    for(i = 0; i < BUFFER_POOL_CLASSES; i++) {
+        while((header = lists[i]) != NULL) {
+            lists[i] = header->info.next;
+            count_held(header->info.capacity, -1);
+            __atomic_add_fetch(&poolStats.frees, 1, __ATOMIC_RELAXED);
+            free(header);
+        }
+    }
+}
+
+/**
+ * @fn void get_buffer_pool_stats(buffer_pool_stats_t *stats)
+ * @brief Lit les compteurs de la réserve
+ * @param stats Reçoit les compteurs
+ * @note Les compteurs sont lus un par un, sans verrou : ils peuvent venir de deux instants proches
+ */
+void get_buffer_pool_stats(buffer_pool_stats_t *stats) {
+    stats->allocations = __atomic_load_n(&poolStats.allocations, __ATOMIC_RELAXED);
+    stats->reuses = __atomic_load_n(&poolStats.reuses, __ATOMIC_RELAXED);
+    stats->releases = __atomic_load_n(&poolStats.releases, __ATOMIC_RELAXED);
+    stats->frees = __atomic_load_n(&poolStats.frees, __ATOMIC_RELAXED);
+    stats->held = __atomic_load_n(&poolStats.held, __ATOMIC_RELAXED);
+    stats->heldBytes = __atomic_load_n(&poolStats.heldBytes, __ATOMIC_RELAXED);
+    stats->usedBytes = __atomic_load_n(&poolStats.usedBytes, __ATOMIC_RELAXED);
+    stats->peakBytes = __atomic_load_n(&poolStats.peakBytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * @fn void print_buffer_pool_stats(FILE *stream)
+ * @brief Ecrit les compteurs de la réserve sur une ligne
+ * @param stream Le flux de sortie
+ */
+void print_buffer_pool_stats(FILE *stream) {
+    buffer_pool_stats_t stats;
+    get_buffer_pool_stats(&stats);
+    fprintf(stream, "[BUFFER_POOL] %lu allocations, %lu réutilisations, %lu rendus, %lu libérations, "
+        "%zu buffers gardés (%zu Ko), %zu Ko empruntés (pic %zu Ko)\n",
+        stats.allocations, stats.reuses, stats.releases, stats.frees,
+        stats.held, stats.heldBytes >> 10, stats.usedBytes >> 10, stats.peakBytes >> 10);
+}
@@ -0,0 +1,484 @@
+/**
+ * @file codec.c
+ * @brief Fichier source de l'écriture et de la lecture séquentielles des messages sérialisés
+ * @version 1.0
+ * @author Lukas Grando
+ */
+
+#include "codec.h"
+
+/**
+ * @fn void init_writer(writer_t *writer, char *storage, size_t capacity)
+ * @brief Initialise un writer vide
+ * @param writer Le writer
+ * @param storage Le buffer fixe dans lequel écrire, NULL pour un buffer alloué qui grandit
+ * @param capacity La taille du buffer fixe ou la taille initiale du buffer emprunté (WRITER_DEFAULT_CAPACITY si 0)
+ * @note Un writer qui grandit se libère avec free_writer
+ */
+void init_writer(writer_t *writer, char *storage, size_t capacity) {
+    writer->growable = storage == NULL;
+    writer->capacity = capacity > 0 ? capacity : WRITER_DEFAULT_CAPACITY;
+    if(writer->growable) {
+        // Le buffer est emprunté à la réserve et garde toute la taille de sa classe
+        storage = buffer_pool_get(writer->capacity);
+        writer->capacity = buffer_pool_capacity(storage);
+    }
+    writer->data = storage;
+    writer->length = 0;
+    writer->overflow = 0;
+    writer->data[0] = '\0';
+}
+
+/**
+ * @fn void free_writer(writer_t *writer)
+ * @brief Rend à la réserve le buffer d'un writer qui grandit (sans effet sur un buffer fixe)
+ * @param writer Le writer
+ */
+void free_writer(writer_t *writer) {
+    if(!writer->growable) return;
+    buffer_pool_release(writer->data);
+    writer->data = NULL;
+    writer->length = 0;
+    writer->capacity = 0;
+}
+
+/**
+ * @fn int writer_reserve(writer_t *writer, size_t size)
+ * @brief S'assure que size octets peuvent encore être écrits
+ * @param writer Le writer
+ * @param size Le nombre d'octets
+ * @return 0 si la place est disponible, -1 sinon (overflow est alors levé)
+ * @note Après un overflow, plus rien n'est écrit : le message s'arrête net au lieu d'avoir des trous
+ */
+int writer_reserve(writer_t *writer, size_t size) {
+    size_t capacity;
+    if(writer->overflow) return -1;
+    // Un octet est toujours gardé pour le '\0' final
+    if(writer->length + size < writer->capacity) return 0;
+    if(!writer->growable) {
+        writer->overflow = 1;
+        return -1;
+    }
+    // La taille double : chaque octet est recopié au plus une fois en moyenne
+    for(capacity = writer->capacity * 2; writer->length + size >= capacity; capacity *= 2);
+    writer->data = buffer_pool_resize(writer->data, capacity);
+    writer->capacity = buffer_pool_capacity(writer->data);
+    return 0;
+}
+
+/**
+ * @fn void writer_put_bytes(writer_t *writer, const void *bytes, size_t size)
+ * @brief Ecrit des octets au curseur
+ * @param writer Le writer
+ * @param bytes Les octets
+ * @param size Le nombre d'octets
+ */
+void writer_put_bytes(writer_t *writer, const void *bytes, size_t size) {
+    if(writer_reserve(writer, size) == -1) return;
+    memcpy(writer->data + writer->length, bytes, size);
+    writer->length += size;
+    writer->data[writer->length] = '\0';
+}
+
+/**
+ * @fn void writer_put_char(writer_t *writer, char c)
+ * @brief Ecrit un caractère au curseur
+ * @param writer Le writer
+ * @param c Le caractère
+ */
+void writer_put_char(writer_t *writer, char c) {
+    if(writer_reserve(writer, 1) == -1) return;
+    writer->data[writer->length++] = c;
+    writer->data[writer->length] = '\0';
+}
+
+/**
+ * @fn void writer_put_string(writer_t *writer, const char *string)
+ * @brief Ecrit une chaîne (sans son '\0') au curseur
+ * @param writer Le writer
+ * @param string La chaîne
+ */
+void writer_put_string(writer_t *writer, const char *string) {
+    writer_put_bytes(writer, string, strlen(string));
+}
+
+/**
+ * @fn void writer_put_int(writer_t *writer, long value)
+ * @brief Ecrit un entier en décimal au curseur
+ * @param writer Le writer
+ * @param value L'entier
+ * @note Plus rapide que writer_printf pour les champs numériques des messages
+ */
+void writer_put_int(writer_t *writer, long value) {
+    char digits[24]; // Assez pour un long de 64 bits et son signe
+    int i = sizeof(digits);
+    // On travaille sur la valeur absolue non signée pour que LONG_MIN ne déborde pas
+    unsigned long abs = value < 0 ? 0UL - (unsigned long) value : (unsigned long) value;
+    // Les chiffres sont produits du moins significatif au plus significatif
+    do {
+        digits[--i] = '0' + abs % 10;
+        abs /= 10;
+    } while(abs != 0);
+    if(value < 0) digits[--i] = '-';
+    writer_put_bytes(writer, digits + i, sizeof(digits) - i);
+}
+
+/**
+ * @fn void writer_printf(writer_t *writer, const char *format, ...)
+ * @brief Ecrit du texte formaté au curseur
+ * @param writer Le writer
+ * @param format Le format (voir printf)
+ * @param ... Les arguments du format
+ */
+void writer_printf(writer_t *writer, const char *format, ...) {
+    va_list args;
+    int size;
+    // On mesure d'abord le texte pour ne jamais l'écrire à moitié
+    va_start(args, format);
+    size = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if(size < 0 || writer_reserve(writer, size) == -1) return;
+    va_start(args, format);
+    vsnprintf(writer->data + writer->length, writer->capacity - writer->length, format, args);
+    va_end(args);
+    writer->length += size;
+}
+
+/**
+ * @fn int reader_is_end(const reader_t *reader)
+ * @brief Indique si le curseur est à la fin du message
+ */
+static int reader_is_end(const reader_t *reader) {
+    return reader->position >= reader->length || reader->data[reader->position] == '\0';
+}
+
+/**
+ * @fn void reader_skip_spaces(reader_t *reader)
+ * @brief Avance le curseur après les espaces
+ */
+static void reader_skip_spaces(reader_t *reader) {
+    while(!reader_is_end(reader) && reader->data[reader->position] == ' ') reader->position++;
+}
+
+/**
+ * @fn void init_reader(reader_t *reader, const char *data, size_t length)
+ * @brief Initialise un reader au début d'un buffer
+ * @param reader Le reader
+ * @param data Le buffer (non copié, il doit rester valable pendant la lecture)
+ * @param length La taille du buffer
+ */
+void init_reader(reader_t *reader, const char *data, size_t length) {
+    reader->data = data;
+    reader->length = length;
+    reader->position = 0;
+    reader->error = CODEC_OK;
+}
+
+/**
+ * @fn int reader_peek(reader_t *reader)
+ * @brief Saute les espaces et renvoie le caractère suivant sans le consommer
+ * @param reader Le reader
+ * @return Le caractère, -1 à la fin du message ou après une erreur
+ */
+int reader_peek(reader_t *reader) {
+    if(reader->error != CODEC_OK) return -1;
+    reader_skip_spaces(reader);
+    return reader_is_end(reader) ? -1 : (unsigned char) reader->data[reader->position];
+}
+
+/**
+ * @fn int reader_at_end(reader_t *reader)
+ * @brief Saute les espaces et les lignes vides et indique si le message est terminé
+ * @param reader Le reader
+ * @return 1 s'il ne reste rien à lire (ou après une erreur), 0 sinon
+ */
+int reader_at_end(reader_t *reader) {
+    if(reader->error != CODEC_OK) return 1;
+    while(!reader_is_end(reader) && (reader->data[reader->position] == ' ' || reader->data[reader->position] == '\n')) reader->position++;
+    return reader_is_end(reader);
+}
+
+/**
+ * @fn codec_error_t reader_get_int(reader_t *reader, long min, long max, long *value)
+ * @brief Lit un entier décimal
+ * @param reader Le reader
+ * @param min La plus petite valeur acceptée
+ * @param max La plus grande valeur acceptée
+ * @param value Reçoit l'entier (inchangé en cas d'erreur)
+ * @return L'erreur du reader (CODEC_OK si l'entier est lu)
+ */
+codec_error_t reader_get_int(reader_t *reader, long min, long max, long *value) {
+    unsigned long abs = 0, limit;
+    long result;
+    int negative = 0, digits = 0, digit;
+    if(reader->error != CODEC_OK) return reader->error;
+    reader_skip_spaces(reader);
+    if(!reader_is_end(reader) && reader->data[reader->position] == '-') {
+        negative = 1;
+        reader->position++;
+    }
+    // Plus grande valeur absolue représentable avec ce signe
+    limit = negative ? 0UL - (unsigned long) LONG_MIN : (unsigned long) LONG_MAX;
+    // Les chiffres sont accumulés directement depuis le buffer
+    while(!reader_is_end(reader) && (digit = reader->data[reader->position] - '0') >= 0 && digit <= 9) {
+        if(abs > (limit - digit) / 10) return reader->error = CODEC_ERROR_RANGE;
+        abs = abs * 10 + digit;
+        reader->position++;
+        digits++;
+    }
+    if(digits == 0) return reader->error = reader_is_end(reader) ? CODEC_ERROR_TRUNCATED : CODEC_ERROR_SYNTAX;
+    // Le champ doit être suivi d'un séparateur
+    if(!reader_is_end(reader) && reader->data[reader->position] != ' ' && reader->data[reader->position] != '\n') return reader->error = CODEC_ERROR_SYNTAX;
+    result = negative ? (long) (0UL - abs) : (long) abs;
+    if(result < min || result > max) return reader->error = CODEC_ERROR_RANGE;
+    *value = result;
+    return CODEC_OK;
+}
+
+/**
+ * @fn codec_error_t reader_get_word(reader_t *reader, char *word, size_t size)
+ * @brief Lit un mot (jusqu'au prochain espace ou retour à la ligne), éventuellement vide
+ * @note Le mot commence juste après le séparateur du champ précédent
+ * @param reader Le reader
+ * @param word Reçoit le mot terminé par '\0'
+ * @param size La taille de word, '\0' compris
+ * @return L'erreur du reader (CODEC_ERROR_RANGE si le mot est trop long)
+ */
+codec_error_t reader_get_word(reader_t *reader, char *word, size_t size) {
+    size_t start, length;
+    if(reader->error != CODEC_OK) return reader->error;
+    // Un seul séparateur est sauté : deux espaces entourent un mot vide
+    if(!reader_is_end(reader) && reader->data[reader->position] == ' ') reader->position++;
+    for(start = reader->position; !reader_is_end(reader) && reader->data[reader->position] != ' ' && reader->data[reader->position] != '\n'; reader->position++);
+    length = reader->position - start;
+    if(length >= size) return reader->error = CODEC_ERROR_RANGE;
+    memcpy(word, reader->data + start, length);
+    word[length] = '\0';
+    return CODEC_OK;
+}
+
+/**
+ * @fn codec_error_t reader_end_line(reader_t *reader)
+ * @brief Termine une ligne : seuls des espaces peuvent rester avant le retour à la ligne
+ * @param reader Le reader
+ * @return L'erreur du reader (CODEC_ERROR_SYNTAX s'il reste un champ sur la ligne)
+ * @note Les lignes vides qui suivent sont sautées, la fin du message termine aussi la ligne
+ */
+codec_error_t reader_end_line(reader_t *reader) {
+    if(reader->error != CODEC_OK) return reader->error;
+    reader_skip_spaces(reader);
+    if(!reader_is_end(reader) && reader->data[reader->position] != '\n') return reader->error = CODEC_ERROR_SYNTAX;
+    reader_at_end(reader);
+    return CODEC_OK;
+}
+
+/**
+ * @fn void writer_put_varint(writer_t *writer, unsigned long value)
+ * @brief Ecrit un entier positif en varint au curseur
+ * @param writer Le writer
+ * @param value L'entier (1 octet jusqu'à 127, 2 jusqu'à 16383...)
+ */
+void writer_put_varint(writer_t *writer, unsigned long value) {
+    unsigned char bytes[10]; // Assez pour 64 bits à 7 bits par octet
+    int size = 0;
+    // Les 7 bits de poids faible d'abord, le bit de poids fort annonce un octet de plus
+    while(value >= 0x80) {
+        bytes[size++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    bytes[size++] = (unsigned char) value;
+    writer_put_bytes(writer, bytes, size);
+}
+
+/**
+ * @fn void writer_put_svarint(writer_t *writer, long value)
+ * @brief Ecrit un entier signé en varint au curseur
+ * @param writer Le writer
+ * @param value L'entier, codé en zigzag (0, -1, 1, -2... deviennent 0, 1, 2, 3...) pour que les petites valeurs
+ * négatives restent courtes
+ */
+void writer_put_svarint(writer_t *writer, long value) {
+    writer_put_varint(writer, value < 0 ? ((0UL - (unsigned long) value) << 1) - 1 : (unsigned long) value << 1);
+}
+
+/**
+ * @fn void writer_put_lstring(writer_t *writer, const char *string)
+ * @brief Ecrit une chaîne précédée de sa taille en varint
+ * @param writer Le writer
+ * @param string La chaîne
+ */
+void writer_put_lstring(writer_t *writer, const char *string) {
+    size_t length = strlen(string);
+    writer_put_varint(writer, length);
+    writer_put_bytes(writer, string, length);
+}
+
+/**
+ * @fn size_t writer_begin_message(writer_t *writer, int version, int type)
+ * @brief Ecrit l'en-tête d'un message binaire, dont la taille est complétée par writer_end_message
+ * @param writer Le writer
+ * @param version La version du format
+ * @param type Le type du message
+ * @return La position de l'en-tête, à passer à writer_end_message
+ */
+size_t writer_begin_message(writer_t *writer, int version, int type) {
+    size_t header = writer->length;
+    unsigned char fields[6] = {version, type, 0, 0, 0, 0};
+    writer_put_bytes(writer, CODEC_MAGIC, CODEC_MAGIC_SIZE);
+    writer_put_bytes(writer, fields, sizeof(fields));
+    return header;
+}
+
+/**
+ * @fn void writer_end_message(writer_t *writer, size_t header)
+ * @brief Termine un message binaire : la taille du contenu écrit depuis l'en-tête est reportée dans l'en-tête
+ * @param writer Le writer
+ * @param header La position de l'en-tête (voir writer_begin_message)
+ */
+void writer_end_message(writer_t *writer, size_t header) {
+    unsigned char *size;
+    unsigned long payload;
+    // Un message qui n'a pas tenu dans le buffer n'est pas complété
+    if(writer->overflow || header + CODEC_HEADER_SIZE > writer->length) return;
+    payload = writer->length - header - CODEC_HEADER_SIZE;
+    size = (unsigned char *) writer->data + header + CODEC_HEADER_SIZE - 4;
+    size[0] = payload >> 24;
+    size[1] = payload >> 16;
+    size[2] = payload >> 8;
+    size[3] = payload;
+}
+
+/**
+ * @fn int codec_is_binary(const char *data, size_t length)
+ * @brief Indique si un buffer commence par un message binaire
+ * @param data Le buffer
+ * @param length La taille du buffer
+ * @return 1 si le buffer commence par le magic, 0 sinon
+ */
+int codec_is_binary(const char *data, size_t length) {
+    return length >= CODEC_HEADER_SIZE && memcmp(data, CODEC_MAGIC, CODEC_MAGIC_SIZE) == 0;
+}
+
+/**
+ * @fn size_t codec_message_length(const char *data, size_t capacity)
+ * @brief Calcule la taille d'un message à envoyer
+ * @param data Le buffer contenant le message
+ * @param capacity La taille du buffer
+ * @return En-tête et contenu pour un message binaire, texte et '\0' final pour un message texte (au plus capacity)
+ */
+size_t codec_message_length(const char *data, size_t capacity) {
+    const unsigned char *size = (const unsigned char *) data + CODEC_HEADER_SIZE - 4;
+    size_t length;
+    if(codec_is_binary(data, capacity)) {
+        length = CODEC_HEADER_SIZE + ((unsigned long) size[0] << 24 | (unsigned long) size[1] << 16 | (unsigned long) size[2] << 8 | size[3]);
+    } else {
+        // Le '\0' final fait partie d'un message texte
+        length = strnlen(data, capacity) + 1;
+    }
+    return length < capacity ? length : capacity;
+}
+
+/**
+ * @fn codec_error_t reader_get_header(reader_t *reader, int *version, int *type)
+ * @brief Lit l'en-tête d'un message binaire et limite le reader à son contenu
+ * @param reader Le reader, placé au début du message
+ * @param version Reçoit la version du format
+ * @param type Reçoit le type du message
+ * @return L'erreur du reader (CODEC_ERROR_SYNTAX sans magic, CODEC_ERROR_TRUNCATED si le contenu dépasse le buffer)
+ */
+codec_error_t reader_get_header(reader_t *reader, int *version, int *type) {
+    const unsigned char *header = (const unsigned char *) reader->data + reader->position;
+    unsigned long payload;
+    if(reader->error != CODEC_OK) return reader->error;
+    if(reader->position + CODEC_HEADER_SIZE > reader->length) return reader->error = CODEC_ERROR_TRUNCATED;
+    if(memcmp(header, CODEC_MAGIC, CODEC_MAGIC_SIZE) != 0) return reader->error = CODEC_ERROR_SYNTAX;
+    header += CODEC_MAGIC_SIZE;
+    payload = (unsigned long) header[2] << 24 | (unsigned long) header[3] << 16 | (unsigned long) header[4] << 8 | header[5];
+    reader->position += CODEC_HEADER_SIZE;
+    if(payload > CODEC_MAX_PAYLOAD || payload > reader->length - reader->position) return reader->error = CODEC_ERROR_TRUNCATED;
+    // Les lectures suivantes ne peuvent pas déborder sur ce qui suit le message
+    reader->length = reader->position + payload;
+    *version = header[0];
+    *type = header[1];
+    return CODEC_OK;
+}
+
+/**
+ * @fn codec_error_t reader_get_varint(reader_t *reader, unsigned long max, unsigned long *value)
+ * @brief Lit un entier positif codé en varint
+ * @param reader Le reader
+ * @param max La plus grande valeur acceptée
+ * @param value Reçoit l'entier (inchangé en cas d'erreur)
+ * @return L'erreur du reader (CODEC_OK si l'entier est lu)
+ */
+codec_error_t reader_get_varint(reader_t *reader, unsigned long max, unsigned long *value) {
+    unsigned long result = 0;
+    unsigned char byte;
+    int shift = 0;
+    if(reader->error != CODEC_OK) return reader->error;
+    do {
+        // Un message binaire peut contenir des '\0' : seule la taille borne la lecture
+        if(reader->position >= reader->length) return reader->error = CODEC_ERROR_TRUNCATED;
+        byte = reader->data[reader->position++];
+        // Les bits qui ne tiennent pas dans un unsigned long sont refusés
+        if(shift >= (int) (sizeof(unsigned long) * CHAR_BIT) || ((unsigned long) (byte & 0x7F) << shift) >> shift != (unsigned long) (byte & 0x7F)) return reader->error = CODEC_ERROR_RANGE;
+        result |= (unsigned long) (byte & 0x7F) << shift;
+        shift += 7;
+    } while(byte & 0x80);
+    if(result > max) return reader->error = CODEC_ERROR_RANGE;
+    *value = result;
+    return CODEC_OK;
+}
+
+/**
+ * @fn codec_error_t reader_get_svarint(reader_t *reader, long min, long max, long *value)
+ * @brief Lit un entier signé codé en varint (voir writer_put_svarint)
+ * @param reader Le reader
+ * @param min La plus petite valeur acceptée
+ * @param max La plus grande valeur acceptée
+ * @param value Reçoit l'entier (inchangé en cas d'erreur)
+ * @return L'erreur du reader (CODEC_OK si l'entier est lu)
+ */
+codec_error_t reader_get_svarint(reader_t *reader, long min, long max, long *value) {
+    unsigned long zigzag;
+    long result;
+    if(reader_get_varint(reader, ULONG_MAX, &zigzag) != CODEC_OK) return reader->error;
+    result = zigzag & 1 ? (long) (0UL - (zigzag >> 1) - 1) : (long) (zigzag >> 1);
+    if(result < min || result > max) return reader->error = CODEC_ERROR_RANGE;
+    *value = result;
+    return CODEC_OK;
+}
+
+/**
+ * @fn codec_error_t reader_get_lstring(reader_t *reader, char *string, size_t size)
+ * @brief Lit une chaîne précédée de sa taille en varint
+ * @param reader Le reader
+ * @param string Reçoit la chaîne terminée par '\0'
+ * @param size La taille de string, '\0' compris
+ * @return L'erreur du reader (CODEC_ERROR_RANGE si la chaîne est trop longue)
+ */
+codec_error_t reader_get_lstring(reader_t *reader, char *string, size_t size) {
+    unsigned long length;
+    if(reader_get_varint(reader, size - 1, &length) != CODEC_OK) return reader->error;
+    if(length > reader->length - reader->position) return reader->error = CODEC_ERROR_TRUNCATED;
+    memcpy(string, reader->data + reader->position, length);
+    string[length] = '\0';
+    reader->position += length;
+    return CODEC_OK;
+}
+
+/**
+ * @fn const char *codec_error2str(codec_error_t error)
+ * @brief Convertit une erreur de lecture en chaîne de caractères
+ * @param error L'erreur
+ * @return La chaîne (statique, à ne pas libérer)
+ */
+const char *codec_error2str(codec_error_t error) {
+    switch(error) {
+        case CODEC_OK: return "pas d'erreur";
+        case CODEC_ERROR_TRUNCATED: return "message tronqué";
+        case CODEC_ERROR_SYNTAX: return "caractère inattendu";
+        case CODEC_ERROR_RANGE: return "valeur hors bornes";
+        default: return "erreur inconnue";
+    }
+}
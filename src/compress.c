@@ -0,0 +1,215 @@
+/**
+ * @file compress.c
+ * @brief Fichier source de la compression des messages.
+ * @version 1.0
+ * @author Lukas Grando
+ */
+
+#include "compress.h"
+
+/**
+ * @fn void init_rle_writer(rle_writer_t *rle)
+ * @brief Initialise une colonne vide, dans un buffer qui grandit
+ * @param rle La colonne
+ * @note La colonne se libère avec free_rle_writer
+ */
+void init_rle_writer(rle_writer_t *rle) {
+    init_writer(&rle->writer, NULL, 0);
+    rle->value = 0;
+    rle->run = 0;
+}
+
+/**
+ * @fn void rle_put(rle_writer_t *rle, unsigned long value)
+ * @brief Ajoute une valeur à la colonne
+ * @param rle La colonne
+ * @param value La valeur
+ */
+void rle_put(rle_writer_t *rle, unsigned long value) {
+    if(rle->run > 0 && value == rle->value) {
+        rle->run++;
+        return;
+    }
+    rle_flush(rle);
+    rle->value = value;
+    rle->run = 1;
+}
+
+/**
+ * @fn void rle_flush(rle_writer_t *rle)
+ * @brief Ecrit la dernière suite de valeurs, avant de lire rle->writer
+ * @param rle La colonne
+ */
+void rle_flush(rle_writer_t *rle) {
+    if(rle->run == 0) return;
+    // <valeur> <répétitions - 1> : une valeur isolée coûte un octet de plus, une suite ne coûte que deux varints
+    writer_put_varint(&rle->writer, rle->value);
+    writer_put_varint(&rle->writer, rle->run - 1);
+    rle->run = 0;
+}
+
+/**
+ * @fn void free_rle_writer(rle_writer_t *rle)
+ * @brief Libère le buffer d'une colonne
+ * @param rle La colonne
+ */
+void free_rle_writer(rle_writer_t *rle) {
+    free_writer(&rle->writer);
+}
+
+/**
+ * @fn void init_rle_reader(rle_reader_t *rle, const char *data, size_t length)
+ * @brief Initialise la lecture d'une colonne
+ * @param rle La colonne
+ * @param data Les octets de la colonne (voir rle_flush)
+ * @param length Le nombre d'octets
+ */
+void init_rle_reader(rle_reader_t *rle, const char *data, size_t length) {
+    init_reader(&rle->reader, data, length);
+    rle->value = 0;
+    rle->remaining = 0;
+}
+
+/**
+ * @fn codec_error_t rle_get(rle_reader_t *rle, unsigned long max, unsigned long *value)
+ * @brief Lit la valeur suivante d'une colonne
+ * @param rle La colonne
+ * @param max La plus grande valeur acceptée
+ * @param value Reçoit la valeur (inchangée en cas d'erreur)
+ * @return L'erreur du reader de la colonne (CODEC_OK si la valeur est lue)
+ */
+codec_error_t rle_get(rle_reader_t *rle, unsigned long max, unsigned long *value) {
+    const unsigned char *bytes = (const unsigned char *) rle->reader.data + rle->reader.position;
+    unsigned long run;
+    if(rle->remaining == 0 && rle->reader.error == CODEC_OK && rle->reader.length - rle->reader.position >= 2
+       && bytes[0] < 0x80 && bytes[1] < 0x80) {
+        // Valeur et répétitions d'un octet chacune, le cas courant : lues sans passer par reader_get_varint
+        rle->value = bytes[0];
+        rle->remaining = (unsigned long) bytes[1] + 1;
+        rle->reader.position += 2;
+    } else if(rle->remaining == 0) {
+        reader_get_varint(&rle->reader, max, &rle->value);
+        if(reader_get_varint(&rle->reader, ULONG_MAX - 1, &run) != CODEC_OK) return rle->reader.error;
+        rle->remaining = run + 1;
+    }
+    // Une suite lue avec une autre borne que celle de sa première valeur est vérifiée à nouveau
+    if(rle->value > max) return rle->reader.error = CODEC_ERROR_RANGE;
+    rle->remaining--;
+    *value = rle->value;
+    return CODEC_OK;
+}
+
+/**
+ * @fn void writer_put_lz_sequence(writer_t *writer, const unsigned char *literals, size_t count, size_t offset, size_t match)
+ * @brief Fonction privée écrivant une séquence du bloc LZ
+ * @param writer Le writer
+ * @param literals Les octets copiés tels quels
+ * @param count Le nombre de littéraux
+ * @param offset La distance de la référence (0 pour la dernière séquence, sans référence)
+ * @param match La taille de la référence
+ */
+void writer_put_lz_sequence(writer_t *writer, const unsigned char *literals, size_t count, size_t offset, size_t match) {
+    size_t extra = offset != 0 ? match - LZ_MIN_MATCH : 0;
+    writer_put_char(writer, (char) ((count < LZ_TOKEN_MAX ? count : LZ_TOKEN_MAX) << 4 | (extra < LZ_TOKEN_MAX ? extra : LZ_TOKEN_MAX)));
+    if(count >= LZ_TOKEN_MAX) writer_put_varint(writer, count - LZ_TOKEN_MAX);
+    writer_put_bytes(writer, literals, count);
+    if(offset == 0) return;
+    writer_put_varint(writer, offset);
+    if(extra >= LZ_TOKEN_MAX) writer_put_varint(writer, extra - LZ_TOKEN_MAX);
+}
+
+/**
+ * @fn void writer_put_lz(writer_t *writer, const char *data, size_t length)
+ * @brief Ecrit un bloc d'octets compressé au curseur
+ * @param writer Le writer
+ * @param data Les octets à compresser
+ * @param length Le nombre d'octets
+ */
+void writer_put_lz(writer_t *writer, const char *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    unsigned int *table, word, hash;
+    size_t position = 0, anchor = 0, candidate, match;
+    writer_put_varint(writer, length);
+    // Dernière position vue (plus un, 0 si aucune) de chaque suite de 4 octets, d'après son hash
+    table = (unsigned int *) buffer_pool_get(sizeof(unsigned int) << LZ_HASH_BITS);
+    memset(table, 0, sizeof(unsigned int) << LZ_HASH_BITS);
+    while(position + LZ_MIN_MATCH <= length) {
+        memcpy(&word, bytes + position, sizeof(word));
+        hash = (word * 2654435761U) >> (32 - LZ_HASH_BITS);
+        candidate = table[hash];
+        table[hash] = position + 1;
+        if(candidate == 0 || position - --candidate > LZ_WINDOW || memcmp(bytes + candidate, bytes + position, LZ_MIN_MATCH) != 0) {
+            // Sans répétition, le pas grandit : une zone incompressible est traversée vite
+            position += 1 + ((position - anchor) >> 6);
+            continue;
+        }
+        for(match = LZ_MIN_MATCH; position + match < length && bytes[candidate + match] == bytes[position + match]; match++);
+        writer_put_lz_sequence(writer, bytes + anchor, position - anchor, position - candidate, match);
+        position += match;
+        anchor = position;
+    }
+    if(anchor < length) writer_put_lz_sequence(writer, bytes + anchor, length - anchor, 0, 0);
+    buffer_pool_release((char *) table);
+}
+
+/**
+ * @fn codec_error_t reader_get_lz(reader_t *reader, size_t max, char **data, size_t *length)
+ * @brief Lit et décompresse un bloc écrit par writer_put_lz
+ * @param reader Le reader, placé au début du bloc
+ * @param max La plus grande taille décompressée acceptée
+ * @param data Reçoit les octets décompressés, suivis d'un '\0', dans un buffer de la réserve (à rendre avec
+ * buffer_pool_release), NULL en cas d'erreur
+ * @param length Reçoit le nombre d'octets décompressés
+ * @return L'erreur du reader (CODEC_ERROR_RANGE si une référence sort du bloc ou si le bloc dépasse max)
+ */
+codec_error_t reader_get_lz(reader_t *reader, size_t max, char **data, size_t *length) {
+    unsigned long size = 0, count, offset = 0, extra = 0;
+    unsigned char token;
+    char *out, *end, *cursor;
+    *data = NULL;
+    *length = 0;
+    if(reader_get_varint(reader, max, &size) != CODEC_OK) return reader->error;
+    out = buffer_pool_get(size + 1);
+    end = out + size;
+    // Chaque séquence est vérifiée avant d'être copiée : un bloc corrompu ne lit ni n'écrit hors des buffers
+    for(cursor = out; cursor < end && reader->error == CODEC_OK; ) {
+        if(reader->position >= reader->length) {
+            reader->error = CODEC_ERROR_TRUNCATED;
+            break;
+        }
+        token = (unsigned char) reader->data[reader->position++];
+        count = token >> 4;
+        if(count == LZ_TOKEN_MAX && reader_get_varint(reader, size, &extra) == CODEC_OK) count += extra;
+        if(reader->error != CODEC_OK) break;
+        if(count > (unsigned long) (end - cursor)) reader->error = CODEC_ERROR_RANGE;
+        else if(count > reader->length - reader->position) reader->error = CODEC_ERROR_TRUNCATED;
+        if(reader->error != CODEC_OK) break;
+        memcpy(cursor, reader->data + reader->position, count);
+        reader->position += count;
+        cursor += count;
+        if(cursor == end) break;
+        reader_get_varint(reader, LZ_WINDOW, &offset);
+        count = (token & LZ_TOKEN_MAX) + LZ_MIN_MATCH;
+        if((token & LZ_TOKEN_MAX) == LZ_TOKEN_MAX && reader_get_varint(reader, size, &extra) == CODEC_OK) count += extra;
+        if(reader->error != CODEC_OK) break;
+        if(offset == 0 || offset > (unsigned long) (cursor - out) || count > (unsigned long) (end - cursor)) {
+            reader->error = CODEC_ERROR_RANGE;
+            break;
+        }
+        if(offset >= count) {
+            memcpy(cursor, cursor - offset, count);
+            cursor += count;
+        } else {
+            // La référence recouvre ce qu'elle écrit (une valeur répétée) : copie octet par octet
+            for(; count > 0; count--, cursor++) *cursor = cursor[-(long) offset];
+        }
+    }
+    if(reader->error != CODEC_OK) {
+        buffer_pool_release(out);
+        return reader->error;
+    }
+    *end = '\0';
+    *data = out;
+    *length = size;
+    return CODEC_OK;
+}
@@ -7,6 +7,101 @@
 
 #include "data.h"
 
+/**
+ * @fn void send_payload(socket_t *socket, char *payload, size_t length)
+ * @brief Fonction privée envoyant un message précédé de sa taille en mode stream.
+ * @param socket La socket sur laquelle envoyer le message.
+ * @param payload Le message.
+ * @param length La taille du message.
+ * @note Un pair qui n'encadre pas ses messages (socket->framed à 0) reçoit le message seul
+ */
+void send_payload(socket_t *socket, char *payload, size_t length) {
+    unsigned char header[MESSAGE_HEADER_SIZE];
+    struct iovec iov[2];
+    if(!socket->framed) {
+        writeBytesToSocket(socket, payload, length);
+        return;
+    }
+    header[0] = length >> 24;
+    header[1] = length >> 16;
+    header[2] = length >> 8;
+    header[3] = length;
+    // En-tête et contenu partent ensemble, sans copie du contenu derrière l'en-tête
+    iov[0].iov_base = header;
+    iov[0].iov_len = MESSAGE_HEADER_SIZE;
+    iov[1].iov_base = payload;
+    iov[1].iov_len = length;
+    writeVectorToSocket(socket, iov, 2);
+}
+
+/**
+ * @fn char *recv_payload(socket_t *socket, size_t *length)
+ * @brief Fonction privée recevant un message entier en mode stream.
+ * @param socket La socket sur laquelle recevoir le message.
+ * @param length Reçoit la taille du message.
+ * @return Le message, suivi d'un '\0' dans un buffer de la réserve (à rendre avec buffer_pool_release), NULL si la
+ * connexion est fermée avant la fin du message ou si le message est trop grand
+ * @note socket->framed est mis à jour d'après le message reçu
+ */
+char *recv_payload(socket_t *socket, size_t *length) {
+    unsigned char header[CODEC_HEADER_SIZE];
+    size_t size, capacity, received;
+    int available;
+    char *payload, *end;
+    *length = 0;
+    // Le premier octet suffit à reconnaître un message encadré : on le regarde sans le lire
+    if(peekSocket(socket, (char *) header, 1) < 1) return NULL;
+    socket->framed = header[0] == 0;
+    if(socket->framed) {
+        if(readAllFromSocket(socket, (char *) header, MESSAGE_HEADER_SIZE) < MESSAGE_HEADER_SIZE) return NULL;
+        size = (size_t) header[1] << 16 | (size_t) header[2] << 8 | header[3];
+        payload = buffer_pool_get(size + 1);
+        if((size_t) readAllFromSocket(socket, payload, size) < size) {
+            buffer_pool_release(payload);
+            return NULL;
+        }
+    } else if(header[0] == (unsigned char) CODEC_MAGIC[0]) {
+        // Message binaire sans en-tête : sa taille est dans l'en-tête du codec (aucun message texte ne commence ainsi)
+        if(readAllFromSocket(socket, (char *) header, CODEC_HEADER_SIZE) < CODEC_HEADER_SIZE) return NULL;
+        if(memcmp(header, CODEC_MAGIC, CODEC_MAGIC_SIZE) != 0) return NULL;
+        size = codec_message_length((char *) header, MESSAGE_MAX_SIZE);
+        payload = buffer_pool_get(size + 1);
+        memcpy(payload, header, CODEC_HEADER_SIZE);
+        if((size_t) readAllFromSocket(socket, payload + CODEC_HEADER_SIZE, size - CODEC_HEADER_SIZE) < size - CODEC_HEADER_SIZE) {
+            buffer_pool_release(payload);
+            return NULL;
+        }
+    } else {
+        // Message texte sans en-tête (MPP 1.0) : il se termine à son '\0'. On regarde ce qui est déjà arrivé puis on
+        // ne lit que jusqu'au '\0', le message suivant reste sur la socket
+        payload = buffer_pool_get(BUFFER_POOL_MIN_SIZE);
+        capacity = buffer_pool_capacity(payload);
+        for(size = 0; size == 0 || payload[size - 1] != '\0'; size += received) {
+            if(size + 1 >= capacity) {
+                if(capacity >= MESSAGE_MAX_SIZE) {
+                    buffer_pool_release(payload);
+                    return NULL;
+                }
+                payload = buffer_pool_resize(payload, capacity * 2);
+                capacity = buffer_pool_capacity(payload);
+            }
+            if((available = peekSocket(socket, payload + size, capacity - size - 1)) < 1) {
+                buffer_pool_release(payload);
+                return NULL;
+            }
+            end = memchr(payload + size, '\0', available);
+            received = end != NULL ? (size_t) (end - payload) - size + 1 : (size_t) available;
+            if((size_t) readAllFromSocket(socket, payload + size, received) < received) {
+                buffer_pool_release(payload);
+                return NULL;
+            }
+        }
+    }
+    payload[size] = '\0';
+    *length = size;
+    return payload;
+}
+
 /**
  * @fn void send_data_DGRAM(socket_t *socket, generic_t data, serialize_t serializeFunc, char *ip, int port)
  * @brief Envoie des données sérialisées en datagramme. 
@@ -20,16 +115,19 @@
  * @see send_data
  */
 void send_data_DGRAM(socket_t *socket, generic_t data, serialize_t serializeFunc, char *ip, int port) {
-    char *buff = (char *) malloc(sizeof(buffer_t));
+    char *buff;
     if(serializeFunc == NULL) {
         DATA_DEBUG_PRINT("[SEND_DATA]\n[BEGIN]\n%s\n[END]\n", (char *)data);
         sendToSocket(socket, (char *)data, ip, port);
         return;
     } 
+    // Le buffer_t est emprunté à la réserve au lieu d'être alloué à chaque envoi
+    buff = buffer_pool_get(sizeof(buffer_t));
     serializeFunc(data, buff);
     DATA_DEBUG_PRINT("[SEND_DATA]\n[BEGIN]\n%s\n[END]\n", buff);
-    sendToSocket(socket, buff, ip, port);
-    free(buff);
+    // Un message binaire (MPP 2.0) contient des '\0' : sa taille est lue dans son en-tête
+    sendBytesToSocket(socket, buff, codec_message_length(buff, MAX_BUFF), ip, port);
+    buffer_pool_release(buff);
 }
 
 /**
@@ -42,18 +140,20 @@ void send_data_DGRAM(socket_t *socket, generic_t data, serialize_t serializeFunc
  * @note Si serializeFunc est NULL, cela considére que data est un buffer_t
  */
 void send_data_stream(socket_t *socket , generic_t data, serialize_t serializeFunc) {
-    // On evite d'allouer de la mémoire sur la stack car buffer_t est assez grand (262144)
-    char *buff = (char *) malloc(sizeof(buffer_t));
+    // On evite d'allouer de la mémoire sur la stack car buffer_t est assez grand (262144) : il vient de la réserve
+    char *buff;
     if(serializeFunc == NULL) {
-        writeToSocket(socket, (char *)data);
+        send_payload(socket, (char *)data, strlen((char *)data) + 1);
         DATA_DEBUG_PRINT("[SEND_DATA]\n[BEGIN]\n%s\n[END]\n", (char *)data);
         return;
     }
 
+    buff = buffer_pool_get(sizeof(buffer_t));
     serializeFunc(data, buff);
     DATA_DEBUG_PRINT("[SEND_DATA]\n[BEGIN]\n%s\n[END]\n", buff);
-    writeToSocket(socket, buff);
-    free(buff);
+    // Un message binaire (MPP 2.0) contient des '\0' : sa taille est lue dans son en-tête
+    send_payload(socket, buff, codec_message_length(buff, MAX_BUFF));
+    buffer_pool_release(buff);
 }
 
 /**
@@ -94,15 +194,22 @@ void send_data(socket_t *socket, generic_t data, serialize_t serializeFunc, ...)
  * @see recv_data
 */
 void recv_data_stream(socket_t *socket, generic_t data, serialize_t dserializeFunc) {
-    char *buff = (char *) malloc(sizeof(buffer_t));
-    readFromSocket(socket, MAX_BUFF, buff);
+    char *buff = buffer_pool_get(sizeof(buffer_t));
+    size_t length = 0;
+    char *payload;
+    // Le message est reçu en entier puis ramené à la taille d'un buffer_t
+    payload = recv_payload(socket, &length);
+    if(length >= MAX_BUFF) length = MAX_BUFF - 1;
+    if(payload != NULL) memcpy(buff, payload, length);
+    buff[length] = '\0';
+    buffer_pool_release(payload);
     DATA_DEBUG_PRINT("[RECV_DATA]\n[BEGIN]\n%s\n[END]\n", buff);
     if(dserializeFunc == NULL) {
         strcpy((char *)data, buff);
     } else {
         dserializeFunc(buff, data);
     }
-    free(buff);
+    buffer_pool_release(buff);
 }
 
 /**
@@ -114,7 +221,7 @@ void recv_data_stream(socket_t *socket, generic_t data, serialize_t dserializeFu
  * @note A n'utiliser que pour les sockets UDP
  */
 void recv_data_DGRAM(socket_t *socket, generic_t data, serialize_t dserializeFunc) {
-    char *buff = (char *) malloc(sizeof(buffer_t));
+    char *buff = buffer_pool_get(sizeof(buffer_t));
     recvFromSocket(socket, MAX_BUFF, buff);
     DATA_DEBUG_PRINT("[RECV_DATA]\n[BEGIN]\n%s\n[END]\n", buff);
     if(dserializeFunc == NULL) {
@@ -122,7 +229,7 @@ void recv_data_DGRAM(socket_t *socket, generic_t data, serialize_t dserializeFun
     } else {
         dserializeFunc(buff, data);
     }
-    free(buff);
+    buffer_pool_release(buff);
 }
 
 /**
@@ -149,3 +256,53 @@ void recv_data(socket_t *socket, generic_t data, serialize_t dserializeFunc, ...
     }
     
 }
+
+/**
+ * @fn int send_message(socket_t *socket, generic_t data, encode_t encodeFunc)
+ * @brief Encode une donnée dans un buffer de la taille exacte du message et l'envoie en mode stream
+ * @param socket La socket sur laquelle envoyer le message.
+ * @param data La donnée à envoyer.
+ * @param encodeFunc La fonction d'encodage (encode_mpp_request par exemple).
+ * @return 0 si le message est envoyé, -1 s'il atteint MESSAGE_MAX_SIZE (rien n'est alors envoyé)
+ * @note L'en-tête et le contenu partent en un seul appel à writev
+ */
+int send_message(socket_t *socket, generic_t data, encode_t encodeFunc) {
+    writer_t writer;
+    size_t length;
+    // Le buffer grandit avec le message au lieu d'être un buffer_t fixe
+    init_writer(&writer, NULL, 0);
+    encodeFunc(&writer, data);
+    // Un message texte garde son '\0' final, qui le termine pour un pair MPP 1.0
+    length = codec_message_length(writer.data, writer.length + 1);
+    if(length >= MESSAGE_MAX_SIZE) {
+        fprintf(stderr, "Message trop long (%zu octets), il n'est pas envoyé\n", length);
+        free_writer(&writer);
+        return -1;
+    }
+    DATA_DEBUG_PRINT("[SEND_MESSAGE] %zu octets\n", length);
+    send_payload(socket, writer.data, length);
+    free_writer(&writer);
+    return 0;
+}
+
+/**
+ * @fn codec_error_t recv_message(socket_t *socket, generic_t data, decode_t decodeFunc)
+ * @brief Reçoit un message entier en mode stream et le décode
+ * @param socket La socket sur laquelle recevoir le message.
+ * @param data La donnée à remplir.
+ * @param decodeFunc La fonction de décodage (decode_mpp_request par exemple).
+ * @return L'erreur de décodage, CODEC_ERROR_TRUNCATED si la connexion est fermée avant la fin du message
+ * @note socket->framed indique ensuite si le pair encadre ses messages
+ */
+codec_error_t recv_message(socket_t *socket, generic_t data, decode_t decodeFunc) {
+    reader_t reader;
+    size_t length;
+    codec_error_t error;
+    char *payload = recv_payload(socket, &length);
+    DATA_DEBUG_PRINT("[RECV_MESSAGE] %zu octets\n", length);
+    // Un message incomplet est décodé comme un message vide : la donnée reçoit sa valeur d'erreur
+    init_reader(&reader, payload != NULL ? payload : "", length);
+    error = decodeFunc(&reader, data);
+    buffer_pool_release(payload);
+    return payload != NULL ? error : CODEC_ERROR_TRUNCATED;
+}
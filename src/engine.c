@@ -0,0 +1,208 @@
+/**
+ * @file engine.c
+ * @brief Fichier source pour l'adaptation de la qualité du moteur audio.
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+
+#include "engine.h"
+
+/* ------------------------------------------------------------------------ */
+/*                     V A R I A B L E S   G L O B A L E S                  */
+/* ------------------------------------------------------------------------ */
+static pthread_mutex_t engineMutex = PTHREAD_MUTEX_INITIALIZER; /*!< Protège l'état du moteur (un thread par channel) */
+static volatile int sampleRate = ENGINE_DEFAULT_RATE; /*!< Fréquence d'échantillonnage du moteur */
+static volatile engine_quality_t quality = ENGINE_QUALITY_HIGH; /*!< Qualité courante, lue sans verrou par les générateurs */
+static double load = 0; /*!< Moyenne glissante de la charge */
+static int calmBlocks = 0; /*!< Nombre de blocs consécutifs sous ENGINE_LOAD_UP */
+static engine_event_t events[ENGINE_EVENTS_MAX]; /*!< Journal circulaire des événements */
+static int eventsHead = 0; /*!< Prochaine case à écrire dans le journal */
+static int eventsCount = 0; /*!< Nombre d'événements dans le journal */
+
+/* Interpolation du rééchantillonneur pour chaque niveau de qualité */
+static const resampler_quality_t resamplerQualities[ENGINE_QUALITY_NB] = { RESAMPLER_SINC, RESAMPLER_CUBIC, RESAMPLER_LINEAR };
+
+/* ------------------------------------------------------------------------ */
+/*                   F O N C T I O N S   P R I V É E S                      */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn void record_event(engine_event_type_t type)
+ * \brief Ajoute un événement au journal
+ * \note Doit être appelée avec engineMutex verrouillé
+ */
+static void record_event(engine_event_type_t type) {
+    engine_event_t *event = &events[eventsHead];
+    clock_gettime(CLOCK_MONOTONIC, &event->date);
+    event->type = type;
+    event->quality = quality;
+    event->load = load;
+    eventsHead = (eventsHead + 1) % ENGINE_EVENTS_MAX;
+    if (eventsCount < ENGINE_EVENTS_MAX) eventsCount++;
+    DEBUG_PRINT("Moteur : événement %d, qualité %d, charge %.2f\n", type, quality, load);
+}
+
+/**
+ * \fn void set_quality(engine_quality_t newQuality, engine_event_type_t type)
+ * \brief Change la qualité courante et l'enregistre dans le journal
+ * \note Doit être appelée avec engineMutex verrouillé
+ */
+static void set_quality(engine_quality_t newQuality, engine_event_type_t type) {
+    quality = newQuality;
+    set_resampler_quality(resamplerQualities[newQuality]);
+    calmBlocks = 0;
+    record_event(type);
+}
+
+/* ------------------------------------------------------------------------ */
+/*                  C O D E    D E S    F O N C T I O N S                   */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn int engine_set_sample_rate(int rate)
+ * \brief Choisit la fréquence d'échantillonnage du moteur
+ * \param rate La fréquence, parmi ENGINE_SUPPORTED_RATES
+ * \return 0 si la fréquence est acceptée, -1 sinon (la fréquence courante est conservée)
+ * \note A appeler avant d'ouvrir un pcm : toute la synthèse et les durées suivent cette fréquence
+ */
+int engine_set_sample_rate(int rate) {
+    static const int supportedRates[] = ENGINE_SUPPORTED_RATES;
+    size_t i;
+    for (i = 0; i < sizeof(supportedRates) / sizeof(supportedRates[0]); i++) {
+        if (supportedRates[i] == rate) {
+            sampleRate = rate;
+            return 0;
+        }
+    }
+    ERROR("Fréquence d'échantillonnage %d Hz non supportée\n", rate);
+    return -1;
+}
+
+/**
+ * \fn int engine_get_sample_rate()
+ * \brief Récupère la fréquence d'échantillonnage du moteur
+ * \return La fréquence en Hz
+ */
+int engine_get_sample_rate() {
+    return sampleRate;
+}
+
+/**
+ * \fn int engine_get_oversampling(int targetRate)
+ * \brief Calcule le facteur de suréchantillonnage d'un étage non linéaire
+ * \param targetRate La fréquence à laquelle l'étage voudrait travailler
+ * \return Le facteur (au moins 1), réduit quand la qualité baisse
+ */
+int engine_get_oversampling(int targetRate) {
+    int factor = (targetRate + sampleRate - 1) / sampleRate;
+    if (quality == ENGINE_QUALITY_MEDIUM) factor = (factor + 1) / 2;
+    else if (quality == ENGINE_QUALITY_LOW) factor = 1;
+    return factor < 1 ? 1 : factor;
+}
+
+/**
+ * \fn engine_quality_t engine_get_quality()
+ * \brief Récupère la qualité de synthèse courante
+ * \return La qualité
+ */
+engine_quality_t engine_get_quality() {
+    return quality;
+}
+
+/**
+ * \fn double engine_get_load()
+ * \brief Récupère la charge moyenne du moteur
+ * \return La charge (1.0 = le rendu prend exactement le temps réel)
+ */
+double engine_get_load() {
+    double value;
+    pthread_mutex_lock(&engineMutex);
+    value = load;
+    pthread_mutex_unlock(&engineMutex);
+    return value;
+}
+
+/**
+ * \fn struct timespec engine_block_begin()
+ * \brief Débute le chronométrage du rendu d'un bloc
+ * \return La date de début du rendu
+ */
+struct timespec engine_block_begin() {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    return start;
+}
+
+/**
+ * \fn void engine_block_end(struct timespec start, size_t frames, int rate)
+ * \brief Termine le chronométrage d'un bloc et adapte la qualité
+ * \param start La date de début du rendu
+ * \param frames Le nombre d'échantillons rendus
+ * \param rate La fréquence d'échantillonnage du bloc
+ */
+void engine_block_end(struct timespec start, size_t frames, int rate) {
+    struct timespec end;
+    double elapsed, budget, blockLoad;
+
+    if (frames == 0) return;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    budget = (double) frames / rate;
+    blockLoad = elapsed / budget;
+
+    pthread_mutex_lock(&engineMutex);
+    load += ENGINE_LOAD_SMOOTHING * (blockLoad - load);
+    // On dégrade dès que la moyenne dépasse le seuil, ou tout de suite si un bloc a raté son échéance
+    if ((load > ENGINE_LOAD_DOWN || blockLoad > 1.0) && quality < ENGINE_QUALITY_LOW) {
+        set_quality(quality + 1, ENGINE_EVENT_DEGRADE);
+    }
+    // On ne remonte qu'après une période calme pour éviter d'osciller entre deux niveaux
+    else if (load < ENGINE_LOAD_UP && quality > ENGINE_QUALITY_HIGH) {
+        if (++calmBlocks >= ENGINE_UP_BLOCKS) set_quality(quality - 1, ENGINE_EVENT_RESTORE);
+    }
+    else calmBlocks = 0;
+    pthread_mutex_unlock(&engineMutex);
+}
+
+/**
+ * \fn void engine_report_underrun()
+ * \brief Signale une sous-alimentation du pcm et dégrade la qualité
+ */
+void engine_report_underrun() {
+    pthread_mutex_lock(&engineMutex);
+    record_event(ENGINE_EVENT_UNDERRUN);
+    if (quality < ENGINE_QUALITY_LOW) set_quality(quality + 1, ENGINE_EVENT_DEGRADE);
+    pthread_mutex_unlock(&engineMutex);
+}
+
+/**
+ * \fn int engine_get_events(engine_event_t *out, int max)
+ * \brief Copie les derniers événements du journal, du plus ancien au plus récent
+ * \param out Le tableau à remplir
+ * \param max La taille du tableau
+ * \return Le nombre d'événements copiés
+ */
+int engine_get_events(engine_event_t *out, int max) {
+    int i, count;
+    pthread_mutex_lock(&engineMutex);
+    count = eventsCount < max ? eventsCount : max;
+    for (i = 0; i < count; i++) {
+        out[i] = events[(eventsHead - count + i + ENGINE_EVENTS_MAX) % ENGINE_EVENTS_MAX];
+    }
+    pthread_mutex_unlock(&engineMutex);
+    return count;
+}
+
+/**
+ * \fn void engine_reset()
+ * \brief Remet le moteur en qualité maximale et vide le journal
+ */
+void engine_reset() {
+    pthread_mutex_lock(&engineMutex);
+    quality = ENGINE_QUALITY_HIGH;
+    set_resampler_quality(resamplerQualities[ENGINE_QUALITY_HIGH]);
+    load = 0;
+    calmBlocks = 0;
+    eventsHead = eventsCount = 0;
+    pthread_mutex_unlock(&engineMutex);
+}
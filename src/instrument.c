@@ -0,0 +1,353 @@
+/**
+ * @file instrument.c
+ * @brief Fichier source pour les instruments décrits par fichier.
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+
+#include "instrument.h"
+
+/* ------------------------------------------------------------------------ */
+/*                     V A R I A B L E S   G L O B A L E S                  */
+/* ------------------------------------------------------------------------ */
+static instrument_def_t definitions[INSTRUMENT_DEFS_MAX]; /*!< Instruments chargés, en lecture seule une fois chargés */
+static int nbDefinitions = 0; /*!< Nombre d'instruments chargés */
+static unsigned char definitionIndex[INSTRUMENT_PLUGIN_FIRST]; /*!< Indice + 1 de la définition de chaque identifiant, 0 si libre */
+
+/* ------------------------------------------------------------------------ */
+/*                   F O N C T I O N S   P R I V É E S                      */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn int instrument_file_filter(const struct dirent *entry)
+ * \brief Filtre scandir : on ne garde que les .inst
+ */
+static int instrument_file_filter(const struct dirent *entry) {
+    size_t len = strlen(entry->d_name);
+    return len > 5 && strcmp(entry->d_name + len - 5, ".inst") == 0;
+}
+
+/**
+ * \fn int add_partial(double *ratios, double *amplitudes, int nbPartials, double ratio, double amplitude)
+ * \brief Ajoute un partiel à la liste en fusionnant ceux de même fréquence
+ * \return Le nouveau nombre de partiels
+ */
+static int add_partial(double *ratios, double *amplitudes, int nbPartials, double ratio, double amplitude) {
+    int i;
+    if (ratio <= 0 || amplitude == 0) return nbPartials;
+    for (i = 0; i < nbPartials; i++) {
+        if (fabs(ratios[i] - ratio) < 1e-9) {
+            amplitudes[i] += amplitude;
+            return nbPartials;
+        }
+    }
+    if (nbPartials == INSTRUMENT_MAX_PARTIALS) return nbPartials;
+    ratios[nbPartials] = ratio;
+    amplitudes[nbPartials] = amplitude;
+    return nbPartials + 1;
+}
+
+/**
+ * \fn int add_oscillator(double *ratios, double *amplitudes, int nbPartials, const char *type, int harmonics, double level)
+ * \brief Développe un oscillateur en série de partiels sinusoïdaux
+ * \return Le nouveau nombre de partiels ou -1 si le type est inconnu
+ */
+static int add_oscillator(double *ratios, double *amplitudes, int nbPartials, const char *type, int harmonics, double level) {
+    int n;
+    if (strcmp(type, "sine") == 0) return add_partial(ratios, amplitudes, nbPartials, 1, level);
+    for (n = 1; n <= harmonics; n++) {
+        if (strcmp(type, "saw") == 0) nbPartials = add_partial(ratios, amplitudes, nbPartials, n, level * (n % 2 ? 1.0 : -1.0) / n);
+        else if (strcmp(type, "square") == 0) {
+            if (n % 2) nbPartials = add_partial(ratios, amplitudes, nbPartials, n, level / n);
+        }
+        else if (strcmp(type, "triangle") == 0) {
+            if (n % 2) nbPartials = add_partial(ratios, amplitudes, nbPartials, n, level * ((n / 2) % 2 ? -1.0 : 1.0) / (n * n));
+        }
+        else return -1;
+    }
+    return nbPartials;
+}
+
+/**
+ * \fn short parse_effect(const char *name)
+ * \brief Convertit un nom d'effet en code d'effet
+ * \return Le code ou EFFECT_NONE si l'effet est inconnu
+ */
+static short parse_effect(const char *name) {
+    if (strcmp(name, "fuzz") == 0) return EFFECT_FUZZ;
+    if (strcmp(name, "compression") == 0) return EFFECT_COMPRESSION;
+    return EFFECT_NONE;
+}
+
+/**
+ * \fn int compile_instrument(instrument_def_t *def, double *ratios, double *amplitudes, int nbPartials, double gain)
+ * \brief Trie les partiels par fréquence, normalise les amplitudes et les range dans la définition
+ * \return 0 si l'instrument a au moins un partiel, -1 sinon
+ */
+static int compile_instrument(instrument_def_t *def, double *ratios, double *amplitudes, int nbPartials, double gain) {
+    double sum = 0, tmp;
+    int i, j;
+
+    // Tri par insertion : les partiels aigus sont à la fin, on peut les couper en réduisant le nombre
+    for (i = 1; i < nbPartials; i++) {
+        for (j = i; j > 0 && ratios[j - 1] > ratios[j]; j--) {
+            tmp = ratios[j]; ratios[j] = ratios[j - 1]; ratios[j - 1] = tmp;
+            tmp = amplitudes[j]; amplitudes[j] = amplitudes[j - 1]; amplitudes[j - 1] = tmp;
+        }
+    }
+    for (i = 0; i < nbPartials; i++) sum += fabs(amplitudes[i]);
+    if (nbPartials == 0 || sum == 0) return -1;
+
+    // La somme des amplitudes vaut gain : le signal ne dépasse jamais gain
+    def->nbPartials = nbPartials;
+    for (i = 0; i < INSTRUMENT_MAX_PARTIALS; i++) {
+        def->ratios[i] = i < nbPartials ? ratios[i] : 0;
+        def->amplitudes[i] = i < nbPartials ? amplitudes[i] / sum * gain : 0;
+    }
+    return 0;
+}
+
+/**
+ * \fn int parse_instrument(instrument_def_t *def, int *id, const char *folder, const char *fileName)
+ * \brief Lit et compile un fichier .inst
+ * \param id Reçoit l'identifiant déclaré par le fichier
+ * \return 0 si l'instrument est valide, -1 sinon
+ */
+static int parse_instrument(instrument_def_t *def, int *id, const char *folder, const char *fileName) {
+    char path[512], line[INSTRUMENT_LINE_SIZE], key[32], arg[32];
+    double ratios[INSTRUMENT_MAX_PARTIALS], amplitudes[INSTRUMENT_MAX_PARTIALS];
+    double ratio, amplitude, gain = 1.0;
+    int nbPartials = 0, harmonics, lineNumber = 0, nbArgs;
+    FILE *file;
+
+    snprintf(path, sizeof(path), "%s/%s", folder, fileName);
+    if ((file = fopen(path, "r")) == NULL) return -1;
+
+    memset(def, 0, sizeof(instrument_def_t));
+    // Nom par défaut : le début du nom de fichier
+    snprintf(def->name, INSTRUMENT_NAME_SIZE, "%-4.4s", fileName);
+    def->sustain = 1.0;
+    *id = -1;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        if (line[0] == '#' || sscanf(line, "%31s", key) != 1) continue;
+
+        if (strcmp(key, "id") == 0 && sscanf(line, "%*s %d", id) == 1 && *id >= INSTRUMENT_NB && *id < INSTRUMENT_PLUGIN_FIRST) {
+            continue;
+        }
+        else if (strcmp(key, "name") == 0 && sscanf(line, "%*s %4s", arg) == 1) {
+            snprintf(def->name, INSTRUMENT_NAME_SIZE, "%-4.4s", arg);
+        }
+        else if (strcmp(key, "osc") == 0 && (nbArgs = sscanf(line, "%*s %31s %d %lf", arg, &harmonics, &amplitude)) >= 1) {
+            if (nbArgs < 2) harmonics = INSTRUMENT_OSC_HARMONICS;
+            if (nbArgs < 3) amplitude = 1.0;
+            if ((nbPartials = add_oscillator(ratios, amplitudes, nbPartials, arg, harmonics, amplitude)) == -1) break;
+        }
+        else if (strcmp(key, "partial") == 0 && sscanf(line, "%*s %lf %lf", &ratio, &amplitude) == 2) {
+            nbPartials = add_partial(ratios, amplitudes, nbPartials, ratio, amplitude);
+        }
+        else if (strcmp(key, "effect") == 0 && sscanf(line, "%*s %31s", arg) == 1 && parse_effect(arg) != EFFECT_NONE) {
+            if (def->nbEffects < INSTRUMENT_MAX_EFFECTS) def->effects[def->nbEffects++] = parse_effect(arg);
+        }
+        else if (strcmp(key, "envelope") == 0 && sscanf(line, "%*s %lf %lf %lf %lf", &def->attack, &def->decay, &def->sustain, &def->release) == 4) {
+            continue;
+        }
+        else if (strcmp(key, "gain") == 0 && sscanf(line, "%*s %lf", &gain) == 1) {
+            continue;
+        }
+        else {
+            ERROR("%s:%d : ligne invalide\n", path, lineNumber);
+            nbPartials = -1;
+            break;
+        }
+    }
+    fclose(file);
+
+    if (nbPartials != -1 && *id == -1) {
+        ERROR("%s : identifiant manquant (id entre %d et %d)\n", path, INSTRUMENT_NB, INSTRUMENT_PLUGIN_FIRST - 1);
+        nbPartials = -1;
+    }
+    if (nbPartials == -1 || compile_instrument(def, ratios, amplitudes, nbPartials, gain) == -1) {
+        ERROR("%s : instrument ignoré\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \fn void partial_kernel(const float *amplitudes, const float *cosSteps, const float *sinSteps, float *cosPhases, float *sinPhases, int nbPartials, float *out, size_t count)
+ * \brief Noyau commun à tous les instruments : somme de partiels par rotation de phase
+ * \note nbPartials est un multiple de INSTRUMENT_LANES. Chaque voie accumule ses propres partiels,
+ * la boucle interne n'a donc pas de dépendance entre voies et se vectorise sans réassocier les flottants.
+ */
+static void partial_kernel(const float *amplitudes, const float *cosSteps, const float *sinSteps, float *cosPhases, float *sinPhases, int nbPartials, float *out, size_t count) {
+    size_t n;
+    int p, l;
+    for (n = 0; n < count; n++) {
+        float acc[INSTRUMENT_LANES] = { 0 };
+        float sum = 0;
+        for (p = 0; p < nbPartials; p += INSTRUMENT_LANES) {
+            for (l = 0; l < INSTRUMENT_LANES; l++) {
+                float c = cosPhases[p + l], s = sinPhases[p + l];
+                acc[l] += amplitudes[p + l] * s;
+                cosPhases[p + l] = c * cosSteps[p + l] - s * sinSteps[p + l];
+                sinPhases[p + l] = c * sinSteps[p + l] + s * cosSteps[p + l];
+            }
+        }
+        for (l = 0; l < INSTRUMENT_LANES; l++) sum += acc[l];
+        out[n] = sum;
+    }
+}
+
+/**
+ * \fn double envelope_gain(const instrument_def_t *def, size_t position, size_t length, int rate)
+ * \brief Calcule le gain de l'enveloppe à une position de la note
+ */
+static double envelope_gain(const instrument_def_t *def, size_t position, size_t length, int rate) {
+    double t = (double) position / rate;
+    double remaining = (double)(length - position) / rate;
+    double gain;
+
+    if (t < def->attack) gain = t / def->attack;
+    else if (t < def->attack + def->decay) gain = 1 - (1 - def->sustain) * (t - def->attack) / def->decay;
+    else gain = def->sustain;
+    if (remaining < def->release) gain *= remaining / def->release;
+    return gain;
+}
+
+/* ------------------------------------------------------------------------ */
+/*                  C O D E    D E S    F O N C T I O N S                   */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn int load_instruments(const char *folder)
+ * \brief Charge et compile toutes les définitions .inst d'un dossier
+ * \param folder Le dossier à charger
+ * \return Le nombre d'instruments chargés
+ * \note Les fichiers invalides sont ignorés avec un message d'erreur, de même que les fichiers
+ * qui déclarent un identifiant déjà pris
+ */
+int load_instruments(const char *folder) {
+    struct dirent **entries = NULL;
+    int i, nbEntries, id;
+
+    free_instruments();
+    // Le tri par nom ne sert qu'à rendre les conflits d'identifiants reproductibles
+    nbEntries = scandir(folder, &entries, instrument_file_filter, alphasort);
+    if (nbEntries == -1) return 0;
+
+    for (i = 0; i < nbEntries; i++) {
+        if (nbDefinitions < INSTRUMENT_DEFS_MAX && parse_instrument(&definitions[nbDefinitions], &id, folder, entries[i]->d_name) == 0) {
+            if (definitionIndex[id] != 0) {
+                ERROR("%s/%s : identifiant %d déjà pris par %s, instrument ignoré\n", folder, entries[i]->d_name, id, definitions[definitionIndex[id] - 1].name);
+            }
+            else {
+                DEBUG_PRINT("Instrument %d : %s (%d partiels)\n", id, definitions[nbDefinitions].name, definitions[nbDefinitions].nbPartials);
+                definitionIndex[id] = ++nbDefinitions;
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return nbDefinitions;
+}
+
+/**
+ * \fn void free_instruments()
+ * \brief Oublie les instruments chargés
+ */
+void free_instruments() {
+    nbDefinitions = 0;
+    memset(definitionIndex, 0, sizeof(definitionIndex));
+}
+
+/**
+ * \fn instrument_t next_instrument(instrument_t instrument, int isUp)
+ * \brief Donne l'instrument disponible suivant ou précédent, en boucle
+ * \param instrument L'identifiant de départ
+ * \param isUp 1 pour le suivant, 0 pour le précédent
+ * \return L'identifiant de l'instrument disponible le plus proche (les identifiants libres sont sautés)
+ */
+instrument_t next_instrument(instrument_t instrument, int isUp) {
+    int id = (int) instrument, i;
+    // Au pire un tour complet : INSTRUMENT_NA est toujours disponible
+    for (i = 0; i < INSTRUMENT_ID_MAX; i++) {
+        id = (id + (isUp ? 1 : INSTRUMENT_ID_MAX - 1)) % INSTRUMENT_ID_MAX;
+        if (id < INSTRUMENT_NB || get_instrument_name((instrument_t) id) != NULL) break;
+    }
+    return (instrument_t) id;
+}
+
+/**
+ * \fn const instrument_def_t *get_instrument_def(instrument_t instrument)
+ * \brief Récupère la définition compilée d'un instrument chargé
+ * \param instrument L'identifiant de l'instrument
+ * \return La définition ou NULL pour un instrument intégré ou inconnu
+ */
+const instrument_def_t *get_instrument_def(instrument_t instrument) {
+    int id = (int) instrument;
+    if (id < INSTRUMENT_NB || id >= INSTRUMENT_PLUGIN_FIRST || definitionIndex[id] == 0) return NULL;
+    return &definitions[definitionIndex[id] - 1];
+}
+
+/**
+ * \fn int get_instrument_plugin(instrument_t instrument)
+ * \brief Récupère le plugin qui joue un instrument
+ * \param instrument L'identifiant de l'instrument
+ * \return L'indice du plugin ou -1 si l'instrument n'est pas un plugin
+ */
+int get_instrument_plugin(instrument_t instrument) {
+    int index = (int) instrument - INSTRUMENT_PLUGIN_FIRST;
+    if (index < 0 || index >= get_plugin_count()) return -1;
+    return index;
+}
+
+/**
+ * \fn const char *get_instrument_name(instrument_t instrument)
+ * \brief Récupère le nom d'un instrument chargé (fichier ou plugin)
+ * \param instrument L'identifiant de l'instrument
+ * \return Le nom ou NULL pour un instrument intégré ou inconnu
+ */
+const char *get_instrument_name(instrument_t instrument) {
+    const instrument_def_t *def = get_instrument_def(instrument);
+    if (def != NULL) return def->name;
+    return get_plugin_name(get_instrument_plugin(instrument));
+}
+
+/**
+ * \fn void render_instrument(const instrument_def_t *def, float *out, size_t offset, size_t count, double freq, size_t length, int rate, int maxPartials)
+ * \brief Rend un bloc d'une note avec un instrument compilé
+ * \param def L'instrument
+ * \param out Le buffer de sortie (amplitude entre -1 et 1)
+ * \param offset Indice dans la note du premier échantillon du bloc
+ * \param count Nombre d'échantillons du bloc
+ * \param freq Fréquence de la note
+ * \param length Durée totale de la note en échantillons (pour le relâchement)
+ * \param rate Fréquence d'échantillonnage
+ * \param maxPartials Nombre maximum de partiels à jouer (les plus aigus sont ignorés)
+ */
+void render_instrument(const instrument_def_t *def, float *out, size_t offset, size_t count, double freq, size_t length, int rate, int maxPartials) {
+    float amplitudes[INSTRUMENT_MAX_PARTIALS], cosSteps[INSTRUMENT_MAX_PARTIALS], sinSteps[INSTRUMENT_MAX_PARTIALS];
+    float cosPhases[INSTRUMENT_MAX_PARTIALS], sinPhases[INSTRUMENT_MAX_PARTIALS];
+    int p, nbActive = 0, nbPartials;
+    size_t n;
+
+    // Les partiels sont triés : on garde ceux sous Nyquist dans la limite demandée
+    while (nbActive < def->nbPartials && nbActive < maxPartials && freq * def->ratios[nbActive] < rate / 2.0) nbActive++;
+    nbPartials = (nbActive + INSTRUMENT_LANES - 1) / INSTRUMENT_LANES * INSTRUMENT_LANES;
+
+    // Phases de départ du bloc, calculées en double pour rester continues d'un bloc à l'autre
+    for (p = 0; p < nbPartials; p++) {
+        double cycles = freq * def->ratios[p] / rate;
+        double phase = 2 * M_PI * fmod(cycles * offset, 1.0);
+        amplitudes[p] = p < nbActive ? def->amplitudes[p] : 0;
+        cosSteps[p] = cos(2 * M_PI * cycles);
+        sinSteps[p] = sin(2 * M_PI * cycles);
+        cosPhases[p] = cos(phase);
+        sinPhases[p] = sin(phase);
+    }
+    partial_kernel(amplitudes, cosSteps, sinSteps, cosPhases, sinPhases, nbPartials, out, count);
+
+    for (n = 0; n < count; n++) out[n] *= envelope_gain(def, offset + n, length, rate);
+}
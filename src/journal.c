@@ -0,0 +1,486 @@
+/**
+ * @file journal.c
+ * @brief Fichier source du journal des éditions du séquenceur.
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+
+#include "journal.h"
+
+/* ------------------------------------------------------------------------ */
+/*                   F O N C T I O N S   P R I V É E S                      */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn journal_delta_t *get_delta(journal_t *journal, int i)
+ * \brief Récupère le i-ème delta gardé, du plus ancien au plus récent
+ */
+static journal_delta_t *get_delta(journal_t *journal, int i) {
+    return &journal->deltas[(journal->oldest + i) % journal->capacity];
+}
+
+/**
+ * \fn void apply_delta(music_t *music, const journal_delta_t *delta, packed_note_t packed)
+ * \brief Ecrit une des deux notes d'un delta dans la musique
+ */
+static void apply_delta(music_t *music, const journal_delta_t *delta, packed_note_t packed) {
+    channel_t *channel = &music->channels[delta->channel];
+    set_channel_note(channel, delta->index, unpack_note(packed));
+    update_channel_nbNotes(channel, delta->index);
+}
+
+/**
+ * \fn void drop_oldest_group(journal_t *journal)
+ * \brief Oublie le groupe le plus ancien pour faire de la place
+ * \note Le groupe le plus ancien n'est jamais le groupe en cours (voir record_delta)
+ */
+static void drop_oldest_group(journal_t *journal) {
+    do {
+        journal->oldest = (journal->oldest + 1) % journal->capacity;
+        journal->count--;
+        journal->applied--;
+    } while (journal->count > 0 && !get_delta(journal, 0)->first);
+}
+
+/**
+ * \fn void mark_dirty(journal_t *journal, short channel, int index)
+ * \brief Ajoute une ligne à l'ensemble des lignes modifiées depuis la dernière sauvegarde
+ */
+static void mark_dirty(journal_t *journal, short channel, int index) {
+    int word = index / NOTE_BLOCK_SIZE, size;
+    uint64_t bit = (uint64_t)1 << (index % NOTE_BLOCK_SIZE);
+
+    if (word >= journal->dirtyWords[channel]) {
+        // L'ensemble grandit comme l'index des blocs, en doublant
+        size = journal->dirtyWords[channel] > 0 ? journal->dirtyWords[channel] : 1;
+        while (size <= word) size *= 2;
+        journal->dirty[channel] = realloc(journal->dirty[channel], size * sizeof(uint64_t));
+        CHECK_ALLOC(journal->dirty[channel]);
+        memset(journal->dirty[channel] + journal->dirtyWords[channel], 0, (size - journal->dirtyWords[channel]) * sizeof(uint64_t));
+        journal->dirtyWords[channel] = size;
+    }
+    if (journal->dirty[channel][word] & bit) return;
+    journal->dirty[channel][word] |= bit;
+    journal->nbDirty++;
+}
+
+/**
+ * \fn void record_delta(journal_t *journal, short channel, int index, packed_note_t before, packed_note_t after)
+ * \brief Ajoute un delta au groupe en cours
+ */
+static void record_delta(journal_t *journal, short channel, int index, packed_note_t before, packed_note_t after) {
+    journal_delta_t *delta;
+    int first = journal->newGroup;
+
+    // La ligne est à sauvegarder même si le delta ne peut pas être gardé
+    mark_dirty(journal, channel, index);
+    if (first) {
+        journal->newGroup = 0;
+        journal->groupSize = 0;
+        journal->overflow = 0;
+    }
+    if (journal->overflow) return;
+    // Une nouvelle édition efface les actions annulées
+    journal->count = journal->applied;
+    if (journal->count == journal->capacity) {
+        // Le groupe en cours occupe tout le tampon : il ne pourra pas être annulé, ni ceux d'avant
+        if (journal->groupSize == journal->capacity) {
+            clear_journal(journal);
+            journal->newGroup = 0;
+            journal->overflow = 1;
+            return;
+        }
+        drop_oldest_group(journal);
+    }
+    delta = get_delta(journal, journal->count);
+    delta->before = before;
+    delta->after = after;
+    delta->index = index;
+    delta->channel = channel;
+    delta->first = first;
+    journal->count++;
+    journal->applied++;
+    journal->groupSize++;
+}
+
+/**
+ * \fn int clamp_channels(short *chFirst, short *chLast)
+ * \brief Remet les channels d'une région dans l'ordre et dans la musique
+ * \return 0 si la région contient au moins un channel, -1 sinon
+ */
+static int clamp_channels(short *chFirst, short *chLast) {
+    short tmp;
+
+    if (*chFirst > *chLast) {
+        tmp = *chFirst;
+        *chFirst = *chLast;
+        *chLast = tmp;
+    }
+    if (*chFirst < 0) *chFirst = 0;
+    if (*chLast >= MUSIC_MAX_CHANNELS) *chLast = MUSIC_MAX_CHANNELS - 1;
+    return *chFirst <= *chLast ? 0 : -1;
+}
+
+/* ------------------------------------------------------------------------ */
+/*                  C O D E    D E S    F O N C T I O N S                   */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn journal_t *create_journal(int capacity)
+ * \brief Crée un journal vide
+ * \param capacity Le nombre de deltas gardés (JOURNAL_DEFAULT_DELTAS si <= 0)
+ * \return Le journal, à libérer avec free_journal
+ */
+journal_t *create_journal(int capacity) {
+    journal_t *journal = malloc(sizeof(journal_t));
+    int i;
+
+    CHECK_ALLOC(journal);
+    journal->capacity = capacity > 0 ? capacity : JOURNAL_DEFAULT_DELTAS;
+    // Toute la mémoire du journal est réservée ici
+    journal->deltas = malloc(journal->capacity * sizeof(journal_delta_t));
+    CHECK_ALLOC(journal->deltas);
+    for (i = 0; i < MUSIC_MAX_CHANNELS; i++) {
+        journal->dirty[i] = NULL;
+        journal->dirtyWords[i] = 0;
+    }
+    journal->nbDirty = 0;
+    clear_journal(journal);
+    return journal;
+}
+
+/**
+ * \fn void free_journal(journal_t *journal)
+ * \brief Libère un journal
+ * \param journal Le journal (NULL accepté)
+ */
+void free_journal(journal_t *journal) {
+    int i;
+
+    if (journal == NULL) return;
+    for (i = 0; i < MUSIC_MAX_CHANNELS; i++) free(journal->dirty[i]);
+    free(journal->deltas);
+    free(journal);
+}
+
+/**
+ * \fn void clear_journal(journal_t *journal)
+ * \brief Oublie tout l'historique
+ * \param journal Le journal
+ */
+void clear_journal(journal_t *journal) {
+    journal->oldest = 0;
+    journal->count = 0;
+    journal->applied = 0;
+    journal->newGroup = 1;
+    journal->groupSize = 0;
+    journal->overflow = 0;
+}
+
+/**
+ * \fn int journal_next_dirty(const journal_t *journal, short channel, int index)
+ * \brief Cherche la prochaine ligne modifiée depuis la dernière sauvegarde
+ * \param journal Le journal
+ * \param channel Le channel
+ * \param index La première ligne cherchée
+ * \return La première ligne modifiée à partir de index, -1 s'il n'y en a pas
+ */
+int journal_next_dirty(const journal_t *journal, short channel, int index) {
+    int word;
+    uint64_t bits;
+
+    if (channel < 0 || channel >= MUSIC_MAX_CHANNELS || index < 0) return -1;
+    // Un mot à la fois, comme next_channel_note : les mots vides sont sautés sans regarder leurs lignes
+    for (word = index / NOTE_BLOCK_SIZE; word < journal->dirtyWords[channel]; word++) {
+        bits = journal->dirty[channel][word];
+        if (word == index / NOTE_BLOCK_SIZE) bits &= ~(uint64_t)0 << (index % NOTE_BLOCK_SIZE);
+        if (bits != 0) return word * NOTE_BLOCK_SIZE + __builtin_ctzll(bits);
+    }
+    return -1;
+}
+
+/**
+ * \fn void journal_mark_saved(journal_t *journal)
+ * \brief Oublie les lignes modifiées : la musique vient d'être sauvegardée
+ * \param journal Le journal
+ * \note L'historique est gardé, une annulation après la sauvegarde marque à nouveau ses lignes
+ */
+void journal_mark_saved(journal_t *journal) {
+    int i;
+
+    for (i = 0; i < MUSIC_MAX_CHANNELS; i++) {
+        if (journal->dirty[i] != NULL) memset(journal->dirty[i], 0, journal->dirtyWords[i] * sizeof(uint64_t));
+    }
+    journal->nbDirty = 0;
+}
+
+/**
+ * \fn void journal_begin(journal_t *journal)
+ * \brief Commence une nouvelle action : les notes modifiées ensuite seront annulées ensemble
+ * \param journal Le journal
+ * \note Une action qui ne modifie aucune note ne laisse rien dans le journal
+ */
+void journal_begin(journal_t *journal) {
+    journal->newGroup = 1;
+}
+
+/**
+ * \fn void journal_set_note(journal_t *journal, music_t *music, short channel, int index, note_t note)
+ * \brief Modifie une note de la musique et garde le delta dans l'action en cours
+ * \param journal Le journal
+ * \param music La musique
+ * \param channel Le channel de la note
+ * \param index La ligne de la note
+ * \param note La nouvelle note
+ * \note Les actions annulées qui n'ont pas été rétablies sont oubliées
+ */
+void journal_set_note(journal_t *journal, music_t *music, short channel, int index, note_t note) {
+    channel_t *ch;
+    packed_note_t before, after = pack_note(note);
+
+    if (channel < 0 || channel >= MUSIC_MAX_CHANNELS || index < 0) return;
+    ch = &music->channels[channel];
+    before = pack_note(get_channel_note(ch, index));
+    if (before == after) return;
+    set_channel_note(ch, index, note);
+    update_channel_nbNotes(ch, index);
+    record_delta(journal, channel, index, before, after);
+}
+
+/**
+ * \fn int journal_link_pattern(journal_t *journal, music_t *music, short channel, int dest, int src)
+ * \brief Fait répéter à un bloc le motif d'un autre bloc (voir link_channel_pattern) et garde les deltas
+ * \param journal Le journal
+ * \param music La musique
+ * \param channel Le channel
+ * \param dest Une ligne du bloc qui devient une répétition
+ * \param src Une ligne du bloc répété
+ * \return Le nombre de lignes modifiées
+ * \note Annuler remet les anciennes notes dans un bloc à part
+ */
+int journal_link_pattern(journal_t *journal, music_t *music, short channel, int dest, int src) {
+    packed_note_t before[NOTE_BLOCK_SIZE], after;
+    channel_t *ch;
+    int start = dest - dest % NOTE_BLOCK_SIZE, i, changed;
+
+    if (channel < 0 || channel >= MUSIC_MAX_CHANNELS || dest < 0) return 0;
+    ch = &music->channels[channel];
+    for (i = 0; i < NOTE_BLOCK_SIZE; i++) before[i] = pack_note(get_channel_note(ch, start + i));
+    if ((changed = link_channel_pattern(ch, dest, src)) <= 0) return 0;
+    // Seules les lignes qui ont changé sont gardées
+    for (i = 0; i < NOTE_BLOCK_SIZE; i++) {
+        after = pack_note(get_channel_note(ch, start + i));
+        if (after != before[i]) record_delta(journal, channel, start + i, before[i], after);
+    }
+    return changed;
+}
+
+/**
+ * \fn int journal_set_range(journal_t *journal, music_t *music, short channel, int start, int count, const packed_note_t *notes)
+ * \brief Remplace des lignes consécutives d'un channel (voir set_channel_range) et garde les deltas
+ * \param journal Le journal
+ * \param music La musique
+ * \param channel Le channel
+ * \param start La première ligne
+ * \param count Le nombre de lignes
+ * \param notes Les notes encodées (count mots)
+ * \return Le nombre de lignes modifiées
+ * \note Une action qui modifie plus de lignes que le journal n'en garde ne peut pas être annulée
+ */
+int journal_set_range(journal_t *journal, music_t *music, short channel, int start, int count, const packed_note_t *notes) {
+    packed_note_t *before;
+    channel_t *ch;
+    int i, changed;
+
+    if (channel < 0 || channel >= MUSIC_MAX_CHANNELS || start < 0 || count <= 0) return 0;
+    ch = &music->channels[channel];
+    before = malloc(count * sizeof(packed_note_t));
+    CHECK_ALLOC(before);
+    get_channel_range(ch, start, count, before);
+    if ((changed = set_channel_range(ch, start, count, notes)) > 0) {
+        for (i = 0; i < count; i++) {
+            if (before[i] != notes[i]) record_delta(journal, channel, start + i, before[i], notes[i]);
+        }
+    }
+    free(before);
+    return changed;
+}
+
+/**
+ * \fn int journal_transform_range(journal_t *journal, music_t *music, short chFirst, short chLast, int start, int end, note_range_op_t op, int value)
+ * \brief Applique une transformation (voir transform_notes) à une région et garde les deltas
+ * \param journal Le journal
+ * \param music La musique
+ * \param chFirst Le premier channel
+ * \param chLast Le dernier channel (inclus)
+ * \param start La première ligne
+ * \param end La dernière ligne (incluse)
+ * \param op La transformation
+ * \param value Le paramètre de la transformation
+ * \return Le nombre de lignes modifiées
+ */
+int journal_transform_range(journal_t *journal, music_t *music, short chFirst, short chLast, int start, int end, note_range_op_t op, int value) {
+    packed_note_t *notes;
+    short c;
+    int count, changed = 0;
+
+    if (clamp_channels(&chFirst, &chLast) < 0 || start < 0 || end < start) return 0;
+    count = end - start + 1;
+    notes = malloc(count * sizeof(packed_note_t));
+    CHECK_ALLOC(notes);
+    for (c = chFirst; c <= chLast; c++) {
+        // Les lignes après la dernière note sont vides : pas besoin de les lire
+        if (music->channels[c].nbNotes <= start) continue;
+        get_channel_range(&music->channels[c], start, count, notes);
+        transform_notes(notes, count, op, value);
+        changed += journal_set_range(journal, music, c, start, count, notes);
+    }
+    free(notes);
+    return changed;
+}
+
+/**
+ * \fn int journal_shift_range(journal_t *journal, music_t *music, short chFirst, short chLast, int start, int count)
+ * \brief Insère (count > 0) ou supprime (count < 0) des lignes dans des channels en décalant les suivantes
+ * \param journal Le journal
+ * \param music La musique
+ * \param chFirst Le premier channel
+ * \param chLast Le dernier channel (inclus)
+ * \param start La ligne où insérer des lignes vides ou la première ligne supprimée
+ * \param count Le nombre de lignes insérées ou supprimées
+ * \return Le nombre de lignes modifiées
+ */
+int journal_shift_range(journal_t *journal, music_t *music, short chFirst, short chLast, int start, int count) {
+    packed_note_t *notes;
+    channel_t *ch;
+    short c;
+    int tail, length, i, changed = 0;
+
+    if (clamp_channels(&chFirst, &chLast) < 0 || start < 0 || count == 0) return 0;
+    for (c = chFirst; c <= chLast; c++) {
+        ch = &music->channels[c];
+        // Seules les lignes entre start et la dernière note bougent
+        if ((tail = ch->nbNotes - start) <= 0) continue;
+        length = count > 0 ? tail + count : tail;
+        notes = malloc(length * sizeof(packed_note_t));
+        CHECK_ALLOC(notes);
+        if (count > 0) {
+            for (i = 0; i < count; i++) notes[i] = PACKED_NOTE_EMPTY;
+            get_channel_range(ch, start, tail, notes + count);
+        } else {
+            // Les lignes supprimées sont remplacées par celles qui les suivent, la fin est vidée
+            i = tail + count > 0 ? tail + count : 0;
+            get_channel_range(ch, start - count, i, notes);
+            for (; i < length; i++) notes[i] = PACKED_NOTE_EMPTY;
+        }
+        changed += journal_set_range(journal, music, c, start, length, notes);
+        free(notes);
+    }
+    return changed;
+}
+
+/**
+ * \fn int copy_range(const music_t *music, short chFirst, short chLast, int start, int end, note_clipboard_t *clip)
+ * \brief Copie une région de la musique
+ * \param music La musique
+ * \param chFirst Le premier channel
+ * \param chLast Le dernier channel (inclus)
+ * \param start La première ligne
+ * \param end La dernière ligne (incluse)
+ * \param clip Reçoit la région (l'ancien contenu est libéré)
+ * \return 0 si la région est copiée, -1 si elle est invalide
+ */
+int copy_range(const music_t *music, short chFirst, short chLast, int start, int end, note_clipboard_t *clip) {
+    short c;
+
+    if (clamp_channels(&chFirst, &chLast) < 0 || start < 0 || end < start) return -1;
+    free_clipboard(clip);
+    clip->channels = chLast - chFirst + 1;
+    clip->lines = end - start + 1;
+    clip->notes = malloc((size_t)clip->channels * clip->lines * sizeof(packed_note_t));
+    CHECK_ALLOC(clip->notes);
+    for (c = chFirst; c <= chLast; c++) {
+        get_channel_range(&music->channels[c], start, clip->lines, clip->notes + (size_t)(c - chFirst) * clip->lines);
+    }
+    return 0;
+}
+
+/**
+ * \fn int journal_paste_range(journal_t *journal, music_t *music, const note_clipboard_t *clip, short channel, int start)
+ * \brief Colle une région copiée et garde les deltas
+ * \param journal Le journal
+ * \param music La musique
+ * \param clip La région copiée
+ * \param channel Le channel qui reçoit le premier channel copié
+ * \param start La ligne qui reçoit la première ligne copiée
+ * \return Le nombre de lignes modifiées
+ * \note Les channels qui dépassent la musique sont ignorés
+ */
+int journal_paste_range(journal_t *journal, music_t *music, const note_clipboard_t *clip, short channel, int start) {
+    int c, changed = 0;
+
+    if (clip->notes == NULL || channel < 0 || start < 0) return 0;
+    for (c = 0; c < clip->channels && channel + c < MUSIC_MAX_CHANNELS; c++) {
+        changed += journal_set_range(journal, music, channel + c, start, clip->lines, clip->notes + (size_t)c * clip->lines);
+    }
+    return changed;
+}
+
+/**
+ * \fn void free_clipboard(note_clipboard_t *clip)
+ * \brief Libère le contenu d'une région copiée et la vide
+ * \param clip La région copiée
+ */
+void free_clipboard(note_clipboard_t *clip) {
+    free(clip->notes);
+    clip->notes = NULL;
+    clip->channels = 0;
+    clip->lines = 0;
+}
+
+/**
+ * \fn int journal_undo(journal_t *journal, music_t *music)
+ * \brief Annule la dernière action
+ * \param journal Le journal
+ * \param music La musique
+ * \return Le nombre de notes remises dans leur état précédent, 0 s'il n'y a rien à annuler
+ */
+int journal_undo(journal_t *journal, music_t *music) {
+    journal_delta_t *delta;
+    int undone = 0;
+
+    // On défait les deltas du plus récent au plus ancien, jusqu'au début du groupe
+    while (journal->applied > 0) {
+        delta = get_delta(journal, --journal->applied);
+        apply_delta(music, delta, delta->before);
+        mark_dirty(journal, delta->channel, delta->index);
+        undone++;
+        if (delta->first) break;
+    }
+    journal->newGroup = 1;
+    return undone;
+}
+
+/**
+ * \fn int journal_redo(journal_t *journal, music_t *music)
+ * \brief Rétablit la dernière action annulée
+ * \param journal Le journal
+ * \param music La musique
+ * \return Le nombre de notes modifiées à nouveau, 0 s'il n'y a rien à rétablir
+ */
+int journal_redo(journal_t *journal, music_t *music) {
+    journal_delta_t *delta;
+    int redone = 0;
+
+    // On refait les deltas dans l'ordre, jusqu'au début du groupe suivant
+    while (journal->applied < journal->count) {
+        delta = get_delta(journal, journal->applied);
+        if (redone > 0 && delta->first) break;
+        apply_delta(music, delta, delta->after);
+        mark_dirty(journal, delta->channel, delta->index);
+        journal->applied++;
+        redone++;
+    }
+    journal->newGroup = 1;
+    return redone;
+}
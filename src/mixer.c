@@ -0,0 +1,420 @@
+/**
+ * @file mixer.c
+ * @brief Fichier source du mixeur et de la lecture en boucle.
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+
+#include "mixer.h"
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \struct loop_mix_t
+ * \brief Un mix de la région, préparé par le thread de mixage pour le thread audio
+ */
+typedef struct loop_mix_s {
+    short *samples; /*!< Les échantillons du mix */
+    size_t frames; /*!< Nombre d'échantillons */
+    struct loop_mix_s *next; /*!< Mix suivant dans la pile des mix joués */
+} loop_mix_t;
+
+/**
+ * \struct loop_t
+ * \brief Etat de la lecture en boucle
+ */
+typedef struct {
+    pthread_t thread; /*!< Thread audio qui joue la boucle */
+    pthread_t worker; /*!< Thread qui mixe la région quand elle change */
+    int running; /*!< 1 tant que la boucle doit être jouée (atomique) */
+    int started; /*!< 1 si les threads ont été lancés et doivent être attendus */
+    snapshot_mailbox_t mailbox; /*!< Dernière version de la musique déposée par le séquenceur */
+    loop_mix_t *ready; /*!< Dernier mix préparé et pas encore pris par le thread audio (atomique) */
+    loop_mix_t *retired; /*!< Pile des mix que le thread audio ne joue plus, libérés par le thread de mixage (atomique) */
+    int start; /*!< Première ligne de la région */
+    int end; /*!< Dernière ligne de la région */
+} loop_t;
+
+/* ------------------------------------------------------------------------ */
+/*                     V A R I A B L E S   G L O B A L E S                  */
+/* ------------------------------------------------------------------------ */
+static loop_t loop = { .running = 0 }; /*!< La boucle en cours */
+static pthread_mutex_t loopMutex = PTHREAD_MUTEX_INITIALIZER; /*!< Protège loop.started, jamais pris par le thread audio */
+static pthread_cond_t loopCond = PTHREAD_COND_INITIALIZER; /*!< Réveille le thread de mixage */
+
+/* ------------------------------------------------------------------------ */
+/*                   F O N C T I O N S   P R I V É E S                      */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn void free_loop_mixes(loop_mix_t *mix)
+ * \brief Libère une liste de mix
+ */
+static void free_loop_mixes(loop_mix_t *mix) {
+    loop_mix_t *next;
+    for (; mix != NULL; mix = next) {
+        next = mix->next;
+        free(mix->samples);
+        free(mix);
+    }
+}
+
+/**
+ * \fn loop_mix_t *create_loop_mix(music_snapshot_t *snapshot)
+ * \brief Mixe la région de la boucle dans une version de la musique
+ * \return Le mix, NULL en cas d'erreur
+ */
+static loop_mix_t *create_loop_mix(music_snapshot_t *snapshot) {
+    loop_mix_t *mix = malloc(sizeof(loop_mix_t));
+    CHECK_ALLOC(mix);
+    mix->next = NULL;
+    if ((mix->samples = mix_region(&snapshot->music, loop.start, loop.end, &mix->frames)) == NULL) {
+        free(mix);
+        return NULL;
+    }
+    return mix;
+}
+
+/**
+ * \fn void *mix_thread(void *args)
+ * \brief Mixe à nouveau la région à chaque nouvelle version déposée par le séquenceur (seules les notes
+ * modifiées sont synthétisées) et libère les mix et les versions dont la boucle ne se sert plus
+ * \param args La version déjà mixée par start_loop, dont le thread prend la référence
+ */
+static void *mix_thread(void *args) {
+    music_snapshot_t *snapshot = args, *latest;
+    loop_mix_t *mix;
+    unsigned long epoch = render_cache_epoch();
+    struct timespec deadline;
+
+    while (is_looping()) {
+        latest = update_snapshot(&loop.mailbox, snapshot);
+        if (latest != snapshot || epoch != render_cache_epoch()) {
+            snapshot = latest;
+            epoch = render_cache_epoch();
+            // En cas d'échec, la boucle continue avec le mix précédent
+            if ((mix = create_loop_mix(snapshot)) != NULL) {
+                free_loop_mixes(__atomic_exchange_n(&loop.ready, mix, __ATOMIC_ACQ_REL));
+            }
+        }
+        free_loop_mixes(__atomic_exchange_n(&loop.retired, NULL, __ATOMIC_ACQ_REL));
+
+        // Le cache peut être vidé sans nouvelle version : on le surveille à intervalle régulier
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += MIXER_WATCH_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&loopMutex);
+        if (__atomic_load_n(&loop.mailbox.latest, __ATOMIC_ACQUIRE) == NULL && is_looping()) {
+            pthread_cond_timedwait(&loopCond, &loopMutex, &deadline);
+        }
+        pthread_mutex_unlock(&loopMutex);
+    }
+    release_snapshot(snapshot);
+    return NULL;
+}
+
+/**
+ * \fn void *loop_thread(void *args)
+ * \brief Joue la région en boucle, en passant entre deux tours au dernier mix préparé
+ * \note Ni verrou, ni allocation, ni libération : le thread de mixage s'en charge
+ */
+static void *loop_thread(void *args) {
+    snd_pcm_t *pcm;
+    loop_mix_t *mix = NULL, *latest;
+    size_t offset, count;
+    (void)args;
+
+    init_sound(&pcm);
+    while (is_looping()) {
+        if ((latest = __atomic_exchange_n(&loop.ready, NULL, __ATOMIC_ACQ_REL)) != NULL) {
+            // L'ancien mix est rendu au thread de mixage, qui le libérera
+            if (mix != NULL) {
+                mix->next = __atomic_load_n(&loop.retired, __ATOMIC_RELAXED);
+                while (!__atomic_compare_exchange_n(&loop.retired, &mix->next, mix, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+            }
+            mix = latest;
+        }
+        // Le flux n'est jamais vidé entre deux tours : la boucle est jouée sans trou
+        for (offset = 0; offset < mix->frames && is_looping(); offset += count) {
+            count = mix->frames - offset < ENGINE_BLOCK_FRAMES ? mix->frames - offset : ENGINE_BLOCK_FRAMES;
+            write_block(pcm, mix->samples + offset, count);
+        }
+    }
+    // On coupe tout de suite, sans attendre la fin du tampon
+    snd_pcm_drop(pcm);
+    snd_pcm_close(pcm);
+    free_loop_mixes(mix);
+    return NULL;
+}
+
+/**
+ * \fn int load_next_note(const music_t *music, short channel, mixer_track_t *track)
+ * \brief Rend la note suivante d'un channel dans son buffer
+ * \return 0 si une note a été rendue, -1 à la fin du channel
+ */
+static int load_next_note(const music_t *music, short channel, mixer_track_t *track) {
+    const channel_t *ch = &music->channels[channel];
+    note_t note;
+    short *buffer;
+    size_t frames;
+
+    if (track->line >= ch->nbNotes) return -1;
+    note = get_channel_note(ch, track->line++);
+    frames = noteToTime(note, music->bpm);
+    if (frames > track->capacity) {
+        if ((buffer = realloc(track->buffer, frames * sizeof(short))) == NULL) {
+            ERROR("Mémoire insuffisante pour rendre la note %d du channel %d\n", track->line - 1, channel);
+            return -1;
+        }
+        track->buffer = buffer;
+        track->capacity = frames;
+    }
+    // Une ligne vide est un silence
+    if (note.id != NOTE_NA_ID) render_note_buffer(note, music->bpm, MIXER_EFFECT, track->buffer);
+    else memset(track->buffer, 0, frames * sizeof(short));
+    track->frames = frames;
+    track->position = 0;
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+/*                  C O D E    D E S    F O N C T I O N S                   */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn short *mix_region(music_t *music, int start, int end, size_t *frames)
+ * \brief Rend et mixe les lignes start à end (incluses) de tous les channels
+ * \param music La musique
+ * \param start La première ligne
+ * \param end La dernière ligne
+ * \param frames Reçoit le nombre d'échantillons du mix (celui du channel le plus long)
+ * \return Le mix, à libérer par l'appelant, ou NULL en cas d'erreur
+ */
+short *mix_region(music_t *music, int start, int end, size_t *frames) {
+    size_t length, total = 0, longestNote = 0, noteFrames, offset, i;
+    size_t *offsets;
+    int ch, line, lines, cached, sample;
+    int *acc;
+    short *scratch, *mix;
+    note_t note;
+
+    if (start < 0) start = 0;
+    if (start > end) return NULL;
+    lines = end - start + 1;
+    if ((offsets = malloc(MUSIC_MAX_CHANNELS * lines * sizeof(size_t))) == NULL) {
+        ERROR("Mémoire insuffisante pour mixer la région %d-%d\n", start, end);
+        return NULL;
+    }
+
+    // Début de chaque ligne dans le mix (les lignes vides aussi ont une durée), le mix dure autant que le plus long channel
+    for (ch = 0; ch < MUSIC_MAX_CHANNELS; ch++) {
+        length = 0;
+        for (line = start; line <= end; line++) {
+            offsets[ch * lines + line - start] = length;
+            noteFrames = noteToTime(get_channel_note(&music->channels[ch], line), music->bpm);
+            if (noteFrames > longestNote) longestNote = noteFrames;
+            length += noteFrames;
+        }
+        if (length > total) total = length;
+    }
+    if (total == 0) {
+        free(offsets);
+        return NULL;
+    }
+
+    acc = calloc(total, sizeof(int));
+    scratch = malloc(longestNote * sizeof(short));
+    mix = malloc(total * sizeof(short));
+    if (acc == NULL || scratch == NULL || mix == NULL) {
+        ERROR("Mémoire insuffisante pour mixer la région %d-%d\n", start, end);
+        free(offsets);
+        free(acc);
+        free(scratch);
+        free(mix);
+        return NULL;
+    }
+
+    for (ch = 0; ch < MUSIC_MAX_CHANNELS; ch++) {
+        // Une ligne vide est un silence, il n'y a rien à ajouter : on ne visite que les notes
+        for (line = next_channel_note(&music->channels[ch], start); line != -1 && line <= end; line = next_channel_note(&music->channels[ch], line + 1)) {
+            note = get_channel_note(&music->channels[ch], line);
+            noteFrames = noteToTime(note, music->bpm);
+            offset = offsets[ch * lines + line - start];
+            // Un motif répété est rendu une seule fois, sous la ligne de sa première occurrence
+            cached = get_channel_pattern_line(&music->channels[ch], line);
+            if (render_cache_read(ch, cached, note, music->bpm, MIXER_EFFECT, scratch, noteFrames) != noteFrames) {
+                engine_quality_t quality = render_note_buffer(note, music->bpm, MIXER_EFFECT, scratch);
+                render_cache_store(ch, cached, note, music->bpm, MIXER_EFFECT, scratch, noteFrames, quality);
+            }
+            for (i = 0; i < noteFrames; i++) acc[offset + i] += scratch[i];
+        }
+    }
+
+    for (i = 0; i < total; i++) {
+        sample = acc[i];
+        mix[i] = sample > MIXER_SAMPLE_MAX ? MIXER_SAMPLE_MAX : sample < -MIXER_SAMPLE_MAX ? -MIXER_SAMPLE_MAX : sample;
+    }
+    free(offsets);
+    free(acc);
+    free(scratch);
+    *frames = total;
+    return mix;
+}
+
+/**
+ * \fn mixer_stream_t *create_mixer_stream(const music_t *music)
+ * \brief Crée un flux de mixage qui rend une musique du début à la fin
+ * \param music La musique (doit rester valable pendant toute la vie du flux)
+ * \return Le flux, à libérer avec free_mixer_stream
+ */
+mixer_stream_t *create_mixer_stream(const music_t *music) {
+    mixer_stream_t *stream = calloc(1, sizeof(mixer_stream_t));
+    CHECK_ALLOC(stream);
+    stream->music = music;
+    return stream;
+}
+
+/**
+ * \fn size_t read_mixer_stream(mixer_stream_t *stream, short *out, size_t frames)
+ * \brief Rend et mixe les échantillons suivants du flux
+ * \param stream Le flux
+ * \param out Le buffer de sortie
+ * \param frames Nombre d'échantillons demandés (au plus ENGINE_BLOCK_FRAMES)
+ * \return Le nombre d'échantillons rendus, inférieur à frames à la fin de la musique
+ */
+size_t read_mixer_stream(mixer_stream_t *stream, short *out, size_t frames) {
+    mixer_track_t *track;
+    size_t produced, longest = 0, count, i;
+    int ch, sample;
+
+    if (frames > ENGINE_BLOCK_FRAMES) frames = ENGINE_BLOCK_FRAMES;
+    memset(stream->acc, 0, frames * sizeof(int));
+    for (ch = 0; ch < MUSIC_MAX_CHANNELS; ch++) {
+        track = &stream->tracks[ch];
+        produced = 0;
+        while (produced < frames) {
+            // Note courante terminée : on rend la suivante d'un coup
+            if (track->position == track->frames && load_next_note(stream->music, ch, track) == -1) break;
+            count = track->frames - track->position < frames - produced ? track->frames - track->position : frames - produced;
+            for (i = 0; i < count; i++) stream->acc[produced + i] += track->buffer[track->position + i];
+            track->position += count;
+            produced += count;
+        }
+        if (produced > longest) longest = produced;
+    }
+
+    for (i = 0; i < longest; i++) {
+        sample = stream->acc[i];
+        out[i] = sample > MIXER_SAMPLE_MAX ? MIXER_SAMPLE_MAX : sample < -MIXER_SAMPLE_MAX ? -MIXER_SAMPLE_MAX : sample;
+    }
+    return longest;
+}
+
+/**
+ * \fn void free_mixer_stream(mixer_stream_t *stream)
+ * \brief Libère un flux de mixage
+ * \param stream Le flux
+ */
+void free_mixer_stream(mixer_stream_t *stream) {
+    int ch;
+    if (stream == NULL) return;
+    for (ch = 0; ch < MUSIC_MAX_CHANNELS; ch++) free(stream->tracks[ch].buffer);
+    free(stream);
+}
+
+/**
+ * \fn int start_loop(music_t *music, int start, int end)
+ * \brief Lance la lecture en boucle d'une région
+ * \param music La musique (une version figée en est prise, voir publish_loop)
+ * \param start La première ligne
+ * \param end La dernière ligne
+ * \return 0 si la boucle est lancée, -1 sinon
+ * \note Une boucle déjà lancée est d'abord arrêtée
+ */
+int start_loop(music_t *music, int start, int end) {
+    music_snapshot_t *snapshot;
+    loop_mix_t *mix;
+    int started;
+    stop_loop();
+    loop.start = start < end ? start : end;
+    loop.end = start < end ? end : start;
+    // Le premier mix est fait avant de lancer la lecture : le thread audio a toujours un mix à jouer
+    snapshot = create_snapshot(music);
+    if ((mix = create_loop_mix(snapshot)) == NULL) {
+        release_snapshot(snapshot);
+        ERROR("Impossible de mixer la région %d-%d\n", loop.start, loop.end);
+        return -1;
+    }
+    __atomic_store_n(&loop.ready, mix, __ATOMIC_RELEASE);
+    __atomic_store_n(&loop.running, 1, __ATOMIC_RELEASE);
+    started = pthread_create(&loop.worker, NULL, mix_thread, snapshot) == 0;
+    if (!started) release_snapshot(snapshot);
+    if (started && pthread_create(&loop.thread, NULL, loop_thread, NULL) != 0) {
+        // Sans thread audio, le thread de mixage n'a plus rien à faire
+        pthread_mutex_lock(&loopMutex);
+        __atomic_store_n(&loop.running, 0, __ATOMIC_RELEASE);
+        pthread_cond_signal(&loopCond);
+        pthread_mutex_unlock(&loopMutex);
+        pthread_join(loop.worker, NULL);
+        started = 0;
+    }
+    pthread_mutex_lock(&loopMutex);
+    loop.started = started;
+    if (!started) __atomic_store_n(&loop.running, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&loopMutex);
+    if (!started) {
+        free_loop_mixes(__atomic_exchange_n(&loop.ready, NULL, __ATOMIC_ACQ_REL));
+        ERROR("Impossible de lancer la boucle\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \fn void stop_loop()
+ * \brief Arrête la lecture en boucle et attend la fin des threads
+ */
+void stop_loop() {
+    int started;
+    pthread_mutex_lock(&loopMutex);
+    started = loop.started;
+    __atomic_store_n(&loop.running, 0, __ATOMIC_RELEASE);
+    loop.started = 0;
+    pthread_cond_signal(&loopCond);
+    pthread_mutex_unlock(&loopMutex);
+    if (started) {
+        pthread_join(loop.thread, NULL);
+        pthread_join(loop.worker, NULL);
+    }
+    clear_mailbox(&loop.mailbox);
+    free_loop_mixes(__atomic_exchange_n(&loop.ready, NULL, __ATOMIC_ACQ_REL));
+    free_loop_mixes(__atomic_exchange_n(&loop.retired, NULL, __ATOMIC_ACQ_REL));
+}
+
+/**
+ * \fn void publish_loop(const music_t *music)
+ * \brief Transmet l'état courant de la musique à la boucle en cours
+ * \param music La musique éditée
+ * \note Sans effet si aucune boucle n'est jouée
+ */
+void publish_loop(const music_t *music) {
+    if (!is_looping()) return;
+    publish_snapshot(&loop.mailbox, create_snapshot(music));
+    pthread_mutex_lock(&loopMutex);
+    pthread_cond_signal(&loopCond);
+    pthread_mutex_unlock(&loopMutex);
+}
+
+/**
+ * \fn int is_looping()
+ * \brief Indique si une boucle est en cours de lecture
+ * \return 1 si une boucle est jouée, 0 sinon
+ */
+int is_looping() {
+    return __atomic_load_n(&loop.running, __ATOMIC_ACQUIRE);
+}
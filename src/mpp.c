@@ -15,16 +15,37 @@
  * @fn void write_music(music_t *music, FILE *file);
  * @param music  La musique à écrire
  * @param file   Le fichier dans lequel écrire la musique
+ * @note Le fichier commence par MPP_FILE_MAGIC et MPP_FILE_REVISED, suivis de la révision et de la musique compressée
  */
 void write_music(music_t *music, FILE *file);
 
 /**
- * @fn void read_music(music_t *music, FILE *file);
+ * @fn codec_error_t read_music(music_t *music, FILE *file);
  * @brief Lit une musique depuis un fichier 
- * @param music La musique à remplir
+ * @param music La musique à remplir, avec sa révision (0 pour un fichier écrit avant les révisions)
  * @param file Le fichier depuis lequou peuvenel lire la musique
+ * @return CODEC_OK si la musique est lue en entier, l'erreur sinon
  */
-void read_music(music_t *music, FILE *file);
+codec_error_t read_music(music_t *music, FILE *file);
+
+/**
+ * @fn int write_music_file(music_t *music, const char *filename);
+ * @brief Remplace le fichier d'une musique d'un coup
+ * @param music La musique à écrire
+ * @param filename Le chemin du fichier
+ * @return 0 si le fichier est remplacé, -1 sinon (l'ancien fichier est alors intact)
+ * @note La musique est écrite dans un fichier temporaire renommé ensuite : un arrêt en pleine écriture ne laisse
+ * jamais une musique à moitié écrite
+ */
+int write_music_file(music_t *music, const char *filename);
+
+/**
+ * @fn unsigned long read_music_revision(const char *filename);
+ * @brief Lit la révision d'une musique enregistrée, sans lire ses notes
+ * @param filename Le chemin du fichier
+ * @return La révision, 0 si le fichier n'existe pas ou a été écrit avant les révisions
+ */
+unsigned long read_music_revision(const char *filename);
 
 /**
  * @fn void write_list_music(musicId_list_t *list, FILE *file);
@@ -42,32 +63,102 @@ void write_list_music(musicId_list_t *list, FILE *file);
 void read_list_music(musicId_list_t *list, FILE *file);
 
 /**
- * @fn serialize_music(music_t *music, buffer_t buffer);
- * @brief Sérialise une musique
+ * @fn void encode_music(writer_t *writer, music_t *music);
+ * @brief Sérialise une musique à la suite d'un writer
+ * @param writer Le writer
  * @param music La musique à sérialiser
- * @param buffer Le buffer dans lequel sérialiser la musique
  * @note La musique est sérialisée de la manière suivante :
  * <date> <bpm>
- * <line> <noteid> <octave> <instrument> <time>
+ * <line> <noteid> <octave> <instrument> <time> <finetune>
  * ...
  * P
- * <line> <noteid> <octave> <instrument> <time>
+ * <line> <noteid> <octave> <instrument> <time> <finetune>
+ * R <block> <pattern>
  * ...
  * P
- * <line> <noteid> <octave> <instrument> <time>
+ * <line> <noteid> <octave> <instrument> <time> <finetune>
  * P
  * @warning La musique doit être initialisée avant d'appeler cette fonction
  */
-void serialize_music(music_t *music, buffer_t buffer);
+void encode_music(writer_t *writer, music_t *music);
 
 /**
- * @fn deserialize_music(char *token, music_t *music, char *saveptr);
- * @brief Désérialise une musique contenue dans un buffer
- * @param token La position dans le buffer ou se trouve la musique sérialisée
+ * @fn codec_error_t decode_music(reader_t *reader, music_t *music);
+ * @brief Désérialise une musique (voir encode_music) directement depuis le buffer d'un reader
+ * @param reader Le reader, placé au début de la musique
  * @param music La musique désérialisée
+ * @return L'erreur du reader, CODEC_OK si la musique est lue en entier
  * @warning La musique doit être initialisée avant d'appeler cette fonction
  */
-void deserialize_music(char *token, music_t *music);
+codec_error_t decode_music(reader_t *reader, music_t *music);
+
+/**
+ * @fn void encode_binary_music(writer_t *writer, music_t *music);
+ * @brief Sérialise une musique en MPP 2.0 à la suite d'un writer
+ * @param writer Le writer
+ * @param music La musique à sérialiser
+ * @note La musique est sérialisée de la manière suivante (varints, voir codec.h) :
+ * <date> <bpm> <nombre de channels>
+ * puis pour chaque channel son nombre de lignes et une suite d'enregistrements commençant par (écart << MPP_RECORD_BITS) | type, où
+ * l'écart est le nombre de lignes vides depuis l'enregistrement précédent :
+ * MPP_RECORD_NOTE <note sur 24 bits>, MPP_RECORD_FINETUNE <note sur 24 bits> <finetune>,
+ * MPP_RECORD_PATTERN <bloc du motif>, et MPP_RECORD_END pour finir le channel
+ */
+void encode_binary_music(writer_t *writer, music_t *music);
+
+/**
+ * @fn codec_error_t decode_binary_music(reader_t *reader, music_t *music);
+ * @brief Désérialise une musique en MPP 2.0 (voir encode_binary_music) directement depuis le buffer d'un reader
+ * @param reader Le reader, placé au début de la musique
+ * @param music La musique désérialisée
+ * @return L'erreur du reader, CODEC_OK si la musique est lue en entier
+ * @warning La musique doit être initialisée avant d'appeler cette fonction
+ */
+codec_error_t decode_binary_music(reader_t *reader, music_t *music);
+
+/**
+ * @fn void encode_compressed_music(writer_t *writer, music_t *music);
+ * @brief Sérialise une musique en MPP 2.1 à la suite d'un writer
+ * @param writer Le writer
+ * @param music La musique à sérialiser
+ * @note La musique est sérialisée de la manière suivante : <date> <bpm> <nombre de channels> puis un bloc LZ (voir
+ * writer_put_lz) qui contient pour chaque channel son nombre de lignes, son nombre d'enregistrements, la taille de
+ * ses MPP_COLUMNS colonnes RLE (voir rle_put) puis les colonnes. Les enregistrements sont ceux de
+ * encode_binary_music, sans MPP_RECORD_END, et leurs champs sont rangés chacun dans sa colonne : les instruments,
+ * octaves et durées qui se répètent de note en note ne coûtent presque rien
+ */
+void encode_compressed_music(writer_t *writer, music_t *music);
+
+/**
+ * @fn codec_error_t decode_compressed_music(reader_t *reader, music_t *music);
+ * @brief Désérialise une musique en MPP 2.1 (voir encode_compressed_music) depuis le buffer d'un reader
+ * @param reader Le reader, placé au début de la musique
+ * @param music La musique désérialisée
+ * @return L'erreur du reader, CODEC_OK si la musique est lue en entier
+ * @warning La musique doit être initialisée avant d'appeler cette fonction
+ */
+codec_error_t decode_compressed_music(reader_t *reader, music_t *music);
+
+/**
+ * @fn void encode_music_patch(writer_t *writer, music_patch_t *patch);
+ * @brief Sérialise un patch en MPP 2.2 à la suite d'un writer
+ * @param writer Le writer
+ * @param patch Le patch à sérialiser
+ * @note Le patch est sérialisé de la manière suivante (varints) : <révision> <bpm> <nombre de channels> puis pour
+ * chaque channel son nombre de lignes, son nombre de lignes modifiées et pour chacune l'écart avec la précédente
+ * et la note encodée
+ */
+void encode_music_patch(writer_t *writer, music_patch_t *patch);
+
+/**
+ * @fn codec_error_t decode_music_patch(reader_t *reader, music_patch_t *patch);
+ * @brief Désérialise un patch en MPP 2.2 (voir encode_music_patch) depuis le buffer d'un reader
+ * @param reader Le reader, placé au début du patch
+ * @param patch Le patch, initialisé par la fonction
+ * @return L'erreur du reader, CODEC_OK si le patch est lu en entier
+ * @note Le patch se libère avec free_music_patch, même en cas d'erreur
+ */
+codec_error_t decode_music_patch(reader_t *reader, music_patch_t *patch);
 
 
 /**********************************************************************************************************************/
@@ -83,13 +174,17 @@ void deserialize_music(char *token, music_t *music);
  * \param music La musique
  * \param musicId L'identifiant de la musique
  * \return mpp_request_t 
+ * \note La requête est au format MPP_VERSION
  */
 mpp_request_t create_mpp_request(mpp_request_code_t code, char *rfidId, music_t *music, time_t musicId) {
     mpp_request_t request;
     request.code = code;
     strcpy(request.rfidId, rfidId);
     request.music = music;
+    request.patch = NULL;
+    request.overwrite = 0;
     request.musicId = musicId;
+    request.version = MPP_VERSION;
     return request;
 }
 
@@ -101,6 +196,7 @@ mpp_request_t create_mpp_request(mpp_request_code_t code, char *rfidId, music_t
  * @param music Le pointeur vers la musique
  * @param musicIds La liste des identifiants de musiques
  * @return mpp_response_t 
+ * @note La réponse est au format MPP_VERSION
  */
 mpp_response_t create_mpp_response(mpp_response_code_t code, char *username, music_t *music, musicId_list_t *musicIds) {
     mpp_response_t response;
@@ -108,6 +204,8 @@ mpp_response_t create_mpp_response(mpp_response_code_t code, char *username, mus
     strcpy(response.username, username);
     response.music = music;
     response.musicIds = musicIds;
+    response.revision = 0;
+    response.version = MPP_VERSION;
     return response;
 }
 
@@ -147,124 +245,270 @@ void print_mpp_response(mpp_response_t *response) {
 }
 
 /**
- * @fn serialize_music(music_t *music, buffer_t buffer);
- * @brief Sérialise une requête MPP
+ * @fn int encode_mpp_request(writer_t *writer, mpp_request_t *request);
+ * @brief Sérialise une requête MPP à la suite d'un writer
  * La requête est sérialisée de la manière suivante :
  * <code> <rfidId>
  * <music>
- * @param request 
- * @param buffer 
+ * En MPP 2.0, un message binaire de type MPP_MESSAGE_REQUEST contient code, rfidId et musicId en varints puis la
+ * musique éventuelle
+ * En MPP 2.2, la révision sur laquelle la musique a été modifiée et 0 ou 1 pour l'écraser quand même suivent la
+ * musique, puis le patch éventuel (voir encode_music_patch)
+ * @param writer Le writer
+ * @param request La requête MPP
+ * @return 0 si la requête est écrite en entier, -1 si elle ne tient pas dans le buffer du writer
+ * @note Le format est choisi d'après request->version
  */
-void serialize_mpp_request(mpp_request_t *request, buffer_t buffer) {
-    sprintf(buffer, "%d %s %ld\n", request->code, request->rfidId, request->musicId);
-    if(request->music != NULL) serialize_music(request->music, buffer);  
+int encode_mpp_request(writer_t *writer, mpp_request_t *request) {
+    size_t header;
+    if(request->version >= MPP_VERSION_BINARY) {
+        // <code> <rfidId> <musicId> <0 ou 1 selon la présence de la musique> [<music>]
+        // puis en MPP 2.2 [<revision> <0 ou 1 pour écraser>] <0 ou 1> [<patch>]
+        header = writer_begin_message(writer, request->version, MPP_MESSAGE_REQUEST);
+        writer_put_varint(writer, request->code);
+        writer_put_lstring(writer, request->rfidId);
+        writer_put_svarint(writer, request->musicId);
+        writer_put_varint(writer, request->music != NULL);
+        if(request->music != NULL && request->version >= MPP_VERSION_COMPRESSED) encode_compressed_music(writer, request->music);
+        else if(request->music != NULL) encode_binary_music(writer, request->music);
+        if(request->version >= MPP_VERSION_DELTA) {
+            if(request->music != NULL) {
+                writer_put_varint(writer, request->music->revision);
+                writer_put_varint(writer, request->overwrite != 0);
+            }
+            writer_put_varint(writer, request->patch != NULL);
+            if(request->patch != NULL) encode_music_patch(writer, request->patch);
+        }
+        writer_end_message(writer, header);
+        return writer->overflow ? -1 : 0;
+    }
+    writer_put_int(writer, request->code);
+    writer_put_char(writer, ' ');
+    writer_put_string(writer, request->rfidId);
+    writer_put_char(writer, ' ');
+    writer_put_int(writer, request->musicId);
+    writer_put_char(writer, '\n');
+    if(request->music != NULL) encode_music(writer, request->music);
+    return writer->overflow ? -1 : 0;
 }
 
 /**
- * @fn deserialize_mpp_request(buffer_t buffer, mpp_request_t *request);
- * @brief Désérialise une requête MPP
- * @param buffer Le buffer ou se trouve la requête sérialisée
+ * @fn codec_error_t decode_mpp_request(reader_t *reader, mpp_request_t *request);
+ * @brief Désérialise une requête MPP directement depuis le buffer d'un reader
+ * @param reader Le reader, placé au début de la requête
  * @param request La requête MPP à remplir
- * @see serialize_mpp_request
- */
-void deserialize_mpp_request(buffer_t buffer, mpp_request_t *request) {
-    // strtok n'est pas thread safe, on utilise strtok_r donc pour cela on doit déclarer un pointeur saveptr
-    char *saveptr = NULL;
-    char *token = NULL;
-    char *bufferCp = malloc(strlen(buffer) + 1);
-    strcpy(bufferCp, buffer);
-    // lecture de la première ligne
-    token = strtok_r(buffer, "\n", &saveptr);
-    sscanf(token, "%d %s %ld", (int *) &request->code, request->rfidId, &request->musicId);
-
-    // lecture des musiques si elles existent
-    token = strtok_r(NULL, "\n", &saveptr);
-    if(token != NULL) {
-        // On trouve ou commence la musique dans la copie du buffer
-        char *tokenCp = strstr(bufferCp, token);
-        request->music = (music_t *)malloc(sizeof(music_t));
-        init_music(request->music, 0);
-        deserialize_music(tokenCp, request->music);
+ * @return CODEC_OK si la requête est lue en entier, l'erreur sinon
+ * @note En cas d'erreur, la requête reçoit le code MPP_INVALID et aucun autre champ
+ */
+codec_error_t decode_mpp_request(reader_t *reader, mpp_request_t *request) {
+    long code = MPP_INVALID, musicId = NO_MUSIC_ID;
+    unsigned long binaryCode = MPP_INVALID, hasMusic = 0, hasPatch = 0, overwrite = 1;
+    int version = MPP_VERSION_TEXT, type = MPP_MESSAGE_REQUEST;
+    char rfidId[sizeof(request->rfidId)];
+    music_t *music = NULL;
+    music_patch_t *patch = NULL;
+    if(codec_is_binary(reader->data + reader->position, reader->length - reader->position)) {
+        // En-tête puis <code> <rfidId> <musicId> <0 ou 1>
+        if(reader_get_header(reader, &version, &type) == CODEC_OK && (version < MPP_VERSION_BINARY || version > MPP_VERSION)) reader->error = CODEC_ERROR_RANGE;
+        if(reader->error == CODEC_OK && type != MPP_MESSAGE_REQUEST) reader->error = CODEC_ERROR_SYNTAX;
+        reader_get_varint(reader, INT_MAX, &binaryCode);
+        reader_get_lstring(reader, rfidId, sizeof(rfidId));
+        reader_get_svarint(reader, LONG_MIN, LONG_MAX, &musicId);
+        reader_get_varint(reader, 1, &hasMusic);
+        code = binaryCode;
+    } else {
+        // <code> <rfidId> <musicId>
+        reader_get_int(reader, INT_MIN, INT_MAX, &code);
+        reader_get_word(reader, rfidId, sizeof(rfidId));
+        reader_get_int(reader, LONG_MIN, LONG_MAX, &musicId);
+        reader_end_line(reader);
+        // La musique est présente si le message continue
+        hasMusic = !reader_at_end(reader);
     }
-    else {
-        request->music = NULL;
+    if(hasMusic && reader->error == CODEC_OK) {
+        music = (music_t *)malloc(sizeof(music_t));
+        CHECK_ALLOC(music);
+        init_music(music, 0);
+        if(version >= MPP_VERSION_COMPRESSED) decode_compressed_music(reader, music);
+        else if(version == MPP_VERSION_BINARY) decode_binary_music(reader, music);
+        else decode_music(reader, music);
+    }
+    // [<revision> <0 ou 1>] : avant MPP 2.2, la musique envoyée remplace toujours celle qui est enregistrée
+    if(version >= MPP_VERSION_DELTA && music != NULL) {
+        reader_get_varint(reader, ULONG_MAX, &music->revision);
+        reader_get_varint(reader, 1, &overwrite);
+    }
+    // <0 ou 1> [<patch>]
+    if(version >= MPP_VERSION_DELTA && reader_get_varint(reader, 1, &hasPatch) == CODEC_OK && hasPatch) {
+        patch = (music_patch_t *)malloc(sizeof(music_patch_t));
+        CHECK_ALLOC(patch);
+        decode_music_patch(reader, patch);
     }
-    free(bufferCp);
+    // Un message binaire est lu en entier, rien ne doit rester après la musique
+    if(reader->error == CODEC_OK && version >= MPP_VERSION_BINARY && reader->position != reader->length) reader->error = CODEC_ERROR_SYNTAX;
+    if(reader->error != CODEC_OK) {
+        // Rien de la requête illisible n'est gardé
+        if(music != NULL) {
+            free_music(music);
+            free(music);
+        }
+        if(patch != NULL) {
+            free_music_patch(patch);
+            free(patch);
+        }
+        *request = create_mpp_request(MPP_INVALID, "", NULL, NO_MUSIC_ID);
+        // Une version inconnue reçoit la réponse dans la plus récente comprise : le client sait jusqu'où descendre
+        request->version = version > MPP_VERSION ? MPP_VERSION : version;
+        return reader->error;
+    }
+    *request = create_mpp_request((mpp_request_code_t) code, rfidId, music, musicId);
+    request->patch = patch;
+    request->overwrite = overwrite;
+    request->version = version;
+    return CODEC_OK;
 }
 
 /**
- * @brief Sérialise une reponse MPP
+ * @fn int encode_mpp_response(writer_t *writer, mpp_response_t *response);
+ * @brief Sérialise une réponse MPP à la suite d'un writer
  * La réponse est sérialisée de la manière suivante :
  * <code> <username>
  * <list_size> <musicId> <musicId> <musicId> ...
  * <music> (même format que pour la requête)
+ * @param writer Le writer
  * @param response La réponse MPP
- * @param buffer Le buffer dans lequel sérialiser la réponse
+ * @return 0 si la réponse est écrite en entier, -1 si elle ne tient pas dans le buffer du writer
+ * @note Le format est choisi d'après response->version
  */
-void serialize_mpp_response(mpp_response_t *response, buffer_t buffer) {
+int encode_mpp_response(writer_t *writer, mpp_response_t *response) {
+    size_t header;
+    time_t previous = 0;
     int i;
-    sprintf(buffer, "%d %s\n", response->code, response->username);
+    if(response->version >= MPP_VERSION_BINARY) {
+        // <code> <username> <0 ou 1> [<list_size> <écarts entre identifiants>] <0 ou 1> [<music>] puis en MPP 2.2 <révision>
+        header = writer_begin_message(writer, response->version, MPP_MESSAGE_RESPONSE);
+        writer_put_varint(writer, response->code);
+        writer_put_lstring(writer, response->username);
+        writer_put_varint(writer, response->musicIds != NULL);
+        if(response->musicIds != NULL) {
+            writer_put_varint(writer, response->musicIds->size);
+            // Les identifiants sont des dates proches : leurs écarts sont plus courts qu'eux
+            for(i = 0; i < response->musicIds->size; i++) {
+                writer_put_svarint(writer, response->musicIds->musicIds[i] - previous);
+                previous = response->musicIds->musicIds[i];
+            }
+        }
+        writer_put_varint(writer, response->music != NULL);
+        if(response->music != NULL && response->version >= MPP_VERSION_COMPRESSED) encode_compressed_music(writer, response->music);
+        else if(response->music != NULL) encode_binary_music(writer, response->music);
+        // <révision> : le client patchera la musique sur cette révision
+        if(response->version >= MPP_VERSION_DELTA) writer_put_varint(writer, response->revision);
+        writer_end_message(writer, header);
+        return writer->overflow ? -1 : 0;
+    }
+    writer_put_int(writer, response->code);
+    writer_put_char(writer, ' ');
+    writer_put_string(writer, response->username);
+    writer_put_char(writer, '\n');
     if(response->musicIds != NULL) {
-        sprintf(buffer, "%s%d\n", buffer, response->musicIds->size);
+        writer_put_int(writer, response->musicIds->size);
+        writer_put_char(writer, '\n');
         for(i = 0; i < response->musicIds->size; i++) {
-            sprintf(buffer, "%s%ld\n", buffer, response->musicIds->musicIds[i]);
+            writer_put_int(writer, response->musicIds->musicIds[i]);
+            writer_put_char(writer, '\n');
         }
-        sprintf(buffer, "%s", buffer);
     } else {
         // permet de discriminer les cas ou la liste est vide 
-        sprintf(buffer, "%s0\n", buffer);
+        writer_put_string(writer, "0\n");
     }
 
-    if(response->music != NULL) serialize_music(response->music, buffer);
+    if(response->music != NULL) encode_music(writer, response->music);
+    return writer->overflow ? -1 : 0;
 }
 
 /**
- * @fn deserialize_mpp_response(buffer_t buffer, mpp_response_t *response);
- * @brief Désérialise une réponse MPP
- * @param buffer Le buffer ou se trouve la réponse sérialisée
+ * @fn codec_error_t decode_mpp_response(reader_t *reader, mpp_response_t *response);
+ * @brief Désérialise une réponse MPP directement depuis le buffer d'un reader
+ * @param reader Le reader, placé au début de la réponse
  * @param response La réponse MPP à remplir
+ * @return CODEC_OK si la réponse est lue en entier, l'erreur sinon
+ * @note En cas d'erreur, la réponse reçoit le code MPP_RESPONSE_BAD_REQUEST et aucun autre champ
  */
-void deserialize_mpp_response(buffer_t buffer, mpp_response_t *response) {
-    // strtok n'est pas thread safe, on utilise strtok_r donc pour cela on doit déclarer un pointeur saveptr
-    // TODO : robustesse !!
-    char *saveptr = NULL;
-    char *bufferCp = malloc(strlen(buffer) + 1);
+codec_error_t decode_mpp_response(reader_t *reader, mpp_response_t *response) {
+    long code = MPP_RESPONSE_BAD_REQUEST, size = 0, musicId = 0;
+    unsigned long binaryCode = MPP_RESPONSE_BAD_REQUEST, binarySize = 0, hasList = 0, hasMusic = 0, revision = 0;
+    int version = MPP_VERSION_TEXT, type = MPP_MESSAGE_RESPONSE;
+    char username[USERNAME_SIZE];
+    musicId_list_t *musicIds = NULL;
+    music_t *music = NULL;
+    long delta;
     int i;
-    strcpy(bufferCp, buffer);
-    // lecture de la première ligne
-    char *token = strtok_r(buffer, "\n", &saveptr);
-    sscanf(token, "%d %s", (int *) &response->code, response->username);
-
-    // Creation de la liste de musiques 
-    token = strtok_r(NULL, "\n", &saveptr);
-    if(token != NULL) {
-        response->musicIds = (musicId_list_t *)malloc(sizeof(musicId_list_t));
-        init_music_list(response->musicIds);
-        int size;
-        sscanf(token, "%d", &size);
-        for(i = 0; i < size; i++) {
-            token = strtok_r(NULL, "\n", &saveptr);
-            time_t musicId;
-            sscanf(token, "%ld", &musicId);
-            add_music_id(response->musicIds, musicId);
+    if(codec_is_binary(reader->data + reader->position, reader->length - reader->position)) {
+        // En-tête puis <code> <username> <0 ou 1> [<list_size> <écarts entre identifiants>] <0 ou 1>
+        if(reader_get_header(reader, &version, &type) == CODEC_OK && (version < MPP_VERSION_BINARY || version > MPP_VERSION)) reader->error = CODEC_ERROR_RANGE;
+        if(reader->error == CODEC_OK && type != MPP_MESSAGE_RESPONSE) reader->error = CODEC_ERROR_SYNTAX;
+        reader_get_varint(reader, INT_MAX, &binaryCode);
+        reader_get_lstring(reader, username, sizeof(username));
+        code = binaryCode;
+        if(reader_get_varint(reader, 1, &hasList) == CODEC_OK && hasList) {
+            musicIds = (musicId_list_t *)malloc(sizeof(musicId_list_t));
+            CHECK_ALLOC(musicIds);
+            init_music_list(musicIds);
+            reader_get_varint(reader, INT_MAX, &binarySize);
+            for(i = 0; i < (long) binarySize && reader_get_svarint(reader, LONG_MIN, LONG_MAX, &delta) == CODEC_OK; i++) {
+                musicId += delta;
+                add_music_id(musicIds, musicId);
+            }
         }
-        // On lit la musique
-        token = strtok_r(NULL, "\n", &saveptr);
-        if(token != NULL) {
-            // On trouve ou commence la musique dans la copie du buffer
-            char *tokenCp = strstr(bufferCp, token);
-            response->music = (music_t *)malloc(sizeof(music_t));
-            init_music(response->music, 0);
-            deserialize_music(tokenCp, response->music);
-        } 
-        else response->music = NULL;
-
+        reader_get_varint(reader, 1, &hasMusic);
     } else {
-        // Si token est NULL, alors il n'y a pas de liste de musiques ni de musique
-        response->musicIds = NULL;
-        response->music = NULL;
+        // <code> <username>
+        reader_get_int(reader, INT_MIN, INT_MAX, &code);
+        reader_get_word(reader, username, sizeof(username));
+        reader_end_line(reader);
+        // Sans la suite, il n'y a pas de liste de musiques ni de musique
+        if(!reader_at_end(reader)) {
+            musicIds = (musicId_list_t *)malloc(sizeof(musicId_list_t));
+            CHECK_ALLOC(musicIds);
+            init_music_list(musicIds);
+            // <list_size> puis un identifiant par ligne
+            reader_get_int(reader, 0, INT_MAX, &size);
+            reader_end_line(reader);
+            for(i = 0; i < size && reader->error == CODEC_OK; i++) {
+                if(reader_get_int(reader, LONG_MIN, LONG_MAX, &musicId) == CODEC_OK) add_music_id(musicIds, musicId);
+                reader_end_line(reader);
+            }
+            hasMusic = !reader_at_end(reader);
+        }
+    }
+    if(hasMusic && reader->error == CODEC_OK) {
+        music = (music_t *)malloc(sizeof(music_t));
+        CHECK_ALLOC(music);
+        init_music(music, 0);
+        if(version >= MPP_VERSION_COMPRESSED) decode_compressed_music(reader, music);
+        else if(version == MPP_VERSION_BINARY) decode_binary_music(reader, music);
+        else decode_music(reader, music);
     }
-    free(bufferCp);
+    if(version >= MPP_VERSION_DELTA) reader_get_varint(reader, ULONG_MAX, &revision);
+    if(reader->error == CODEC_OK && version >= MPP_VERSION_BINARY && reader->position != reader->length) reader->error = CODEC_ERROR_SYNTAX;
+    if(reader->error != CODEC_OK) {
+        if(musicIds != NULL) {
+            free_music_list(musicIds);
+            free(musicIds);
+        }
+        if(music != NULL) {
+            free_music(music);
+            free(music);
+        }
+        *response = create_mpp_response(MPP_RESPONSE_BAD_REQUEST, "", NULL, NULL);
+        response->version = version;
+        return reader->error;
+    }
+    *response = create_mpp_response((mpp_response_code_t) code, username, music, musicIds);
+    response->revision = revision;
+    if(music != NULL) music->revision = revision;
+    response->version = version;
+    return CODEC_OK;
 }
 
 /**
@@ -286,6 +530,10 @@ char *code2str_request(mpp_request_code_t code) {
             strcpy(str, "Lister les musiques");
             break;
 
+        case MPP_PATCH_MUSIC:
+            strcpy(str, "Modifier une musique");
+            break;
+
         case MPP_CONNECT:
             strcpy(str, "Connexion");
             break;
@@ -333,6 +581,10 @@ char *code2str_response(mpp_response_code_t code) {
             strcpy(str, "La musique n'a pas été trouvée");
             break;
 
+        case MPP_RESPONSE_CONFLICT:
+            strcpy(str, "La musique a changé depuis la révision du patch");
+            break;
+
         default:
             strcpy(str, "Code inconnu");
             break;
@@ -419,21 +671,47 @@ void get_music_list_from_db(musicId_list_t *list, char *rfidId) {
 }
 
 /**
- * @fn add_music_to_db(music_t *music, char *rfidId);
+ * @fn add_music_to_db(music_t *music, char *rfidId, int overwrite, unsigned long *revision);
  * @brief Ajoute une musique à la base de données
- * @param music La musique à ajouter
+ * @param music La musique à ajouter, modifiée depuis music->revision, qui reçoit sa nouvelle révision une fois écrite
  * @param rfidId L'identifiant RFID de l'utilisateur
- * @return int 
+ * @param overwrite 1 pour remplacer la musique enregistrée même si elle a changé depuis music->revision
+ * @param revision Reçoit la nouvelle révision de la musique, ou sa révision enregistrée en cas de conflit
+ * @return MPP_RESPONSE_MUSIC_CREATED si la musique est enregistrée, MPP_RESPONSE_CONFLICT si elle a changé depuis
+ * music->revision sans overwrite, MPP_RESPONSE_NOT_FOUND si elle a été supprimée depuis sans overwrite et
+ * MPP_RESPONSE_NOK si son fichier ou la liste de l'utilisateur ne peuvent pas être écrits
+ * @note Si son fichier n'est pas écrit, la révision de la musique n'est pas modifiée
  */
-int add_music_to_db(music_t *music, char *rfidId) {
+mpp_response_code_t add_music_to_db(music_t *music, char *rfidId, int overwrite, unsigned long *revision) {
     char filename[255];
+    unsigned long base = music->revision;
+    FILE *file;
+
+    // On écrit la musique dans un fichier séparé, elle remplace la révision enregistrée
+    sprintf(filename, "%s/%s/%s/%ld.mipi", MPP_DB_FOLDER, MPP_DB_MUSIC_FOLDER, rfidId, music->date.tv_sec);
+    *revision = read_music_revision(filename);
+    // Comme pour un patch, une musique modifiée sur une révision dépassée ou supprimée depuis n'écrase rien sans
+    // l'accord de l'utilisateur
+    if(!overwrite && *revision != base) {
+        file = fopen(filename, "rb");
+        if(file == NULL) return MPP_RESPONSE_NOT_FOUND;
+        fclose(file);
+        return MPP_RESPONSE_CONFLICT;
+    }
+    music->revision = *revision + 1;
+    if(write_music_file(music, filename) == -1) {
+        music->revision = base;
+        return MPP_RESPONSE_NOK;
+    }
+    *revision = music->revision;
+
+    // On écrit l'identifiant de la musique dans la liste, seulement une fois son fichier écrit
     sprintf(filename, "%s/%s/%s/%s", MPP_DB_FOLDER, MPP_DB_MUSIC_FOLDER, rfidId, MPP_DB_MUSIC_FILE);
-    FILE *file = fopen(filename, "r+");
+    file = fopen(filename, "r+");
     if(file == NULL) {
         file = fopen(filename, "w+"); // On crée le fichier s'il n'existe pas
-        if(file == NULL) return -1;
+        if(file == NULL) return MPP_RESPONSE_NOK;
     }
-    // On écrit l'identifiant de la musique dans le fichier
     musicId_list_t list;
     read_list_music(&list, file);
     int music_exists = search_music(&list, music->date.tv_sec);
@@ -442,16 +720,44 @@ int add_music_to_db(music_t *music, char *rfidId) {
     fseek(file, 0, SEEK_SET); 
     write_list_music(&list, file);
     fclose(file);
+    free_music_list(&list);
+    return MPP_RESPONSE_MUSIC_CREATED;
+}
 
-    // On écrit la musique dans un fichier séparé
-    sprintf(filename, "%s/%s/%s/%ld.mipi", MPP_DB_FOLDER, MPP_DB_MUSIC_FOLDER, rfidId, music->date.tv_sec);
-    file = fopen(filename, "w");
-
-    if(file == NULL) return -1;
-
-    write_music(music, file);
+/**
+ * @fn patch_music_in_db(music_patch_t *patch, time_t musicId, char *rfidId, unsigned long *revision);
+ * @brief Applique un patch à une musique de la base de données
+ * @param patch Le patch
+ * @param musicId L'identifiant de la musique
+ * @param rfidId L'identifiant RFID de l'utilisateur
+ * @param revision Reçoit la nouvelle révision de la musique, ou sa révision enregistrée en cas de conflit
+ * @return MPP_RESPONSE_MUSIC_UPDATED si le patch est appliqué, MPP_RESPONSE_NOT_FOUND si la musique n'existe pas,
+ * MPP_RESPONSE_CONFLICT si elle a changé depuis patch->base, MPP_RESPONSE_BAD_REQUEST si le patch ne correspond pas
+ * à la musique et MPP_RESPONSE_NOK si le fichier ne peut pas être écrit
+ */
+mpp_response_code_t patch_music_in_db(music_patch_t *patch, time_t musicId, char *rfidId, unsigned long *revision) {
+    char filename[255];
+    mpp_response_code_t code;
+    codec_error_t error;
+    music_t music;
+    sprintf(filename, "%s/%s/%s/%ld.mipi", MPP_DB_FOLDER, MPP_DB_MUSIC_FOLDER, rfidId, musicId);
+    FILE *file = fopen(filename, "rb");
+    if(file == NULL) return MPP_RESPONSE_NOT_FOUND;
+    init_music(&music, 0);
+    error = read_music(&music, file);
     fclose(file);
-    return 0;
+    *revision = music.revision;
+    // La base de données est verrouillée pendant la requête : personne n'écrit la musique entre la lecture et l'écriture
+    if(error != CODEC_OK) code = MPP_RESPONSE_NOK;
+    else if(music.revision != patch->base) code = MPP_RESPONSE_CONFLICT;
+    else if(apply_music_patch(&music, patch) == -1) code = MPP_RESPONSE_BAD_REQUEST;
+    else {
+        music.revision++;
+        code = write_music_file(&music, filename) == 0 ? MPP_RESPONSE_MUSIC_UPDATED : MPP_RESPONSE_NOK;
+        if(code == MPP_RESPONSE_MUSIC_UPDATED) *revision = music.revision;
+    }
+    free_music(&music);
+    return code;
 }
 
 /**
@@ -554,6 +860,7 @@ void get_username_from_db(char *username, char *rfidId) {
  * @param response Réponse MPP à envoyer
  */
 void connect_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *response) {
+    (void)sd;
     // On vérifie que l'utilisateur est présent dans user.db
     get_username_from_db(response->username, request->rfidId);
     if(*response->username == '\0') {
@@ -573,6 +880,7 @@ void connect_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *respo
  * @warning La listes des musique doit être libérée après utilisation
  */
 void list_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *response) {
+    (void)sd;
     // On vérifie que l'utilisateur est présent dans user.db
     get_username_from_db(response->username, request->rfidId);
     if(*response->username == '\0') {
@@ -591,19 +899,39 @@ void list_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *re
  * @param sd Socket du client
  * @param request requête MPP reçue
  * @param response reponse MPP à envoyer
- * @note Un fichier est crée pour chaque musique dans le dossier de l'utilisateur
+ * @note Un fichier est crée pour chaque musique dans le dossier de l'utilisateur. Une musique enregistrée depuis la
+ * révision du client reçoit une réponse CONFLICT, sauf si la requête demande de l'écraser
  * @warning Si l'utilisateur n'existe pas, une reponse BAD_REQUEST est envoyée
  */
 void add_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *response) {
+    (void)sd;
     // On vérifie que l'utilisateur est présent dans user.db
     get_username_from_db(response->username, request->rfidId);
-    if(*response->username == '\0') {
+    if(*response->username == '\0' || request->music == NULL) {
+        CREATE_BAD_REQUEST(response);
+        return;
+    }
+    // On ajoute la musique à la base de données, si elle n'a pas changé depuis la révision du client
+    response->code = add_music_to_db(request->music, request->rfidId, request->overwrite, &response->revision);
+}
+
+/**
+ * @fn patch_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *response);
+ * @brief Gère une requête pour modifier quelques lignes d'une musique
+ * @param sd Socket du client
+ * @param request requête MPP reçue
+ * @param response reponse MPP à envoyer, avec la nouvelle révision de la musique
+ * @warning Si l'utilisateur n'existe pas, une reponse BAD_REQUEST est envoyée
+ */
+void patch_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *response) {
+    (void)sd;
+    // On vérifie que l'utilisateur est présent dans user.db
+    get_username_from_db(response->username, request->rfidId);
+    if(*response->username == '\0' || request->patch == NULL) {
         CREATE_BAD_REQUEST(response);
         return;
     }
-    // On ajoute la musique à la base de données
-    add_music_to_db(request->music, request->rfidId);
-    response->code = MPP_RESPONSE_MUSIC_CREATED;
+    response->code = patch_music_in_db(request->patch, request->musicId, request->rfidId, &response->revision);
 }
 
 /**
@@ -614,6 +942,7 @@ void add_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *res
  * @param response Réponse MPP à envoyer
  */
 void get_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *response) {
+    (void)sd;
     // On vérifie que l'utilisateur est présent dans user.db
     get_username_from_db(response->username, request->rfidId);
     if(*response->username == '\0') {
@@ -622,7 +951,9 @@ void get_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *res
     }
     // On récupère la musique de la base de données
     response->music = (music_t *)malloc(sizeof(music_t));
+    init_music(response->music, 0);
     get_music_from_db(response->music, request->musicId, request->rfidId);
+    response->revision = response->music->revision;
     response->code = MPP_RESPONSE_OK;
 }
 
@@ -634,6 +965,7 @@ void get_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *res
  * @param response Réponse MPP à envoyer
  */
 void delete_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *response) {
+    (void)sd;
     // On vérifie que l'utilisateur est présent dans user.db
     get_username_from_db(response->username, request->rfidId);
     if(*response->username == '\0') {
@@ -645,13 +977,92 @@ void delete_music_handler(socket_t *sd, mpp_request_t *request, mpp_response_t *
     response->code = MPP_RESPONSE_OK;
 }
 
+/**
+ * @fn init_music_patch(music_patch_t *patch, music_t *music);
+ * @brief Initialise un patch vide sur la révision d'une musique
+ * @param patch Le patch
+ * @param music La musique modifiée, dont le bpm et le nombre de lignes sont repris
+ * @note Le patch se libère avec free_music_patch
+ */
+void init_music_patch(music_patch_t *patch, music_t *music) {
+    int i;
+    patch->base = music->revision;
+    patch->bpm = music->bpm;
+    for(i = 0; i < MUSIC_MAX_CHANNELS; i++) patch->nbNotes[i] = music->channels[i].nbNotes;
+    patch->notes = NULL;
+    patch->size = 0;
+    patch->capacity = 0;
+}
+
+/**
+ * @fn add_music_patch_note(music_patch_t *patch, short channel, int line, packed_note_t note);
+ * @brief Ajoute une ligne modifiée à un patch
+ * @param patch Le patch
+ * @param channel Le channel
+ * @param line La ligne, après celles du même channel déjà ajoutées
+ * @param note La nouvelle note encodée
+ */
+void add_music_patch_note(music_patch_t *patch, short channel, int line, packed_note_t note) {
+    if(patch->size == patch->capacity) {
+        patch->capacity = patch->capacity > 0 ? 2 * patch->capacity : REALLLOC_SIZE;
+        patch->notes = (music_patch_note_t *)realloc(patch->notes, patch->capacity * sizeof(music_patch_note_t));
+        CHECK_ALLOC(patch->notes);
+    }
+    patch->notes[patch->size].channel = channel;
+    patch->notes[patch->size].line = line;
+    patch->notes[patch->size].note = note;
+    patch->size++;
+}
+
+/**
+ * @fn apply_music_patch(music_t *music, music_patch_t *patch);
+ * @brief Applique un patch à une musique
+ * @param music La musique
+ * @param patch Le patch
+ * @return 0 si la musique correspond au patch une fois modifiée, -1 sinon
+ */
+int apply_music_patch(music_t *music, music_patch_t *patch) {
+    channel_t *channel;
+    int i;
+    for(i = 0; i < patch->size; i++) {
+        channel = &music->channels[patch->notes[i].channel];
+        set_channel_note(channel, patch->notes[i].line, unpack_note(patch->notes[i].note));
+        update_channel_nbNotes(channel, patch->notes[i].line);
+    }
+    music->bpm = patch->bpm;
+    // Le nombre de lignes de chaque channel découle de ses notes : s'il diffère, le patch a été fait sur une autre musique
+    for(i = 0; i < MUSIC_MAX_CHANNELS; i++) {
+        if(patch->nbNotes[i] != -1 && patch->nbNotes[i] != music->channels[i].nbNotes) return -1;
+    }
+    return 0;
+}
+
+/**
+ * @fn free_music_patch(music_patch_t *patch);
+ * @brief Libère les lignes d'un patch
+ * @param patch Le patch
+ */
+void free_music_patch(music_patch_t *patch) {
+    free(patch->notes);
+    patch->notes = NULL;
+    patch->size = 0;
+    patch->capacity = 0;
+}
+
 /**
  * @fn free_request(mpp_request_t *request);
  * @brief Libère une requête MPP
  * @param request Requête MPP
  */
 void free_request(mpp_request_t *request) {
-    if(request->music != NULL) free(request->music);
+    if(request->music != NULL) {
+        free_music(request->music);
+        free(request->music);
+    }
+    if(request->patch != NULL) {
+        free_music_patch(request->patch);
+        free(request->patch);
+    }
     free(request);
 }
 
@@ -661,11 +1072,28 @@ void free_request(mpp_request_t *request) {
  * @param response Réponse MPP
  */
 void free_response(mpp_response_t *response) {
-    if(response->music != NULL) free(response->music);
-    if(response->musicIds != NULL) free_music_list(response->musicIds);
+    clear_response(response);
     free(response);
 }
 
+/**
+ * @fn clear_response(mpp_response_t *response);
+ * @brief Libère la musique et la liste d'une réponse MPP, sans la structure
+ * @param response Réponse MPP, reçue par exemple dans une variable locale
+ */
+void clear_response(mpp_response_t *response) {
+    if(response->music != NULL) {
+        free_music(response->music);
+        free(response->music);
+        response->music = NULL;
+    }
+    if(response->musicIds != NULL) {
+        free_music_list(response->musicIds);
+        free(response->musicIds);
+        response->musicIds = NULL;
+    }
+}
+
 /**
  * @fn void create_user_directories();
  * @brief Crée un répertoire pour les utilisateurs
@@ -698,71 +1126,433 @@ void create_user_directories() {
 /**********************************************************************************************************************/
 
 /**
- * @fn serialize_music(music_t *music, buffer_t buffer);
- * @brief Sérialise une musique
+ * @fn void encode_music(writer_t *writer, music_t *music);
+ * @brief Sérialise une musique à la suite d'un writer
+ * @param writer Le writer
  * @param music La musique à sérialiser
- * @param buffer Le buffer dans lequel sérialiser la musique
  * @note La musique est sérialisée de la manière suivante :
  * <date> <bpm>
- * <line> <noteid> <octave> <instrument> <time>
+ * <line> <noteid> <octave> <instrument> <time> <finetune>
  * ...
  * P
- * <line> <noteid> <octave> <instrument> <time>
+ * <line> <noteid> <octave> <instrument> <time> <finetune>
+ * R <block> <pattern>
  * ...
  * P
- * <line> <noteid> <octave> <instrument> <time>
+ * <line> <noteid> <octave> <instrument> <time> <finetune>
  * P
  * @warning La musique doit être initialisée avant d'appeler cette fonction
  */
-void serialize_music(music_t *music, buffer_t buffer) {
-    int i, j;
-    sprintf(buffer, "%s%ld %d\n", buffer, music->date.tv_sec, music->bpm);
-    // On parcourt chaque channel et on écrit seulement les notes non vides
-    for(i = 0; i < MUSIC_MAX_CHANNELS; i++) {
+void encode_music(writer_t *writer, music_t *music) {
+    int i, j, pattern;
+    note_t note;
+    writer_put_int(writer, music->date.tv_sec);
+    writer_put_char(writer, ' ');
+    writer_put_int(writer, music->bpm);
+    writer_put_char(writer, '\n');
+    // On parcourt chaque channel et on écrit seulement les notes non vides (les blocs vides sont sautés)
+    for(i = 0; i < MUSIC_MAX_CHANNELS && !writer->overflow; i++) {
         channel_t *channel = &music->channels[i];
-        for(j = 0; j < channel->nbNotes; j++) {
-            note_t *note = &channel->notes[j];
-            sprintf(buffer, "%s%d %d %d %d %d\n", buffer, j, note->id, note->octave, note->instrument, note->time);
+        for(j = next_channel_note(channel, 0); j != -1 && !writer->overflow; j = next_channel_note(channel, j + 1)) {
+            // Un bloc qui répète un motif déjà écrit tient en une ligne : R <début du bloc> <début du motif>
+            if((pattern = get_channel_pattern_line(channel, j)) != j) {
+                writer_put_string(writer, "R ");
+                writer_put_int(writer, j - j % NOTE_BLOCK_SIZE);
+                writer_put_char(writer, ' ');
+                writer_put_int(writer, pattern - pattern % NOTE_BLOCK_SIZE);
+                writer_put_char(writer, '\n');
+                j += NOTE_BLOCK_SIZE - j % NOTE_BLOCK_SIZE - 1;
+                continue;
+            }
+            note = get_channel_note(channel, j);
+            writer_put_int(writer, j);
+            writer_put_char(writer, ' ');
+            writer_put_int(writer, note.id);
+            writer_put_char(writer, ' ');
+            writer_put_int(writer, note.octave);
+            writer_put_char(writer, ' ');
+            writer_put_int(writer, note.instrument);
+            writer_put_char(writer, ' ');
+            writer_put_int(writer, note.time);
+            writer_put_char(writer, ' ');
+            writer_put_int(writer, note.fineTune);
+            writer_put_char(writer, '\n');
         }
         // On marque la fin du channel
-        sprintf(buffer, "%sP\n", buffer);
+        writer_put_string(writer, "P\n");
+    }
+}
+
+/**
+ * @fn codec_error_t decode_music(reader_t *reader, music_t *music);
+ * @brief Désérialise une musique (voir encode_music) directement depuis le buffer d'un reader
+ * @param reader Le reader, placé au début de la musique
+ * @param music La musique désérialisée
+ * @return L'erreur du reader, CODEC_OK si la musique est lue en entier
+ * @warning La musique doit être initialisée avant d'appeler cette fonction
+ */
+codec_error_t decode_music(reader_t *reader, music_t *music) {
+    long date = 0, bpm = 0, index = 0, pattern = 0, id = 0, octave = 0, instrument = 0, time = 0, fineTune = 0;
+    int channelCount, c;
+    note_t note;
+    reader_get_int(reader, LONG_MIN, LONG_MAX, &date);
+    reader_get_int(reader, 0, SHRT_MAX, &bpm);
+    if(reader_end_line(reader) != CODEC_OK) return reader->error;
+    music->date.tv_sec = date;
+    music->bpm = bpm;
+
+    for(channelCount = 0; channelCount < MUSIC_MAX_CHANNELS && !reader_at_end(reader); channelCount++) {
+        channel_t *channel = &music->channels[channelCount];
+        // Chaque ligne est décodée d'après son premier caractère, jusqu'au P de fin du channel
+        while((c = reader_peek(reader)) != 'P') {
+            if(c == -1) {
+                if(reader->error == CODEC_OK) reader->error = CODEC_ERROR_TRUNCATED;
+                return reader->error;
+            }
+            // Répétition d'un motif, écrit plus haut dans le channel
+            if(c == 'R') {
+                reader->position++;
+                reader_get_int(reader, 0, MPP_MAX_LINE, &index);
+                reader_get_int(reader, 0, MPP_MAX_LINE, &pattern);
+                if(reader_end_line(reader) != CODEC_OK) return reader->error;
+                link_channel_pattern(channel, index, pattern);
+                continue;
+            }
+            // <line> <noteid> <octave> <instrument> <time> [<finetune>] (l'accord fin est absent des anciennes musiques)
+            reader_get_int(reader, 0, MPP_MAX_LINE, &index);
+            reader_get_int(reader, 0, NB_NOTES - 1, &id);
+            reader_get_int(reader, 0, PACKED_NOTE_OCTAVE_MASK, &octave);
+            reader_get_int(reader, 0, PACKED_NOTE_INSTRUMENT_MASK, &instrument);
+            reader_get_int(reader, 0, PACKED_NOTE_TIME_MASK, &time);
+            fineTune = 0;
+            if((c = reader_peek(reader)) != '\n' && c != -1) reader_get_int(reader, SCHAR_MIN, SCHAR_MAX, &fineTune);
+            if(reader_end_line(reader) != CODEC_OK) return reader->error;
+            note = create_note(id, octave, (instrument_t) instrument, (time_duration_t) time);
+            note.fineTune = fineTune;
+            set_channel_note(channel, index, note);
+            update_channel_nbNotes(channel, index);
+        }
+        reader->position++;
+        reader_end_line(reader);
     }
+    return reader->error;
 }
 
 /**
- * @fn deserialize_music(char *token, music_t *music, char *saveptr);
- * @brief Désérialise une musique contenue dans un buffer
- * @param token La position dans le buffer ou se trouve la musique sérialisée
+ * @fn void encode_binary_music(writer_t *writer, music_t *music);
+ * @brief Sérialise une musique en MPP 2.0 à la suite d'un writer
+ * @param writer Le writer
+ * @param music La musique à sérialiser
+ */
+void encode_binary_music(writer_t *writer, music_t *music) {
+    const packed_note_t fields = ~((packed_note_t) PACKED_NOTE_FINETUNE_MASK << PACKED_NOTE_FINETUNE_SHIFT);
+    int i, j, pattern, previous;
+    note_t note;
+    writer_put_svarint(writer, music->date.tv_sec);
+    writer_put_varint(writer, music->bpm);
+    writer_put_varint(writer, MUSIC_MAX_CHANNELS);
+    for(i = 0; i < MUSIC_MAX_CHANNELS && !writer->overflow; i++) {
+        channel_t *channel = &music->channels[i];
+        // La taille annoncée permet au décodage d'allouer le channel une fois
+        writer_put_varint(writer, channel->nbNotes);
+        // Les lignes sont écrites dans l'ordre : seul l'écart avec la précédente est gardé, souvent 0
+        previous = -1;
+        for(j = next_channel_note(channel, 0); j != -1 && !writer->overflow; j = next_channel_note(channel, j + 1)) {
+            if((pattern = get_channel_pattern_line(channel, j)) != j) {
+                j -= j % NOTE_BLOCK_SIZE;
+                writer_put_varint(writer, (unsigned long) (j - previous - 1) << MPP_RECORD_BITS | MPP_RECORD_PATTERN);
+                writer_put_varint(writer, pattern / NOTE_BLOCK_SIZE);
+                previous = j += NOTE_BLOCK_SIZE - 1;
+                continue;
+            }
+            note = get_channel_note(channel, j);
+            writer_put_varint(writer, (unsigned long) (j - previous - 1) << MPP_RECORD_BITS | (note.fineTune != 0 ? MPP_RECORD_FINETUNE : MPP_RECORD_NOTE));
+            // Note, octave, durée et instrument tiennent dans les 24 bits de poids faible de la note encodée
+            writer_put_varint(writer, pack_note(note) & fields);
+            if(note.fineTune != 0) writer_put_svarint(writer, note.fineTune);
+            previous = j;
+        }
+        writer_put_varint(writer, MPP_RECORD_END);
+    }
+}
+
+/**
+ * @fn codec_error_t decode_binary_music(reader_t *reader, music_t *music);
+ * @brief Désérialise une musique en MPP 2.0 (voir encode_binary_music) directement depuis le buffer d'un reader
+ * @param reader Le reader, placé au début de la musique
  * @param music La musique désérialisée
+ * @return L'erreur du reader, CODEC_OK si la musique est lue en entier
  * @warning La musique doit être initialisée avant d'appeler cette fonction
  */
-void deserialize_music(char *token, music_t *music) {
-    int channelCount = 0;
-    char *line = NULL;
-    char *saveptr = NULL;
-    scale_t scale = init_scale();
-    line = strtok_r(token, "\n", &saveptr);
-    sscanf(line, "%ld %hd", &music->date.tv_sec, &music->bpm);
-
-    while (line != NULL && channelCount < MUSIC_MAX_CHANNELS) {
-        line = strtok_r(NULL, "\n", &saveptr);
-        if (line != NULL) {
-            int channelId = channelCount;
-            channel_t *channel = &music->channels[channelId];
-            while (line != NULL && *line != 'P') {
-                int index = 0;
-                // on récupère d'abord la ligne
-                sscanf(line, "%d", &index);
-                // on récupère les notes
-                note_t *note = &channel->notes[index];
-                sscanf(line, "%d %hd %hd %d %d", &index, &note->id, &note->octave, (int *)&note->instrument, (int *)&note->time);
-                note->frequency = get_note_freq(note, &scale);
-                update_channel_nbNotes(channel, index);
-                line = strtok_r(NULL, "\n", &saveptr);
+codec_error_t decode_binary_music(reader_t *reader, music_t *music) {
+    unsigned long bpm = 0, channels = 0, lines = 0, record = MPP_RECORD_END, value = 0;
+    long date = 0, fineTune, line;
+    int i, runStart = 0, runCount;
+    packed_note_t run[MPP_DECODE_RUN];
+    note_t note;
+    reader_get_svarint(reader, LONG_MIN, LONG_MAX, &date);
+    reader_get_varint(reader, SHRT_MAX, &bpm);
+    reader_get_varint(reader, MUSIC_MAX_CHANNELS, &channels);
+    if(reader->error != CODEC_OK) return reader->error;
+    music->date.tv_sec = date;
+    music->bpm = bpm;
+
+    for(i = 0; i < (int) channels; i++) {
+        channel_t *channel = &music->channels[i];
+        line = -1;
+        runCount = 0;
+        if(reader_get_varint(reader, MPP_MAX_LINE + 1, &lines) != CODEC_OK) return reader->error;
+        reserve_channel_lines(channel, lines);
+        while(reader_get_varint(reader, (unsigned long) (MPP_MAX_LINE + 1) << MPP_RECORD_BITS | MPP_RECORD_END, &record) == CODEC_OK
+              && (record & ((1 << MPP_RECORD_BITS) - 1)) != MPP_RECORD_END) {
+            line += (long) (record >> MPP_RECORD_BITS) + 1;
+            if(line > MPP_MAX_LINE) return reader->error = CODEC_ERROR_RANGE;
+            if((record & ((1 << MPP_RECORD_BITS) - 1)) == MPP_RECORD_PATTERN) {
+                if(reader_get_varint(reader, MPP_MAX_LINE / NOTE_BLOCK_SIZE, &value) != CODEC_OK) return reader->error;
+                if(runCount > 0) set_channel_range(channel, runStart, runCount, run);
+                runCount = 0;
+                link_channel_pattern(channel, line, value * NOTE_BLOCK_SIZE);
+                line += NOTE_BLOCK_SIZE - 1;
+                continue;
+            }
+            fineTune = 0;
+            reader_get_varint(reader, ((packed_note_t) 1 << PACKED_NOTE_FINETUNE_SHIFT) - 1, &value);
+            if((record & ((1 << MPP_RECORD_BITS) - 1)) == MPP_RECORD_FINETUNE) reader_get_svarint(reader, SCHAR_MIN, SCHAR_MAX, &fineTune);
+            if(reader->error != CODEC_OK) return reader->error;
+            note = unpack_note(value);
+            if(note.id >= NB_NOTES) return reader->error = CODEC_ERROR_RANGE;
+            note.fineTune = fineTune;
+            // Les notes sont écrites par suites de lignes : l'index des durées est mis à jour une fois par suite
+            if(runCount > 0 && line - runStart >= MPP_DECODE_RUN) {
+                set_channel_range(channel, runStart, runCount, run);
+                runCount = 0;
             }
-            channelCount++;
+            if(runCount == 0) runStart = line;
+            // Les lignes sautées sont vides
+            while(runStart + runCount < line) run[runCount++] = PACKED_NOTE_EMPTY;
+            run[runCount++] = pack_note(note);
         }
+        if(reader->error != CODEC_OK) return reader->error;
+        if(runCount > 0) set_channel_range(channel, runStart, runCount, run);
     }
+    return reader->error;
+}
+
+/**
+ * @fn void encode_compressed_music(writer_t *writer, music_t *music);
+ * @brief Sérialise une musique en MPP 2.1 à la suite d'un writer
+ * @param writer Le writer
+ * @param music La musique à sérialiser
+ */
+void encode_compressed_music(writer_t *writer, music_t *music) {
+    rle_writer_t columns[MPP_COLUMNS];
+    writer_t block;
+    int i, j, c, pattern, previous, records;
+    note_t note;
+    writer_put_svarint(writer, music->date.tv_sec);
+    writer_put_varint(writer, music->bpm);
+    writer_put_varint(writer, MUSIC_MAX_CHANNELS);
+    // Les channels sont écrits en clair dans un bloc compressé d'un coup : les channels qui se ressemblent se compressent ensemble
+    init_writer(&block, NULL, 0);
+    for(i = 0; i < MUSIC_MAX_CHANNELS; i++) {
+        channel_t *channel = &music->channels[i];
+        for(c = 0; c < MPP_COLUMNS; c++) init_rle_writer(&columns[c]);
+        previous = -1;
+        records = 0;
+        for(j = next_channel_note(channel, 0); j != -1; j = next_channel_note(channel, j + 1), records++) {
+            if((pattern = get_channel_pattern_line(channel, j)) != j) {
+                j -= j % NOTE_BLOCK_SIZE;
+                rle_put(&columns[MPP_COLUMN_RECORDS], (unsigned long) (j - previous - 1) << MPP_RECORD_BITS | MPP_RECORD_PATTERN);
+                rle_put(&columns[MPP_COLUMN_PATTERNS], pattern / NOTE_BLOCK_SIZE);
+                previous = j += NOTE_BLOCK_SIZE - 1;
+                continue;
+            }
+            note = get_channel_note(channel, j);
+            rle_put(&columns[MPP_COLUMN_RECORDS], (unsigned long) (j - previous - 1) << MPP_RECORD_BITS | (note.fineTune != 0 ? MPP_RECORD_FINETUNE : MPP_RECORD_NOTE));
+            rle_put(&columns[MPP_COLUMN_IDS], note.id);
+            rle_put(&columns[MPP_COLUMN_OCTAVES], note.octave & PACKED_NOTE_OCTAVE_MASK);
+            rle_put(&columns[MPP_COLUMN_INSTRUMENTS], note.instrument & PACKED_NOTE_INSTRUMENT_MASK);
+            rle_put(&columns[MPP_COLUMN_TIMES], note.time & PACKED_NOTE_TIME_MASK);
+            if(note.fineTune != 0) rle_put(&columns[MPP_COLUMN_FINETUNES], (unsigned char) note.fineTune);
+            previous = j;
+        }
+        // <lignes> <enregistrements> <taille de chaque colonne> <colonnes>
+        writer_put_varint(&block, channel->nbNotes);
+        writer_put_varint(&block, records);
+        for(c = 0; c < MPP_COLUMNS; c++) {
+            rle_flush(&columns[c]);
+            writer_put_varint(&block, columns[c].writer.length);
+        }
+        for(c = 0; c < MPP_COLUMNS; c++) {
+            writer_put_bytes(&block, columns[c].writer.data, columns[c].writer.length);
+            free_rle_writer(&columns[c]);
+        }
+    }
+    writer_put_lz(writer, block.data, block.length);
+    free_writer(&block);
+}
+
+/**
+ * @fn codec_error_t get_compressed_note(rle_reader_t *columns, int finetune, packed_note_t *packed);
+ * @brief Lit les champs d'une note dans les colonnes d'un channel compressé
+ * @param columns Les colonnes du channel
+ * @param finetune 1 si la note a un accord fin
+ * @param packed Reçoit la note encodée
+ * @return La première erreur des colonnes, CODEC_OK si la note est lue
+ */
+codec_error_t get_compressed_note(rle_reader_t *columns, int finetune, packed_note_t *packed) {
+    unsigned long id, octave, instrument, time, fineTune = 0;
+    if(RLE_GET(&columns[MPP_COLUMN_IDS], NB_NOTES - 1, &id) != CODEC_OK) return columns[MPP_COLUMN_IDS].reader.error;
+    if(RLE_GET(&columns[MPP_COLUMN_OCTAVES], PACKED_NOTE_OCTAVE_MASK, &octave) != CODEC_OK) return columns[MPP_COLUMN_OCTAVES].reader.error;
+    if(RLE_GET(&columns[MPP_COLUMN_INSTRUMENTS], PACKED_NOTE_INSTRUMENT_MASK, &instrument) != CODEC_OK) return columns[MPP_COLUMN_INSTRUMENTS].reader.error;
+    if(RLE_GET(&columns[MPP_COLUMN_TIMES], PACKED_NOTE_TIME_MASK, &time) != CODEC_OK) return columns[MPP_COLUMN_TIMES].reader.error;
+    if(finetune && RLE_GET(&columns[MPP_COLUMN_FINETUNES], PACKED_NOTE_FINETUNE_MASK, &fineTune) != CODEC_OK) return columns[MPP_COLUMN_FINETUNES].reader.error;
+    // Les champs sont rangés directement dans la note encodée, sans passer par note_t
+    *packed = (packed_note_t) id << PACKED_NOTE_ID_SHIFT | (packed_note_t) octave << PACKED_NOTE_OCTAVE_SHIFT
+        | (packed_note_t) time << PACKED_NOTE_TIME_SHIFT | (packed_note_t) instrument << PACKED_NOTE_INSTRUMENT_SHIFT
+        | (packed_note_t) fineTune << PACKED_NOTE_FINETUNE_SHIFT;
+    return CODEC_OK;
+}
+
+/**
+ * @fn codec_error_t decode_compressed_music(reader_t *reader, music_t *music);
+ * @brief Désérialise une musique en MPP 2.1 (voir encode_compressed_music) depuis le buffer d'un reader
+ * @param reader Le reader, placé au début de la musique
+ * @param music La musique désérialisée
+ * @return L'erreur du reader, CODEC_OK si la musique est lue en entier
+ * @warning La musique doit être initialisée avant d'appeler cette fonction
+ */
+codec_error_t decode_compressed_music(reader_t *reader, music_t *music) {
+    unsigned long bpm = 0, channels = 0, lines = 0, records = 0, record = 0, value = 0, sizes[MPP_COLUMNS];
+    long date = 0, line;
+    int i, c, runStart = 0, runCount;
+    rle_reader_t columns[MPP_COLUMNS];
+    packed_note_t run[MPP_DECODE_RUN], packed;
+    reader_t block;
+    codec_error_t error = CODEC_OK;
+    char *data;
+    size_t length;
+    reader_get_svarint(reader, LONG_MIN, LONG_MAX, &date);
+    reader_get_varint(reader, SHRT_MAX, &bpm);
+    reader_get_varint(reader, MUSIC_MAX_CHANNELS, &channels);
+    if(reader_get_lz(reader, MPP_MAX_COMPRESSED, &data, &length) != CODEC_OK) return reader->error;
+    music->date.tv_sec = date;
+    music->bpm = bpm;
+
+    init_reader(&block, data, length);
+    for(i = 0; i < (int) channels && error == CODEC_OK; i++) {
+        channel_t *channel = &music->channels[i];
+        line = -1;
+        runCount = 0;
+        reader_get_varint(&block, MPP_MAX_LINE + 1, &lines);
+        reader_get_varint(&block, MPP_MAX_LINE + 1, &records);
+        for(c = 0; c < MPP_COLUMNS; c++) reader_get_varint(&block, length, &sizes[c]);
+        // Chaque colonne a son propre reader, limité à ses octets
+        for(c = 0; c < MPP_COLUMNS && block.error == CODEC_OK; c++) {
+            if(sizes[c] > block.length - block.position) block.error = CODEC_ERROR_TRUNCATED;
+            else init_rle_reader(&columns[c], block.data + block.position, sizes[c]);
+            block.position += sizes[c];
+        }
+        if((error = block.error) != CODEC_OK) break;
+        reserve_channel_lines(channel, lines);
+        for(; records > 0 && error == CODEC_OK; records--) {
+            if((error = RLE_GET(&columns[MPP_COLUMN_RECORDS], (unsigned long) (MPP_MAX_LINE + 1) << MPP_RECORD_BITS | MPP_RECORD_PATTERN, &record)) != CODEC_OK) break;
+            line += (long) (record >> MPP_RECORD_BITS) + 1;
+            if(line > MPP_MAX_LINE || (record & ((1 << MPP_RECORD_BITS) - 1)) == MPP_RECORD_END) {
+                error = CODEC_ERROR_RANGE;
+                break;
+            }
+            if((record & ((1 << MPP_RECORD_BITS) - 1)) == MPP_RECORD_PATTERN) {
+                if((error = rle_get(&columns[MPP_COLUMN_PATTERNS], MPP_MAX_LINE / NOTE_BLOCK_SIZE, &value)) != CODEC_OK) break;
+                if(runCount > 0) set_channel_range(channel, runStart, runCount, run);
+                runCount = 0;
+                link_channel_pattern(channel, line, value * NOTE_BLOCK_SIZE);
+                line += NOTE_BLOCK_SIZE - 1;
+                continue;
+            }
+            if((error = get_compressed_note(columns, (record & ((1 << MPP_RECORD_BITS) - 1)) == MPP_RECORD_FINETUNE, &packed)) != CODEC_OK) break;
+            // Mêmes suites de lignes que decode_binary_music
+            if(runCount > 0 && line - runStart >= MPP_DECODE_RUN) {
+                set_channel_range(channel, runStart, runCount, run);
+                runCount = 0;
+            }
+            if(runCount == 0) runStart = line;
+            while(runStart + runCount < line) run[runCount++] = PACKED_NOTE_EMPTY;
+            run[runCount++] = packed;
+        }
+        if(runCount > 0) set_channel_range(channel, runStart, runCount, run);
+    }
+    // Le bloc est lu en entier, rien ne doit rester après le dernier channel
+    if(error == CODEC_OK && block.position != block.length) error = CODEC_ERROR_SYNTAX;
+    buffer_pool_release(data);
+    if(error != CODEC_OK) reader->error = error;
+    return reader->error;
+}
+
+/**
+ * @fn void encode_music_patch(writer_t *writer, music_patch_t *patch);
+ * @brief Sérialise un patch en MPP 2.2 à la suite d'un writer
+ * @param writer Le writer
+ * @param patch Le patch à sérialiser
+ * @note Les lignes du patch doivent être rangées par channel puis par ligne (voir add_music_patch_note)
+ */
+void encode_music_patch(writer_t *writer, music_patch_t *patch) {
+    int i, first = 0, last, previous;
+    writer_put_varint(writer, patch->base);
+    writer_put_varint(writer, patch->bpm);
+    writer_put_varint(writer, MUSIC_MAX_CHANNELS);
+    for(i = 0; i < MUSIC_MAX_CHANNELS && !writer->overflow; i++) {
+        // Les lignes du channel se suivent dans le patch
+        for(last = first; last < patch->size && patch->notes[last].channel == i; last++);
+        writer_put_varint(writer, patch->nbNotes[i]);
+        writer_put_varint(writer, last - first);
+        for(previous = -1; first < last; first++) {
+            writer_put_varint(writer, patch->notes[first].line - previous - 1);
+            writer_put_varint(writer, patch->notes[first].note);
+            previous = patch->notes[first].line;
+        }
+    }
+}
+
+/**
+ * @fn codec_error_t decode_music_patch(reader_t *reader, music_patch_t *patch);
+ * @brief Désérialise un patch en MPP 2.2 (voir encode_music_patch) depuis le buffer d'un reader
+ * @param reader Le reader, placé au début du patch
+ * @param patch Le patch, initialisé par la fonction
+ * @return L'erreur du reader, CODEC_OK si le patch est lu en entier
+ * @note Le patch se libère avec free_music_patch, même en cas d'erreur
+ */
+codec_error_t decode_music_patch(reader_t *reader, music_patch_t *patch) {
+    unsigned long base = 0, bpm = 0, channels = 0, lines = 0, count = 0, gap = 0, value = 0;
+    long line;
+    int i;
+    patch->notes = NULL;
+    patch->size = 0;
+    patch->capacity = 0;
+    // Un channel absent du patch n'est pas vérifié (voir apply_music_patch)
+    for(i = 0; i < MUSIC_MAX_CHANNELS; i++) patch->nbNotes[i] = -1;
+    reader_get_varint(reader, ULONG_MAX, &base);
+    reader_get_varint(reader, SHRT_MAX, &bpm);
+    reader_get_varint(reader, MUSIC_MAX_CHANNELS, &channels);
+    patch->base = base;
+    patch->bpm = bpm;
+    for(i = 0; i < (int) channels && reader->error == CODEC_OK; i++) {
+        reader_get_varint(reader, MPP_MAX_LINE + 1, &lines);
+        // Le nombre de lignes est borné avant d'allouer quoi que ce soit
+        if(reader_get_varint(reader, MPP_MAX_PATCH_NOTES - patch->size, &count) != CODEC_OK) break;
+        patch->nbNotes[i] = lines;
+        for(line = -1; count > 0; count--) {
+            reader_get_varint(reader, MPP_MAX_LINE, &gap);
+            if(reader_get_varint(reader, (packed_note_t) ~0, &value) != CODEC_OK) break;
+            line += (long) gap + 1;
+            if(line > MPP_MAX_LINE || unpack_note(value).id >= NB_NOTES) {
+                reader->error = CODEC_ERROR_RANGE;
+                break;
+            }
+            add_music_patch_note(patch, i, line, value);
+        }
+    }
+    return reader->error;
 }
 
 /**
@@ -800,33 +1590,104 @@ void read_list_music(musicId_list_t *list, FILE *file) {
  * @fn void write_music(music_t *music, FILE *file);
  * @param music  La musique à écrire
  * @param file   Le fichier dans lequel écrire la musique
+ * @note Le fichier commence par MPP_FILE_MAGIC et MPP_FILE_REVISED, suivis de la révision et de la musique compressée
  */
 void write_music(music_t *music, FILE *file) {
     // On change de stragégie pour l'écriture des musiques
     // On écrit la version sérialisée de la musique dans le fichier
     // Plus légère et plus modulaire (si la structure de la musique change, on pourra toujours lire les anciennes musiques)
     //fwrite(music, sizeof(music_t), 1, file);
-    char *buffer = (char *) malloc(sizeof(buffer_t));
-    serialize_music(music, buffer);
-    fprintf(file, "%s", buffer);
-    free(buffer);
+    // Le fichier n'est pas borné comme un message MPP : le buffer grandit avec la musique
+    writer_t writer;
+    init_writer(&writer, NULL, 0);
+    // <magic> <format> <révision> puis la musique compressée, les anciens fichiers restent lisibles (voir read_music)
+    writer_put_bytes(&writer, MPP_FILE_MAGIC, MPP_FILE_MAGIC_SIZE);
+    writer_put_char(&writer, MPP_FILE_REVISED);
+    writer_put_varint(&writer, music->revision);
+    encode_compressed_music(&writer, music);
+    fwrite(writer.data, 1, writer.length, file);
+    free_writer(&writer);
 }
 
 /**
- * @fn void read_music(music_t *music, FILE *file);
+ * @fn codec_error_t read_music(music_t *music, FILE *file);
  * @brief Lit une musique depuis un fichier 
- * @param music La musique à remplir
+ * @param music La musique à remplir, avec sa révision (0 pour un fichier écrit avant les révisions)
  * @param file Le fichier depuis lequel lire la musique
+ * @return CODEC_OK si la musique est lue en entier, l'erreur sinon
  */
-void read_music(music_t *music, FILE *file) {
+codec_error_t read_music(music_t *music, FILE *file) {
     // On change de stragégie pour la lecture des musiques
     // On lit la version sérialisée de la musique dans le fichier
     // Plus légère et plus modulaire (si la structure de la musique change, on pourra toujours lire les anciennes musiques)
-    char *buffer = (char *) malloc(sizeof(buffer_t));
-    fread(buffer, sizeof(buffer_t), 1, file);
-    fprintf(stderr, "READ_MUSIC : %s\n", buffer);
-    fflush(stderr);
-    deserialize_music(buffer, music);
-    free(buffer);
+    reader_t reader;
+    long size;
+    char *buffer;
+    // Le fichier est lu en entier, dans un buffer de la réserve : il n'est pas borné comme un message MPP
+    if(fseek(file, 0, SEEK_END) == -1 || (size = ftell(file)) < 0) return CODEC_ERROR_TRUNCATED;
+    fseek(file, 0, SEEK_SET);
+    buffer = buffer_pool_get(size + 1);
+    size = fread(buffer, 1, size, file);
+    init_reader(&reader, buffer, size);
+    music->revision = 0;
+    if(size > MPP_FILE_MAGIC_SIZE && memcmp(buffer, MPP_FILE_MAGIC, MPP_FILE_MAGIC_SIZE) == 0) {
+        reader.position = MPP_FILE_MAGIC_SIZE + 1;
+        // Un fichier MPP_FILE_COMPRESSED a été écrit avant les révisions
+        if(buffer[MPP_FILE_MAGIC_SIZE] == MPP_FILE_REVISED) reader_get_varint(&reader, ULONG_MAX, &music->revision);
+        else if(buffer[MPP_FILE_MAGIC_SIZE] != MPP_FILE_COMPRESSED) reader.error = CODEC_ERROR_RANGE;
+        if(reader.error == CODEC_OK) decode_compressed_music(&reader, music);
+    } else {
+        // Fichier écrit avant la compression : la musique est en texte
+        decode_music(&reader, music);
+    }
+    if(reader.error != CODEC_OK) fprintf(stderr, "Musique illisible : %s\n", codec_error2str(reader.error));
+    buffer_pool_release(buffer);
+    return reader.error;
+}
+
+/**
+ * @fn int write_music_file(music_t *music, const char *filename);
+ * @brief Remplace le fichier d'une musique d'un coup
+ * @param music La musique à écrire
+ * @param filename Le chemin du fichier
+ * @return 0 si le fichier est remplacé, -1 sinon (l'ancien fichier est alors intact)
+ */
+int write_music_file(music_t *music, const char *filename) {
+    char tmpname[260];
+    int error;
+    sprintf(tmpname, "%s.tmp", filename);
+    FILE *file = fopen(tmpname, "wb");
+    if(file == NULL) return -1;
+    write_music(music, file);
+    error = ferror(file);
+    // rename remplace l'ancien fichier en une opération : un lecteur voit l'ancienne musique ou la nouvelle
+    if(fclose(file) != 0 || error || rename(tmpname, filename) == -1) {
+        remove(tmpname);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @fn unsigned long read_music_revision(const char *filename);
+ * @brief Lit la révision d'une musique enregistrée, sans lire ses notes
+ * @param filename Le chemin du fichier
+ * @return La révision, 0 si le fichier n'existe pas ou a été écrit avant les révisions
+ */
+unsigned long read_music_revision(const char *filename) {
+    char header[MPP_FILE_MAGIC_SIZE + 1 + 10];
+    unsigned long revision = 0;
+    reader_t reader;
+    size_t size;
+    FILE *file = fopen(filename, "rb");
+    if(file == NULL) return 0;
+    // <magic> <format> <révision en varint> : les premiers octets suffisent
+    size = fread(header, 1, sizeof(header), file);
+    fclose(file);
+    if(size <= MPP_FILE_MAGIC_SIZE || memcmp(header, MPP_FILE_MAGIC, MPP_FILE_MAGIC_SIZE) != 0 || header[MPP_FILE_MAGIC_SIZE] != MPP_FILE_REVISED) return 0;
+    init_reader(&reader, header, size);
+    reader.position = MPP_FILE_MAGIC_SIZE + 1;
+    reader_get_varint(&reader, ULONG_MAX, &revision);
+    return revision;
 }
 
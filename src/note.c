@@ -9,49 +9,715 @@
 /*                   E N T Ê T E S    S T A N D A R D S                     */
 /* ------------------------------------------------------------------------ */
 #include "note.h"
+#include "instrument.h"
+#include "renderCache.h"
 
+/* ------------------------------------------------------------------------ */
+/*                     V A R I A B L E S   G L O B A L E S                  */
+/* ------------------------------------------------------------------------ */
+static double pitchTable[NB_NOTES][NOTE_OCTAVE_NB][2 * NOTE_FINETUNE_MAX + 1]; /*!< Fréquence par note, octave et accord fin */
+static pthread_once_t pitchTableOnce = PTHREAD_ONCE_INIT; /*!< La table n'est construite qu'une fois, quel que soit le thread */
+
+/* ------------------------------------------------------------------------ */
+/*                   F O N C T I O N S   P R I V É E S                      */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn void init_pitch_table()
+ * \brief Calcule la fréquence de toutes les notes, à toutes les octaves et tous les accords fins
+ */
+static void init_pitch_table() {
+	scale_t scale = init_scale();
+	int id, octave, fineTune;
+	double octaveFreq;
+
+	for (id = 0; id < NB_NOTES; id++) {
+		for (octave = 0; octave < NOTE_OCTAVE_NB; octave++) {
+			octaveFreq = scale.freqScale[id] * pow(2, octave - REF_OCTAVE);
+			for (fineTune = -NOTE_FINETUNE_MAX; fineTune <= NOTE_FINETUNE_MAX; fineTune++) {
+				pitchTable[id][octave][fineTune + NOTE_FINETUNE_MAX] = octaveFreq * pow(2, fineTune / (12.0 * NOTE_FINETUNE_STEPS));
+			}
+		}
+	}
+}
+
+/**
+ * \fn const note_block_t *find_block(const channel_t *channel, int index)
+ * \brief Récupère le bloc qui contient une ligne
+ * \return Le bloc ou NULL s'il n'a jamais été écrit
+ */
+static const note_block_t *find_block(const channel_t *channel, int index) {
+	int block = index / NOTE_BLOCK_SIZE;
+	if (index < 0 || block >= channel->nbBlocks) return NULL;
+	return channel->blocks[block];
+}
+
+/**
+ * \fn int time_class(packed_note_t packed)
+ * \brief Classe de durée d'une note encodée (la durée vaut 1 << classe)
+ */
+static int time_class(packed_note_t packed) {
+	int time = (packed >> PACKED_NOTE_TIME_SHIFT) & PACKED_NOTE_TIME_MASK;
+	int class = 0;
+	while (class < NOTE_TIME_CLASSES - 1 && (1 << class) < time) class++;
+	return class;
+}
+
+/**
+ * \fn void rebuild_timeline(channel_t *channel)
+ * \brief Reconstruit l'arbre des durées sur toutes les lignes de l'index, en temps linéaire
+ * \note Appelée quand l'index grandit, donc un nombre logarithmique de fois
+ */
+static void rebuild_timeline(channel_t *channel) {
+	int size = channel->nbBlocks * NOTE_BLOCK_SIZE;
+	int i, j, c;
+	const note_block_t *block;
+
+	channel->timeline = realloc(channel->timeline, (size + 1) * sizeof(*channel->timeline));
+	CHECK_ALLOC(channel->timeline);
+	memset(channel->timeline, 0, (size + 1) * sizeof(*channel->timeline));
+	for (i = 1; i <= size; i++) {
+		block = channel->blocks[(i - 1) / NOTE_BLOCK_SIZE];
+		channel->timeline[i][time_class(block != NULL ? block->notes[(i - 1) % NOTE_BLOCK_SIZE] : PACKED_NOTE_EMPTY)]++;
+		// Chaque noeud remonte ses comptes à son parent
+		j = i + (i & -i);
+		if (j <= size) {
+			for (c = 0; c < NOTE_TIME_CLASSES; c++) channel->timeline[j][c] += channel->timeline[i][c];
+		}
+	}
+}
+
+/**
+ * \fn void update_timeline(channel_t *channel, int line, int class, int delta)
+ * \brief Ajoute delta au nombre de lignes d'une durée, à partir d'une ligne
+ */
+static void update_timeline(channel_t *channel, int line, int class, int delta) {
+	int size = channel->nbBlocks * NOTE_BLOCK_SIZE;
+	int i;
+	if (channel->timeline == NULL) return;
+	for (i = line + 1; i <= size; i += i & -i) channel->timeline[i][class] += delta;
+}
+
+/**
+ * \fn packed_note_t get_packed_note(const channel_t *channel, int index)
+ * \brief Récupère une ligne encodée, PACKED_NOTE_EMPTY hors des blocs alloués
+ */
+static packed_note_t get_packed_note(const channel_t *channel, int index) {
+	const note_block_t *block = find_block(channel, index);
+	return block != NULL ? block->notes[index % NOTE_BLOCK_SIZE] : PACKED_NOTE_EMPTY;
+}
+
+/**
+ * \fn void release_block(note_block_t *block)
+ * \brief Rend une référence sur un bloc, le libère s'il n'est plus partagé
+ * \note Le compteur est atomique : une version jouée peut rendre ses blocs pendant une édition
+ */
+static void release_block(note_block_t *block) {
+	if (block != NULL && __atomic_sub_fetch(&block->refs, 1, __ATOMIC_ACQ_REL) == 0) free(block);
+}
+
+/**
+ * \fn void unlink_pattern(channel_t *channel, int block)
+ * \brief Sort un bloc de l'index du groupe des blocs qui désignent le même motif, avant de le remplacer
+ * \note Si le bloc était la première occurrence d'un motif répété, la répétition suivante prend sa place :
+ * l'index n'est parcouru que dans ce cas
+ */
+static void unlink_pattern(channel_t *channel, int block) {
+	int first = channel->patterns[block];
+	int i, next = -1;
+
+	if (first != block) {
+		channel->repeats[first]--;
+	} else if (channel->repeats[block] > 0) {
+		for (i = block + 1; i < channel->nbBlocks; i++) {
+			if (channel->patterns[i] != block) continue;
+			if (next == -1) {
+				next = i;
+				channel->repeats[next] = channel->repeats[block] - 1;
+			}
+			channel->patterns[i] = next;
+		}
+	}
+	channel->patterns[block] = block;
+	channel->repeats[block] = 0;
+}
+
+/**
+ * \fn void link_pattern(channel_t *channel, int block, int first)
+ * \brief Ajoute un bloc de l'index au groupe des blocs qui désignent le même motif
+ * \note Un bloc placé avant la première occurrence du motif devient la première occurrence : seul ce cas
+ * parcourt l'index
+ */
+static void link_pattern(channel_t *channel, int block, int first) {
+	int i;
+
+	if (first < block) {
+		channel->patterns[block] = first;
+		channel->repeats[first]++;
+		return;
+	}
+	for (i = first; i < channel->nbBlocks; i++) {
+		if (channel->patterns[i] == first) channel->patterns[i] = block;
+	}
+	channel->repeats[block] = channel->repeats[first] + 1;
+	channel->repeats[first] = 0;
+}
+
+/**
+ * \fn void grow_index(channel_t *channel, int block)
+ * \brief Agrandit l'index des blocs pour qu'il contienne un bloc
+ */
+static void grow_index(channel_t *channel, int block) {
+	int nbBlocks, i;
+	if (block < channel->nbBlocks) return;
+	// L'index grandit par doublement pour que l'ajout de lignes en fin de channel reste amorti
+	nbBlocks = channel->nbBlocks > 0 ? channel->nbBlocks : 1;
+	while (nbBlocks <= block) nbBlocks *= 2;
+	channel->blocks = realloc(channel->blocks, nbBlocks * sizeof(note_block_t *));
+	CHECK_ALLOC(channel->blocks);
+	channel->patterns = realloc(channel->patterns, nbBlocks * sizeof(int));
+	CHECK_ALLOC(channel->patterns);
+	channel->repeats = realloc(channel->repeats, nbBlocks * sizeof(int));
+	CHECK_ALLOC(channel->repeats);
+	for (i = channel->nbBlocks; i < nbBlocks; i++) {
+		channel->blocks[i] = NULL;
+		channel->patterns[i] = i;
+		channel->repeats[i] = 0;
+	}
+	channel->nbBlocks = nbBlocks;
+	rebuild_timeline(channel);
+}
+
+/**
+ * \fn note_block_t *alloc_block(channel_t *channel, int index)
+ * \brief Récupère le bloc qui contient une ligne, en l'allouant (ainsi que l'index) si besoin
+ * \note Un bloc partagé avec une copie (voir share_music) est d'abord dupliqué : seule cette copie est modifiée
+ */
+static note_block_t *alloc_block(channel_t *channel, int index) {
+	int block = index / NOTE_BLOCK_SIZE;
+	int i;
+	note_block_t *shared;
+
+	grow_index(channel, block);
+	if (channel->blocks[block] == NULL) {
+		channel->blocks[block] = malloc(sizeof(note_block_t));
+		CHECK_ALLOC(channel->blocks[block]);
+		for (i = 0; i < NOTE_BLOCK_SIZE; i++) channel->blocks[block]->notes[i] = PACKED_NOTE_EMPTY;
+		channel->blocks[block]->used = 0;
+		channel->blocks[block]->refs = 1;
+	} else if (__atomic_load_n(&channel->blocks[block]->refs, __ATOMIC_ACQUIRE) > 1) {
+		// Copie à l'écriture : les versions qui partagent le bloc gardent l'ancien
+		shared = channel->blocks[block];
+		// La variante ne répète plus le motif
+		unlink_pattern(channel, block);
+		channel->blocks[block] = malloc(sizeof(note_block_t));
+		CHECK_ALLOC(channel->blocks[block]);
+		memcpy(channel->blocks[block]->notes, shared->notes, sizeof(shared->notes));
+		channel->blocks[block]->used = shared->used;
+		channel->blocks[block]->refs = 1;
+		release_block(shared);
+	}
+	return channel->blocks[block];
+}
 
 /* ------------------------------------------------------------------------ */
 /*                  C O D E    D E S    F O N C T I O N S                   */
 /* ------------------------------------------------------------------------ */
 /**
- * \fn note_t create_note(short id, double frequency, short octave,instrument_t instrument, time_t time);
+ * \fn note_t create_note(short id, short octave,instrument_t instrument, time_t time);
  * \brief Créé une note avec les param donnés
  * \param id Nom de la note
- * \param frequency Fréquence en Hz à l’octave de référence
  * \param octave octave de la note
  * \param instrument Istrument sur lequel la jouer
  * \param time Durée de la note
  */
-note_t create_note(short id, double frequency, short octave,instrument_t instrument, time_duration_t time){
+note_t create_note(short id, short octave,instrument_t instrument, time_duration_t time){
 	note_t  maNote ;
 	maNote.id = id;
-	maNote.frequency = frequency ;
 	maNote.octave = octave;
 	maNote.instrument =instrument;
 	maNote.time =time;
+	maNote.fineTune = 0;
 	return maNote;
 }
 
 /**
- * \fn void mod_note(note_t noteModif, short id, double frequency, short octave,instrument_t instrument, time_t time);
+ * \fn void mod_note(note_t noteModif, short id, short octave,instrument_t instrument, time_t time);
  * \brief modifie la note avec les param donnés
  * \param noteModif note à modifier
  * \param id numéro de la note dans la gamme
- * \param frequency Fréquence en Hz à l’octave de référence
  * \param octave octave de la note
  * \param instrument Istrument sur lequel la jouer
  * \param time Durée de la note
  */
-note_t* mod_note(note_t * noteModif,short id, double frequency, short octave,instrument_t instrument, time_duration_t time){
+note_t* mod_note(note_t * noteModif,short id, short octave,instrument_t instrument, time_duration_t time){
 	noteModif->id = noteModif->id;
-	noteModif->frequency = frequency ;
 	noteModif->octave = octave;
 	noteModif->instrument =instrument;
 	noteModif->time =time;
 	return noteModif;
 }
 
+/**
+ * \fn packed_note_t pack_note(note_t note);
+ * \brief Encode une note sur 32 bits
+ * \param note la note à encoder
+ * \return la note encodée
+ */
+packed_note_t pack_note(note_t note) {
+	return ((packed_note_t)(note.id & PACKED_NOTE_ID_MASK) << PACKED_NOTE_ID_SHIFT)
+		| ((packed_note_t)(note.octave & PACKED_NOTE_OCTAVE_MASK) << PACKED_NOTE_OCTAVE_SHIFT)
+		| ((packed_note_t)(note.time & PACKED_NOTE_TIME_MASK) << PACKED_NOTE_TIME_SHIFT)
+		| ((packed_note_t)(note.instrument & PACKED_NOTE_INSTRUMENT_MASK) << PACKED_NOTE_INSTRUMENT_SHIFT)
+		| ((packed_note_t)(note.fineTune & PACKED_NOTE_FINETUNE_MASK) << PACKED_NOTE_FINETUNE_SHIFT);
+}
+
+/**
+ * \fn note_t unpack_note(packed_note_t packed);
+ * \brief Décode une note encodée
+ * \param packed la note encodée
+ * \return la note
+ */
+note_t unpack_note(packed_note_t packed) {
+	note_t note;
+	note.id = (packed >> PACKED_NOTE_ID_SHIFT) & PACKED_NOTE_ID_MASK;
+	note.octave = (packed >> PACKED_NOTE_OCTAVE_SHIFT) & PACKED_NOTE_OCTAVE_MASK;
+	note.time = (packed >> PACKED_NOTE_TIME_SHIFT) & PACKED_NOTE_TIME_MASK;
+	note.instrument = (packed >> PACKED_NOTE_INSTRUMENT_SHIFT) & PACKED_NOTE_INSTRUMENT_MASK;
+	// L'accord fin est signé
+	note.fineTune = (int8_t)((packed >> PACKED_NOTE_FINETUNE_SHIFT) & PACKED_NOTE_FINETUNE_MASK);
+	return note;
+}
+
+/**
+ * \fn note_t get_channel_note(const channel_t *channel, int index);
+ * \brief Récupère une note d'un channel
+ * \param channel le channel
+ * \param index la ligne de la note
+ * \return la note
+ */
+note_t get_channel_note(const channel_t *channel, int index) {
+	const note_block_t *block = find_block(channel, index);
+	if (block == NULL) return unpack_note(PACKED_NOTE_EMPTY);
+	return unpack_note(block->notes[index % NOTE_BLOCK_SIZE]);
+}
+
+/**
+ * \fn void set_channel_note(channel_t *channel, int index, note_t note);
+ * \brief Modifie une note d'un channel
+ * \param channel le channel
+ * \param index la ligne de la note
+ * \param note la nouvelle note
+ */
+void set_channel_note(channel_t *channel, int index, note_t note) {
+	packed_note_t packed = pack_note(note);
+	note_block_t *block;
+	packed_note_t old;
+	if (index < 0) return;
+	// Ecrire une ligne vide dans un bloc absent ne change rien : on n'alloue pas
+	if (packed == PACKED_NOTE_EMPTY && find_block(channel, index) == NULL) return;
+	block = alloc_block(channel, index);
+	old = block->notes[index % NOTE_BLOCK_SIZE];
+	block->notes[index % NOTE_BLOCK_SIZE] = packed;
+	// Le mot d'occupation suit la ligne
+	if (((packed >> PACKED_NOTE_ID_SHIFT) & PACKED_NOTE_ID_MASK) != NOTE_NA_ID) block->used |= (uint64_t)1 << (index % NOTE_BLOCK_SIZE);
+	else block->used &= ~((uint64_t)1 << (index % NOTE_BLOCK_SIZE));
+	// La durée a changé : on décale toutes les lignes suivantes
+	if (time_class(old) != time_class(packed)) {
+		update_timeline(channel, index, time_class(old), -1);
+		update_timeline(channel, index, time_class(packed), 1);
+	}
+}
+
+/**
+ * \fn int get_channel_notes(const channel_t *channel, int start, int count, note_t *notes);
+ * \brief Récupère des lignes consécutives d'un channel
+ * \param channel le channel
+ * \param start la première ligne
+ * \param count le nombre de lignes
+ * \param notes reçoit les notes (count notes)
+ * \return le nombre de lignes lues dans des blocs alloués, les autres sont des notes vides
+ */
+int get_channel_notes(const channel_t *channel, int start, int count, note_t *notes) {
+	const note_block_t *block = NULL;
+	int i, line, stored = 0;
+
+	for (i = 0; i < count; i++) {
+		line = start + i;
+		// On ne cherche le bloc qu'en changeant de bloc
+		if (i == 0 || line % NOTE_BLOCK_SIZE == 0) block = find_block(channel, line);
+		if (block == NULL) {
+			notes[i] = unpack_note(PACKED_NOTE_EMPTY);
+			continue;
+		}
+		notes[i] = unpack_note(block->notes[line % NOTE_BLOCK_SIZE]);
+		stored++;
+	}
+	return stored;
+}
+
+/**
+ * \fn void get_channel_range(const channel_t *channel, int start, int count, packed_note_t *notes);
+ * \brief Copie des lignes consécutives d'un channel, encodées
+ * \param channel le channel
+ * \param start la première ligne
+ * \param count le nombre de lignes
+ * \param notes reçoit les notes encodées (count mots)
+ * \note Copie bloc par bloc, les blocs absents donnent des lignes vides
+ */
+void get_channel_range(const channel_t *channel, int start, int count, packed_note_t *notes) {
+	const note_block_t *block;
+	int done, line, n, i;
+	if (start < 0) return;
+
+	for (done = 0; done < count; done += n) {
+		line = start + done;
+		// Lignes de la région qui tombent dans ce bloc
+		n = NOTE_BLOCK_SIZE - line % NOTE_BLOCK_SIZE;
+		if (n > count - done) n = count - done;
+		if ((block = find_block(channel, line)) != NULL) memcpy(notes + done, block->notes + line % NOTE_BLOCK_SIZE, n * sizeof(packed_note_t));
+		else for (i = 0; i < n; i++) notes[done + i] = PACKED_NOTE_EMPTY;
+	}
+}
+
+/**
+ * \fn int set_channel_range(channel_t *channel, int start, int count, const packed_note_t *notes);
+ * \brief Remplace des lignes consécutives d'un channel en une passe
+ * \param channel le channel
+ * \param start la première ligne
+ * \param count le nombre de lignes
+ * \param notes les notes encodées (count mots)
+ * \return le nombre de lignes modifiées
+ * \note Tient à jour l'occupation, l'index des durées, nbNotes et le cache de rendu (pas besoin d'update_channel_nbNotes)
+ */
+int set_channel_range(channel_t *channel, int start, int count, const packed_note_t *notes) {
+	note_block_t *block;
+	int done, line, offset, n, i, changed = 0, first = -1, last = -1;
+	// Sur une grande région, reconstruire l'index des durées une fois coûte moins qu'une mise à jour par ligne
+	int rebuild = count > 4 * NOTE_BLOCK_SIZE;
+	packed_note_t old;
+	uint64_t used;
+
+	if (start < 0 || count <= 0) return 0;
+	for (done = 0; done < count; done += n) {
+		line = start + done;
+		offset = line % NOTE_BLOCK_SIZE;
+		n = NOTE_BLOCK_SIZE - offset;
+		if (n > count - done) n = count - done;
+		// Ecrire des lignes vides dans un bloc absent ne change rien : on n'alloue pas
+		if (find_block(channel, line) == NULL) {
+			for (i = 0; i < n && notes[done + i] == PACKED_NOTE_EMPTY; i++);
+			if (i == n) continue;
+		}
+		block = alloc_block(channel, line);
+		for (i = 0; i < n; i++) {
+			old = block->notes[offset + i];
+			if (old == notes[done + i]) continue;
+			block->notes[offset + i] = notes[done + i];
+			if (!rebuild && time_class(old) != time_class(notes[done + i])) {
+				update_timeline(channel, line + i, time_class(old), -1);
+				update_timeline(channel, line + i, time_class(notes[done + i]), 1);
+			}
+			if (first == -1) first = line + i;
+			last = line + i;
+			changed++;
+		}
+		// Le mot d'occupation est recalculé d'un coup pour tout le bloc
+		used = 0;
+		for (i = 0; i < NOTE_BLOCK_SIZE; i++) used |= (uint64_t)(((block->notes[i] >> PACKED_NOTE_ID_SHIFT) & PACKED_NOTE_ID_MASK) != NOTE_NA_ID) << i;
+		block->used = used;
+	}
+	if (changed == 0) return 0;
+	if (rebuild) rebuild_timeline(channel);
+	render_cache_mark_range_dirty(channel->id, first, last - first + 1);
+	// La dernière note peut être entrée dans la région ou en être sortie
+	if (channel->nbNotes <= start + count) channel->nbNotes = prev_channel_note(channel, start + count - 1) + 1;
+	return changed;
+}
+
+/**
+ * \fn void transform_notes(packed_note_t *notes, int count, note_range_op_t op, int value);
+ * \brief Applique une transformation à des notes encodées
+ * \param notes les notes
+ * \param count le nombre de notes
+ * \param op la transformation
+ * \param value le paramètre de la transformation
+ * \note Travaille directement sur les mots, sans décoder les notes
+ */
+void transform_notes(packed_note_t *notes, int count, note_range_op_t op, int value) {
+	const packed_note_t pitchMask = (PACKED_NOTE_ID_MASK << PACKED_NOTE_ID_SHIFT) | (PACKED_NOTE_OCTAVE_MASK << PACKED_NOTE_OCTAVE_SHIFT);
+	int i, id, field, instruments;
+
+	// Une boucle par transformation, sans branchement sur op à chaque note
+	switch (op) {
+		case NOTE_RANGE_TRANSPOSE:
+			for (i = 0; i < count; i++) {
+				id = (notes[i] >> PACKED_NOTE_ID_SHIFT) & PACKED_NOTE_ID_MASK;
+				if (id == NOTE_NA_ID) continue;
+				// Hauteur en demi-tons depuis C-0
+				field = ((notes[i] >> PACKED_NOTE_OCTAVE_SHIFT) & PACKED_NOTE_OCTAVE_MASK) * (NB_NOTES - 1) + id - 1 + value;
+				field = field < 0 ? 0 : field > NOTE_OCTAVE_MAX * (NB_NOTES - 1) + NB_NOTES - 2 ? NOTE_OCTAVE_MAX * (NB_NOTES - 1) + NB_NOTES - 2 : field;
+				notes[i] = (notes[i] & ~pitchMask) | ((packed_note_t)(field % (NB_NOTES - 1) + 1) << PACKED_NOTE_ID_SHIFT) | ((packed_note_t)(field / (NB_NOTES - 1)) << PACKED_NOTE_OCTAVE_SHIFT);
+			}
+			break;
+		case NOTE_RANGE_OCTAVE:
+			for (i = 0; i < count; i++) {
+				if (((notes[i] >> PACKED_NOTE_ID_SHIFT) & PACKED_NOTE_ID_MASK) == NOTE_NA_ID) continue;
+				field = (int)((notes[i] >> PACKED_NOTE_OCTAVE_SHIFT) & PACKED_NOTE_OCTAVE_MASK) + value;
+				field = field < 0 ? 0 : field > NOTE_OCTAVE_MAX ? NOTE_OCTAVE_MAX : field;
+				notes[i] = (notes[i] & ~((packed_note_t)PACKED_NOTE_OCTAVE_MASK << PACKED_NOTE_OCTAVE_SHIFT)) | ((packed_note_t)field << PACKED_NOTE_OCTAVE_SHIFT);
+			}
+			break;
+		case NOTE_RANGE_INSTRUMENT:
+			// Les identifiants libres sont sautés, on avance d'un instrument disponible à la fois
+			instruments = abs(value);
+			for (i = 0; i < count; i++) {
+				if (((notes[i] >> PACKED_NOTE_ID_SHIFT) & PACKED_NOTE_ID_MASK) == NOTE_NA_ID) continue;
+				field = (int)((notes[i] >> PACKED_NOTE_INSTRUMENT_SHIFT) & PACKED_NOTE_INSTRUMENT_MASK);
+				for (id = 0; id < instruments; id++) field = next_instrument((instrument_t) field, value > 0);
+				notes[i] = (notes[i] & ~((packed_note_t)PACKED_NOTE_INSTRUMENT_MASK << PACKED_NOTE_INSTRUMENT_SHIFT)) | ((packed_note_t)field << PACKED_NOTE_INSTRUMENT_SHIFT);
+			}
+			break;
+		case NOTE_RANGE_TIME:
+			// Quatre doublements séparent la double croche de la ronde
+			value = value > 4 ? 4 : value < -4 ? -4 : value;
+			for (i = 0; i < count; i++) {
+				if (((notes[i] >> PACKED_NOTE_ID_SHIFT) & PACKED_NOTE_ID_MASK) == NOTE_NA_ID) continue;
+				field = (notes[i] >> PACKED_NOTE_TIME_SHIFT) & PACKED_NOTE_TIME_MASK;
+				field = value > 0 ? field << value : field >> -value;
+				field = field < TIME_CROCHE_DOUBLE ? TIME_CROCHE_DOUBLE : field > TIME_RONDE ? TIME_RONDE : field;
+				notes[i] = (notes[i] & ~((packed_note_t)PACKED_NOTE_TIME_MASK << PACKED_NOTE_TIME_SHIFT)) | ((packed_note_t)field << PACKED_NOTE_TIME_SHIFT);
+			}
+			break;
+	}
+}
+
+/**
+ * \fn int next_channel_note(const channel_t *channel, int from);
+ * \brief Cherche la prochaine ligne non vide d'un channel
+ * \param channel le channel
+ * \param from la ligne à partir de laquelle chercher (incluse)
+ * \return l'indice de la ligne, -1 s'il n'y en a plus
+ * \note Les blocs jamais écrits sont sautés d'un coup, les lignes vides d'un bloc un mot à la fois
+ */
+int next_channel_note(const channel_t *channel, int from) {
+	int block, offset;
+	uint64_t used;
+	if (from < 0) from = 0;
+
+	for (block = from / NOTE_BLOCK_SIZE, offset = from % NOTE_BLOCK_SIZE; block < channel->nbBlocks; block++, offset = 0) {
+		if (channel->blocks[block] == NULL) continue;
+		// On masque les lignes avant offset : la note cherchée est le bit de poids faible restant
+		used = channel->blocks[block]->used & (~(uint64_t)0 << offset);
+		if (used != 0) return block * NOTE_BLOCK_SIZE + __builtin_ctzll(used);
+	}
+	return -1;
+}
+
+/**
+ * \fn int prev_channel_note(const channel_t *channel, int from);
+ * \brief Cherche la ligne non vide précédente d'un channel
+ * \param channel le channel
+ * \param from la ligne à partir de laquelle chercher vers le début (incluse)
+ * \return l'indice de la ligne, -1 s'il n'y en a pas
+ */
+int prev_channel_note(const channel_t *channel, int from) {
+	int block, offset;
+	uint64_t used;
+	if (from < 0) return -1;
+	if (from >= channel->nbBlocks * NOTE_BLOCK_SIZE) from = channel->nbBlocks * NOTE_BLOCK_SIZE - 1;
+
+	for (block = from / NOTE_BLOCK_SIZE, offset = from % NOTE_BLOCK_SIZE; block >= 0; block--, offset = NOTE_BLOCK_SIZE - 1) {
+		if (channel->blocks[block] == NULL) continue;
+		// On masque les lignes après offset : la note cherchée est le bit de poids fort restant
+		used = channel->blocks[block]->used & (~(uint64_t)0 >> (NOTE_BLOCK_SIZE - 1 - offset));
+		if (used != 0) return block * NOTE_BLOCK_SIZE + NOTE_BLOCK_SIZE - 1 - __builtin_clzll(used);
+	}
+	return -1;
+}
+
+/**
+ * \fn int count_channel_notes(const channel_t *channel);
+ * \brief Compte les lignes non vides d'un channel
+ * \param channel le channel
+ * \return le nombre de notes
+ * \note Compte les bits d'occupation de chaque bloc, sans lire les notes
+ */
+int count_channel_notes(const channel_t *channel) {
+	int block, count = 0;
+	for (block = 0; block < channel->nbBlocks; block++) {
+		if (channel->blocks[block] != NULL) count += __builtin_popcountll(channel->blocks[block]->used);
+	}
+	return count;
+}
+
+/**
+ * \fn void get_channel_time_counts(const channel_t *channel, int line, int counts[NOTE_TIME_CLASSES]);
+ * \brief Compte les lignes de chaque durée avant une ligne, en temps logarithmique
+ * \param channel le channel
+ * \param line la ligne (les lignes 0 à line - 1 sont comptées)
+ * \param counts reçoit le nombre de lignes de chaque durée
+ * \note counts[i] compte les lignes de durée 1 << i (voir time_duration_t). Le début d'une ligne en échantillons
+ * s'en déduit sans parcourir les notes (voir line_to_frame)
+ */
+void get_channel_time_counts(const channel_t *channel, int line, int counts[NOTE_TIME_CLASSES]) {
+	int size = channel->nbBlocks * NOTE_BLOCK_SIZE;
+	int i, c;
+
+	memset(counts, 0, NOTE_TIME_CLASSES * sizeof(int));
+	// Une copie partagée n'a pas d'arbre : on compte ligne par ligne
+	if (channel->timeline == NULL) {
+		for (i = 0; i < line; i++) counts[time_class(get_packed_note(channel, i))]++;
+		return;
+	}
+	for (i = line < size ? line : size; i > 0; i -= i & -i) {
+		for (c = 0; c < NOTE_TIME_CLASSES; c++) counts[c] += channel->timeline[i][c];
+	}
+	// Au-delà de l'index, toutes les lignes sont vides
+	if (line > size) counts[time_class(PACKED_NOTE_EMPTY)] += line - size;
+}
+
+/**
+ * \fn int find_channel_line(const channel_t *channel, size_t frame, const size_t classFrames[NOTE_TIME_CLASSES], size_t *lineStart);
+ * \brief Cherche la ligne jouée à un instant donné, en temps logarithmique
+ * \param channel le channel
+ * \param frame l'instant, en échantillons depuis le début du channel
+ * \param classFrames la durée en échantillons de chaque durée de note
+ * \param lineStart reçoit le début de la ligne trouvée, en échantillons
+ * \return la ligne
+ */
+int find_channel_line(const channel_t *channel, size_t frame, const size_t classFrames[NOTE_TIME_CLASSES], size_t *lineStart) {
+	int size = channel->nbBlocks * NOTE_BLOCK_SIZE;
+	int line = 0, step, c;
+	size_t remaining = frame, frames, emptyFrames = classFrames[time_class(PACKED_NOTE_EMPTY)];
+
+	// Une copie partagée n'a pas d'arbre : on avance ligne par ligne
+	if (channel->timeline == NULL) {
+		while ((frames = classFrames[time_class(get_packed_note(channel, line))]) > 0 && frames <= remaining) {
+			remaining -= frames;
+			line++;
+		}
+		*lineStart = frame - remaining;
+		return line;
+	}
+	// Descente dans l'arbre : on saute tous les noeuds qui finissent avant l'instant
+	step = 1;
+	while (step * 2 <= size) step *= 2;
+	for (; step > 0 && size > 0; step /= 2) {
+		if (line + step > size) continue;
+		for (frames = 0, c = 0; c < NOTE_TIME_CLASSES; c++) frames += channel->timeline[line + step][c] * classFrames[c];
+		if (frames <= remaining) {
+			line += step;
+			remaining -= frames;
+		}
+	}
+	// Au-delà de l'index, les lignes vides ont toutes la même durée
+	if (line == size && emptyFrames > 0) {
+		line += remaining / emptyFrames;
+		remaining %= emptyFrames;
+	}
+	*lineStart = frame - remaining;
+	return line;
+}
+
+/**
+ * \fn int link_channel_pattern(channel_t *channel, int dest, int src);
+ * \brief Fait répéter à un bloc du channel le motif d'un autre bloc
+ * \param channel le channel
+ * \param dest une ligne du bloc qui devient une répétition
+ * \param src une ligne du bloc répété
+ * \return le nombre de lignes modifiées, -1 si les lignes sont invalides ou dans le même bloc
+ * \note Les anciennes notes du bloc dest sont remplacées, sans copie des notes du motif
+ */
+int link_channel_pattern(channel_t *channel, int dest, int src) {
+	int destBlock = dest / NOTE_BLOCK_SIZE, srcBlock = src / NOTE_BLOCK_SIZE;
+	int i, line, last, changed = 0;
+	note_block_t *pattern;
+	packed_note_t old, packed;
+
+	if (dest < 0 || src < 0 || destBlock == srcBlock) return -1;
+	pattern = srcBlock < channel->nbBlocks ? channel->blocks[srcBlock] : NULL;
+	if (find_block(channel, dest) == pattern) return 0;
+	grow_index(channel, destBlock);
+	for (i = 0; i < NOTE_BLOCK_SIZE; i++) {
+		line = destBlock * NOTE_BLOCK_SIZE + i;
+		old = get_packed_note(channel, line);
+		packed = pattern != NULL ? pattern->notes[i] : PACKED_NOTE_EMPTY;
+		if (old == packed) continue;
+		if (time_class(old) != time_class(packed)) {
+			update_timeline(channel, line, time_class(old), -1);
+			update_timeline(channel, line, time_class(packed), 1);
+		}
+		// Le rendu de la ligne n'est plus valable
+		render_cache_mark_dirty(channel->id, line);
+		changed++;
+	}
+	// Le bloc dest désigne maintenant le motif, l'ancien bloc est rendu
+	if (pattern != NULL) __atomic_add_fetch(&pattern->refs, 1, __ATOMIC_RELAXED);
+	release_block(channel->blocks[destBlock]);
+	unlink_pattern(channel, destBlock);
+	channel->blocks[destBlock] = pattern;
+	if (pattern != NULL) link_pattern(channel, destBlock, channel->patterns[srcBlock]);
+
+	// La dernière note peut être entrée dans le bloc ou en être sortie
+	last = (destBlock + 1) * NOTE_BLOCK_SIZE;
+	if (channel->nbNotes <= last) channel->nbNotes = prev_channel_note(channel, last - 1) + 1;
+	return changed;
+}
+
+/**
+ * \fn int get_channel_pattern_line(const channel_t *channel, int index);
+ * \brief Ligne qui joue la même note dans la première occurrence du motif d'une ligne
+ * \param channel le channel
+ * \param index la ligne
+ * \return la ligne équivalente de la première occurrence, index si le motif n'est pas répété plus tôt
+ * \note Permet de ne rendre et de ne transmettre qu'une fois les notes d'un motif répété
+ */
+int get_channel_pattern_line(const channel_t *channel, int index) {
+	if (find_block(channel, index) == NULL) return index;
+	return channel->patterns[index / NOTE_BLOCK_SIZE] * NOTE_BLOCK_SIZE + index % NOTE_BLOCK_SIZE;
+}
+
+/**
+ * \fn void reserve_channel_lines(channel_t *channel, int lines);
+ * \brief Agrandit d'avance l'index des blocs d'un channel pour qu'il contienne des lignes
+ * \param channel le channel
+ * \param lines le nombre de lignes
+ */
+void reserve_channel_lines(channel_t *channel, int lines) {
+	if (lines > 0) grow_index(channel, (lines - 1) / NOTE_BLOCK_SIZE);
+}
+
+/**
+ * \fn int is_channel_note_empty(const channel_t *channel, int index);
+ * \brief Indique si une ligne d'un channel est vide, sans décoder la note
+ * \param channel le channel
+ * \param index la ligne
+ * \return 1 si la ligne est vide, 0 sinon
+ */
+int is_channel_note_empty(const channel_t *channel, int index) {
+	const note_block_t *block = find_block(channel, index);
+	if (block == NULL) return 1;
+	return !((block->used >> (index % NOTE_BLOCK_SIZE)) & 1);
+}
+
+
+/**
+ * \fn double get_note_pitch(short id, short octave, short fineTune);
+ * \brief Fréquence d'une note, lue dans la table des hauteurs
+ * \param id identifiant de la note
+ * \param octave octave de la note
+ * \param fineTune accord fin en pas (borné à NOTE_FINETUNE_MAX)
+ * \return la fréquence en Hz, NOTE_NA_FQ pour une non note
+ * \note La table est construite une seule fois, au premier appel, à partir de init_scale
+ */
+double get_note_pitch(short id, short octave, short fineTune) {
+	pthread_once(&pitchTableOnce, init_pitch_table);
+	if (id < 0 || id >= NB_NOTES || octave < 0 || octave >= NOTE_OCTAVE_NB) return NOTE_NA_FQ;
+	if (fineTune > NOTE_FINETUNE_MAX) fineTune = NOTE_FINETUNE_MAX;
+	if (fineTune < -NOTE_FINETUNE_MAX) fineTune = -NOTE_FINETUNE_MAX;
+	return pitchTable[id][octave][fineTune + NOTE_FINETUNE_MAX];
+}
 
 /**
  * \fn scale_t init_scale()
@@ -89,8 +755,8 @@ scale_t init_scale() {
  * \note Elle met à jour la position dans la gamme
  */
 void get_next_note(note_t *note, scale_t *scale) {
+	(void)scale;
 	note->id = (note->id + 1) % NB_NOTES;
-	note->frequency = scale->freqScale[note->id];
 }
 
 /**
@@ -100,8 +766,8 @@ void get_next_note(note_t *note, scale_t *scale) {
  * \param scale la gamme
  */
 void get_previous_note(note_t *note, scale_t *scale) {
+	(void)scale;
 	note->id = ((note->id - 1) == -1) ? NB_NOTES - 1 : note->id - 1;
-	note->frequency = scale->freqScale[note->id];
 }
 
 /**
@@ -123,10 +789,10 @@ double get_note_freq(note_t *note, scale_t *scale) {
  */
 note_t * cp_note(note_t * dest, note_t src){
 	dest->id = src.id;
-	dest->frequency = src.frequency ;
 	dest->octave = src.octave;
 	dest->instrument =src.instrument;
 	dest->time =src.time;
+	dest->fineTune = src.fineTune;
 	return dest;
 }
 
@@ -138,13 +804,31 @@ note_t * cp_note(note_t * dest, note_t src){
  * \see channel_t
  */
 void init_channel(channel_t *channel, int id) {
-	note_t note = create_note(0, NOTE_NA_FQ, REF_OCTAVE, INSTRUMENT_NA, TIME_NOIRE);
-	int i;
-	for (i = 0; i < CHANNEL_MAX_NOTES; i++) channel->notes[i] = note;
+	// Aucun bloc : toutes les lignes sont vides
+	channel->blocks = NULL;
+	channel->nbBlocks = 0;
+	channel->patterns = NULL;
+	channel->repeats = NULL;
+	channel->timeline = NULL;
 	channel->nbNotes = 0; // Aucune note non vide // TODO : voir si on peut sans passer
 	channel->id  = id;
 }
 
+/**
+ * \fn void free_channel(channel_t *channel);
+ * \brief Libère les blocs d'un channel, qui redevient vide
+ * \param channel le channel
+ */
+void free_channel(channel_t *channel) {
+	int i;
+	for (i = 0; i < channel->nbBlocks; i++) release_block(channel->blocks[i]);
+	free(channel->blocks);
+	free(channel->patterns);
+	free(channel->repeats);
+	free(channel->timeline);
+	init_channel(channel, channel->id);
+}
+
 /**
  * \fn init_music(music_t *music, short bpm);
  * \brief Initialiser une musique avec des channels vides
@@ -154,9 +838,58 @@ void init_channel(channel_t *channel, int id) {
 void init_music(music_t *music, short bpm) {
 	int i;
 	music->bpm = bpm;
+	music->revision = 0;
 	for (i = 0; i < MUSIC_MAX_CHANNELS; i++) init_channel(&music->channels[i], i);
 }
 
+/**
+ * \fn void share_music(music_t *dest, const music_t *src);
+ * \brief Copie une musique en partageant ses blocs de notes
+ * \param dest la copie (non initialisée)
+ * \param src la musique copiée
+ * \note Seuls les index des blocs sont copiés. Une écriture dans l'une des deux musiques duplique le bloc
+ * modifié avant de l'écrire, l'autre n'est jamais modifiée. La copie n'a pas d'index des durées.
+ * Elle se libère avec free_music
+ */
+void share_music(music_t *dest, const music_t *src) {
+	int i, j;
+	const channel_t *channel;
+
+	dest->date = src->date;
+	dest->bpm = src->bpm;
+	dest->revision = src->revision;
+	for (i = 0; i < MUSIC_MAX_CHANNELS; i++) {
+		channel = &src->channels[i];
+		init_channel(&dest->channels[i], channel->id);
+		dest->channels[i].nbNotes = channel->nbNotes;
+		if (channel->nbBlocks == 0) continue;
+		dest->channels[i].blocks = malloc(channel->nbBlocks * sizeof(note_block_t *));
+		CHECK_ALLOC(dest->channels[i].blocks);
+		dest->channels[i].nbBlocks = channel->nbBlocks;
+		dest->channels[i].patterns = malloc(channel->nbBlocks * sizeof(int));
+		CHECK_ALLOC(dest->channels[i].patterns);
+		memcpy(dest->channels[i].patterns, channel->patterns, channel->nbBlocks * sizeof(int));
+		dest->channels[i].repeats = malloc(channel->nbBlocks * sizeof(int));
+		CHECK_ALLOC(dest->channels[i].repeats);
+		memcpy(dest->channels[i].repeats, channel->repeats, channel->nbBlocks * sizeof(int));
+		for (j = 0; j < channel->nbBlocks; j++) {
+			dest->channels[i].blocks[j] = channel->blocks[j];
+			if (channel->blocks[j] != NULL) __atomic_add_fetch(&channel->blocks[j]->refs, 1, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/**
+ * \fn void free_music(music_t *music);
+ * \brief Libère les notes d'une musique, qui redevient vide
+ * \param music la musique
+ * \note La structure elle-même n'est pas libérée
+ */
+void free_music(music_t *music) {
+	int i;
+	for (i = 0; i < MUSIC_MAX_CHANNELS; i++) free_channel(&music->channels[i]);
+}
+
 /**
  * \fn void instrument2str(instrument_t instrument, char *str);
  * \brief Convertir un instrument en chaine de caractère
@@ -189,9 +922,22 @@ void instrument2str(instrument_t instrument, char *str) {
 		case INSTRUMENT_SINPHASER:
 			strcpy(str, INSTRUMENT_SINPHASER_NAME);
 			break;
+		case INSTRUMENT_SAMPLE1:
+			strcpy(str, INSTRUMENT_SAMPLE1_NAME);
+			break;
+		case INSTRUMENT_SAMPLE2:
+			strcpy(str, INSTRUMENT_SAMPLE2_NAME);
+			break;
+		case INSTRUMENT_SAMPLE3:
+			strcpy(str, INSTRUMENT_SAMPLE3_NAME);
+			break;
+		case INSTRUMENT_SAMPLE4:
+			strcpy(str, INSTRUMENT_SAMPLE4_NAME);
+			break;
 		
 		default:
-			strcpy(str, INSTRUMENT_NA_NAME);
+			// Instrument chargé depuis un fichier
+			strcpy(str, get_instrument_name(instrument) != NULL ? get_instrument_name(instrument) : INSTRUMENT_NA_NAME);
 			break;
 	}
 }
@@ -259,16 +1005,14 @@ void note2str(note_t note, char *str) {
  * Pour cela il compare la note passée en paramètre avec la dernière note du channel
  */
 void update_channel_nbNotes(channel_t *channel, int noteIndex) {
-	note_t currentNote = channel->notes[noteIndex];
+	// La note a été modifiée, son rendu n'est plus valable
+	render_cache_mark_dirty(channel->id, noteIndex);
 	if(noteIndex >= channel->nbNotes) {
-		if(currentNote.id != NOTE_NA_ID) channel->nbNotes = noteIndex + 1;
+		if(!is_channel_note_empty(channel, noteIndex)) channel->nbNotes = noteIndex + 1;
 		return;
 	} 
-	if(noteIndex == channel->nbNotes - 1) {
-		while(channel->notes[channel->nbNotes - 1].id == NOTE_NA_ID && channel->nbNotes > 0) {
-			channel->nbNotes--;
-		}
-	}
+	// La dernière note a été vidée : on remonte à la précédente un mot d'occupation à la fois
+	if(noteIndex == channel->nbNotes - 1) channel->nbNotes = prev_channel_note(channel, noteIndex) + 1;
 
 	return;
 }
\ No newline at end of file
@@ -36,8 +36,8 @@ void *handleClient(void *arg) {
     *response = create_mpp_response(MPP_RESPONSE_BAD_REQUEST, "", NULL, NULL);
     *request = create_mpp_request(MPP_CONNECT, "", NULL, NO_MUSIC_ID);
 
-    // On attend la requête du client
-    recv_data(sd, request, (serialize_t) deserialize_mpp_request);
+    // On attend la requête du client, reçue en entier même si elle arrive en plusieurs morceaux
+    if(recv_message(sd, request, (decode_t) decode_mpp_request) != CODEC_OK) fprintf(stderr, "[PI2ISERV] Requête illisible\n");
     wait_sem(accessDB);
     // On traite la requête
     switch (request->code) {
@@ -61,13 +61,19 @@ void *handleClient(void *arg) {
             delete_music_handler(sd, request, response);
             break;
 
+        case MPP_PATCH_MUSIC:
+            patch_music_handler(sd, request, response);
+            break;
+
         default:
             *response = create_mpp_response(MPP_RESPONSE_BAD_REQUEST, "", NULL, NULL);
             break;
     }
 
+    // La réponse est envoyée dans la version de la requête : un client MPP 1.0 reste servi en texte
+    response->version = request->version;
     // Envoi de la réponse au client
-    send_data(sd, response, (serialize_t) serialize_mpp_response);
+    send_message(sd, response, (encode_t) encode_mpp_response);
     post_sem(accessDB);
     // Fermeture de la socket
     freeSocket(sd);
@@ -109,6 +115,9 @@ int main() {
  */
 void exitFunction() {
     fprintf(stderr, "[PI2ISERV] Fermeture du serveur\n");
+    // Bilan des buffers d'entrée/sortie : les réutilisations doivent dominer les allocations
+    print_buffer_pool_stats(stderr);
+    buffer_pool_trim();
     if (se != NULL) {
         freeSocket(se);
         se = NULL;
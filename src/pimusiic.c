@@ -20,10 +20,37 @@
 void clean_up() {
     // On arrête la bibliothèque graphique
     endwin();
+    // Les threads de lecture rendent avec les samples et les instruments : ils s'arrêtent avant qu'on les libère
+    stop_playlist();
+    stop_loop();
+    render_cache_clear();
+    // On libère la banque de samples et les instruments
+    free_sample_bank();
+    free_instruments();
+    unload_plugins();
     exit(EXIT_SUCCESS);
 }
 
-int main() {
+int main(int argc, char **argv) {
+    int opt;
+    // Options : -r <fréquence d'échantillonnage> (22050, 32000, 44100 ou 48000)
+    //           -p <nombre de musiques préchargées par la liste de lecture> -c <mémoire des débuts pré-rendus en Mo>
+    while ((opt = getopt(argc, argv, "r:p:c:")) != -1) {
+        switch (opt) {
+            case 'r':
+                if (engine_set_sample_rate(atoi(optarg)) == -1) exit(EXIT_FAILURE);
+                break;
+            case 'p':
+                if (set_playlist_prefetch(atoi(optarg)) == -1) exit(EXIT_FAILURE);
+                break;
+            case 'c':
+                set_playlist_cache_size((size_t) atoi(optarg) * 1024 * 1024);
+                break;
+            default:
+                ERROR("Usage : %s [-r fréquence] [-p préchargement] [-c mémoire en Mo]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
     atexit(clean_up);
     
 	
@@ -32,6 +59,12 @@ int main() {
     music_t music;
     init_music(&music, 120);
     choices_t choice = CHOICE_MAIN_MENU;
+    // Chargement de la banque de samples (une seule fois au démarrage)
+    init_sample_bank(SAMPLE_BANK_FOLDER);
+    // Chargement des instruments décrits par fichier
+    load_instruments(INSTRUMENT_FOLDER);
+    // Chargement des instruments en plugin
+    load_plugins(PLUGIN_FOLDER, engine_get_sample_rate());
     // Initialisation de la bibliothèque graphique
     init_ncurses();
 
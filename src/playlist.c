@@ -0,0 +1,329 @@
+/**
+ * @file playlist.c
+ * @brief Fichier source de la lecture enchaînée des musiques.
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+
+#include "playlist.h"
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \struct playlist_slot_t
+ * \brief Une musique récupérée à l'avance
+ */
+typedef struct {
+    int index; /*!< Indice de la musique dans la liste, -1 si l'emplacement est libre */
+    int ready; /*!< 1 quand la musique a été récupérée (ou que la récupération a échoué) */
+    music_t *music; /*!< La musique, NULL si elle n'a pas pu être récupérée */
+    mixer_stream_t *stream; /*!< Flux de mixage, déjà avancé de la durée du début pré-rendu */
+    short *intro; /*!< Début pré-rendu */
+    size_t introFrames; /*!< Nombre d'échantillons du début pré-rendu */
+} playlist_slot_t;
+
+/**
+ * \struct playlist_t
+ * \brief Etat de la lecture enchaînée
+ */
+typedef struct {
+    pthread_t player; /*!< Thread qui joue les musiques */
+    pthread_t fetcher; /*!< Thread qui récupère et pré-rend les musiques suivantes */
+    int running; /*!< 1 tant que la liste doit être jouée */
+    int started; /*!< 1 si les threads ont été lancés et doivent être attendus */
+    char rfid[PLAYLIST_RFID_SIZE]; /*!< Rfid de l'utilisateur */
+    time_t *musicIds; /*!< Identifiants des musiques */
+    int count; /*!< Nombre de musiques */
+    int current; /*!< Indice de la musique jouée */
+    int depth; /*!< Nombre de musiques récupérées à l'avance */
+    size_t introFrames; /*!< Durée pré-rendue au début de chaque musique */
+    playlist_slot_t slots[PLAYLIST_MAX_PREFETCH + 1]; /*!< La musique jouée et les suivantes */
+} playlist_t;
+
+/* ------------------------------------------------------------------------ */
+/*                     V A R I A B L E S   G L O B A L E S                  */
+/* ------------------------------------------------------------------------ */
+static playlist_t playlist = { .running = 0 }; /*!< La liste en cours */
+static int prefetchDepth = PLAYLIST_DEFAULT_PREFETCH; /*!< Réglage du nombre de musiques récupérées à l'avance */
+static size_t cacheBytes = PLAYLIST_DEFAULT_CACHE_BYTES; /*!< Réglage de la mémoire des débuts pré-rendus */
+static pthread_mutex_t playlistMutex = PTHREAD_MUTEX_INITIALIZER; /*!< Protège l'état de la liste */
+static pthread_cond_t playlistCond = PTHREAD_COND_INITIALIZER; /*!< Signale une musique prête ou terminée */
+
+/* ------------------------------------------------------------------------ */
+/*                   F O N C T I O N S   P R I V É E S                      */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn playlist_slot_t *get_slot(int index)
+ * \brief Emplacement d'une musique de la liste
+ */
+static playlist_slot_t *get_slot(int index) {
+    return &playlist.slots[index % (PLAYLIST_MAX_PREFETCH + 1)];
+}
+
+/**
+ * \fn void free_slot(playlist_slot_t *slot)
+ * \brief Libère une musique récupérée
+ */
+static void free_slot(playlist_slot_t *slot) {
+    free_mixer_stream(slot->stream);
+    if (slot->music != NULL) free_music(slot->music);
+    free(slot->music);
+    free(slot->intro);
+    memset(slot, 0, sizeof(playlist_slot_t));
+    slot->index = -1;
+}
+
+/**
+ * \fn int is_playing()
+ * \brief Indique si la liste doit encore être jouée
+ */
+static int is_playing() {
+    int running;
+    pthread_mutex_lock(&playlistMutex);
+    running = playlist.running;
+    pthread_mutex_unlock(&playlistMutex);
+    return running;
+}
+
+/**
+ * \fn void fetch_music(int index, playlist_slot_t *slot)
+ * \brief Récupère une musique par MPP et rend son début
+ * \note Appelée sans le verrou : la requête réseau ne bloque pas le lecteur
+ */
+static void fetch_music(int index, playlist_slot_t *slot) {
+    mpp_response_t response = client_request_handler(MPP_GET_MUSIC, playlist.rfid, NULL, playlist.musicIds[index]);
+    size_t done, count;
+
+    memset(slot, 0, sizeof(playlist_slot_t));
+    slot->index = index;
+    if (response.code != MPP_RESPONSE_OK || response.music == NULL) {
+        ERROR("Impossible de récupérer la musique %d de la liste\n", index);
+        if (response.music != NULL) free_music(response.music);
+        free(response.music);
+        return;
+    }
+    slot->music = response.music;
+    slot->stream = create_mixer_stream(slot->music);
+
+    // On rend le début maintenant pour que le lecteur n'ait rien à synthétiser au changement de musique
+    if (playlist.introFrames == 0 || (slot->intro = malloc(playlist.introFrames * sizeof(short))) == NULL) return;
+    for (done = 0; done < playlist.introFrames; done += count) {
+        count = playlist.introFrames - done < ENGINE_BLOCK_FRAMES ? playlist.introFrames - done : ENGINE_BLOCK_FRAMES;
+        if ((count = read_mixer_stream(slot->stream, slot->intro + done, count)) == 0) break;
+    }
+    slot->introFrames = done;
+}
+
+/**
+ * \fn void *fetcher_thread(void *args)
+ * \brief Récupère la musique jouée puis jusqu'à depth musiques suivantes
+ */
+static void *fetcher_thread(void *args) {
+    playlist_slot_t slot;
+    int next;
+    (void)args;
+
+    pthread_mutex_lock(&playlistMutex);
+    next = playlist.current;
+    while (1) {
+        while (playlist.running && (next >= playlist.count || next > playlist.current + playlist.depth)) {
+            pthread_cond_wait(&playlistCond, &playlistMutex);
+        }
+        if (!playlist.running) break;
+        pthread_mutex_unlock(&playlistMutex);
+
+        fetch_music(next, &slot);
+
+        pthread_mutex_lock(&playlistMutex);
+        if (!playlist.running) {
+            free_slot(&slot);
+            break;
+        }
+        slot.ready = 1;
+        *get_slot(next) = slot;
+        next++;
+        pthread_cond_broadcast(&playlistCond);
+    }
+    pthread_mutex_unlock(&playlistMutex);
+    return NULL;
+}
+
+/**
+ * \fn void *player_thread(void *args)
+ * \brief Joue les musiques l'une après l'autre dans le même flux
+ */
+static void *player_thread(void *args) {
+    snd_pcm_t *pcm;
+    short buffer[ENGINE_BLOCK_FRAMES];
+    playlist_slot_t *slot;
+    size_t offset, count;
+    int finished = 0;
+    (void)args;
+
+    init_sound(&pcm);
+    while (1) {
+        // On attend que la musique soit récupérée (elle l'est déjà sauf au lancement ou si le réseau est lent)
+        pthread_mutex_lock(&playlistMutex);
+        slot = get_slot(playlist.current);
+        while (playlist.running && !(slot->ready && slot->index == playlist.current)) {
+            pthread_cond_wait(&playlistCond, &playlistMutex);
+        }
+        if (!playlist.running) {
+            pthread_mutex_unlock(&playlistMutex);
+            break;
+        }
+        pthread_mutex_unlock(&playlistMutex);
+
+        if (slot->music != NULL) {
+            for (offset = 0; offset < slot->introFrames && is_playing(); offset += count) {
+                count = slot->introFrames - offset < ENGINE_BLOCK_FRAMES ? slot->introFrames - offset : ENGINE_BLOCK_FRAMES;
+                write_block(pcm, slot->intro + offset, count);
+            }
+            // Le reste est rendu au fil de la lecture, le flux n'est jamais vidé entre deux musiques
+            while (is_playing() && (count = read_mixer_stream(slot->stream, buffer, ENGINE_BLOCK_FRAMES)) > 0) {
+                write_block(pcm, buffer, count);
+            }
+        }
+
+        pthread_mutex_lock(&playlistMutex);
+        free_slot(slot);
+        if (++playlist.current >= playlist.count) {
+            finished = playlist.running;
+            playlist.running = 0;
+        }
+        pthread_cond_broadcast(&playlistCond);
+        pthread_mutex_unlock(&playlistMutex);
+    }
+    // A la fin de la liste on laisse finir le son, sur un arrêt on coupe tout de suite
+    if (finished) snd_pcm_drain(pcm);
+    else snd_pcm_drop(pcm);
+    snd_pcm_close(pcm);
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+/*                  C O D E    D E S    F O N C T I O N S                   */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn int set_playlist_prefetch(int depth)
+ * \brief Règle le nombre de musiques récupérées et pré-rendues à l'avance
+ * \param depth Le nombre de musiques (0 à PLAYLIST_MAX_PREFETCH)
+ * \return 0 si la valeur est acceptée, -1 sinon
+ * \note Prend effet au prochain lancement de la liste
+ */
+int set_playlist_prefetch(int depth) {
+    if (depth < 0 || depth > PLAYLIST_MAX_PREFETCH) {
+        ERROR("Profondeur de préchargement %d invalide (0 à %d)\n", depth, PLAYLIST_MAX_PREFETCH);
+        return -1;
+    }
+    prefetchDepth = depth;
+    return 0;
+}
+
+/**
+ * \fn void set_playlist_cache_size(size_t bytes)
+ * \brief Règle la mémoire partagée par les débuts pré-rendus des musiques suivantes
+ * \param bytes Le nombre d'octets (0 pour ne rien pré-rendre)
+ * \note Prend effet au prochain lancement de la liste
+ */
+void set_playlist_cache_size(size_t bytes) {
+    cacheBytes = bytes;
+}
+
+/**
+ * \fn int start_playlist(char *rfid, const musicId_list_t *musicIds, int first)
+ * \brief Lance la lecture enchaînée d'une liste de musiques
+ * \param rfid Le rfid de l'utilisateur
+ * \param musicIds Les identifiants des musiques (copiés)
+ * \param first L'indice de la première musique jouée
+ * \return 0 si la lecture est lancée, -1 sinon
+ * \note Une liste déjà lancée est d'abord arrêtée
+ */
+int start_playlist(char *rfid, const musicId_list_t *musicIds, int first) {
+    size_t maxIntro;
+    int i;
+
+    stop_playlist();
+    if (musicIds->size <= 0 || first < 0 || first >= musicIds->size) return -1;
+
+    strncpy(playlist.rfid, rfid, PLAYLIST_RFID_SIZE - 1);
+    playlist.rfid[PLAYLIST_RFID_SIZE - 1] = '\0';
+    playlist.musicIds = malloc(musicIds->size * sizeof(time_t));
+    CHECK_ALLOC(playlist.musicIds);
+    memcpy(playlist.musicIds, musicIds->musicIds, musicIds->size * sizeof(time_t));
+    playlist.count = musicIds->size;
+    playlist.current = first;
+    playlist.depth = prefetchDepth;
+    // La mémoire est partagée entre la musique jouée et celles récupérées à l'avance
+    maxIntro = (size_t) PLAYLIST_INTRO_SECONDS * engine_get_sample_rate();
+    playlist.introFrames = cacheBytes / sizeof(short) / (playlist.depth + 1);
+    if (playlist.introFrames > maxIntro) playlist.introFrames = maxIntro;
+    for (i = 0; i <= PLAYLIST_MAX_PREFETCH; i++) {
+        memset(&playlist.slots[i], 0, sizeof(playlist_slot_t));
+        playlist.slots[i].index = -1;
+    }
+
+    pthread_mutex_lock(&playlistMutex);
+    playlist.running = 1;
+    playlist.started = pthread_create(&playlist.fetcher, NULL, fetcher_thread, NULL) == 0;
+    if (playlist.started && pthread_create(&playlist.player, NULL, player_thread, NULL) != 0) {
+        // Le lecteur n'a pas pu être lancé : on arrête le thread de récupération
+        playlist.running = 0;
+        pthread_cond_broadcast(&playlistCond);
+        pthread_mutex_unlock(&playlistMutex);
+        pthread_join(playlist.fetcher, NULL);
+        playlist.started = 0;
+        pthread_mutex_lock(&playlistMutex);
+    }
+    if (!playlist.started) playlist.running = 0;
+    pthread_mutex_unlock(&playlistMutex);
+
+    if (!playlist.started) {
+        ERROR("Impossible de lancer la liste de lecture\n");
+        free(playlist.musicIds);
+        playlist.musicIds = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \fn void stop_playlist()
+ * \brief Arrête la lecture de la liste et attend la fin des threads
+ */
+void stop_playlist() {
+    int started, i;
+
+    pthread_mutex_lock(&playlistMutex);
+    started = playlist.started;
+    playlist.running = 0;
+    playlist.started = 0;
+    pthread_cond_broadcast(&playlistCond);
+    pthread_mutex_unlock(&playlistMutex);
+    if (!started) return;
+
+    pthread_join(playlist.player, NULL);
+    pthread_join(playlist.fetcher, NULL);
+    for (i = 0; i <= PLAYLIST_MAX_PREFETCH; i++) {
+        if (playlist.slots[i].index != -1) free_slot(&playlist.slots[i]);
+    }
+    free(playlist.musicIds);
+    playlist.musicIds = NULL;
+}
+
+/**
+ * \fn int get_playlist_current()
+ * \brief Indique la musique en cours de lecture
+ * \return L'indice de la musique dans la liste, -1 si la liste n'est pas jouée
+ */
+int get_playlist_current() {
+    int current;
+    pthread_mutex_lock(&playlistMutex);
+    current = playlist.running ? playlist.current : -1;
+    pthread_mutex_unlock(&playlistMutex);
+    return current;
+}
@@ -0,0 +1,272 @@
+/**
+ * @file plugin.c
+ * @brief Fichier source pour le chargement des instruments en plugin.
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+
+#include "plugin.h"
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \struct plugin_t
+ * \brief Un plugin chargé
+ */
+typedef struct {
+    void *handle; /*!< Bibliothèque ouverte par dlopen */
+    const pimusiic_plugin_t *descriptor; /*!< Descripteur exporté par le plugin */
+    char name[PLUGIN_NAME_SIZE]; /*!< Nom affiché */
+    uint64_t cpuNs; /*!< Temps CPU cumulé dans process (mis à jour atomiquement) */
+    uint64_t frames; /*!< Echantillons produits (mis à jour atomiquement) */
+    uint64_t calls; /*!< Blocs rendus (mis à jour atomiquement) */
+} plugin_t;
+
+/**
+ * \struct plugin_slot_t
+ * \brief Une instance de chaque plugin, créées au chargement et prises par un thread de rendu
+ */
+typedef struct {
+    void *instances[PLUGIN_MAX]; /*!< Instance de chaque plugin (NULL si le plugin n'a pas pu la créer) */
+    int used; /*!< 1 si un thread de rendu utilise ces instances (atomique) */
+} plugin_slot_t;
+
+/* ------------------------------------------------------------------------ */
+/*                     V A R I A B L E S   G L O B A L E S                  */
+/* ------------------------------------------------------------------------ */
+static plugin_t plugins[PLUGIN_MAX]; /*!< Plugins chargés */
+static int nbPlugins = 0; /*!< Nombre de plugins chargés */
+static int pluginRate = 0; /*!< Fréquence d'échantillonnage des instances */
+static plugin_slot_t slots[PLUGIN_INSTANCE_SLOTS]; /*!< Instances créées au chargement */
+static pthread_key_t slotKey; /*!< Instances prises par le thread courant */
+static pthread_once_t slotKeyOnce = PTHREAD_ONCE_INIT; /*!< Création unique de la clé */
+
+/* ------------------------------------------------------------------------ */
+/*                   F O N C T I O N S   P R I V É E S                      */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn int plugin_file_filter(const struct dirent *entry)
+ * \brief Filtre scandir : on ne garde que les .so
+ */
+static int plugin_file_filter(const struct dirent *entry) {
+    size_t len = strlen(entry->d_name);
+    return len > 3 && strcmp(entry->d_name + len - 3, ".so") == 0;
+}
+
+/**
+ * \fn void release_slot(void *data)
+ * \brief Destructeur de la clé : rend les instances d'un thread qui se termine, sans les détruire
+ */
+static void release_slot(void *data) {
+    __atomic_store_n(&((plugin_slot_t *) data)->used, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * \fn void create_slot_key()
+ * \brief Crée la clé des instances par thread
+ */
+static void create_slot_key() {
+    pthread_key_create(&slotKey, release_slot);
+}
+
+/**
+ * \fn void *get_instance(int index, int rate)
+ * \brief Récupère l'instance d'un plugin pour le thread courant
+ * \return L'instance ou NULL si le plugin n'a pas pu la créer, si la fréquence a changé depuis le chargement ou si
+ * tous les jeux d'instances sont pris
+ * \note N'alloue jamais : à sa première note, un thread prend un jeu d'instances libre par un échange atomique
+ */
+static void *get_instance(int index, int rate) {
+    plugin_slot_t *slot;
+    int i, expected;
+
+    if (rate != pluginRate) return NULL;
+    pthread_once(&slotKeyOnce, create_slot_key);
+    if ((slot = pthread_getspecific(slotKey)) == NULL) {
+        for (i = 0; i < PLUGIN_INSTANCE_SLOTS && slot == NULL; i++) {
+            expected = 0;
+            if (__atomic_compare_exchange_n(&slots[i].used, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) slot = &slots[i];
+        }
+        if (slot == NULL) return NULL;
+        pthread_setspecific(slotKey, slot);
+    }
+    return slot->instances[index];
+}
+
+/**
+ * \fn int load_plugin(plugin_t *plugin, const char *folder, const char *fileName)
+ * \brief Ouvre un plugin et vérifie son descripteur
+ * \return 0 si le plugin est utilisable, -1 sinon
+ */
+static int load_plugin(plugin_t *plugin, const char *folder, const char *fileName) {
+    char path[512];
+    pimusiic_plugin_entry_t entry;
+    const pimusiic_plugin_t *descriptor;
+
+    snprintf(path, sizeof(path), "%s/%s", folder, fileName);
+    memset(plugin, 0, sizeof(plugin_t));
+    if ((plugin->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+        ERROR("Plugin %s : %s\n", path, dlerror());
+        return -1;
+    }
+    // dlsym renvoie un void *, on passe par memcpy pour le convertir en pointeur de fonction
+    void *symbol = dlsym(plugin->handle, PIMUSIIC_PLUGIN_ENTRY);
+    memcpy(&entry, &symbol, sizeof(entry));
+    descriptor = symbol != NULL ? entry() : NULL;
+
+    if (descriptor == NULL || descriptor->abiVersion != PIMUSIIC_PLUGIN_ABI_VERSION || descriptor->name == NULL
+        || descriptor->create == NULL || descriptor->note_on == NULL || descriptor->process == NULL || descriptor->destroy == NULL) {
+        ERROR("Plugin %s : descripteur absent, incomplet ou d'une autre version d'ABI\n", path);
+        dlclose(plugin->handle);
+        plugin->handle = NULL;
+        return -1;
+    }
+    plugin->descriptor = descriptor;
+    snprintf(plugin->name, PLUGIN_NAME_SIZE, "%-4.4s", descriptor->name);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+/*                  C O D E    D E S    F O N C T I O N S                   */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn int load_plugins(const char *folder, int rate)
+ * \brief Charge tous les plugins .so d'un dossier et crée leurs instances
+ * \param folder Le dossier à charger
+ * \param rate La fréquence d'échantillonnage du moteur
+ * \return Le nombre de plugins chargés
+ * \note Les plugins invalides ou d'une autre version d'ABI sont ignorés avec un message d'erreur
+ */
+int load_plugins(const char *folder, int rate) {
+    struct dirent **entries = NULL;
+    int i, j, nbEntries;
+
+    unload_plugins();
+    // On trie par nom pour que l'identifiant d'un plugin soit stable
+    nbEntries = scandir(folder, &entries, plugin_file_filter, alphasort);
+    if (nbEntries == -1) return 0;
+
+    pluginRate = rate;
+    for (i = 0; i < nbEntries; i++) {
+        if (nbPlugins < PLUGIN_MAX && load_plugin(&plugins[nbPlugins], folder, entries[i]->d_name) == 0) {
+            DEBUG_PRINT("Plugin %d : %s (%s)\n", nbPlugins, plugins[nbPlugins].name, entries[i]->d_name);
+            // Les instances sont créées ici : le rendu n'a jamais à allouer
+            for (j = 0; j < PLUGIN_INSTANCE_SLOTS; j++) {
+                slots[j].instances[nbPlugins] = plugins[nbPlugins].descriptor->create(rate, PLUGIN_MAX_FRAMES);
+                if (slots[j].instances[nbPlugins] == NULL) ERROR("Plugin %s : impossible de créer une instance\n", plugins[nbPlugins].name);
+            }
+            nbPlugins++;
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return nbPlugins;
+}
+
+/**
+ * \fn void unload_plugins()
+ * \brief Décharge tous les plugins
+ * \note Les threads de rendu doivent être terminés
+ */
+void unload_plugins() {
+    int i, j;
+    // Le thread courant rend ses instances, les autres threads de rendu sont terminés
+    pthread_once(&slotKeyOnce, create_slot_key);
+    if (pthread_getspecific(slotKey) != NULL) {
+        release_slot(pthread_getspecific(slotKey));
+        pthread_setspecific(slotKey, NULL);
+    }
+    for (i = 0; i < nbPlugins; i++) {
+        // Les instances sont détruites tant que le code des plugins est encore chargé
+        for (j = 0; j < PLUGIN_INSTANCE_SLOTS; j++) {
+            if (slots[j].instances[i] != NULL) plugins[i].descriptor->destroy(slots[j].instances[i]);
+            slots[j].instances[i] = NULL;
+        }
+        DEBUG_PRINT("Plugin %s : %.3f ms CPU pour %lu échantillons\n", plugins[i].name, plugins[i].cpuNs / 1e6, (unsigned long) plugins[i].frames);
+        dlclose(plugins[i].handle);
+    }
+    nbPlugins = 0;
+}
+
+/**
+ * \fn int get_plugin_count()
+ * \brief Récupère le nombre de plugins chargés
+ * \return Le nombre de plugins
+ */
+int get_plugin_count() {
+    return nbPlugins;
+}
+
+/**
+ * \fn const char *get_plugin_name(int index)
+ * \brief Récupère le nom d'un plugin
+ * \param index L'indice du plugin
+ * \return Le nom ou NULL si l'indice n'est pas chargé
+ */
+const char *get_plugin_name(int index) {
+    if (index < 0 || index >= nbPlugins) return NULL;
+    return plugins[index].name;
+}
+
+/**
+ * \fn int render_plugin(int index, float *out, size_t offset, size_t count, double freq, size_t length, int rate)
+ * \brief Rend un bloc d'une note avec un plugin
+ * \param index L'indice du plugin
+ * \param out Le buffer de sortie
+ * \param offset Indice dans la note du premier échantillon du bloc (0 déclenche note_on)
+ * \param count Nombre d'échantillons du bloc
+ * \param freq Fréquence de la note
+ * \param length Durée totale de la note en échantillons
+ * \param rate Fréquence d'échantillonnage
+ * \return 0 si le bloc est rendu, -1 sinon (le buffer est alors rempli de silence)
+ */
+int render_plugin(int index, float *out, size_t offset, size_t count, double freq, size_t length, int rate) {
+    struct timespec start, end;
+    plugin_t *plugin;
+    void *instance;
+    size_t done, frames;
+
+    if (index < 0 || index >= nbPlugins || (instance = get_instance(index, rate)) == NULL) {
+        memset(out, 0, count * sizeof(float));
+        return -1;
+    }
+    plugin = &plugins[index];
+
+    // Le temps CPU du thread ne compte que le travail du plugin, pas les préemptions
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    if (offset == 0) plugin->descriptor->note_on(instance, freq, length);
+    for (done = 0; done < count; done += frames) {
+        frames = count - done < PLUGIN_MAX_FRAMES ? count - done : PLUGIN_MAX_FRAMES;
+        plugin->descriptor->process(instance, out + done, frames);
+    }
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+    __atomic_fetch_add(&plugin->cpuNs, (uint64_t)((end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec)), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&plugin->frames, (uint64_t) count, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&plugin->calls, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * \fn int get_plugin_stats(plugin_stats_t *out, int max, int rate)
+ * \brief Copie le temps de calcul cumulé de chaque plugin
+ * \param out Le tableau à remplir
+ * \param max La taille du tableau
+ * \param rate Fréquence d'échantillonnage (pour convertir les échantillons en temps réel)
+ * \return Le nombre de plugins copiés
+ */
+int get_plugin_stats(plugin_stats_t *out, int max, int rate) {
+    int i;
+    for (i = 0; i < nbPlugins && i < max; i++) {
+        strcpy(out[i].name, plugins[i].name);
+        out[i].cpuNs = __atomic_load_n(&plugins[i].cpuNs, __ATOMIC_RELAXED);
+        out[i].frames = __atomic_load_n(&plugins[i].frames, __ATOMIC_RELAXED);
+        out[i].calls = __atomic_load_n(&plugins[i].calls, __ATOMIC_RELAXED);
+        out[i].load = out[i].frames == 0 ? 0 : out[i].cpuNs / (out[i].frames * 1e9 / rate);
+    }
+    return i;
+}
@@ -0,0 +1,238 @@
+/**
+ * @file renderCache.c
+ * @brief Fichier source du cache de rendu de la musique.
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+
+#include "renderCache.h"
+
+/* ------------------------------------------------------------------------ */
+/*              D É F I N I T I O N S   D E   T Y P E S                     */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \struct render_entry_t
+ * \brief Rendu d'une note et clé qui a servi à le produire
+ */
+typedef struct {
+    short *samples; /*!< Echantillons rendus (NULL si rien n'est gardé) */
+    size_t frames; /*!< Nombre d'échantillons */
+    packed_note_t note; /*!< Note rendue (encodée, comparée en un seul mot) */
+    short bpm; /*!< Bpm utilisé pour la durée */
+    short effect; /*!< Effet appliqué */
+    int rate; /*!< Fréquence d'échantillonnage du rendu */
+    engine_quality_t quality; /*!< Plus basse qualité utilisée pendant le rendu */
+    char valid; /*!< 1 si le rendu est complet et la note n'a pas été modifiée depuis */
+} render_entry_t;
+
+/* ------------------------------------------------------------------------ */
+/*                     V A R I A B L E S   G L O B A L E S                  */
+/* ------------------------------------------------------------------------ */
+static render_entry_t *entries[MUSIC_MAX_CHANNELS]; /*!< Une entrée par ligne rendue, par channel */
+static int nbEntries[MUSIC_MAX_CHANNELS]; /*!< Nombre d'entrées allouées par channel */
+static size_t cacheBytes = 0; /*!< Mémoire occupée */
+static unsigned long cacheEpoch = 0; /*!< Nombre de notes marquées sales depuis le démarrage */
+static pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER; /*!< Protège les entrées (les channels rendent en parallèle) */
+
+/* ------------------------------------------------------------------------ */
+/*                   F O N C T I O N S   P R I V É E S                      */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn render_entry_t *get_entry(short channel, int index, int grow)
+ * \brief Récupère l'entrée d'une note
+ * \param grow 1 pour agrandir la table du channel si la ligne n'y est pas encore
+ * \return L'entrée ou NULL si la position est hors de la musique ou de la table
+ * \note Le verrou doit être pris (la table peut être déplacée en grandissant)
+ */
+static render_entry_t *get_entry(short channel, int index, int grow) {
+    render_entry_t *table;
+    int size;
+    if (channel < 0 || channel >= MUSIC_MAX_CHANNELS || index < 0) return NULL;
+    if (index >= nbEntries[channel]) {
+        if (!grow) return NULL;
+        // Les channels n'ont pas de longueur maximale : la table suit la dernière ligne rendue
+        size = nbEntries[channel] > 0 ? nbEntries[channel] : NOTE_BLOCK_SIZE;
+        while (size <= index) size *= 2;
+        if ((table = realloc(entries[channel], size * sizeof(render_entry_t))) == NULL) return NULL;
+        memset(table + nbEntries[channel], 0, (size - nbEntries[channel]) * sizeof(render_entry_t));
+        entries[channel] = table;
+        nbEntries[channel] = size;
+    }
+    return &entries[channel][index];
+}
+
+/**
+ * \fn void release_entry(render_entry_t *entry)
+ * \brief Libère le rendu d'une entrée
+ */
+static void release_entry(render_entry_t *entry) {
+    if (entry->samples != NULL) {
+        cacheBytes -= entry->frames * sizeof(short);
+        free(entry->samples);
+    }
+    entry->samples = NULL;
+    entry->frames = 0;
+    entry->valid = 0;
+}
+
+/**
+ * \fn short *prepare_entry(render_entry_t *entry, note_t note, short bpm, short effect, size_t frames)
+ * \brief Alloue le buffer d'une entrée et y range la clé, l'entrée reste invalide
+ * \return Le buffer ou NULL si la mémoire du cache est épuisée
+ * \note Le verrou doit être pris
+ */
+static short *prepare_entry(render_entry_t *entry, note_t note, short bpm, short effect, size_t frames) {
+    size_t bytes = frames * sizeof(short);
+
+    // On réutilise le buffer s'il a déjà la bonne taille
+    if (entry->samples == NULL || entry->frames != frames) {
+        release_entry(entry);
+        if (cacheBytes + bytes > RENDER_CACHE_MAX_BYTES || (entry->samples = malloc(bytes)) == NULL) return NULL;
+        cacheBytes += bytes;
+        entry->frames = frames;
+    }
+    entry->valid = 0;
+    entry->note = pack_note(note);
+    entry->bpm = bpm;
+    entry->effect = effect;
+    entry->rate = engine_get_sample_rate();
+    return entry->samples;
+}
+
+/**
+ * \fn int same_key(const render_entry_t *entry, note_t note, short bpm, short effect)
+ * \brief Vérifie que l'entrée a été rendue avec les mêmes paramètres
+ */
+static int same_key(const render_entry_t *entry, note_t note, short bpm, short effect) {
+    // Le moteur a retrouvé de la marge depuis ce rendu dégradé : on le refait
+    if (!entry->valid || entry->quality > engine_get_quality()) return 0;
+    return entry->note == pack_note(note) && entry->bpm == bpm && entry->effect == effect && entry->rate == engine_get_sample_rate();
+}
+
+/* ------------------------------------------------------------------------ */
+/*                  C O D E    D E S    F O N C T I O N S                   */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn size_t render_cache_read(short channel, int index, note_t note, short bpm, short effect, short *out, size_t max)
+ * \brief Copie le rendu d'une note s'il est valable
+ * \param channel L'identifiant du channel
+ * \param index L'indice de la note dans le channel
+ * \param note La note à jouer
+ * \param bpm Le bpm de la musique
+ * \param effect L'effet appliqué à la note
+ * \param out Le buffer qui reçoit le rendu
+ * \param max La taille du buffer
+ * \return Le nombre d'échantillons copiés, 0 si le rendu est absent, sale, périmé ou trop grand
+ * \note Un rendu fait à une qualité inférieure à la qualité courante du moteur est considéré périmé
+ */
+size_t render_cache_read(short channel, int index, note_t note, short bpm, short effect, short *out, size_t max) {
+    render_entry_t *entry;
+    size_t frames = 0;
+
+    pthread_mutex_lock(&cacheMutex);
+    if ((entry = get_entry(channel, index, 0)) != NULL && same_key(entry, note, bpm, effect) && entry->frames <= max) {
+        frames = entry->frames;
+        memcpy(out, entry->samples, frames * sizeof(short));
+    }
+    pthread_mutex_unlock(&cacheMutex);
+    return frames;
+}
+
+/**
+ * \fn void render_cache_store(short channel, int index, note_t note, short bpm, short effect, const short *samples, size_t frames, engine_quality_t quality)
+ * \brief Garde une copie du rendu complet d'une note
+ * \param channel L'identifiant du channel
+ * \param index L'indice de la note dans le channel
+ * \param note La note rendue
+ * \param bpm Le bpm de la musique
+ * \param effect L'effet appliqué à la note
+ * \param samples Les échantillons rendus
+ * \param frames Le nombre d'échantillons
+ * \param quality La plus basse qualité utilisée pendant le rendu
+ * \note Rien n'est gardé si la mémoire du cache est épuisée
+ */
+void render_cache_store(short channel, int index, note_t note, short bpm, short effect, const short *samples, size_t frames, engine_quality_t quality) {
+    render_entry_t *entry;
+    short *copy;
+    if (frames == 0) return;
+
+    pthread_mutex_lock(&cacheMutex);
+    if ((entry = get_entry(channel, index, 1)) != NULL && (copy = prepare_entry(entry, note, bpm, effect, frames)) != NULL) {
+        memcpy(copy, samples, frames * sizeof(short));
+        entry->quality = quality;
+        entry->valid = 1;
+    }
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+/**
+ * \fn void render_cache_mark_dirty(short channel, int index)
+ * \brief Marque une note comme modifiée et libère son rendu
+ * \param channel L'identifiant du channel
+ * \param index L'indice de la note dans le channel
+ */
+void render_cache_mark_dirty(short channel, int index) {
+    render_entry_t *entry;
+
+    pthread_mutex_lock(&cacheMutex);
+    if ((entry = get_entry(channel, index, 0)) != NULL) release_entry(entry);
+    cacheEpoch++;
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+/**
+ * \fn void render_cache_mark_range_dirty(short channel, int start, int count)
+ * \brief Marque des notes consécutives comme modifiées et libère leurs rendus
+ * \param channel L'identifiant du channel
+ * \param start L'indice de la première note
+ * \param count Le nombre de notes
+ * \note Le verrou n'est pris qu'une fois pour toute la région
+ */
+void render_cache_mark_range_dirty(short channel, int start, int count) {
+    render_entry_t *entry;
+    int i;
+
+    pthread_mutex_lock(&cacheMutex);
+    for (i = 0; i < count; i++) {
+        // Les lignes au-delà de la table n'ont jamais été rendues
+        if ((entry = get_entry(channel, start + i, 0)) == NULL) break;
+        release_entry(entry);
+    }
+    cacheEpoch++;
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+/**
+ * \fn void render_cache_clear()
+ * \brief Libère tous les rendus
+ */
+void render_cache_clear() {
+    int i, j;
+    pthread_mutex_lock(&cacheMutex);
+    for (i = 0; i < MUSIC_MAX_CHANNELS; i++) {
+        for (j = 0; j < nbEntries[i]; j++) release_entry(&entries[i][j]);
+        free(entries[i]);
+        entries[i] = NULL;
+        nbEntries[i] = 0;
+    }
+    cacheEpoch++;
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+/**
+ * \fn unsigned long render_cache_epoch()
+ * \brief Compteur incrémenté à chaque note marquée sale
+ * \return La valeur du compteur
+ * \note Permet de savoir sans parcourir les notes si un rendu construit à partir du cache est encore à jour
+ */
+unsigned long render_cache_epoch() {
+    unsigned long epoch;
+    pthread_mutex_lock(&cacheMutex);
+    epoch = cacheEpoch;
+    pthread_mutex_unlock(&cacheMutex);
+    return epoch;
+}
+
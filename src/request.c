@@ -6,6 +6,21 @@
  */
 #include "request.h"
 
+int serverVersion = MPP_VERSION; /*!< Version MPP comprise par le serveur, abaissée d'un cran à chaque refus */
+
+/**
+ * @fn mpp_response_t send_client_request(mpp_request_code_t code, char *rfid, music_t *music, music_patch_t *patch, int overwrite, time_t musicId)
+ * @brief Fonction privée qui envoie une requête au serveur, dans la version précédente s'il ne comprend pas la sienne
+ * @param code Le code de la requête à envoyer
+ * @param rfid Le rfid de l'utilisateur
+ * @param music La musique à envoyer (si nécessaire)
+ * @param patch Le patch à envoyer (MPP_PATCH_MUSIC)
+ * @param overwrite 1 pour écraser la musique enregistrée même si elle a changé depuis sa révision (MPP_ADD_MUSIC)
+ * @param musicId L'identifiant de la musique (si nécessaire)
+ * @return mpp_response_t La réponse du serveur
+*/
+mpp_response_t send_client_request(mpp_request_code_t code, char *rfid, music_t *music, music_patch_t *patch, int overwrite, time_t musicId);
+
 /**
  * @fn mpp_response_t send_connection_request(socket_t *socket, char *rfid)
  * @brief Envoie une requête de connexion
@@ -19,11 +34,12 @@ mpp_response_t send_connection_request(socket_t *socket, char *rfid) {
 
     // On créer la requête
     request = create_mpp_request(MPP_CONNECT, rfid, NULL, NO_MUSIC_ID);
+    request.version = serverVersion;
 
     // On envoie la requête
-    send_data(socket, &request, (serialize_t) serialize_mpp_request);
+    send_message(socket, &request, (encode_t) encode_mpp_request);
     // On attend la réponse
-    recv_data(socket, &response, (serialize_t) deserialize_mpp_response);
+    recv_message(socket, &response, (decode_t) decode_mpp_response);
 
     return response;
 }
@@ -38,27 +54,52 @@ mpp_response_t send_connection_request(socket_t *socket, char *rfid) {
 mpp_response_t send_list_music_request(socket_t *socket, char *rfid) {
     mpp_response_t response = create_mpp_response(MPP_RESPONSE_BAD_REQUEST, "", NULL, NULL);
     mpp_request_t request = create_mpp_request(MPP_LIST_MUSIC, rfid, NULL, NO_MUSIC_ID);
+    request.version = serverVersion;
     // On envoie la requête
-    send_data(socket, &request, (serialize_t) serialize_mpp_request);
+    send_message(socket, &request, (encode_t) encode_mpp_request);
     // On attend la réponse
-    recv_data(socket, &response, (serialize_t) deserialize_mpp_response);
+    recv_message(socket, &response, (decode_t) decode_mpp_response);
     return response;
 }
 
 /**
- * @fn mpp_response_t send_save_music_request(socket_t *socket, char *rfid, music_t *music)
+ * @fn mpp_response_t send_save_music_request(socket_t *socket, char *rfid, music_t *music, int overwrite)
  * @brief Envoie une requête pour sauvegarder une musique
  * @param socket La socket de connexion au serveur
  * @param rfid Le rfid de l'utilisateur
- * @param music La musique à sauvegarder
+ * @param music La musique à sauvegarder, modifiée depuis music->revision
+ * @param overwrite 1 pour écraser la musique enregistrée même si elle a changé depuis music->revision
  * @return mpp_response_t 
  */
-mpp_response_t send_save_music_request(socket_t *socket, char *rfid, music_t *music) {
+mpp_response_t send_save_music_request(socket_t *socket, char *rfid, music_t *music, int overwrite) {
     mpp_response_t response;
     mpp_request_t request = create_mpp_request(MPP_ADD_MUSIC, rfid, music, NO_MUSIC_ID);
+    request.overwrite = overwrite;
+    request.version = serverVersion;
+    
+    send_message(socket, &request, (encode_t) encode_mpp_request);
+    recv_message(socket, &response, (decode_t) decode_mpp_response);
+
+    return response;
+}
+
+/**
+ * @fn mpp_response_t send_patch_music_request(socket_t *socket, char *rfid, time_t musicId, music_patch_t *patch)
+ * @brief Envoie une requête pour modifier quelques lignes d'une musique enregistrée
+ * @param socket La socket de connexion au serveur
+ * @param rfid Le rfid de l'utilisateur
+ * @param musicId L'identifiant de la musique
+ * @param patch Les lignes modifiées depuis la révision patch->base
+ * @return mpp_response_t 
+ */
+mpp_response_t send_patch_music_request(socket_t *socket, char *rfid, time_t musicId, music_patch_t *patch) {
+    mpp_response_t response;
+    mpp_request_t request = create_mpp_request(MPP_PATCH_MUSIC, rfid, NULL, musicId);
+    request.patch = patch;
+    request.version = serverVersion;
     
-    send_data(socket, &request, (serialize_t) serialize_mpp_request);
-    recv_data(socket, &response, (serialize_t) deserialize_mpp_response);
+    send_message(socket, &request, (encode_t) encode_mpp_request);
+    recv_message(socket, &response, (decode_t) decode_mpp_response);
 
     return response;
 }
@@ -74,9 +115,10 @@ mpp_response_t send_save_music_request(socket_t *socket, char *rfid, music_t *mu
 mpp_response_t send_delete_music_request(socket_t *socket, char *rfid, time_t musicId) {
     mpp_response_t response;
     mpp_request_t request = create_mpp_request(MPP_DELETE_MUSIC, rfid, NULL, musicId);
+    request.version = serverVersion;
     
-    send_data(socket, &request, (serialize_t) serialize_mpp_request);
-    recv_data(socket, &response, (serialize_t) deserialize_mpp_response);
+    send_message(socket, &request, (encode_t) encode_mpp_request);
+    recv_message(socket, &response, (decode_t) decode_mpp_response);
 
     return response;
 }
@@ -93,9 +135,10 @@ mpp_response_t send_delete_music_request(socket_t *socket, char *rfid, time_t mu
 mpp_response_t send_get_music_request(socket_t *socket, char *rfid, time_t musicId) {
     mpp_response_t response;
     mpp_request_t request = create_mpp_request(MPP_GET_MUSIC, rfid, NULL, musicId);
+    request.version = serverVersion;
     
-    send_data(socket, &request, (serialize_t) serialize_mpp_request);
-    recv_data(socket, &response, (serialize_t) deserialize_mpp_response);
+    send_message(socket, &request, (encode_t) encode_mpp_request);
+    recv_message(socket, &response, (decode_t) decode_mpp_response);
 
     return response;
 }
@@ -110,8 +153,26 @@ mpp_response_t send_get_music_request(socket_t *socket, char *rfid, time_t music
  * @return mpp_response_t La réponse du serveur
 */
 mpp_response_t client_request_handler(mpp_request_code_t code , char *rfid, music_t *music, time_t musicId) {
+    return send_client_request(code, rfid, music, NULL, 0, musicId);
+}
+
+/**
+ * @fn mpp_response_t send_client_request(mpp_request_code_t code, char *rfid, music_t *music, music_patch_t *patch, int overwrite, time_t musicId)
+ * @brief Fonction privée qui envoie une requête au serveur, dans la version précédente s'il ne comprend pas la sienne
+ * @param code Le code de la requête à envoyer
+ * @param rfid Le rfid de l'utilisateur
+ * @param music La musique à envoyer (si nécessaire)
+ * @param patch Le patch à envoyer (MPP_PATCH_MUSIC)
+ * @param overwrite 1 pour écraser la musique enregistrée même si elle a changé depuis sa révision (MPP_ADD_MUSIC)
+ * @param musicId L'identifiant de la musique (si nécessaire)
+ * @return mpp_response_t La réponse du serveur
+*/
+mpp_response_t send_client_request(mpp_request_code_t code, char *rfid, music_t *music, music_patch_t *patch, int overwrite, time_t musicId) {
     mpp_response_t response;
+    int version = serverVersion, framed;
     socket_t *socket = connectToServer(MPP_DEFAULT_IP, MPP_DEFAULT_PORT);
+    // Un serveur MPP 1.0 n'encadre pas ses messages
+    socket->framed = version != MPP_VERSION_TEXT;
     switch (code) {
         case MPP_CONNECT:
             response = send_connection_request(socket, rfid);
@@ -120,7 +181,10 @@ mpp_response_t client_request_handler(mpp_request_code_t code , char *rfid, musi
             response = send_list_music_request(socket, rfid);
             break;
         case MPP_ADD_MUSIC:
-            response = send_save_music_request(socket, rfid, music);
+            response = send_save_music_request(socket, rfid, music, overwrite);
+            break;
+        case MPP_PATCH_MUSIC:
+            response = send_patch_music_request(socket, rfid, musicId, patch);
             break;
         case MPP_DELETE_MUSIC:
             response = send_delete_music_request(socket, rfid, musicId);
@@ -132,6 +196,42 @@ mpp_response_t client_request_handler(mpp_request_code_t code , char *rfid, musi
             response = create_mpp_response(MPP_RESPONSE_BAD_REQUEST, "", NULL, NULL);
             break;
     }
+    framed = socket->framed;
     freeSocket(socket);
+    // Un serveur plus ancien répond BAD_REQUEST dans une version inférieure (MPP 1.0 en texte sans en-tête) : la requête
+    // est refaite dans la version précédente
+    if(version > MPP_VERSION_TEXT && BAD_REQUEST((&response)) && response.version != version
+       && (version > MPP_VERSION_BINARY || !framed)) {
+        serverVersion = version - 1;
+        clear_response(&response);
+        return send_client_request(code, rfid, music, patch, overwrite, musicId);
+    }
     return response;
-}
\ No newline at end of file
+}
+
+/**
+ * @fn mpp_response_t client_save_request_handler(char *rfid, music_t *music, music_patch_t *patch, int overwrite)
+ * @brief Sauvegarde une musique sur le serveur, en n'envoyant que ses lignes modifiées si possible
+ * @param rfid Le rfid de l'utilisateur
+ * @param music La musique à sauvegarder, sa révision est mise à jour si la sauvegarde réussit
+ * @param patch Les lignes modifiées depuis la révision de la musique (NULL pour envoyer la musique entière)
+ * @param overwrite 1 pour que la musique entière écrase celle du serveur même si elle a changé depuis sa révision
+ * @return mpp_response_t La réponse du serveur
+ * @note La musique est envoyée en entier (MPP_ADD_MUSIC) si elle n'a pas encore de révision ou si le serveur ne
+ * connaît pas MPP 2.2. Elle porte sa révision : comme un patch, elle est refusée (MPP_RESPONSE_CONFLICT) si la
+ * musique a changé sur le serveur. Une sauvegarde refusée n'est jamais refaite avec overwrite : c'est à
+ * l'utilisateur de choisir entre la version du serveur et la sienne
+*/
+mpp_response_t client_save_request_handler(char *rfid, music_t *music, music_patch_t *patch, int overwrite) {
+    mpp_response_t response;
+    if(patch != NULL && patch->base != 0 && serverVersion >= MPP_VERSION_DELTA) {
+        response = send_client_request(MPP_PATCH_MUSIC, rfid, NULL, patch, 0, music->date.tv_sec);
+        if(response.code < MPP_RESPONSE_BAD_REQUEST) music->revision = response.revision;
+        // Seul un serveur antérieur à MPP 2.2, qui ne connaît pas la requête, reçoit ensuite la musique entière
+        if(!BAD_REQUEST((&response)) || response.version >= MPP_VERSION_DELTA) return response;
+        clear_response(&response);
+    }
+    response = send_client_request(MPP_ADD_MUSIC, rfid, music, NULL, overwrite, NO_MUSIC_ID);
+    if(response.code < MPP_RESPONSE_BAD_REQUEST) music->revision = response.revision;
+    return response;
+}
@@ -0,0 +1,222 @@
+/**
+ * @file resampler.c
+ * @brief Fichier source pour le rééchantillonneur polyphase.
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+
+#include "resampler.h"
+
+/* ------------------------------------------------------------------------ */
+/*                     V A R I A B L E S   G L O B A L E S                  */
+/* ------------------------------------------------------------------------ */
+static short linearTable[RESAMPLER_PHASES][2]; /*!< Coefficients de l'interpolation linéaire */
+static short cubicTable[RESAMPLER_PHASES][4]; /*!< Coefficients de l'interpolation cubique */
+static short sincTable[RESAMPLER_SINC_TABLES][RESAMPLER_PHASES][RESAMPLER_MAX_TAPS]; /*!< Coefficients des sinus cardinaux */
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT; /*!< Calcul unique des tables */
+static volatile resampler_quality_t currentQuality = RESAMPLER_SINC; /*!< Qualité courante */
+
+/* ------------------------------------------------------------------------ */
+/*                   F O N C T I O N S   P R I V É E S                      */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn void quantize_phase(const double *coeffs, short *out, int taps)
+ * \brief Normalise une phase (gain unitaire) et la convertit en Q14
+ * \note L'erreur d'arrondi est reportée sur le plus grand coefficient pour garder un gain exact
+ */
+static void quantize_phase(const double *coeffs, short *out, int taps) {
+    double sum = 0;
+    int k, total = 0, biggest = 0;
+    for (k = 0; k < taps; k++) sum += coeffs[k];
+    for (k = 0; k < taps; k++) {
+        out[k] = (short) lround(coeffs[k] / sum * (1 << RESAMPLER_COEF_BITS));
+        total += out[k];
+        if (fabs(coeffs[k]) > fabs(coeffs[biggest])) biggest = k;
+    }
+    out[biggest] += (1 << RESAMPLER_COEF_BITS) - total;
+}
+
+/**
+ * \fn void compute_tables()
+ * \brief Calcule toutes les tables de coefficients
+ */
+static void compute_tables() {
+    double coeffs[RESAMPLER_MAX_TAPS];
+    int p, k, table;
+
+    for (p = 0; p < RESAMPLER_PHASES; p++) {
+        double t = (double) p / RESAMPLER_PHASES;
+
+        // Linéaire : x[0], x[1]
+        coeffs[0] = 1 - t;
+        coeffs[1] = t;
+        quantize_phase(coeffs, linearTable[p], 2);
+
+        // Catmull-Rom : x[-1], x[0], x[1], x[2]
+        coeffs[0] = (-t * t * t + 2 * t * t - t) / 2;
+        coeffs[1] = (3 * t * t * t - 5 * t * t + 2) / 2;
+        coeffs[2] = (-3 * t * t * t + 4 * t * t + t) / 2;
+        coeffs[3] = (t * t * t - t * t) / 2;
+        quantize_phase(coeffs, cubicTable[p], 4);
+
+        // Sinus cardinaux fenêtrés (Blackman), la coupure est divisée par 2 à chaque table
+        // pour éviter le repliement quand on transpose vers l'aigu
+        for (table = 0; table < RESAMPLER_SINC_TABLES; table++) {
+            int taps = RESAMPLER_SINC_TAPS << table;
+            double cutoff = 0.9 / (1 << table);
+            for (k = 0; k < taps; k++) {
+                // distance entre le coefficient k et la position à interpoler
+                double d = (k - (taps / 2 - 1)) - t;
+                double x = d / (taps / 2);
+                double sinc = d == 0 ? 1 : sin(M_PI * cutoff * d) / (M_PI * cutoff * d);
+                double window = fabs(x) >= 1 ? 0 : 0.42 + 0.5 * cos(M_PI * x) + 0.08 * cos(2 * M_PI * x);
+                coeffs[k] = sinc * window;
+            }
+            quantize_phase(coeffs, sincTable[table][p], taps);
+        }
+    }
+}
+
+/**
+ * \fn int fir_dot(const short *x, const short *c, const int taps)
+ * \brief Produit scalaire entier entre les échantillons et une phase
+ * \note Appelée avec un nombre de coefficients constant pour que le compilateur la vectorise
+ */
+static inline int fir_dot(const short *x, const short *c, const int taps) {
+    int k, acc = 0;
+    for (k = 0; k < taps; k++) acc += x[k] * c[k];
+    return acc;
+}
+
+/**
+ * \fn short gather_tap(const sample_t *sample, long index)
+ * \brief Lit un échantillon en gérant la boucle et les bords du sample
+ */
+static short gather_tap(const sample_t *sample, long index) {
+    size_t loopLength = sample->loopEnd - sample->loopStart;
+    if (index < 0) return 0;
+    if (sample->looped && (size_t) index >= sample->loopEnd) index = sample->loopStart + ((size_t) index - sample->loopEnd) % loopLength;
+    if ((size_t) index >= sample->frames) return 0;
+    return sample->data[index];
+}
+
+/* ------------------------------------------------------------------------ */
+/*                  C O D E    D E S    F O N C T I O N S                   */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn void init_resampler()
+ * \brief Précalcule les tables de coefficients
+ * \note Peut être appelée plusieurs fois, les tables ne sont calculées qu'une fois
+ */
+void init_resampler() {
+    pthread_once(&tablesOnce, compute_tables);
+}
+
+/**
+ * \fn void set_resampler_quality(resampler_quality_t quality)
+ * \brief Change la qualité d'interpolation utilisée par toutes les voix
+ * \param quality La qualité
+ */
+void set_resampler_quality(resampler_quality_t quality) {
+    currentQuality = quality;
+}
+
+/**
+ * \fn resampler_quality_t get_resampler_quality()
+ * \brief Récupère la qualité d'interpolation courante
+ * \return La qualité
+ */
+resampler_quality_t get_resampler_quality() {
+    return currentQuality;
+}
+
+/**
+ * \fn uint64_t resampler_step(double freq, double rootFreq, int sampleRate, int outputRate)
+ * \brief Calcule le pas de lecture en virgule fixe 32.32
+ * \param freq La fréquence à jouer
+ * \param rootFreq La fréquence d'origine du sample
+ * \param sampleRate La fréquence d'échantillonnage du sample
+ * \param outputRate La fréquence d'échantillonnage de sortie
+ * \return Le pas de lecture
+ */
+uint64_t resampler_step(double freq, double rootFreq, int sampleRate, int outputRate) {
+    if (freq <= 0 || rootFreq <= 0) freq = rootFreq = 1;
+    return (uint64_t) llround(freq / rootFreq * sampleRate / outputRate * RESAMPLER_ONE);
+}
+
+/**
+ * \fn size_t resample(const sample_t *sample, uint64_t *position, uint64_t step, short *buffer, size_t count, resampler_quality_t quality)
+ * \brief Lit un sample à une vitesse quelconque
+ * \param sample Le sample
+ * \param position La position de lecture en virgule fixe 32.32 (mise à jour)
+ * \param step Le pas de lecture en virgule fixe 32.32
+ * \param buffer Le buffer à remplir
+ * \param count Le nombre d'échantillons à produire
+ * \param quality La qualité d'interpolation
+ * \return Le nombre d'échantillons produits avant la fin du sample (le reste n'est pas écrit)
+ * \note La boucle du sample est respectée
+ */
+size_t resample(const sample_t *sample, uint64_t *position, uint64_t step, short *buffer, size_t count, resampler_quality_t quality) {
+    const short *table;
+    short taps[RESAMPLER_MAX_TAPS];
+    uint64_t pos = *position;
+    uint64_t loopLength = (uint64_t)(sample->loopEnd - sample->loopStart) << RESAMPLER_FRAC_BITS;
+    size_t limit = sample->looped ? sample->loopEnd : sample->frames;
+    size_t n;
+    int nbTaps, sincTable_i = 0;
+
+    init_resampler();
+    // Choix de la table : plus on transpose vers l'aigu, plus la coupure doit être basse
+    if (quality == RESAMPLER_SINC) {
+        while (sincTable_i < RESAMPLER_SINC_TABLES - 1 && step > (RESAMPLER_ONE << sincTable_i)) sincTable_i++;
+        table = &sincTable[sincTable_i][0][0];
+        nbTaps = RESAMPLER_SINC_TAPS << sincTable_i;
+    }
+    else if (quality == RESAMPLER_CUBIC) {
+        table = &cubicTable[0][0];
+        nbTaps = 4;
+    }
+    else {
+        table = &linearTable[0][0];
+        nbTaps = 2;
+    }
+
+    for (n = 0; n < count; n++) {
+        size_t index = pos >> RESAMPLER_FRAC_BITS;
+        long first;
+        const short *x;
+        const short *coeffs;
+        int acc;
+
+        if (sample->looped && index >= sample->loopEnd) {
+            pos -= loopLength * ((index - sample->loopStart) / (sample->loopEnd - sample->loopStart));
+            index = pos >> RESAMPLER_FRAC_BITS;
+        }
+        if (index >= sample->frames) break;
+
+        // Seuls les bords du sample ont besoin d'être recopiés
+        first = (long) index - (nbTaps / 2 - 1);
+        if (first >= 0 && (size_t) first + nbTaps <= limit) x = sample->data + first;
+        else {
+            int k;
+            for (k = 0; k < nbTaps; k++) taps[k] = gather_tap(sample, first + k);
+            x = taps;
+        }
+
+        coeffs = table + ((pos >> (RESAMPLER_FRAC_BITS - RESAMPLER_PHASE_BITS)) & (RESAMPLER_PHASES - 1)) * (quality == RESAMPLER_SINC ? RESAMPLER_MAX_TAPS : nbTaps);
+        switch (nbTaps) {
+            case 2: acc = fir_dot(x, coeffs, 2); break;
+            case 4: acc = fir_dot(x, coeffs, 4); break;
+            case 8: acc = fir_dot(x, coeffs, 8); break;
+            case 16: acc = fir_dot(x, coeffs, 16); break;
+            default: acc = fir_dot(x, coeffs, RESAMPLER_MAX_TAPS); break;
+        }
+        acc >>= RESAMPLER_COEF_BITS;
+        buffer[n] = acc > SHRT_MAX ? SHRT_MAX : acc < SHRT_MIN ? SHRT_MIN : acc;
+        pos += step;
+    }
+    *position = pos;
+    return n;
+}
@@ -0,0 +1,269 @@
+/**
+ * @file sample.c
+ * @brief Fichier source pour la banque de samples.
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+
+#include "sample.h"
+#include "resampler.h"
+
+/* ------------------------------------------------------------------------ */
+/*                     V A R I A B L E S   G L O B A L E S                  */
+/* ------------------------------------------------------------------------ */
+static sample_bank_t bank = { .size = 0 }; /*!< Banque globale, en lecture seule une fois chargée */
+
+/* ------------------------------------------------------------------------ */
+/*                   F O N C T I O N S   P R I V É E S                      */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn uint32_t read_le32(const unsigned char *p)
+ * \brief Lit un entier 32 bits little endian
+ */
+static uint32_t read_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * \fn uint16_t read_le16(const unsigned char *p)
+ * \brief Lit un entier 16 bits little endian
+ */
+static uint16_t read_le16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * \fn int has_extension(const char *name, const char *ext)
+ * \brief Vérifie l'extension d'un nom de fichier
+ */
+static int has_extension(const char *name, const char *ext) {
+    size_t len = strlen(name), extLen = strlen(ext);
+    return len > extLen && strcmp(name + len - extLen, ext) == 0;
+}
+
+/**
+ * \fn int sample_file_filter(const struct dirent *entry)
+ * \brief Filtre scandir : on ne garde que les .wav et .raw
+ */
+static int sample_file_filter(const struct dirent *entry) {
+    return has_extension(entry->d_name, ".wav") || has_extension(entry->d_name, ".raw");
+}
+
+/**
+ * \fn int parse_wav(sample_t *sample)
+ * \brief Trouve les chunks fmt, data et smpl d'un fichier WAV projeté
+ * \return 0 si le fichier est un WAV PCM 16 bits mono, -1 sinon
+ */
+static int parse_wav(sample_t *sample) {
+    const unsigned char *map = (const unsigned char *) sample->map;
+    size_t offset = 12;
+    int hasFormat = 0;
+
+    if (sample->mapSize < 12 || memcmp(map, "RIFF", 4) != 0 || memcmp(map + 8, "WAVE", 4) != 0) return -1;
+
+    // On parcourt les chunks du fichier
+    while (offset + 8 <= sample->mapSize) {
+        const unsigned char *chunk = map + offset;
+        size_t size = read_le32(chunk + 4);
+        if (offset + 8 + size > sample->mapSize) size = sample->mapSize - offset - 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            // On ne gère que le PCM 16 bits mono
+            if (read_le16(chunk + 8) != 1 || read_le16(chunk + 10) != 1 || read_le16(chunk + 22) != 16) return -1;
+            sample->rate = read_le32(chunk + 12);
+            hasFormat = 1;
+        }
+        else if (memcmp(chunk, "data", 4) == 0) {
+            sample->data = (const short *) (chunk + 8);
+            sample->frames = size / sizeof(short);
+        }
+        else if (memcmp(chunk, "smpl", 4) == 0 && size >= 36) {
+            // Note MIDI jouée par le sample à sa vitesse d'origine
+            sample->rootFreq = 440.0 * pow(2, ((int) read_le32(chunk + 8 + 12) - 69) / 12.0);
+            // Première boucle du chunk smpl (début et fin inclus)
+            if (size >= 60 && read_le32(chunk + 8 + 28) > 0) {
+                sample->loopStart = read_le32(chunk + 8 + 36 + 8);
+                sample->loopEnd = read_le32(chunk + 8 + 36 + 12) + 1;
+                sample->looped = 1;
+            }
+        }
+        // Les chunks sont alignés sur 2 octets
+        offset += 8 + size + (size & 1);
+    }
+
+    if (!hasFormat || sample->data == NULL) return -1;
+    return 0;
+}
+
+/**
+ * \fn int load_sample(sample_t *sample, const char *folder, const char *name)
+ * \brief Projette un fichier de sample en mémoire
+ * \return 0 si le sample est chargé, -1 sinon
+ */
+static int load_sample(sample_t *sample, const char *folder, const char *name) {
+    char path[512];
+    struct stat st;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", folder, name);
+    memset(sample, 0, sizeof(sample_t));
+    strncpy(sample->name, name, SAMPLE_NAME_SIZE - 1);
+
+    if ((fd = open(path, O_RDONLY)) == -1) return -1;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t) sizeof(short)) {
+        close(fd);
+        return -1;
+    }
+    // MAP_POPULATE : les pages sont chargées maintenant et pas au premier déclenchement
+    sample->mapSize = st.st_size;
+    sample->map = mmap(NULL, sample->mapSize, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (sample->map == MAP_FAILED) {
+        sample->map = NULL;
+        return -1;
+    }
+
+    if (has_extension(name, ".wav")) {
+        if (parse_wav(sample) == -1) {
+            munmap(sample->map, sample->mapSize);
+            sample->map = NULL;
+            return -1;
+        }
+    }
+    else {
+        sample->data = (const short *) sample->map;
+        sample->frames = sample->mapSize / sizeof(short);
+        sample->rate = SAMPLE_RAW_RATE;
+    }
+
+    // Sans chunk smpl, on suppose que le sample joue un DO à l'octave de référence
+    if (sample->rootFreq <= 0) sample->rootFreq = NOTE_C_FQ;
+    // On valide les points de boucle
+    if (!sample->looped || sample->loopEnd > sample->frames || sample->loopStart >= sample->loopEnd) {
+        sample->looped = 0;
+        sample->loopStart = 0;
+        sample->loopEnd = sample->frames;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+/*                  C O D E    D E S    F O N C T I O N S                   */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn int init_sample_bank(const char *folder)
+ * \brief Charge tous les fichiers .wav et .raw d'un dossier dans la banque globale
+ * \param folder Le dossier à charger
+ * \return Le nombre de samples chargés
+ * \note Les fichiers invalides sont ignorés, un dossier absent donne une banque vide
+ */
+int init_sample_bank(const char *folder) {
+    struct dirent **entries = NULL;
+    int i, nbEntries;
+
+    free_sample_bank();
+    init_resampler();
+    // On trie par nom pour que l'indice d'un sample soit stable
+    nbEntries = scandir(folder, &entries, sample_file_filter, alphasort);
+    if (nbEntries == -1) return 0;
+
+    for (i = 0; i < nbEntries; i++) {
+        if (bank.size < SAMPLE_BANK_MAX && load_sample(&bank.samples[bank.size], folder, entries[i]->d_name) == 0) {
+            DEBUG_PRINT("Sample %d : %s (%zu frames, %d Hz, racine %.2f Hz)\n", bank.size, entries[i]->d_name, bank.samples[bank.size].frames, bank.samples[bank.size].rate, bank.samples[bank.size].rootFreq);
+            bank.size++;
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return bank.size;
+}
+
+/**
+ * \fn void free_sample_bank()
+ * \brief Libère les projections mémoire de la banque globale
+ */
+void free_sample_bank() {
+    int i;
+    for (i = 0; i < bank.size; i++) {
+        if (bank.samples[i].map != NULL) munmap(bank.samples[i].map, bank.samples[i].mapSize);
+    }
+    bank.size = 0;
+}
+
+/**
+ * \fn const sample_t *get_sample(int index)
+ * \brief Récupère un sample de la banque par son indice
+ * \param index L'indice du sample
+ * \return Le sample ou NULL si l'indice n'est pas chargé
+ */
+const sample_t *get_sample(int index) {
+    if (index < 0 || index >= bank.size) return NULL;
+    return &bank.samples[index];
+}
+
+/**
+ * \fn const sample_t *find_sample(const char *name)
+ * \brief Récupère un sample de la banque par son nom de fichier
+ * \param name Le nom du fichier (sans le dossier)
+ * \return Le sample ou NULL s'il n'est pas chargé
+ */
+const sample_t *find_sample(const char *name) {
+    int i;
+    for (i = 0; i < bank.size; i++) {
+        if (strcmp(bank.samples[i].name, name) == 0) return &bank.samples[i];
+    }
+    return NULL;
+}
+
+/**
+ * \fn sample_voice_t create_sample_voice(const sample_t *sample, double freq, int outputRate)
+ * \brief Crée une voix qui lit un sample depuis le début à une hauteur donnée
+ * \param sample Le sample à lire (peut être NULL)
+ * \param freq La fréquence à jouer (0 pour la hauteur d'origine)
+ * \param outputRate La fréquence d'échantillonnage de sortie
+ * \return La voix
+ */
+sample_voice_t create_sample_voice(const sample_t *sample, double freq, int outputRate) {
+    sample_voice_t voice;
+    voice.sample = sample;
+    voice.position = 0;
+    voice.step = RESAMPLER_ONE;
+    if (sample != NULL) voice.step = resampler_step(freq > 0 ? freq : sample->rootFreq, sample->rootFreq, sample->rate, outputRate);
+    return voice;
+}
+
+/**
+ * \fn size_t render_sample_voice(sample_voice_t *voice, short *buffer, size_t count)
+ * \brief Produit les prochains échantillons de la voix dans un buffer
+ * \param voice La voix
+ * \param buffer Le buffer à remplir
+ * \param count Le nombre d'échantillons à écrire
+ * \return Le nombre d'échantillons réellement issus du sample (le reste est du silence)
+ * \note La boucle du sample est respectée, sans boucle la fin du buffer est complétée par du silence.
+ * A la hauteur d'origine les échantillons sont copiés, sinon ils passent par le rééchantillonneur.
+ */
+size_t render_sample_voice(sample_voice_t *voice, short *buffer, size_t count) {
+    const sample_t *sample = voice->sample;
+    size_t written = 0, chunk, index;
+
+    // Hauteur quelconque : interpolation
+    if (sample != NULL && voice->step != RESAMPLER_ONE) written = resample(sample, &voice->position, voice->step, buffer, count, get_resampler_quality());
+
+    // Hauteur d'origine : on copie par morceaux contigus directement depuis la projection
+    while (sample != NULL && voice->step == RESAMPLER_ONE && written < count) {
+        index = voice->position >> RESAMPLER_FRAC_BITS;
+        // Fin de la boucle atteinte : on revient au début de la boucle
+        if (sample->looped && index >= sample->loopEnd) index = sample->loopStart + (index - sample->loopEnd) % (sample->loopEnd - sample->loopStart);
+        if (index >= sample->frames) break;
+
+        chunk = (sample->looped ? sample->loopEnd : sample->frames) - index;
+        if (chunk > count - written) chunk = count - written;
+        memcpy(buffer + written, sample->data + index, chunk * sizeof(short));
+        voice->position = (uint64_t)(index + chunk) << RESAMPLER_FRAC_BITS;
+        written += chunk;
+    }
+    if (written < count) memset(buffer + written, 0, (count - written) * sizeof(short));
+    return written;
+}
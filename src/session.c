@@ -161,8 +161,87 @@ char *recvFromSocket(socket_t *sock, int size, char *buff) {
  * \param  buff : message à envoyer
 */
 void writeToSocket(socket_t *sock, char *buff) {
-    int len = strlen(buff)+1;
-    CHECK(write(sock->fd, buff, len), "__WRITE__");
+    writeBytesToSocket(sock, buff, strlen(buff)+1);
+}
+
+/**
+ * \fn     void writeBytesToSocket(socket_t *sock, char *buff, int size);
+ * \brief  Ecriture d'un message de taille connue sur une socket
+ * \param  sock : la structure socket_t contenant la socket
+ * \param  buff : message à envoyer, qui peut contenir des '\0' (message binaire)
+ * \param  size : taille du message
+*/
+void writeBytesToSocket(socket_t *sock, char *buff, int size) {
+    struct iovec iov = {buff, size};
+    writeVectorToSocket(sock, &iov, 1);
+}
+
+/**
+ * \fn     void writeVectorToSocket(socket_t *sock, struct iovec *iov, int count);
+ * \brief  Ecriture d'un message en plusieurs morceaux (en-tête et contenu par exemple) avec writev
+ * \param  sock : la structure socket_t contenant la socket
+ * \param  iov : les morceaux du message, modifiés pendant l'écriture
+ * \param  count : le nombre de morceaux
+ * \note   Les écritures partielles sont reprises jusqu'à ce que tout le message soit écrit
+*/
+void writeVectorToSocket(socket_t *sock, struct iovec *iov, int count) {
+    ssize_t written;
+    while(count > 0) {
+        written = writev(sock->fd, iov, count);
+        if(written == -1 && errno == EINTR) continue;
+        CHECK(written, "__WRITEV__");
+        // Les morceaux écrits en entier sont sautés, le suivant reprend là où l'écriture s'est arrêtée
+        while(count > 0 && (size_t) written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+/**
+ * \fn     int readAllFromSocket(socket_t *sock, char *buff, int size);
+ * \brief  Lecture d'exactement size octets sur une socket
+ * \param  sock : la structure socket_t contenant la socket
+ * \param  buff : buffer dans lequel on va stocker les octets
+ * \param  size : nombre d'octets à lire
+ * \return Le nombre d'octets lus, moins de size si la connexion est fermée avant
+ * \note   Les lectures partielles sont reprises jusqu'à ce que les size octets soient lus
+*/
+int readAllFromSocket(socket_t *sock, char *buff, int size) {
+    int done = 0;
+    ssize_t received;
+    while(done < size) {
+        received = read(sock->fd, buff + done, size - done);
+        if(received == -1 && errno == EINTR) continue;
+        CHECK(received, "__READ__");
+        // Connexion fermée par le pair
+        if(received == 0) break;
+        done += received;
+    }
+    return done;
+}
+
+/**
+ * \fn     int peekSocket(socket_t *sock, char *buff, int size);
+ * \brief  Copie les octets déjà arrivés sur une socket sans les consommer
+ * \param  sock : la structure socket_t contenant la socket
+ * \param  buff : buffer dans lequel on va copier les octets
+ * \param  size : nombre maximum d'octets à copier
+ * \return Le nombre d'octets copiés (au moins 1, on attend qu'il en arrive), 0 si la connexion est fermée
+ * \note   Les octets copiés restent à lire : on peut regarder où finit un message avant de le lire
+*/
+int peekSocket(socket_t *sock, char *buff, int size) {
+    ssize_t received;
+    do {
+        received = recv(sock->fd, buff, size, MSG_PEEK);
+    } while(received == -1 && errno == EINTR);
+    CHECK(received, "__RECV__");
+    return received;
 }
 
 /**
@@ -176,13 +255,27 @@ void writeToSocket(socket_t *sock, char *buff) {
  * \see socket_t
 */
 void sendToSocket(socket_t *sock, char *buff, char *ip, int port) {
+    sendBytesToSocket(sock, buff, strlen(buff)+1, ip, port);
+}
+
+/**
+ * \fn void sendBytesToSocket(socket_t *sock, char *buff, int size, char *ip, int port);
+ * \brief Envoi d'un message de taille connue à une adresse IP et un port donnés pour une socket UDP
+ * \param sock : file descriptor de la socket
+ * \param buff : message à envoyer, qui peut contenir des '\0' (message binaire)
+ * \param size : taille du message
+ * \param ip : adresse ip du destinataire
+ * \param port : port du destinataire
+ * \note Cette fonction est utilisée pour les sockets UDP
+*/
+void sendBytesToSocket(socket_t *sock, char *buff, int size, char *ip, int port) {
     if(sock->mode != SOCK_DGRAM) {
         fprintf(stderr, "La socket n'est pas en mode UDP\n");
         exit(-1);
     }
     
     struct sockaddr_in addr = createAddress(ip, port);
-    CHECK(sendto(sock->fd, buff, strlen(buff)+1, 0, (struct sockaddr *)&addr, sizeof addr), "__SENDTO__");
+    CHECK(sendto(sock->fd, buff, size, 0, (struct sockaddr *)&addr, sizeof addr), "__SENDTO__");
 }
 
 /**
@@ -241,6 +334,7 @@ socket_t *initSocket(int mode, int fd) {
     CHECK_MALLOC(sock, "__MALLOC__");
     sock->fd = fd;
     sock->mode = mode;
+    sock->framed = 1;
     memset(&sock->localAddr, 0, sizeof(sock->localAddr));
     memset(&sock->remoteAddr, 0, sizeof(sock->remoteAddr));
     return sock;
@@ -0,0 +1,87 @@
+/**
+ * @file snapshot.c
+ * @brief Fichier source des versions figées d'une musique.
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+
+#include "snapshot.h"
+
+/* ------------------------------------------------------------------------ */
+/*                  C O D E    D E S    F O N C T I O N S                   */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * \fn music_snapshot_t *create_snapshot(const music_t *music)
+ * \brief Fige l'état courant d'une musique
+ * \param music La musique éditée
+ * \return La version, avec une référence pour l'appelant
+ * \note Ne copie que les index des blocs de notes
+ */
+music_snapshot_t *create_snapshot(const music_t *music) {
+    music_snapshot_t *snapshot = malloc(sizeof(music_snapshot_t));
+    CHECK_ALLOC(snapshot);
+    snapshot->refs = 1;
+    share_music(&snapshot->music, music);
+    return snapshot;
+}
+
+/**
+ * \fn music_snapshot_t *retain_snapshot(music_snapshot_t *snapshot)
+ * \brief Prend une référence de plus sur une version
+ * \param snapshot La version
+ * \return La version
+ */
+music_snapshot_t *retain_snapshot(music_snapshot_t *snapshot) {
+    __atomic_add_fetch(&snapshot->refs, 1, __ATOMIC_RELAXED);
+    return snapshot;
+}
+
+/**
+ * \fn void release_snapshot(music_snapshot_t *snapshot)
+ * \brief Rend une référence sur une version, la libère à la dernière
+ * \param snapshot La version (NULL accepté)
+ */
+void release_snapshot(music_snapshot_t *snapshot) {
+    if (snapshot == NULL || __atomic_sub_fetch(&snapshot->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    // Les blocs encore utilisés par la musique éditée ou une autre version ne sont pas libérés
+    free_music(&snapshot->music);
+    free(snapshot);
+}
+
+/**
+ * \fn void publish_snapshot(snapshot_mailbox_t *mailbox, music_snapshot_t *snapshot)
+ * \brief Dépose une version dans la boîte d'un lecteur
+ * \param mailbox La boîte
+ * \param snapshot La version, dont la référence est donnée à la boîte
+ * \note Une version déposée que le lecteur n'a pas encore prise est remplacée et rendue
+ */
+void publish_snapshot(snapshot_mailbox_t *mailbox, music_snapshot_t *snapshot) {
+    release_snapshot(__atomic_exchange_n(&mailbox->latest, snapshot, __ATOMIC_ACQ_REL));
+}
+
+/**
+ * \fn music_snapshot_t *update_snapshot(snapshot_mailbox_t *mailbox, music_snapshot_t *current)
+ * \brief Passe à la dernière version déposée, s'il y en a une
+ * \param mailbox La boîte du lecteur
+ * \param current La version utilisée jusque là (NULL accepté)
+ * \return La version à utiliser : la nouvelle (current est alors rendue) ou current
+ * \note Sans verrou : appelée par le thread audio entre deux notes
+ */
+music_snapshot_t *update_snapshot(snapshot_mailbox_t *mailbox, music_snapshot_t *current) {
+    music_snapshot_t *latest;
+    // Rien de neuf : une simple lecture, sans écriture partagée
+    if (__atomic_load_n(&mailbox->latest, __ATOMIC_ACQUIRE) == NULL) return current;
+    if ((latest = __atomic_exchange_n(&mailbox->latest, NULL, __ATOMIC_ACQ_REL)) == NULL) return current;
+    release_snapshot(current);
+    return latest;
+}
+
+/**
+ * \fn void clear_mailbox(snapshot_mailbox_t *mailbox)
+ * \brief Rend la version déposée et pas encore prise
+ * \param mailbox La boîte
+ */
+void clear_mailbox(snapshot_mailbox_t *mailbox) {
+    release_snapshot(__atomic_exchange_n(&mailbox->latest, NULL, __ATOMIC_ACQ_REL));
+}
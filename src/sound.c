@@ -15,6 +15,7 @@
  * \fn short sine_sound(int time, int amplitude , int phase, double freq ) 
  * \brief retourne la valeur de sin 
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
@@ -24,55 +25,61 @@ double sine_sound(double time, double amplitude , double phase, double freq );
  * \fn short *sine_wave() 
  * \brief joue une note en sinus
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *sine_wave(short *buffer, size_t sample_count, double freq);
+short *sine_wave(short *buffer, size_t offset, size_t sample_count, double freq);
 
 /**
  * \fn short *square_wave()
  * \brief joue une note en sinus
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *square_wave(short *buffer, size_t sample_count, double freq);
+short *square_wave(short *buffer, size_t offset, size_t sample_count, double freq);
 
 /**
  * \fn short *sawtooth_wave() 
  * \brief joue une note en sinus
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *sawtooth_wave(short *buffer, size_t sample_count, double freq);
+short *sawtooth_wave(short *buffer, size_t offset, size_t sample_count, double freq);
 
 /**
  * \fn short *triangle_wave() 
  * \brief joue une note en sinus
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *triangle_wave(short *buffer, size_t sample_count, double freq);
+short *triangle_wave(short *buffer, size_t offset, size_t sample_count, double freq);
 
 /**
  * \fn short **warm_wave() 
  * \brief joue une note en sinus
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *warm_wave(short *buffer, size_t sample_count, double freq);
+short *warm_wave(short *buffer, size_t offset, size_t sample_count, double freq);
 
 /**
  * \fn short **organ_wave() 
  * \brief joue une note en orgue 
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *organ_wave(short *buffer, size_t sample_count, double freq);
+short *organ_wave(short *buffer, size_t offset, size_t sample_count, double freq);
 
 
 /**
@@ -81,35 +88,50 @@ short *organ_wave(short *buffer, size_t sample_count, double freq);
  * \param note_t note note à jouer
  * \return frequence de la note en double
  */
-short *sinphaser_wave(short *buffer,size_t sample_count, double freq);
+short *sinphaser_wave(short *buffer, size_t offset, size_t sample_count, double freq);
 
 /**
  * @fn piano_wave()
  * @brief joue une note en piano
  * @param short *buffer buffer de short pour la note
+ * @param size_t offset indice dans la note du premier échantillon à rendre
  * @param size_t sample_count nb d'échantillonage
  * @param double freq fréquence d'échantillonage
  * @return short *buffer
  */
-short *piano_wave(short *buffer, size_t sample_count, double freq);
+short *piano_wave(short *buffer, size_t offset, size_t sample_count, double freq);
 
 /**
  * \fn short **silent_wave() 
  * \brief joue une note en silence (lol)
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *silent_wave(short *buffer, size_t sample_count,double freq);
+short *silent_wave(short *buffer, size_t offset, size_t sample_count, double freq);
+
+/**
+ * \fn short *sample_wave()
+ * \brief joue une note avec un sample de la banque
+ * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
+ * \param size_t sample_count nb d'échantillonage
+ * \param double freq fréquence de la note (le sample est transposé depuis sa fréquence d'origine)
+ * \param int index indice du sample dans la banque
+ */
+short *sample_wave(short *buffer, size_t offset, size_t sample_count, double freq, int index);
 
 /**
  * \fn switch_instrument()
- * \brief joue une note sur un instrument
+ * \brief rend un bloc d'une note sur un instrument
  * \param note_t note note à jouer
  * \param double freq frequence réelle de la note
- * \param double time durée du temps
+ * \param size_t offset indice dans la note du premier échantillon du bloc
+ * \param double time durée du bloc
+ * \param render_state_t *state état du rendu conservé entre les blocs de la note
  */
-void switch_instrument(short * buffer,note_t note,double freq,size_t time,short effect);
+void switch_instrument(short * buffer,note_t note,double freq,size_t offset,size_t time,short effect,render_state_t *state);
 
 /**
  * \fn  noteToTime()
@@ -136,14 +158,24 @@ double noteToFreq(note_t note);
  */
 short * pdt_convolution(short * buffer1,short * buffer2,size_t time);
 
+/**
+ * \fn  render_note()
+ * \brief rend et écrit une note par blocs, en gardant éventuellement une copie du rendu
+ * \param pcm flux où écrire la note (NULL pour un rendu hors lecture)
+ * \param record buffer de la durée de la note qui reçoit le rendu (NULL pour ne rien garder)
+ * \return la plus basse qualité utilisée pendant le rendu
+ */
+engine_quality_t render_note(note_t note, short bpm, snd_pcm_t *pcm, short effect, short *record);
+
 /**
  * \fn short **organ_wave() 
  * \brief joue une note en orgue 
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *organ_wave(short *buffer, size_t sample_count, double freq);
+short *organ_wave(short *buffer, size_t offset, size_t sample_count, double freq);
 
 
 /**
@@ -152,7 +184,15 @@ short *organ_wave(short *buffer, size_t sample_count, double freq);
  * \param note_t note note à jouer
  * \return frequence de la note en double
  */
-short *sinphaser_wave(short *buffer,size_t sample_count, double freq);
+short *sinphaser_wave(short *buffer, size_t offset, size_t sample_count, double freq);
+
+/**
+ * \fn double fast_tanh(double x)
+ * \brief approximation rationnelle de tanh (erreur < 2.5%, exacte en 0 et saturée au delà de 3)
+ * \param double x valeur
+ * \return tanh(x) approchée
+ */
+double fast_tanh(double x);
 
 /**
  * \fn  fuzz_effect()
@@ -160,7 +200,7 @@ short *sinphaser_wave(short *buffer,size_t sample_count, double freq);
  * \param note_t note note à jouer
  * \return frequence de la note en double
  */
-short *fuzz_effect(short *buffer,size_t sample_count);
+short *fuzz_effect(short *buffer,size_t sample_count,short *previous);
 
 /**
  * \fn  compression_effect()
@@ -168,7 +208,53 @@ short *fuzz_effect(short *buffer,size_t sample_count);
  * \param note_t note note à jouer
  * \return frequence de la note en double
  */
-short * compression_effect(short *buffer,size_t time);
+short * compression_effect(short *buffer,size_t time,short *previous);
+
+/**
+ * \fn  apply_effect()
+ * \brief applique un effet sur un bloc
+ * \param short effect code de l'effet (EFFECT_FUZZ, EFFECT_COMPRESSION)
+ * \param short *buffer buffer à transformer
+ * \param size_t time nb d'échantillons
+ * \param short *previous dernier échantillon du bloc précédent avant l'effet
+ */
+void apply_effect(short effect, short *buffer, size_t time, short *previous);
+
+/**
+ * \fn  instrument_wave()
+ * \brief joue une note avec un instrument chargé depuis un fichier
+ * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
+ * \param size_t sample_count nb d'échantillonage
+ * \param double freq fréquence de la note
+ * \param const instrument_def_t *def instrument compilé
+ * \param render_state_t *state état du rendu de la note
+ */
+short *instrument_wave(short *buffer, size_t offset, size_t sample_count, double freq, const instrument_def_t *def, render_state_t *state);
+
+/**
+ * \fn  plugin_wave()
+ * \brief joue une note avec un instrument en plugin
+ * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
+ * \param size_t sample_count nb d'échantillonage
+ * \param double freq fréquence de la note
+ * \param int index indice du plugin
+ * \param render_state_t *state état du rendu de la note
+ */
+short *plugin_wave(short *buffer, size_t offset, size_t sample_count, double freq, int index, render_state_t *state);
+
+/**
+ * \fn  oversampled_shaper()
+ * \brief applique une fonction de transfert non linéaire en suréchantillonnant localement
+ * \param short *buffer buffer à transformer
+ * \param size_t time nb d'échantillons
+ * \param short *previous dernier échantillon du bloc précédent
+ * \param double (*shaper)(double) fonction de transfert sur un échantillon normalisé
+ * \param int factor facteur de suréchantillonnage
+ * \return le buffer transformé
+ */
+short *oversampled_shaper(short *buffer, size_t time, short *previous, double (*shaper)(double), int factor);
 /* ------------------------------------------------------------------------ */
 /*                  C O D E    D E S    F O N C T I O N S                   */
 /* ------------------------------------------------------------------------ */
@@ -190,7 +276,7 @@ void init_sound(snd_pcm_t **pcm){
     snd_pcm_hw_params_set_access(*pcm, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED); // On utilise un accès RW
     snd_pcm_hw_params_set_format(*pcm, hw_params, SND_PCM_FORMAT_S16_LE); // On utilise un format 16 bits
     snd_pcm_hw_params_set_channels(*pcm, hw_params, 1); // On utilise un seul canal
-    snd_pcm_hw_params_set_rate(*pcm, hw_params, SAMPLE_RATE, 0); // On utilise un taux d'échantillonnage de 48000 Hz
+    snd_pcm_hw_params_set_rate(*pcm, hw_params, engine_get_sample_rate(), 0); // On utilise le taux d'échantillonnage du moteur
     snd_pcm_hw_params_set_periods(*pcm, hw_params, 10, 0); // On utilise 10 périodes
     snd_pcm_hw_params_set_period_time(*pcm, hw_params, 100000, 0); // 0.1 seconds
     snd_pcm_hw_params(*pcm, hw_params);
@@ -213,39 +299,140 @@ void end_sound(snd_pcm_t *pcm){
  * \brief joue une note 
  * \param bpm le bpm de la musique 
  * \param note la note à jouer 
+ * \note la note est rendue et écrite par blocs de ENGINE_BLOCK_FRAMES échantillons,
+ * chaque bloc est chronométré pour que le moteur adapte la qualité à la charge
  */
-void play_note(note_t note,short bpm,snd_pcm_t *pcm,short effect) {;
-    //snd_pcm_prepare(pcm); // On prépare le flux
+void play_note(note_t note,short bpm,snd_pcm_t *pcm,short effect) {
+    render_note(note, bpm, pcm, effect, NULL);
+}
+
+/**
+ * \fn engine_quality_t render_note_buffer(note_t note, short bpm, short effect, short *out);
+ * \brief rend une note entière dans un buffer, sans la jouer
+ * \param note la note à rendre
+ * \param bpm le bpm de la musique
+ * \param effect l'effet appliqué à la note
+ * \param out buffer de noteToTime(note, bpm) échantillons
+ * \return la plus basse qualité utilisée pendant le rendu
+ */
+engine_quality_t render_note_buffer(note_t note, short bpm, short effect, short *out) {
+    return render_note(note, bpm, NULL, effect, out);
+}
+
+/**
+ * \fn void play_channel_note(short channel, int index, note_t note, short bpm, snd_pcm_t *pcm, short effect);
+ * \brief joue une note d'un channel en passant par le cache de rendu
+ * \param channel l'identifiant du channel
+ * \param index l'indice de la note dans le channel
+ * \param note la note à jouer
+ * \param bpm le bpm de la musique
+ * \note une note inchangée depuis la dernière lecture est écrite depuis le cache sans être synthétisée
+ * \see play_channel_note_from
+ */
+void play_channel_note(short channel, int index, note_t note, short bpm, snd_pcm_t *pcm, short effect) {
+    play_channel_note_from(channel, index, note, bpm, pcm, effect, 0);
+}
+
+/**
+ * \fn void play_channel_note_from(short channel, int index, note_t note, short bpm, snd_pcm_t *pcm, short effect, size_t skip);
+ * \brief joue la fin d'une note d'un channel en passant par le cache de rendu
+ * \param channel l'identifiant du channel
+ * \param index l'indice de la note dans le channel
+ * \param note la note à jouer
+ * \param bpm le bpm de la musique
+ * \param skip nombre d'échantillons du début de la note à ne pas jouer
+ * \note sert à reprendre la lecture au milieu d'une note (voir frame_to_line).
+ * Le rendu est copié hors du cache : le séquenceur peut éditer la note (et libérer son rendu) pendant qu'elle est jouée
+ */
+void play_channel_note_from(short channel, int index, note_t note, short bpm, snd_pcm_t *pcm, short effect, size_t skip) {
+    short *buffer;
+    size_t frames = noteToTime(note, bpm), offset, count;
+    engine_quality_t quality;
+
+    if (skip >= frames) return;
+    if ((buffer = malloc(frames * sizeof(short))) == NULL) {
+        ERROR("Mémoire insuffisante pour rendre la note %d du channel %d\n", index, channel);
+        return;
+    }
+    if (render_cache_read(channel, index, note, bpm, effect, buffer, frames) != frames) {
+        if (skip == 0) {
+            // La note est rendue pendant la lecture, comme sans cache, puis gardée si la mémoire le permet
+            quality = render_note(note, bpm, pcm, effect, buffer);
+            render_cache_store(channel, index, note, bpm, effect, buffer, frames, quality);
+            free(buffer);
+            return;
+        }
+        // On ne peut pas commencer la synthèse au milieu : la note est rendue entière puis jouée à partir de skip
+        quality = render_note_buffer(note, bpm, effect, buffer);
+        render_cache_store(channel, index, note, bpm, effect, buffer, frames, quality);
+    }
+    for (offset = skip; offset < frames; offset += count) {
+        count = frames - offset < ENGINE_BLOCK_FRAMES ? frames - offset : ENGINE_BLOCK_FRAMES;
+        write_block(pcm, buffer + offset, count);
+    }
+    free(buffer);
+}
+
+/**
+ * \fn  render_note()
+ * \brief rend et écrit une note par blocs, en gardant éventuellement une copie du rendu
+ * \param pcm flux où écrire la note (NULL pour un rendu hors lecture)
+ * \param record buffer de la durée de la note qui reçoit le rendu (NULL pour ne rien garder)
+ * \return la plus basse qualité utilisée pendant le rendu
+ * \note chaque bloc est chronométré pour que le moteur adapte la qualité à la charge
+ */
+engine_quality_t render_note(note_t note, short bpm, snd_pcm_t *pcm, short effect, short *record) {
 	//fonction qui transforme un note_t en freq ( réelle )
 	double freq = noteToFreq(note);
 	//calculer la durée de la note en fonction du bpm
 	size_t time = noteToTime(note,bpm);
-    // On alloue un buffer pour stocker le sample de la note
-	short * buffer = (short*)malloc(sizeof(short)*time);
-
-    // On joue la note
-	switch_instrument(buffer,note,freq,time,effect);//on joue la note 
-	
-    // On écrit le buffer dans le flux
-    snd_pcm_writei(pcm, buffer, time);
-    // On attends autant de temps que la note dure
-    //snd_pcm_drain(pcm); // On vide le tampon
+    short buffer[ENGINE_BLOCK_FRAMES];
+    size_t offset, count;
+    struct timespec start;
+    render_state_t state = { .length = time, .previous = { 0 } };
+    engine_quality_t quality, worst = ENGINE_QUALITY_HIGH;
+
+    for (offset = 0; offset < time; offset += count) {
+        count = time - offset < ENGINE_BLOCK_FRAMES ? time - offset : ENGINE_BLOCK_FRAMES;
+        if ((quality = engine_get_quality()) > worst) worst = quality;
+        // On rend le bloc en mesurant le temps pris
+        start = engine_block_begin();
+        switch_instrument(buffer,note,freq,offset,count,effect,&state);
+        engine_block_end(start, count, engine_get_sample_rate());
+
+        if (record != NULL) memcpy(record + offset, buffer, count * sizeof(short));
+        if (pcm != NULL) write_block(pcm, buffer, count);
+    }
+    return worst;
+}
 
-    free(buffer); // On libère la mémoire allouée pour le buffer
+/**
+ * \fn  write_block()
+ * \brief écrit un bloc dans le flux, en relançant le flux s'il n'a pas été alimenté à temps
+ */
+void write_block(snd_pcm_t *pcm, const short *buffer, size_t count) {
+    snd_pcm_sframes_t written = snd_pcm_writei(pcm, buffer, count);
+    if (written == -EPIPE) {
+        engine_report_underrun();
+        snd_pcm_recover(pcm, written, 1);
+        snd_pcm_writei(pcm, buffer, count);
+    }
 }
 
 /**
  * \fn short *sine_wave() 
  * \brief joue une note en sinus
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *sine_wave(short *buffer, size_t sample_count, double freq) {
+short *sine_wave(short *buffer, size_t offset, size_t sample_count, double freq) {
+    double rate = engine_get_sample_rate();
 	int i;
     double t; // Temps en secondes
     for (i = 0; i < sample_count; i++) {
-        t = ((double)i) / SAMPLE_RATE; // On calcule le temps en secondes
+        t = ((double)(offset + i)) / rate; // On calcule le temps en secondes
         // On le multiplie par BASE_AMPLITUDE pour le mettre à l'échelle
         buffer[i] = BASE_AMPLITUDE * sine_sound(t, 1, 0, freq); // Création du signal sinusoïdal
     }
@@ -253,13 +440,14 @@ short *sine_wave(short *buffer, size_t sample_count, double freq) {
 }
 
 
-short *sinphaser_wave(short *buffer,size_t sample_count,double freq){
+short *sinphaser_wave(short *buffer, size_t offset, size_t sample_count, double freq){
+    double rate = engine_get_sample_rate();
 	int i;
     double t;
 	for(i=0;i<sample_count;i++){
-        t = ((double)i) / SAMPLE_RATE; // On calcule le temps en secondes
+        t = ((double)(offset + i)) / rate; // On calcule le temps en secondes
         double sine1 = sine_sound(t, 1, 0, freq);
-        double sine2 = sine_sound(i, 1, 1/(freq*2), freq); // pk 1/(freq*2) t inaudible la 
+        double sine2 = sine_sound(offset + i, 1, 1/(freq*2), freq); // pk 1/(freq*2) t inaudible la 
         //double sine2 = sine_sound(t, 1, M_PI/4,freq); // on tente avec une phase de pi/4 
 		buffer[i] = BASE_AMPLITUDE * (sine1 + sine2);
 	
@@ -284,37 +472,34 @@ double sine_sound(double time, double amplitude , double phase, double freq ){
  * \fn short *sine_chelou_wave() 
  * \brief joue une note en sinus
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *organ_wave(short *buffer, size_t sample_count, double freq){
-	int i;
-    double sinus1, sinus2, sinus3, sinus4, sinus5, sinus6, sinus7, sinus8, sinus9;
-    double drawbar16 = freq / 2.0;
-    double drawbar5N1T3 = drawbar16 * 3.0;
-    double drawbar8 = freq;
-    double drawbar4 = freq * 2.0;
-    double drawbar2N2T3 = freq * 3.0;
-    double drawbar2 = freq * 4.0;
-    double drawbar1N3 = freq * 5.0;
-    double drawbar1N1T3 = freq * 6.0;
-    double drawbar1 = freq * 8.0;
-    double t;
-    //  {0, 8, 4, 0, 0, 0, 0, 4, 0};
+short *organ_wave(short *buffer, size_t offset, size_t sample_count, double freq){
+    double rate = engine_get_sample_rate();
+	size_t i;
+    int j, nbDrawbars = 0;
+    // Tirettes 16', 5 1/3', 8', 4', 2 2/3', 2', 1 3/5', 1 1/3', 1' : rapport à la fondamentale et amplitude
+    static const double drawbarRatios[] = {0.5, 1.5, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 8.0};
+    static const double drawbarAmplitudes[] = {0, 1, 0.5, 0, 0, 0, 0, 0.5, 0};
+    // Nombre de tirettes jouées selon la charge du moteur (les plus aiguës sautent en premier)
+    static const int drawbarsPerQuality[ENGINE_QUALITY_NB] = {9, 7, 3};
+    double ratios[9], amplitudes[9];
+    double t, value;
+
+    // Les tirettes fermées ne coûtent rien, celles au dessus de Nyquist se replieraient
+    for (j = 0; j < drawbarsPerQuality[engine_get_quality()]; j++) {
+        if (drawbarAmplitudes[j] == 0 || freq * drawbarRatios[j] >= rate / 2) continue;
+        ratios[nbDrawbars] = drawbarRatios[j];
+        amplitudes[nbDrawbars++] = drawbarAmplitudes[j];
+    }
 
 	for (i = 0; i < sample_count; i++) {
-        t = (double)i / SAMPLE_RATE;
-        sinus1 = sine_sound(t, 0, 0.0, drawbar16) * (0)/8;
-        sinus2 = sine_sound(t, 1, 0.0, drawbar5N1T3);
-        sinus3 = sine_sound(t, 0.5, 0.0, drawbar8);
-        sinus4 = sine_sound(t, 0, 0.0, drawbar4);
-        sinus5 = sine_sound(t, 0, 0.0, drawbar2N2T3);
-        sinus6 = sine_sound(t, 0, 0.0, drawbar2);
-        sinus7 = sine_sound(t, 0, 0.0, drawbar1N3);
-        sinus8 = sine_sound(t, 0.5, 0.0, drawbar1N1T3);
-        sinus9 = sine_sound(t, 0, 0.0, drawbar1);
-
-        buffer[i]= BASE_AMPLITUDE * (sinus1 + sinus2 + sinus3 + sinus4 + sinus5 + sinus6 + sinus7 + sinus8 + sinus9);
+        t = (double)(offset + i) / rate;
+        value = 0;
+        for (j = 0; j < nbDrawbars; j++) value += sine_sound(t, amplitudes[j], 0.0, freq * ratios[j]);
+        buffer[i]= BASE_AMPLITUDE * value;
     }
 
 	/*	
@@ -334,13 +519,15 @@ short *organ_wave(short *buffer, size_t sample_count, double freq){
  * \fn short *square_wave()
  * \brief joue une note en sinus
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *square_wave(short *buffer, size_t sample_count, double freq) {
-	int samples_full_cycle = (double)SAMPLE_RATE / (double)freq;
+short *square_wave(short *buffer, size_t offset, size_t sample_count, double freq) {
+    double rate = engine_get_sample_rate();
+	int samples_full_cycle = rate / freq;
 	int samples_half_cycle = samples_full_cycle / 2.0f;
-	int cycle_index = 0;
+	int cycle_index = offset % samples_full_cycle;
 	int i = 0;
 	for (i = 0; i < sample_count; i++) {
 		buffer[i] = cycle_index < samples_half_cycle ? BASE_AMPLITUDE : -BASE_AMPLITUDE;
@@ -353,13 +540,15 @@ short *square_wave(short *buffer, size_t sample_count, double freq) {
  * \fn short *sawtooth_wave() 
  * \brief joue une note en sinus
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *sawtooth_wave(short *buffer, size_t sample_count, double freq) {
+short *sawtooth_wave(short *buffer, size_t offset, size_t sample_count, double freq) {
+    double rate = engine_get_sample_rate();
 	int i = 0;
     for (i = 0; i < sample_count; i++) {
-        double t = ((double)i / SAMPLE_RATE);
+        double t = ((double)(offset + i) / rate);
         double frac = t - floor(t); // Partie fractionnaire de t
         buffer[i] = BASE_AMPLITUDE * (2 * frac - 1); // Création du signal de scie
     }
@@ -371,13 +560,15 @@ short *sawtooth_wave(short *buffer, size_t sample_count, double freq) {
  * \fn short *triangle_wave() 
  * \brief joue une note en sinus
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *triangle_wave(short *buffer, size_t sample_count, double freq) {
+short *triangle_wave(short *buffer, size_t offset, size_t sample_count, double freq) {
+    double rate = engine_get_sample_rate();
 	int i = 0;	
     for (i = 0; i < sample_count; i++) {
-        double t = ((double)i / SAMPLE_RATE) * freq;
+        double t = ((double)(offset + i) / rate) * freq;
         double frac = t - (int)t; // Partie fractionnaire de t
         buffer[i] = BASE_AMPLITUDE * (2 * fabs(frac) - 1); // Utilisation de la fonction valeur absolue pour obtenir le signal triangulaire
     }
@@ -389,17 +580,24 @@ short *triangle_wave(short *buffer, size_t sample_count, double freq) {
  * \fn short **warm_wave() 
  * \brief joue une note en sinus
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *warm_wave(short *buffer, size_t sample_count, double freq) {
+short *warm_wave(short *buffer, size_t offset, size_t sample_count, double freq) {
+    double rate = engine_get_sample_rate();
+    // Nombre d'harmoniques selon la charge du moteur
+    static const int harmonicsPerQuality[ENGINE_QUALITY_NB] = {10, 5, 3};
+    int nbHarmonics = harmonicsPerQuality[engine_get_quality()];
     int i = 0;
+    // Les harmoniques au dessus de Nyquist se replieraient dans le spectre audible
+    while (nbHarmonics > 1 && freq * nbHarmonics >= rate / 2) nbHarmonics--;
     for (i = 0; i < sample_count; i++) {
-        float t = ((float)i / SAMPLE_RATE);
+        float t = ((float)(offset + i) / rate);
         float value = 0.0;
         // Somme des sinus harmoniques
         int harmonics = 1;
-        for (harmonics = 1; harmonics <= 10; harmonics++) {
+        for (harmonics = 1; harmonics <= nbHarmonics; harmonics++) {
             value += sin(2 * M_PI * freq * harmonics * t) / harmonics;
         }
 
@@ -417,38 +615,48 @@ double random_uniform() {
  * @fn piano_wave()
  * @brief joue une note en piano
  * @param short *buffer buffer de short pour la note
+ * @param size_t offset indice dans la note du premier échantillon à rendre
  * @param size_t sample_count nb d'échantillonage
  * @param double freq fréquence d'échantillonage
  * @return short *buffer
  */
-short *piano_wave(short *buffer, size_t sample_count, double freq) {
+short *piano_wave(short *buffer, size_t offset, size_t sample_count, double freq) {
+    double rate = engine_get_sample_rate();
     // Tentative de piano par synthèse additive
     // PS : c'est foireux
     double amplitude[] = {1.0, 0.5, 0.3, 0.2, 0.1};
     double phase[] = {0.0, 0.0, 0.0, 0.0, 0.0};
     double harmonics[] = {1.0, 2.5, 3.5, 1.5, 5.5};
+    // Nombre d'harmoniques selon la charge du moteur (les plus faibles sautent en premier)
+    static const size_t harmonicsPerQuality[ENGINE_QUALITY_NB] = {5, 3, 2};
+    size_t nbHarmonics = harmonicsPerQuality[engine_get_quality()];
     double t, result;
     size_t i, j;
 
     for (i = 0; i < sample_count; i++) {
-        t = (double)i / SAMPLE_RATE;
+        t = (double)(offset + i) / rate;
         result = 0.0;
-        for (j = 0; j < 5; j++) {
+        for (j = 0; j < nbHarmonics; j++) {
+            // Les harmoniques au dessus de Nyquist se replieraient dans le spectre audible
+            if (freq * harmonics[j] >= rate / 2) continue;
             result += sine_sound(t, amplitude[j], phase[j], freq * harmonics[j]);
         }
         buffer[i] = BASE_AMPLITUDE * result;
     }
+    return buffer;
 }
 
 /**
  * \fn short **silent_wave() 
  * \brief joue une note en silence (lol)
  * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
  * \param size_t sample_count nb d'échantillonage
  * \param double freq fréquence d'échantillonage
  */
-short *silent_wave(short *buffer, size_t sample_count,double freq){
+short *silent_wave(short *buffer, size_t offset, size_t sample_count, double freq){
 	int i = 0;	
+	(void)offset;
     for (i = 0; i < sample_count; i++) {
         buffer[i] = 0; // on met rien
     }
@@ -456,91 +664,187 @@ short *silent_wave(short *buffer, size_t sample_count,double freq){
 }
 
 
-short *fuzz_effect(short *buffer,size_t time){
-int i;
-	for(i=0;i<time;i++){
-	double normalized_sample = (double)buffer[i]/ BASE_AMPLITUDE;
+/**
+ * \fn short *sample_wave()
+ * \brief joue une note avec un sample de la banque
+ * \param short *buffer buffer de short pour la note
+ * \param size_t offset indice dans la note du premier échantillon à rendre
+ * \param size_t sample_count nb d'échantillonage
+ * \param double freq fréquence de la note (le sample est transposé depuis sa fréquence d'origine)
+ * \param int index indice du sample dans la banque
+ */
+short *sample_wave(short *buffer, size_t offset, size_t sample_count, double freq, int index) {
+    // La voix lit directement dans la banque, un sample absent donne du silence
+    sample_voice_t voice = create_sample_voice(get_sample(index), freq, engine_get_sample_rate());
+    // On reprend la lecture là où le bloc précédent s'est arrêté
+    voice.position = offset * voice.step;
+    render_sample_voice(&voice, buffer, sample_count);
+    return buffer;
+}
 
-    // Appliquez la distorsion non linéaire
-    double fuzzed_sample = tanh(normalized_sample * 4);
+double fast_tanh(double x) {
+    if (x > 3) return 1;
+    if (x < -3) return -1;
+    return x * (27 + x * x) / (27 + 9 * x * x);
+}
 
-    // Remettez à l'échelle l'échantillon à sa plage d'amplitude originale
-    buffer[i] = (short)(fuzzed_sample * BASE_AMPLITUDE);
-	
-	}
+short *oversampled_shaper(short *buffer, size_t time, short *previousSample, double (*shaper)(double), int factor) {
+    size_t i;
+    int k;
+    double previous = (double)*previousSample / BASE_AMPLITUDE;
+    for (i = 0; i < time; i++) {
+        double current = (double)buffer[i] / BASE_AMPLITUDE;
+        double sum = 0;
+        // On interpole linéairement factor points entre l'échantillon précédent et le courant,
+        // on les distord puis on les moyenne : les harmoniques créées au dessus de Nyquist sont atténuées
+        for (k = 1; k <= factor; k++) sum += shaper(previous + (current - previous) * k / factor);
+        previous = current;
+        buffer[i] = (short)(sum / factor * BASE_AMPLITUDE);
+    }
+    *previousSample = (short)(previous * BASE_AMPLITUDE);
+    return buffer;
+}
 
-return buffer;
+/**
+ * \fn  fuzz_shaper()
+ * \brief fonction de transfert du fuzz
+ */
+double fuzz_shaper(double x) {
+    // Appliquez la distorsion non linéaire
+    return tanh(x * 4);
+}
 
+/**
+ * \fn  fuzz_shaper_fast()
+ * \brief fonction de transfert du fuzz avec tanh approchée
+ */
+double fuzz_shaper_fast(double x) {
+    return fast_tanh(x * 4);
 }
 
-short * compression_effect(short *buffer,size_t time){
-int i;
-	for(i=0;i<time;i++){
-		//per unit
-	double normalized_sample = (double)buffer[i]/ BASE_AMPLITUDE;
+short *fuzz_effect(short *buffer,size_t time,short *previous){
+    // Sous charge, on remplace tanh par une approximation rationnelle
+    int approximate = engine_get_quality() != ENGINE_QUALITY_HIGH;
+    return oversampled_shaper(buffer, time, previous, approximate ? fuzz_shaper_fast : fuzz_shaper, engine_get_oversampling(FUZZ_OVERSAMPLED_RATE));
+}
+
+/**
+ * \fn  compression_shaper()
+ * \brief fonction de transfert de la compression
+ */
+double compression_shaper(double normalized_sample) {
 	double compressed_sample = normalized_sample;
 	if (fabs(normalized_sample) > 0.5) {
         compressed_sample = (1 + (normalized_sample - 0.5) / 2.0) * 0.5 * (normalized_sample > 0 ? 1 : -1);
     }
-		buffer[i]=(short)(compressed_sample * BASE_AMPLITUDE);
-	
-	}
+    return compressed_sample;
+}
 
-return buffer;
+short * compression_effect(short *buffer,size_t time,short *previous){
+    return oversampled_shaper(buffer, time, previous, compression_shaper, engine_get_oversampling(COMPRESSION_OVERSAMPLED_RATE));
+}
+
+void apply_effect(short effect, short *buffer, size_t time, short *previous) {
+    if(effect == EFFECT_FUZZ) fuzz_effect(buffer, time, previous);
+    else if(effect == EFFECT_COMPRESSION) compression_effect(buffer, time, previous);
+}
+
+short *instrument_wave(short *buffer, size_t offset, size_t sample_count, double freq, const instrument_def_t *def, render_state_t *state) {
+    // Nombre de partiels selon la charge du moteur
+    static const int partialsPerQuality[ENGINE_QUALITY_NB] = {INSTRUMENT_MAX_PARTIALS, INSTRUMENT_MAX_PARTIALS / 4, INSTRUMENT_LANES};
+    float out[ENGINE_BLOCK_FRAMES];
+    size_t i, count;
+    int j;
+
+    for (i = 0; i < sample_count; i += count) {
+        count = sample_count - i < ENGINE_BLOCK_FRAMES ? sample_count - i : ENGINE_BLOCK_FRAMES;
+        render_instrument(def, out, offset + i, count, freq, state->length, engine_get_sample_rate(), partialsPerQuality[engine_get_quality()]);
+        for (j = 0; j < count; j++) buffer[i + j] = (short)(out[j] * BASE_AMPLITUDE);
+    }
+    // La chaîne d'effets de l'instrument passe avant l'effet de la note
+    for (j = 0; j < def->nbEffects; j++) apply_effect(def->effects[j], buffer, sample_count, &state->previous[1 + j]);
+    return buffer;
+}
+
+short *plugin_wave(short *buffer, size_t offset, size_t sample_count, double freq, int index, render_state_t *state) {
+    float out[ENGINE_BLOCK_FRAMES];
+    size_t i, count;
+    int j;
+
+    for (i = 0; i < sample_count; i += count) {
+        count = sample_count - i < ENGINE_BLOCK_FRAMES ? sample_count - i : ENGINE_BLOCK_FRAMES;
+        render_plugin(index, out, offset + i, count, freq, state->length, engine_get_sample_rate());
+        for (j = 0; j < count; j++) {
+            // Le plugin n'est pas tenu de rester entre -1 et 1
+            float value = out[j] > 1 ? 1 : out[j] < -1 ? -1 : out[j];
+            buffer[i + j] = (short)(value * BASE_AMPLITUDE);
+        }
+    }
+    return buffer;
 }
 
 /**
  * \fn switch_instrument()
- * \brief joue une note sur un instrument
+ * \brief rend un bloc d'une note sur un instrument
  * \param note_t note note à jouer
  * \param double freq frequence réelle de la note
- * \param double time durée du temps
+ * \param size_t offset indice dans la note du premier échantillon du bloc
+ * \param double time durée du bloc
+ * \param render_state_t *state état du rendu conservé entre les blocs de la note
  */
  //sample rate x la durée = sample_count
-void switch_instrument(short *buffer,note_t note,double freq,size_t time,short effect){
+void switch_instrument(short *buffer,note_t note,double freq,size_t offset,size_t time,short effect,render_state_t *state){
+    const instrument_def_t *def;
+    int plugin;
 	
 	switch(note.instrument){
 		
 		case INSTRUMENT_SIN:
-			sine_wave(buffer,time,freq);
+			sine_wave(buffer,offset,time,freq);
 		break;
 		
 		case INSTRUMENT_SAWTOOTH:
-			warm_wave(buffer,time,freq);
+			warm_wave(buffer,offset,time,freq);
 		break;
 		
 		case INSTRUMENT_TRIANGLE:
-			triangle_wave(buffer,time,freq);
+			triangle_wave(buffer,offset,time,freq);
 		break;
 		
 		case INSTRUMENT_SQUARE:
-			square_wave(buffer,time,freq);
+			square_wave(buffer,offset,time,freq);
 		break;
 		
 		case INSTRUMENT_ORGAN:
-			organ_wave(buffer,time,freq);
+			organ_wave(buffer,offset,time,freq);
 		break;
 		
 		case INSTRUMENT_SINPHASER:
-			sinphaser_wave(buffer,time,freq);
+			sinphaser_wave(buffer,offset,time,freq);
 		break;
 
         case INSTRUMENT_PIANO:
-            piano_wave(buffer, time, freq);
+            piano_wave(buffer, offset, time, freq);
+        break;
+
+        case INSTRUMENT_SAMPLE1:
+        case INSTRUMENT_SAMPLE2:
+        case INSTRUMENT_SAMPLE3:
+        case INSTRUMENT_SAMPLE4:
+            sample_wave(buffer, offset, time, freq, note.instrument - INSTRUMENT_SAMPLE1);
         break;
 		
 		default : 
-			silent_wave(buffer,time,freq);
+            // Instrument chargé depuis un fichier
+            if((def = get_instrument_def(note.instrument)) != NULL) instrument_wave(buffer, offset, time, freq, def, state);
+            // Instrument en plugin
+            else if((plugin = get_instrument_plugin(note.instrument)) != -1) plugin_wave(buffer, offset, time, freq, plugin, state);
+			else silent_wave(buffer,offset,time,freq);
 		break;
 		
 	}
 	
-	if(effect == 1 ){
-		fuzz_effect(buffer,time);
-	}
-	if(effect == 2 ){
-		compression_effect(buffer,time);
-	}
+	apply_effect(effect, buffer, time, &state->previous[0]);
 	return;
 	
 }
@@ -552,8 +856,8 @@ void switch_instrument(short *buffer,note_t note,double freq,size_t time,short e
  * \return frequence de la note en double
  */
 double noteToFreq(note_t note){
-	return note.frequency * pow(2,(double)note.octave-3);
-	//return note.frequency;
+	// Une seule lecture dans la table, sans pow() pendant le rendu
+	return get_note_pitch(note.id, note.octave, note.fineTune);
 }
 
 
@@ -565,7 +869,42 @@ double noteToFreq(note_t note){
  * \return time temps de la note en double
  */
 size_t noteToTime(note_t note, short bpm){
-	return round(SAMPLE_RATE*(60.0/bpm)*(note.time/4.0));
+	return round(engine_get_sample_rate()*(60.0/bpm)*(note.time/4.0));
+}
+
+/**
+ * \fn size_t line_to_frame(const channel_t *channel, int line, short bpm);
+ * \brief position d'une ligne dans le channel, en temps logarithmique
+ * \param channel le channel
+ * \param line la ligne
+ * \param bpm le bpm de la musique
+ * \return le début de la ligne, en échantillons depuis le début du channel
+ */
+size_t line_to_frame(const channel_t *channel, int line, short bpm) {
+	int counts[NOTE_TIME_CLASSES], c;
+	size_t frame = 0;
+	get_channel_time_counts(channel, line, counts);
+	for (c = 0; c < NOTE_TIME_CLASSES; c++) frame += counts[c] * noteToTime(create_note(NOTE_NA_ID, REF_OCTAVE, INSTRUMENT_NA, 1 << c), bpm);
+	return frame;
+}
+
+/**
+ * \fn int frame_to_line(const channel_t *channel, size_t frame, short bpm, size_t *offset);
+ * \brief ligne jouée à un instant donné, en temps logarithmique
+ * \param channel le channel
+ * \param frame l'instant, en échantillons depuis le début du channel
+ * \param bpm le bpm de la musique
+ * \param offset reçoit la position de l'instant dans la ligne, en échantillons
+ * \return la ligne
+ */
+int frame_to_line(const channel_t *channel, size_t frame, short bpm, size_t *offset) {
+	size_t classFrames[NOTE_TIME_CLASSES], lineStart;
+	int c, line;
+	// Chaque durée est arrondie comme à la lecture : la position tombe sur le bon échantillon
+	for (c = 0; c < NOTE_TIME_CLASSES; c++) classFrames[c] = noteToTime(create_note(NOTE_NA_ID, REF_OCTAVE, INSTRUMENT_NA, 1 << c), bpm);
+	line = find_channel_line(channel, frame, classFrames, &lineStart);
+	*offset = frame - lineStart;
+	return line;
 }
 
 /**
@@ -594,22 +933,34 @@ short * pdt_convolution(short * buffer1, short * buffer2, size_t time) {
 }
 
 
+/**
+ * \fn  play_sample(char *fic, snd_pcm_t *pcm);
+ * \brief joue un sample de la banque
+ * \param fic nom du fichier du sample dans la banque
+ * \note le sample est écrit directement depuis la mémoire projetée, sans lecture de fichier
+ * \see init_sample_bank
+ */
 void play_sample(char * fic,snd_pcm_t *pcm){
-    FILE *f = fopen(fic, "rb");
-    if(f==NULL)	{
-        printf("erreur fic");
+    const sample_t *sample = find_sample(fic);
+    short buffer[ENGINE_BLOCK_FRAMES];
+    sample_voice_t voice;
+    size_t remaining, count;
+    if(sample == NULL) {
+        ERROR("Sample %s absent de la banque\n", fic);
         return;
     }
-    fseek(f, 0, SEEK_END);
-    long file_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    short *samples = (short*)malloc(file_size);
-    fread(samples, 1, file_size, f);
-    fclose(f);
-
-    snd_pcm_writei(pcm, samples, SAMPLE_RATE);
-
-    free(samples);
-
+    // A la même fréquence que le moteur, on écrit directement la projection
+    if(sample->rate == engine_get_sample_rate()) {
+        snd_pcm_writei(pcm, sample->data, sample->frames);
+        return;
+    }
+    // Sinon on le rééchantillonne par blocs
+    voice = create_sample_voice(sample, 0, engine_get_sample_rate());
+    remaining = (size_t)((double)sample->frames * engine_get_sample_rate() / sample->rate);
+    while(remaining > 0) {
+        count = remaining < ENGINE_BLOCK_FRAMES ? remaining : ENGINE_BLOCK_FRAMES;
+        render_sample_voice(&voice, buffer, count);
+        snd_pcm_writei(pcm, buffer, count);
+        remaining -= count;
+    }
 }
-
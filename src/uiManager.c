@@ -139,6 +139,59 @@ void print_sequencer_lines(WINDOW *win, short channelId, music_t *music, sequenc
 */
 void change_sequencer_note(note_t *note, short col, scale_t scale, int isUp);
 
+/**
+ * \fn int get_sequencer_selection(const sequencer_nav_t *seqNav, short *chFirst, short *chLast, int *start, int *end)
+ * \brief Récupère la région sélectionnée, entre le coin posé et le curseur
+ * \param seqNav La structure de navigation dans le séquenceur
+ * \param chFirst Reçoit le premier channel
+ * \param chLast Reçoit le dernier channel
+ * \param start Reçoit la première ligne
+ * \param end Reçoit la dernière ligne
+ * \return 1 si une région est sélectionnée, 0 si elle se réduit à la ligne du curseur
+ */
+int get_sequencer_selection(const sequencer_nav_t *seqNav, short *chFirst, short *chLast, int *start, int *end);
+
+/**
+ * \fn int change_sequencer_selection(journal_t *journal, music_t *music, const sequencer_nav_t *seqNav, int isUp)
+ * \brief Modification de toutes les notes de la région sélectionnée en fonction de la colonne actuelle
+ * \param journal Le journal des éditions
+ * \param music La musique
+ * \param seqNav La structure de navigation dans le séquenceur
+ * \param isUp La direction de la modification (0 pour le bas, 1 pour le haut)
+ * \return Le nombre de lignes modifiées
+ */
+int change_sequencer_selection(journal_t *journal, music_t *music, const sequencer_nav_t *seqNav, int isUp);
+
+/**
+ * \fn mpp_response_t save_sequencer_music(journal_t *journal, music_t *music, char *rfid)
+ * \brief Sauvegarde de la musique du séquenceur, seules les lignes modifiées depuis la dernière sauvegarde sont envoyées
+ * \param journal Le journal des éditions, qui garde les lignes modifiées
+ * \param music La musique
+ * \param rfid Le rfid de l'utilisateur
+ * \return La réponse du serveur
+ */
+mpp_response_t save_sequencer_music(journal_t *journal, music_t *music, char *rfid);
+
+/**
+ * \fn mpp_response_t resolve_save_conflict(journal_t *journal, music_t *music, char *rfid, int deleted)
+ * \brief Demande à l'utilisateur quoi faire d'une sauvegarde refusée : la musique a changé ou disparu sur le serveur
+ * \param journal Le journal des éditions
+ * \param music La musique, remplacée par celle du serveur si l'utilisateur la recharge
+ * \param rfid Le rfid de l'utilisateur
+ * \param deleted 1 si la musique a été supprimée du serveur, 0 si elle y a été modifiée
+ * \return La réponse du serveur, un code inférieur à MPP_RESPONSE_BAD_REQUEST si la musique du séquenceur est
+ * celle du serveur
+ */
+mpp_response_t resolve_save_conflict(journal_t *journal, music_t *music, char *rfid, int deleted);
+
+/**
+ * \fn void show_audio_stats(WINDOW *win, int y, int x)
+ * \brief Affichage de l'état du moteur audio : qualité, sous-alimentations récentes et plugin le plus coûteux
+ * \param win La fenêtre où afficher l'état
+ * \param y La ligne
+ * \param x La colonne
+ */
+void show_audio_stats(WINDOW *win, int y, int x);
 
 /**********************************************************************************************************************/
 /*                                           Public Fonction Definitions                                              */
@@ -316,11 +369,18 @@ choices_t show_list_music(char *rfid, music_t *music) {
             }
             attroff(A_REVERSE);
         }
+        // Musique jouée par la liste de lecture
+        if(get_playlist_current() != -1) mvprintw(4 + MAX_MENU_ITEMS, 4, "Playing %-4d [P] : stop", get_playlist_current());
+        else mvprintw(4 + MAX_MENU_ITEMS, 4, "%-30s", "[P] : play from selection");
         refresh();
         c = getch();
         timeout(1);
         if(c == ERR) c = getchr_wiringpi();
         switch (c) {
+            case KEY_BUTTON_PLAYLIST:
+                if(get_playlist_current() != -1) stop_playlist();
+                else start_playlist(rfid, musicIds, current);
+                break;
             case KEY_UP:
                 if(current > 0) current--;
                 if(current < start) start--;
@@ -332,9 +392,13 @@ choices_t show_list_music(char *rfid, music_t *music) {
                 if(current >= MAX_MENU_ITEMS) start++;
                 break;
             case KEY_BUTTON_CHANGEMODE:
+                // On passe au séquenceur, la liste de lecture s'arrête
+                stop_playlist();
                 // On récupère la musique
                 response = client_request_handler(MPP_GET_MUSIC, rfid, music, musicIds->musicIds[current]);
                 if(response.code == MPP_RESPONSE_OK) {
+                    // La musique reçue remplace la précédente, on reprend ses blocs de notes
+                    free_music(music);
                     *music = *response.music;
 
                 } else {
@@ -373,6 +437,7 @@ void show_date(time_t timestamp, char *chaine) {
  */
 choices_t show_create_music_menu(music_t *music, char *rfid) {
     init_menu("Create music", "", 1);
+    free_music(music);
     init_music(music, 120);
     music->bpm = 120;
     char date[20];
@@ -461,7 +526,7 @@ void sequencer_nav_down(sequencer_nav_t *nav, int channelId) {
         channelId = nav->ch;
     }
     if (nav->lines[channelId] >= nav->start[channelId] + SEQUENCER_CH_LINES - 4) nav->start[channelId] = nav->start[channelId] + SEQUENCER_CH_LINES - 3; // On défile vers le bas
-    if (nav->lines[channelId] < CHANNEL_MAX_NOTES - 1) nav->lines[channelId]++;
+    nav->lines[channelId]++;
 }
 
 /**
@@ -501,6 +566,23 @@ void sequencer_nav_right(sequencer_nav_t *nav) {
     if (nav->col < SEQUENCER_NAV_COL_MAX - 1) nav->col++;
 }
 
+/**
+ * @fn void sequencer_nav_goto(sequencer_nav_t *nav, int channelId, int line)
+ * @brief Place le curseur d'un channel sur une ligne, en faisant défiler le channel si besoin
+ * @param nav la structure de navigation
+ * @param channelId le channel (-1 pour le channel sélectionné)
+ * @param line la ligne
+ */
+void sequencer_nav_goto(sequencer_nav_t *nav, int channelId, int line) {
+    if(channelId == -1) {
+        channelId = nav->ch;
+    }
+    if (line < 0) return;
+    nav->lines[channelId] = line;
+    // On affiche la page qui contient la ligne
+    nav->start[channelId] = line - line % (SEQUENCER_CH_LINES - 3);
+}
+
 /**
  * @fn create_sequencer_nav()
  * @brief Création de la structure de navigation du séquenceur
@@ -514,7 +596,11 @@ sequencer_nav_t create_sequencer_nav(int playMode) {
     for (i = 0; i < SEQUENCER_NAV_CH_MAX; i++) {
         nav.start[i] = 0;
         nav.lines[i] = 0;
+        nav.played[i] = -1;
     }
+    nav.marked = 0;
+    nav.markCh = SEQUENCER_NAV_CH1;
+    nav.markLine = -1;
     nav.playMode = playMode;
     //nav.line = 0;
     return nav;
@@ -532,10 +618,16 @@ sequencer_nav_t create_sequencer_nav(int playMode) {
 choices_t show_sequencer(music_t *music, char *rfid) {
     mpp_response_t reponse;
     choices_t choice = -1;
-    note_t *note;
+    note_t note;
+    playback_t playback = { .running = 0 }; // Lecture en arrière-plan, pendant l'édition
+    journal_t *journal = create_journal(JOURNAL_DEFAULT_DELTAS); // Historique des éditions
     int i;
     char need2save = 0;
     int btnMode = NAVIGATION_MODE;
+    int loopStart = -1; // Première ligne de la boucle en cours de sélection
+    note_clipboard_t clipboard = { 0, 0, NULL }; // Dernière région copiée
+    short chFirst, chLast;
+    int start, end;
     int c = ERR; // la touche pressée
     clear(); // on nettoie l'écran
     bkgd(COLOR_PAIR(COLOR_PAIR_SEQ)); // on change la couleur du background
@@ -566,9 +658,24 @@ choices_t show_sequencer(music_t *music, char *rfid) {
                     sequencer_nav_up(&seqNav, -1);
                     break;
                 }
-                note = &(music->channels[seqNav.ch].notes[seqNav.lines[seqNav.ch]]);
-                change_sequencer_note(note, seqNav.col, scale, 1);
-                update_channel_nbNotes(&(music->channels[seqNav.ch]), seqNav.lines[seqNav.ch]);
+                if(seqNav.marked) {
+                    // Toute la région change d'un coup, en une seule action annulable
+                    journal_begin(journal);
+                    if(change_sequencer_selection(journal, music, &seqNav, 1) > 0) {
+                        publish_playback(&playback, music);
+                        publish_loop(music);
+                        need2save = 1;
+                    }
+                    break;
+                }
+                note = get_channel_note(&(music->channels[seqNav.ch]), seqNav.lines[seqNav.ch]);
+                change_sequencer_note(&note, seqNav.col, scale, 1);
+                // Chaque appui est une action annulable
+                journal_begin(journal);
+                journal_set_note(journal, music, seqNav.ch, seqNav.lines[seqNav.ch], note);
+                // La lecture et la boucle en cours prennent la note modifiée sans s'arrêter
+                publish_playback(&playback, music);
+                publish_loop(music);
                 need2save = 1;
                 break;
 
@@ -576,10 +683,22 @@ choices_t show_sequencer(music_t *music, char *rfid) {
                 if(seqNav.col == SEQUENCER_NAV_COL_LINE) {
                     sequencer_nav_down(&seqNav, -1);
                 }
+                if(seqNav.marked) {
+                    journal_begin(journal);
+                    if(change_sequencer_selection(journal, music, &seqNav, 0) > 0) {
+                        publish_playback(&playback, music);
+                        publish_loop(music);
+                        need2save = 1;
+                    }
+                    break;
+                }
                 // Sinon modification de la note
-                note = &(music->channels[seqNav.ch].notes[seqNav.lines[seqNav.ch]]);
-                change_sequencer_note(note, seqNav.col, scale, 0);
-                update_channel_nbNotes(&(music->channels[seqNav.ch]), seqNav.lines[seqNav.ch]);
+                note = get_channel_note(&(music->channels[seqNav.ch]), seqNav.lines[seqNav.ch]);
+                change_sequencer_note(&note, seqNav.col, scale, 0);
+                journal_begin(journal);
+                journal_set_note(journal, music, seqNav.ch, seqNav.lines[seqNav.ch], note);
+                publish_playback(&playback, music);
+                publish_loop(music);
                 need2save = 1;
                 break;
             case KEY_LEFT:
@@ -596,10 +715,32 @@ choices_t show_sequencer(music_t *music, char *rfid) {
             case KEY_BUTTON_CH1NSAVE:
                 if(btnMode == EDIT_MODE) {
                     if(*rfid != '\0') {
-                        reponse = client_request_handler(MPP_ADD_MUSIC, rfid, music, -1);
+                        reponse = save_sequencer_music(journal, music, rfid);
+                        if(CONFLICT((&reponse)) || NOT_FOUND((&reponse))) {
+                            // Rien n'est écrasé sur le serveur sans l'accord de l'utilisateur
+                            stop_loop();
+                            stop_playback(&playback);
+                            clear_response(&reponse);
+                            reponse = resolve_save_conflict(journal, music, rfid, NOT_FOUND((&reponse)));
+                            // La musique rechargée peut être plus courte : on repart du début
+                            seqNav = create_sequencer_nav(seqNav.playMode);
+                            // On redessine le séquenceur par dessus la boîte de dialogue
+                            clear();
+                            bkgd(COLOR_PAIR(COLOR_PAIR_SEQ));
+                            refresh();
+                            touchwin(seqHelp);
+                            wrefresh(seqHelp);
+                            touchwin(seqBody);
+                            wrefresh(seqBody);
+                            for(i = 0; i < MUSIC_MAX_CHANNELS; i++) {
+                                touchwin(channelWin[i]);
+                                wrefresh(channelWin[i]);
+                            }
+                        }
                         if(reponse.code < MPP_RESPONSE_BAD_REQUEST) {
                             need2save = 0;
                         }
+                        clear_response(&reponse);
                     }
                     break;
                 }
@@ -620,7 +761,10 @@ choices_t show_sequencer(music_t *music, char *rfid) {
 
             case KEY_BUTTON_CH3NPLAY:
                 if(btnMode == EDIT_MODE) {
-                    play_music(channelWin, music);
+                    // 1er appui : lecture en arrière-plan, 2ème : arrêt
+                    stop_loop();
+                    if(playback.running) stop_playback(&playback);
+                    else start_playback(&playback, music, 0);
                     break;
                 } 
                 // On change de channel
@@ -637,16 +781,116 @@ choices_t show_sequencer(music_t *music, char *rfid) {
                 sequencer_nav_down(&seqNav, -1);
             break;
 
+            case KEY_BUTTON_PLAYFROM:
+                // On part du début de la ligne sélectionnée, les autres channels se calent sur le même instant
+                stop_loop();
+                stop_playback(&playback);
+                start_playback(&playback, music, line_to_frame(&music->channels[seqNav.ch], seqNav.lines[seqNav.ch], music->bpm));
+                break;
+
+            case KEY_BUTTON_NEXTNOTE:
+                // -1 s'il n'y a pas d'autre note : le curseur ne bouge pas
+                sequencer_nav_goto(&seqNav, -1, next_channel_note(&music->channels[seqNav.ch], seqNav.lines[seqNav.ch] + 1));
+                break;
+
+            case KEY_BUTTON_PREVNOTE:
+                sequencer_nav_goto(&seqNav, -1, prev_channel_note(&music->channels[seqNav.ch], seqNav.lines[seqNav.ch] - 1));
+                break;
+
+            case KEY_BUTTON_PATTERN:
+                // La mesure (bloc de NOTE_BLOCK_SIZE lignes) sous le curseur devient une répétition de la précédente
+                journal_begin(journal);
+                if(journal_link_pattern(journal, music, seqNav.ch, seqNav.lines[seqNav.ch], seqNav.lines[seqNav.ch] - NOTE_BLOCK_SIZE) > 0) {
+                    publish_playback(&playback, music);
+                    publish_loop(music);
+                    need2save = 1;
+                }
+                break;
+
+            case KEY_BUTTON_UNDO:
+            case KEY_BUTTON_REDO:
+                if((c == KEY_BUTTON_UNDO ? journal_undo(journal, music) : journal_redo(journal, music)) > 0) {
+                    publish_playback(&playback, music);
+                    publish_loop(music);
+                    need2save = 1;
+                }
+                break;
+
+            case KEY_BUTTON_MARK:
+                // Le coin posé reste en place, l'autre coin de la région suit le curseur
+                if(!seqNav.marked) {
+                    seqNav.marked = 1;
+                    seqNav.markCh = seqNav.ch;
+                    seqNav.markLine = seqNav.lines[seqNav.ch];
+                } else {
+                    seqNav.marked = 0;
+                    seqNav.markLine = -1;
+                }
+                break;
+
+            case KEY_BUTTON_COPY:
+                get_sequencer_selection(&seqNav, &chFirst, &chLast, &start, &end);
+                copy_range(music, chFirst, chLast, start, end, &clipboard);
+                break;
+
+            case KEY_BUTTON_PASTE:
+                journal_begin(journal);
+                if(journal_paste_range(journal, music, &clipboard, seqNav.ch, seqNav.lines[seqNav.ch]) > 0) {
+                    publish_playback(&playback, music);
+                    publish_loop(music);
+                    need2save = 1;
+                }
+                break;
+
+            case KEY_BUTTON_INSERT:
+            case KEY_BUTTON_DELETE:
+                // Autant de lignes que la région sélectionnée en compte, les lignes suivantes sont décalées
+                get_sequencer_selection(&seqNav, &chFirst, &chLast, &start, &end);
+                journal_begin(journal);
+                if(journal_shift_range(journal, music, chFirst, chLast, start, c == KEY_BUTTON_INSERT ? end - start + 1 : start - end - 1) > 0) {
+                    publish_playback(&playback, music);
+                    publish_loop(music);
+                    need2save = 1;
+                }
+                break;
+
+            case KEY_BUTTON_LOOP:
+                // 1er appui : début de la région, 2ème : fin et lecture, 3ème : arrêt
+                if(is_looping()) {
+                    stop_loop();
+                } else if(loopStart == -1) {
+                    loopStart = seqNav.lines[seqNav.ch];
+                } else {
+                    stop_playback(&playback);
+                    start_loop(music, loopStart, seqNav.lines[seqNav.ch]);
+                    loopStart = -1;
+                }
+                if(is_looping()) mvwprintw(seqBody, 0, 1, "%-24s", "SEQUENCER [LOOP]");
+                else if(loopStart != -1) mvwprintw(seqBody, 0, 1, "SEQUENCER [LOOP %4d- ]  ", loopStart);
+                else mvwprintw(seqBody, 0, 1, "%-24s", "SEQUENCER");
+                wrefresh(seqBody);
+            break;
+
             default:
                 break;
         }
+        // On relève les lignes jouées en arrière-plan
+        poll_playback(&playback);
+        for(i = 0; i < MUSIC_MAX_CHANNELS; i++) seqNav.played[i] = playback.running ? playback.nav.lines[i] : -1;
         // On rafraichit les fenêtres
         show_sequencer_info(seqInfo, music, btnMode, need2save);
         show_sequencer_channels(channelWin, music, &seqNav);
         //mvwprintw(seqBody, 0, 1, "%d, %d, %d %d", music->channels[0].nbNotes, music->channels[1].nbNotes, music->channels[2].nbNotes, seqNav.lines[seqNav.ch]);
     }
 
+    // La boucle et la lecture ne survivent pas au séquenceur
+    stop_loop();
+    stop_playback(&playback);
+    // Les lignes modifiées sont oubliées avec le journal : la prochaine sauvegarde enverra la musique entière
+    if(need2save) music->revision = 0;
     // On libère la mémoire
+    free_journal(journal);
+    free_clipboard(&clipboard);
     delwin(seqInfo);
     delwin(seqHelp);
     delwin(seqBody);
@@ -669,51 +913,99 @@ int getchr_wiringpi()
 }
 
 /**
- * @fn void play_music(music_t *music)
- * @brief Joue la musique et affiche les lignes jouées
+ * @fn void start_playback(playback_t *playback, const music_t *music, size_t frame)
+ * @brief Lance la lecture de la musique en arrière-plan à partir d'un instant
+ * @param playback La lecture (arrêtée)
+ * @param music La musique (une version figée en est prise)
+ * @param frame L'instant de départ, en échantillons depuis le début de la musique
+ * @note Chaque channel reprend au milieu de la note jouée à cet instant, tous restent alignés
  */
-void play_music(WINDOW **channelWin, music_t *music) {
-    pthread_t threads[MUSIC_MAX_CHANNELS];
-    sem_t show_sem[MUSIC_MAX_CHANNELS];
-    sem_t syncSem; // Sémaphore de synchronisation
-    sem_t finishSem; // Sémaphore de fin
-    sequencer_nav_t seqNav = create_sequencer_nav(1);
-    int i, finishCount = 0;
+void start_playback(playback_t *playback, const music_t *music, size_t frame) {
+    music_snapshot_t *snapshot = create_snapshot(music);
+    int i;
+    playback->nav = create_sequencer_nav(1);
+    playback->stop = 0;
+    playback->finished = 0;
+    playback->running = 1;
     // On attend que tout est en place pour jouer la musique
-    sem_init(&syncSem, 0, 0);
-    sem_init(&finishSem, 0, 0);
+    sem_init(&playback->syncSem, 0, 0);
+    sem_init(&playback->finishSem, 0, 0);
     for(i = 0; i < MUSIC_MAX_CHANNELS; i++) {
-        sem_init(show_sem + i , 0, 0);
-        channel_thread_args_t *args = create_channel_thread_args(show_sem + i, &syncSem, &finishSem, &seqNav, music, i);
-        pthread_create(&threads[i], NULL, play_channel, (void *) args);
+        sem_init(&playback->showSem[i], 0, 0);
+        // Chaque channel part de la même version
+        playback->mailboxes[i].latest = NULL;
+        publish_snapshot(&playback->mailboxes[i], retain_snapshot(snapshot));
+        channel_thread_args_t *args = create_channel_thread_args(&playback->showSem[i], &playback->syncSem, &playback->finishSem, &playback->nav, &playback->mailboxes[i], &playback->stop, i);
+        // Ligne jouée à cet instant dans ce channel, sans parcourir les notes précédentes
+        args->startLine = frame_to_line(&music->channels[i], frame, music->bpm, &args->skip);
+        playback->nav.lines[i] = args->startLine;
+        playback->nav.start[i] = args->startLine - args->startLine % (SEQUENCER_CH_LINES - 3);
+        pthread_create(&playback->threads[i], NULL, play_channel, (void *) args);
         // mettre la priorité des threads aux maximum
         struct sched_param param;
         param.sched_priority = sched_get_priority_max(SCHED_FIFO);
-        pthread_setschedparam(threads[i], SCHED_FIFO, &param);
+        pthread_setschedparam(playback->threads[i], SCHED_FIFO, &param);
     }
-    show_sequencer_channels(channelWin, music, &seqNav);
+    release_snapshot(snapshot);
     for(i = 0; i < MUSIC_MAX_CHANNELS; i++) {
         // On débloque les threads
-        sem_post(&syncSem);
+        sem_post(&playback->syncSem);
     }
+}
 
-    while(finishCount < MUSIC_MAX_CHANNELS) {
-        if(sem_trywait(&finishSem) == 0) finishCount++;
-
-        for(i = 0; i < MUSIC_MAX_CHANNELS; i++) {
-            if(sem_trywait(&show_sem[i]) == 0) {
-                print_sequencer_lines(channelWin[i], i, music, &seqNav);
-            }
-        }
+/**
+ * @fn int poll_playback(playback_t *playback)
+ * @brief Relève les lignes jouées depuis le dernier appel et attend les threads à la fin de la lecture
+ * @param playback La lecture
+ * @return Les channels dont la ligne jouée a changé (bit i pour le channel i)
+ */
+int poll_playback(playback_t *playback) {
+    int i, changed = 0;
+    if(!playback->running) return 0;
+    while(sem_trywait(&playback->finishSem) == 0) playback->finished++;
+    for(i = 0; i < MUSIC_MAX_CHANNELS; i++) {
+        while(sem_trywait(&playback->showSem[i]) == 0) changed |= 1 << i;
     }
+    if(playback->finished < MUSIC_MAX_CHANNELS) return changed;
 
-    // On libère les sémaphores
-    sem_destroy(&syncSem);
-    sem_destroy(&finishSem);
+    // Tous les channels ont fini : on libère la lecture
     for(i = 0; i < MUSIC_MAX_CHANNELS; i++) {
-        sem_destroy(&show_sem[i]);
+        pthread_join(playback->threads[i], NULL);
+        clear_mailbox(&playback->mailboxes[i]);
+        sem_destroy(&playback->showSem[i]);
     }
+    sem_destroy(&playback->syncSem);
+    sem_destroy(&playback->finishSem);
+    playback->running = 0;
+    return changed;
+}
 
+/**
+ * @fn void publish_playback(playback_t *playback, const music_t *music)
+ * @brief Transmet l'état courant de la musique à la lecture en cours
+ * @param playback La lecture
+ * @param music La musique éditée
+ * @note Sans effet si la lecture est arrêtée. Les channels passent à la nouvelle version à leur note suivante
+ */
+void publish_playback(playback_t *playback, const music_t *music) {
+    music_snapshot_t *snapshot;
+    int i;
+    if(!playback->running) return;
+    // Une seule version, partagée par les channels : seuls les index des blocs sont copiés
+    snapshot = create_snapshot(music);
+    for(i = 0; i < MUSIC_MAX_CHANNELS; i++) publish_snapshot(&playback->mailboxes[i], retain_snapshot(snapshot));
+    release_snapshot(snapshot);
+}
+
+/**
+ * @fn void stop_playback(playback_t *playback)
+ * @brief Arrête la lecture à la fin des notes en cours et attend les threads
+ * @param playback La lecture
+ */
+void stop_playback(playback_t *playback) {
+    if(!playback->running) return;
+    __atomic_store_n(&playback->stop, 1, __ATOMIC_RELEASE);
+    while(playback->running) poll_playback(playback);
 }
 
 /**
@@ -730,22 +1022,27 @@ void *play_channel(void *args) {
     sem_t *finishSem = channelArgs->finishSem;
     sem_t *show_sem = channelArgs->showSem;
     sequencer_nav_t *seqNav = channelArgs->seqNav;
-    music_t *music = channelArgs->music;
-    channel_t *channel = &(music->channels[channelId]);
+    music_snapshot_t *snapshot = NULL;
+    const channel_t *channel;
     snd_pcm_t *pcm;
     // On initialise le pcm
     init_sound(&pcm);
     // On attend que tout le monde soit prêt
     sem_wait(syncSem);
-    for(i = 0; i < channel->nbNotes; i++) {
+    for(i = channelArgs->startLine; !__atomic_load_n(channelArgs->stop, __ATOMIC_ACQUIRE); i++) {
+        // Entre deux notes, on passe à la dernière version éditée, sans verrou
+        snapshot = update_snapshot(channelArgs->mailbox, snapshot);
+        channel = &snapshot->music.channels[channelId];
+        if(i >= channel->nbNotes) break;
         snd_pcm_prepare(pcm);
-        // On joue la note
-        play_note(channel->notes[i], music->bpm, pcm, effect);
+        // On joue la note (la première peut reprendre en son milieu), un motif répété partage le rendu de sa première occurrence
+        play_channel_note_from(channelId, get_channel_pattern_line(channel, i), get_channel_note(channel, i), snapshot->music.bpm, pcm, effect, i == channelArgs->startLine ? channelArgs->skip : 0);
         snd_pcm_drain(pcm);
         sequencer_nav_down(seqNav, channelId);
         // On met à jour la fenêtre
         sem_post(show_sem);
     }
+    release_snapshot(snapshot);
     // On libère le pcm
     end_sound(pcm);
     // On libère le sémaphore de fin
@@ -755,19 +1052,22 @@ void *play_channel(void *args) {
 }
 
 /**
- * @brief create_channel_thread_args(sem_t *syncSem, sem_t *finishSem, sequencer_nav_t *seqNav, music_t *music, int channel)
+ * @brief create_channel_thread_args(sem_t *syncSem, sem_t *finishSem, sequencer_nav_t *seqNav, snapshot_mailbox_t *mailbox, int *stop, int channel)
  * @brief Crée les arguments pour le thread de channel
  * @return channel_thread_args_t 
  * @note Les arguments doivent être libérés après utilisation
  */
-channel_thread_args_t *create_channel_thread_args(sem_t *showSem, sem_t *syncSem, sem_t *finishSem, sequencer_nav_t *seqNav, music_t *music, int channel) {
+channel_thread_args_t *create_channel_thread_args(sem_t *showSem, sem_t *syncSem, sem_t *finishSem, sequencer_nav_t *seqNav, snapshot_mailbox_t *mailbox, int *stop, int channel) {
     channel_thread_args_t *args = malloc(sizeof(channel_thread_args_t));
     args->showSem = showSem;
     args->syncSem = syncSem;
     args->finishSem = finishSem;
     args->seqNav = seqNav;
-    args->music = music;
+    args->mailbox = mailbox;
+    args->stop = stop;
     args->channel = channel;
+    args->startLine = 0;
+    args->skip = 0;
     return args;
 }
 
@@ -794,13 +1094,16 @@ void show_sequencer_info(WINDOW *win, music_t *music, int mode, char need2save)
     mvwprintw(win, 1, 1, "Created :");
     mvwprintw(win, 2, 1, "BPM :");
     mvwprintw(win, 3, 1, "Mode :");
+    mvwprintw(win, 2, 20, "Notes :");
     // On affiche les informations
     wattron(win, ( need2save ? COLOR_PAIR(COLOR_PAIR_SEQ_NOTSAVED) : COLOR_PAIR(COLOR_PAIR_SEQ_SAVED) )  | A_BOLD);
     mvwprintw(win, 1, 10, " %s", date);
     wattroff(win, need2save ? COLOR_PAIR(COLOR_PAIR_MENU_WARNING) : COLOR_PAIR(COLOR_PAIR_SEQ_NOTE) | A_BOLD);
     wattron(win, A_BOLD);
     mvwprintw(win, 2, 6, " %d", music->bpm);
+    mvwprintw(win, 2, 27, " %d", count_channel_notes(&music->channels[0]) + count_channel_notes(&music->channels[1]) + count_channel_notes(&music->channels[2]));
     wattroff(win, A_BOLD);
+    show_audio_stats(win, 3, 20);
 
     if(mode == NAVIGATION_MODE) {
         wattron(win, COLOR_PAIR(COLOR_PAIR_SEQ_OCTAVE) | A_BOLD);
@@ -815,7 +1118,7 @@ void show_sequencer_info(WINDOW *win, music_t *music, int mode, char need2save)
         mvwprintw(win, 3, 8, "%s", "EDITION");
         wattroff(win, COLOR_PAIR(COLOR_PAIR_SEQ_NOTE));
         wattron(win, COLOR_PAIR(COLOR_PAIR_SEQ));
-        mvwprintw(win, 4, 1, "[BTN1] Save        [BTN2] Quit       [BTN3] Play ");
+        mvwprintw(win, 4, 1, "[BTN1] Save        [BTN2] Quit       [BTN3] Play/Stop");
         wattroff(win, COLOR_PAIR(COLOR_PAIR_SEQ) | A_BOLD);
     }
     
@@ -841,11 +1144,12 @@ void show_sequencer_help(WINDOW *win) {
     mvwaddch(win, 1, 1, ACS_DARROW);
     mvwaddch(win, 1, 3, ACS_UARROW);
 
-    mvwprintw(win, 2, 1, "%s", " / : Change column in the channel");
+    mvwprintw(win, 2, 1, "%s", " / : Change column in the channel  [O] : Repeat bar");
     mvwaddch(win, 2, 1, ACS_LARROW);
     mvwaddch(win, 2, 3, ACS_RARROW);
 
-    mvwprintw(win, 3, 1, "%s", "[BTN4] : Change button mode");
+    mvwprintw(win, 3, 1, "%s", "[BTN4] : Mode  [U]/[Y] : Undo/Redo  [N]/[B] : Note");
+    mvwprintw(win, 4, 1, "%s", "[L] : Loop start/end/stop  [K] : Play from cursor");
     // On rafraichit la fenêtre
     wrefresh(win);
 }
@@ -1026,16 +1330,13 @@ choices_t create_menu(const char *title, const char *text, char **choices, int n
 void print_sequencer_lines(WINDOW *win, short channelId, music_t *music, sequencer_nav_t *seqNav) {
     // On affiche les informations
     int i;
+    note_t notes[SEQUENCER_CH_LINES - 3];
+    // On lit toutes les lignes visibles d'un coup
+    get_channel_notes(&music->channels[channelId], seqNav->start[channelId], SEQUENCER_CH_LINES - 3, notes);
     for(i = 0; i < SEQUENCER_CH_LINES - 3; i++) {
-        if(seqNav->start[channelId] + i >= CHANNEL_MAX_NOTES) {
-            note_t emptyNote = create_note(-1, -1, -1, -1, -1);
-            print_sequencer_note(win, emptyNote, channelId, i, seqNav, 0);
-            continue;
-        }
-        note_t note = music->channels[channelId].notes[seqNav->start[channelId] + i];
         int isSelected = 0;
         if(seqNav->ch == channelId && seqNav->lines[channelId] == seqNav->start[channelId]+i) isSelected = 1;
-        print_sequencer_note(win, note, channelId, i, seqNav, isSelected);
+        print_sequencer_note(win, notes[i], channelId, i, seqNav, isSelected);
     }
     // On rafraichit la fenêtre
     wrefresh(win);
@@ -1057,14 +1358,17 @@ void print_sequencer_note(WINDOW *win, note_t note, short ch, int line, sequence
     char instrumentName[5]; // Nom de l'instrument
     char noteName[3]; // Nom de la note
     int playModeSelected = seqNav->playMode && seqNav->lines[ch] == seqNav->start[ch] + line ? 1 : 0;
+    // Pendant l'édition, la ligne jouée en arrière-plan est repérée par son numéro
+    int isPlayed = !seqNav->playMode && seqNav->played[ch] == seqNav->start[ch] + line ? 1 : 0;
+    // Les lignes de la région sélectionnée sont soulignées
+    short chFirst, chLast;
+    int start, end;
+    int isMarked = !seqNav->playMode && get_sequencer_selection(seqNav, &chFirst, &chLast, &start, &end) && ch >= chFirst && ch <= chLast && seqNav->start[ch] + line >= start && seqNav->start[ch] + line <= end ? 1 : 0;
     note2str(note, noteName); // On récupère le nom de la note
     instrument2str(note.instrument, instrumentName); // On récupère le nom de l'instrument
-    wattron(win, COLOR_PAIR(COLOR_PAIR_SEQ) | REVERSE_IF_COL(seqNav->col, SEQUENCER_NAV_COL_LINE, isSelected) |  REVERSE_IF_COL(seqNav->col, SEQUENCER_NAV_COL_LINE, playModeSelected));
-    if(seqNav->start[ch] + line >= CHANNEL_MAX_NOTES) {
-        mvwprintw(win, 2+line, 1, "%s", "----");
-    }
-    else mvwprintw(win, 2+line, 1, "%04X", seqNav->start[ch] + line);
-    wattroff(win, COLOR_PAIR(COLOR_PAIR_SEQ) | REVERSE_IFNOT_PLAYMODE(seqNav->playMode, playModeSelected));
+    wattron(win, COLOR_PAIR(COLOR_PAIR_SEQ) | REVERSE_IF_COL(seqNav->col, SEQUENCER_NAV_COL_LINE, isSelected) |  REVERSE_IF_COL(seqNav->col, SEQUENCER_NAV_COL_LINE, playModeSelected) | (isPlayed ? A_REVERSE : 0) | (isMarked ? A_UNDERLINE : 0));
+    mvwprintw(win, 2+line, 1, "%04X", seqNav->start[ch] + line);
+    wattroff(win, COLOR_PAIR(COLOR_PAIR_SEQ) | REVERSE_IFNOT_PLAYMODE(seqNav->playMode, playModeSelected) | A_UNDERLINE);
     wattron(win, COLOR_PAIR(COLOR_PAIR_SEQ));
     mvwprintw(win, 2+line, 5, "|");
     mvwprintw(win, 2+line, 10, "|");
@@ -1113,12 +1417,12 @@ void change_sequencer_note(note_t *note, short col, scale_t scale, int isUp) {
             }
             break;
         case SEQUENCER_NAV_COL_OCTAVE:
-            if (isUp) note->octave = note->octave + 1 > 8 ? 8 : note->octave + 1;
-            else note->octave = note->octave - 1 < 0 ? 8 : note->octave - 1;
+            if (isUp) note->octave = note->octave + 1 > NOTE_OCTAVE_MAX ? NOTE_OCTAVE_MAX : note->octave + 1;
+            else note->octave = note->octave - 1 < 0 ? NOTE_OCTAVE_MAX : note->octave - 1;
             break;
         case SEQUENCER_NAV_COL_INSTRUMENT:
-            if (isUp) note->instrument = note->instrument + 1 == INSTRUMENT_NB ? 0 : note->instrument + 1;
-            else note->instrument = (note->instrument - 1) == -1 ? INSTRUMENT_NB - 1 : note->instrument - 1;
+            // Les identifiants des instruments chargés ne se suivent pas : on saute les identifiants libres
+            note->instrument = next_instrument(note->instrument, isUp);
             break;
         case SEQUENCER_NAV_COL_TIME:
             if(note->time < TIME_END) note->time = isUp ? note->time * 2 : note->time / 2;
@@ -1128,6 +1432,136 @@ void change_sequencer_note(note_t *note, short col, scale_t scale, int isUp) {
     }
 }
 
+/**
+ * \fn int get_sequencer_selection(const sequencer_nav_t *seqNav, short *chFirst, short *chLast, int *start, int *end)
+ * \brief Récupère la région sélectionnée, entre le coin posé et le curseur
+ * \param seqNav La structure de navigation dans le séquenceur
+ * \param chFirst Reçoit le premier channel
+ * \param chLast Reçoit le dernier channel
+ * \param start Reçoit la première ligne
+ * \param end Reçoit la dernière ligne
+ * \return 1 si une région est sélectionnée, 0 si elle se réduit à la ligne du curseur
+ */
+int get_sequencer_selection(const sequencer_nav_t *seqNav, short *chFirst, short *chLast, int *start, int *end) {
+    int line = seqNav->lines[seqNav->ch];
+    // Sans coin posé, la région est la ligne du curseur
+    if(!seqNav->marked) {
+        *chFirst = *chLast = seqNav->ch;
+        *start = *end = line;
+        return 0;
+    }
+    *chFirst = seqNav->markCh < seqNav->ch ? seqNav->markCh : seqNav->ch;
+    *chLast = seqNav->markCh < seqNav->ch ? seqNav->ch : seqNav->markCh;
+    *start = seqNav->markLine < line ? seqNav->markLine : line;
+    *end = seqNav->markLine < line ? line : seqNav->markLine;
+    return 1;
+}
+
+/**
+ * \fn int change_sequencer_selection(journal_t *journal, music_t *music, const sequencer_nav_t *seqNav, int isUp)
+ * \brief Modification de toutes les notes de la région sélectionnée en fonction de la colonne actuelle
+ * \param journal Le journal des éditions
+ * \param music La musique
+ * \param seqNav La structure de navigation dans le séquenceur
+ * \param isUp La direction de la modification (0 pour le bas, 1 pour le haut)
+ * \return Le nombre de lignes modifiées
+ */
+int change_sequencer_selection(journal_t *journal, music_t *music, const sequencer_nav_t *seqNav, int isUp) {
+    short chFirst, chLast;
+    int start, end;
+    note_range_op_t op;
+    get_sequencer_selection(seqNav, &chFirst, &chLast, &start, &end);
+    // Sur une région, la colonne des notes transpose d'un demi-ton au lieu de suivre la gamme
+    switch(seqNav->col) {
+        case SEQUENCER_NAV_COL_NOTE: op = NOTE_RANGE_TRANSPOSE; break;
+        case SEQUENCER_NAV_COL_OCTAVE: op = NOTE_RANGE_OCTAVE; break;
+        case SEQUENCER_NAV_COL_INSTRUMENT: op = NOTE_RANGE_INSTRUMENT; break;
+        case SEQUENCER_NAV_COL_TIME: op = NOTE_RANGE_TIME; break;
+        default: return 0;
+    }
+    return journal_transform_range(journal, music, chFirst, chLast, start, end, op, isUp ? 1 : -1);
+}
+
+/**
+ * \fn mpp_response_t save_sequencer_music(journal_t *journal, music_t *music, char *rfid)
+ * \brief Sauvegarde de la musique du séquenceur, seules les lignes modifiées depuis la dernière sauvegarde sont envoyées
+ * \param journal Le journal des éditions, qui garde les lignes modifiées
+ * \param music La musique
+ * \param rfid Le rfid de l'utilisateur
+ * \return La réponse du serveur
+ */
+mpp_response_t save_sequencer_music(journal_t *journal, music_t *music, char *rfid) {
+    mpp_response_t response;
+    music_patch_t patch;
+    short ch;
+    int line;
+    // Au-delà de MPP_MAX_PATCH_NOTES lignes, la musique entière compressée coûte moins cher
+    if(journal->nbDirty > MPP_MAX_PATCH_NOTES) {
+        response = client_save_request_handler(rfid, music, NULL, 0);
+    } else {
+        init_music_patch(&patch, music);
+        for(ch = 0; ch < MUSIC_MAX_CHANNELS; ch++) {
+            for(line = journal_next_dirty(journal, ch, 0); line != -1; line = journal_next_dirty(journal, ch, line + 1)) {
+                add_music_patch_note(&patch, ch, line, pack_note(get_channel_note(&music->channels[ch], line)));
+            }
+        }
+        response = client_save_request_handler(rfid, music, &patch, 0);
+        free_music_patch(&patch);
+    }
+    if(response.code < MPP_RESPONSE_BAD_REQUEST) journal_mark_saved(journal);
+    return response;
+}
+
+/**
+ * \fn mpp_response_t resolve_save_conflict(journal_t *journal, music_t *music, char *rfid, int deleted)
+ * \brief Demande à l'utilisateur quoi faire d'une sauvegarde refusée : la musique a changé ou disparu sur le serveur
+ * \param journal Le journal des éditions
+ * \param music La musique, remplacée par celle du serveur si l'utilisateur la recharge
+ * \param rfid Le rfid de l'utilisateur
+ * \param deleted 1 si la musique a été supprimée du serveur, 0 si elle y a été modifiée
+ * \return La réponse du serveur, un code inférieur à MPP_RESPONSE_BAD_REQUEST si la musique du séquenceur est
+ * celle du serveur
+ */
+mpp_response_t resolve_save_conflict(journal_t *journal, music_t *music, char *rfid, int deleted) {
+    mpp_response_t response;
+    int c = ERR;
+    clear();
+    init_menu("Save conflict", "", 1);
+    attron(COLOR_PAIR(COLOR_PAIR_MENU_WARNING) | A_BOLD);
+    mvprintw(3, 4, "%s", deleted ? "This music was deleted from the server since it was loaded."
+                                 : "This music was saved from somewhere else since it was loaded.");
+    attroff(COLOR_PAIR(COLOR_PAIR_MENU_WARNING) | A_BOLD);
+    attron(COLOR_PAIR(COLOR_PAIR_MENU | A_BOLD));
+    mvprintw(RPI_LINES - 3, 4, "%s", deleted ? "[BTN0] Save it again" : "[BTN0] Overwrite it");
+    mvprintw(RPI_LINES - 3, RPI_COLS - 26, "%s", deleted ? "[BTN4] Keep editing" : "[BTN4] Reload server one");
+    attroff(COLOR_PAIR(COLOR_PAIR_MENU | A_BOLD));
+    refresh();
+    while(c != KEY_BUTTON_CH1NSAVE && c != KEY_BUTTON_CHANGEMODE) {
+        c = getch();
+        if(c == ERR) c = getchr_wiringpi();
+    }
+    if(c == KEY_BUTTON_CH1NSAVE) {
+        // La musique du séquenceur remplace celle du serveur, en entier : seul cet accord de l'utilisateur l'écrase
+        response = client_save_request_handler(rfid, music, NULL, 1);
+        if(response.code < MPP_RESPONSE_BAD_REQUEST) journal_mark_saved(journal);
+        return response;
+    }
+    if(deleted) return create_mpp_response(MPP_RESPONSE_NOT_FOUND, "", NULL, NULL);
+    // Les éditions du séquenceur sont abandonnées au profit de la version du serveur
+    response = client_request_handler(MPP_GET_MUSIC, rfid, NULL, music->date.tv_sec);
+    if(response.code != MPP_RESPONSE_OK || response.music == NULL) {
+        show_request_error("Error while retrieving music !");
+        return response;
+    }
+    free_music(music);
+    *music = *response.music;
+    free(response.music);
+    response.music = NULL;
+    clear_journal(journal);
+    journal_mark_saved(journal);
+    return response;
+}
+
 /**
  * @fn void wait_for_key()
  * @brief Attendre l'appui sur la touche KEY_BUTTON_CHANGEMODE
@@ -1179,4 +1613,32 @@ void show_sequencer_channels(WINDOW **channelWin, music_t *music, sequencer_nav_
     }
 }
 
+/**
+ * \fn void show_audio_stats(WINDOW *win, int y, int x)
+ * \brief Affichage de l'état du moteur audio : qualité, sous-alimentations récentes et plugin le plus coûteux
+ * \param win La fenêtre où afficher l'état
+ * \param y La ligne
+ * \param x La colonne
+ */
+void show_audio_stats(WINDOW *win, int y, int x) {
+    static const char *qualities[ENGINE_QUALITY_NB] = { "HIGH", "MED", "LOW" };
+    engine_event_t events[ENGINE_EVENTS_MAX];
+    plugin_stats_t plugins[PLUGIN_MAX];
+    int i, nbEvents, nbPlugins, underruns = 0, heaviest = -1;
+
+    nbEvents = engine_get_events(events, ENGINE_EVENTS_MAX);
+    for (i = 0; i < nbEvents; i++) {
+        if (events[i].type == ENGINE_EVENT_UNDERRUN) underruns++;
+    }
+    // Seul le plugin qui consomme le plus de budget audio est affiché
+    nbPlugins = get_plugin_stats(plugins, PLUGIN_MAX, engine_get_sample_rate());
+    for (i = 0; i < nbPlugins; i++) {
+        if (plugins[i].calls > 0 && (heaviest == -1 || plugins[i].load > plugins[heaviest].load)) heaviest = i;
+    }
 
+    mvwprintw(win, y, x, "Audio :");
+    wattron(win, A_BOLD);
+    mvwprintw(win, y, x + 7, " %-4s %2d xrun", qualities[engine_get_quality()], underruns);
+    if (heaviest != -1) mvwprintw(win, y, x + 21, " %s %3d%%", plugins[heaviest].name, (int) (plugins[heaviest].load * 100));
+    wattroff(win, A_BOLD);
+}
@@ -0,0 +1,37 @@
+/**
+ * @file test.h
+ * @brief Vérifications communes aux tests
+ * @details Chaque fichier test_X.c teste le module X et se lance seul (make test les lance tous). Une vérification
+ * qui échoue est affichée puis comptée et le test continue : le programme se termine en erreur si une seule a échoué.
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int testChecks = 0; /*!< Nombre de vérifications faites */
+static int testFailures = 0; /*!< Nombre de vérifications échouées */
+
+/**
+ * @def TEST_CHECK
+ * @brief Vérifie une condition, affiche la ligne et la condition si elle est fausse
+ */
+#define TEST_CHECK(condition) do { \
+    testChecks++; \
+    if(!(condition)) { \
+        testFailures++; \
+        fprintf(stderr, "%s:%d : échec de %s\n", __FILE__, __LINE__, #condition); \
+    } \
+} while(0)
+
+/**
+ * @def TEST_END
+ * @brief Affiche le bilan du test et donne le code de sortie du programme
+ */
+#define TEST_END() (printf("%s : %d vérifications, %d échecs\n", __FILE__, testChecks, testFailures), \
+    testFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE)
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * @file test_bufferPool.c
+ * @brief Tests de la réserve de buffers : classes de taille, agrandissement et emprunts concurrents
+ * @version 1.0
+ * @author Lukas Grando
+ */
+#include "bufferPool.h"
+#include "test.h"
+
+#define TEST_POOL_THREADS 8 /*!< Nombre de threads qui empruntent en même temps */
+#define TEST_POOL_ROUNDS 20000 /*!< Nombre d'emprunts de chaque thread */
+#define TEST_POOL_HELD 4 /*!< Nombre de buffers gardés en même temps par chaque thread */
+
+/**
+ * @fn void *borrow_buffers(void *args)
+ * @brief Emprunte et rend des buffers de tailles variées en vérifiant que personne d'autre n'écrit dedans
+ * @param args Reçoit le nombre de buffers abîmés (int), initialisé par l'appelant avec l'identifiant du thread
+ */
+void *borrow_buffers(void *args) {
+    int *result = (int *) args, id = *result, round, slot, damaged = 0;
+    char *held[TEST_POOL_HELD] = { NULL };
+    size_t sizes[TEST_POOL_HELD] = { 0 }, size;
+    unsigned int seed = id;
+
+    for(round = 0; round < TEST_POOL_ROUNDS; round++) {
+        slot = round % TEST_POOL_HELD;
+        if(held[slot] != NULL) {
+            // Le buffer porte encore la marque de ce thread à ses deux bouts
+            if(held[slot][0] != (char) id || held[slot][sizes[slot] - 1] != (char) id) damaged++;
+            buffer_pool_release(held[slot]);
+        }
+        size = 1 + rand_r(&seed) % (BUFFER_POOL_MIN_SIZE * 64);
+        held[slot] = buffer_pool_get(size);
+        sizes[slot] = size;
+        held[slot][0] = (char) id;
+        held[slot][size - 1] = (char) id;
+    }
+    for(slot = 0; slot < TEST_POOL_HELD; slot++) buffer_pool_release(held[slot]);
+    *result = damaged;
+    return NULL;
+}
+
+/**
+ * @fn void test_classes()
+ * @brief Un buffer a la capacité de sa classe, garde son contenu quand il grandit et il est repris après être rendu
+ */
+void test_classes() {
+    buffer_pool_stats_t before, after;
+    char *buffer, *again;
+
+    buffer = buffer_pool_get(1);
+    TEST_CHECK(buffer_pool_capacity(buffer) == BUFFER_POOL_MIN_SIZE);
+    buffer_pool_release(buffer);
+    buffer = buffer_pool_get(BUFFER_POOL_MIN_SIZE + 1);
+    TEST_CHECK(buffer_pool_capacity(buffer) == 2 * BUFFER_POOL_MIN_SIZE);
+    strcpy(buffer, "BELL");
+    buffer = buffer_pool_resize(buffer, 10 * BUFFER_POOL_MIN_SIZE);
+    TEST_CHECK(buffer_pool_capacity(buffer) >= 10 * BUFFER_POOL_MIN_SIZE && strcmp(buffer, "BELL") == 0);
+    buffer_pool_release(buffer);
+
+    get_buffer_pool_stats(&before);
+    again = buffer_pool_get(10 * BUFFER_POOL_MIN_SIZE);
+    get_buffer_pool_stats(&after);
+    TEST_CHECK(after.reuses == before.reuses + 1 && after.allocations == before.allocations);
+    buffer_pool_release(again);
+    buffer_pool_release(NULL);
+}
+
+/**
+ * @fn void test_threads()
+ * @brief Des threads qui empruntent en même temps ne reçoivent jamais le même buffer et réutilisent presque tout
+ */
+void test_threads() {
+    pthread_t threads[TEST_POOL_THREADS];
+    int results[TEST_POOL_THREADS], i;
+    buffer_pool_stats_t stats;
+
+    for(i = 0; i < TEST_POOL_THREADS; i++) {
+        results[i] = i + 1;
+        pthread_create(&threads[i], NULL, borrow_buffers, &results[i]);
+    }
+    for(i = 0; i < TEST_POOL_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        TEST_CHECK(results[i] == 0);
+    }
+    get_buffer_pool_stats(&stats);
+    TEST_CHECK(stats.usedBytes == 0);
+    TEST_CHECK(stats.allocations < stats.reuses / 10);
+    buffer_pool_trim();
+    get_buffer_pool_stats(&stats);
+    TEST_CHECK(stats.held == 0 && stats.heldBytes == 0);
+}
+
+int main() {
+    test_classes();
+    test_threads();
+    return TEST_END();
+}
@@ -0,0 +1,135 @@
+/**
+ * @file test_codec.c
+ * @brief Tests du codec : allers-retours des champs binaires, bornes et messages tronqués
+ * @version 1.0
+ * @author Lukas Grando
+ */
+#include "codec.h"
+#include "test.h"
+
+/**
+ * @fn void test_varints()
+ * @brief Les varints et les chaînes relus valent ceux écrits, aux bornes de chaque taille
+ */
+void test_varints() {
+    unsigned long values[] = { 0, 1, 127, 128, 16383, 16384, 0xFFFFFFFFUL, ULONG_MAX };
+    long signedValues[] = { 0, -1, 1, -64, 64, LONG_MIN, LONG_MAX };
+    int nbValues = sizeof(values) / sizeof(values[0]), nbSigned = sizeof(signedValues) / sizeof(signedValues[0]), i;
+    unsigned long value;
+    long signedValue;
+    char string[16];
+    writer_t writer;
+    reader_t reader;
+
+    init_writer(&writer, NULL, 0);
+    for(i = 0; i < nbValues; i++) writer_put_varint(&writer, values[i]);
+    for(i = 0; i < nbSigned; i++) writer_put_svarint(&writer, signedValues[i]);
+    writer_put_lstring(&writer, "");
+    writer_put_lstring(&writer, "BELL\nPAD");
+    TEST_CHECK(!writer.overflow);
+
+    init_reader(&reader, writer.data, writer.length);
+    for(i = 0; i < nbValues; i++) {
+        TEST_CHECK(reader_get_varint(&reader, ULONG_MAX, &value) == CODEC_OK && value == values[i]);
+    }
+    for(i = 0; i < nbSigned; i++) {
+        TEST_CHECK(reader_get_svarint(&reader, LONG_MIN, LONG_MAX, &signedValue) == CODEC_OK && signedValue == signedValues[i]);
+    }
+    TEST_CHECK(reader_get_lstring(&reader, string, sizeof(string)) == CODEC_OK && strcmp(string, "") == 0);
+    TEST_CHECK(reader_get_lstring(&reader, string, sizeof(string)) == CODEC_OK && strcmp(string, "BELL\nPAD") == 0);
+    TEST_CHECK(reader_at_end(&reader));
+    free_writer(&writer);
+}
+
+/**
+ * @fn void test_errors()
+ * @brief Une valeur hors bornes, un champ coupé ou un varint trop long sont refusés, et l'erreur reste
+ */
+void test_errors() {
+    const char cut[] = { (char) 0x80 };
+    const char tooLong[] = { (char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF,
+        (char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, 0x01 };
+    unsigned long value = 42;
+    char string[4];
+    writer_t writer;
+    reader_t reader;
+
+    init_writer(&writer, NULL, 0);
+    writer_put_varint(&writer, 300);
+    writer_put_lstring(&writer, "TROP LONG");
+    init_reader(&reader, writer.data, writer.length);
+    TEST_CHECK(reader_get_varint(&reader, 299, &value) == CODEC_ERROR_RANGE && value == 42);
+    // La première erreur fait échouer les lectures suivantes
+    TEST_CHECK(reader_get_lstring(&reader, string, sizeof(string)) == CODEC_ERROR_RANGE);
+    init_reader(&reader, writer.data, writer.length);
+    reader_get_varint(&reader, ULONG_MAX, &value);
+    TEST_CHECK(reader_get_lstring(&reader, string, sizeof(string)) == CODEC_ERROR_RANGE);
+    free_writer(&writer);
+
+    init_reader(&reader, cut, sizeof(cut));
+    TEST_CHECK(reader_get_varint(&reader, ULONG_MAX, &value) == CODEC_ERROR_TRUNCATED);
+    init_reader(&reader, tooLong, sizeof(tooLong));
+    TEST_CHECK(reader_get_varint(&reader, ULONG_MAX, &value) != CODEC_OK);
+}
+
+/**
+ * @fn void test_header()
+ * @brief L'en-tête d'un message donne sa taille exacte et limite le reader à son contenu
+ */
+void test_header() {
+    writer_t writer;
+    reader_t reader;
+    size_t header, length;
+    unsigned long value;
+    int version, type;
+
+    init_writer(&writer, NULL, 0);
+    header = writer_begin_message(&writer, 3, 7);
+    writer_put_varint(&writer, 1000);
+    writer_put_varint(&writer, 0);
+    writer_end_message(&writer, header);
+    // Un second message collé au premier ne doit pas être lu avec lui
+    writer_put_varint(&writer, 99);
+    TEST_CHECK(codec_is_binary(writer.data, writer.length));
+    length = codec_message_length(writer.data, writer.length);
+    TEST_CHECK(length == writer.length - 1);
+
+    init_reader(&reader, writer.data, writer.length);
+    TEST_CHECK(reader_get_header(&reader, &version, &type) == CODEC_OK && version == 3 && type == 7);
+    TEST_CHECK(reader_get_varint(&reader, ULONG_MAX, &value) == CODEC_OK && value == 1000);
+    TEST_CHECK(reader_get_varint(&reader, ULONG_MAX, &value) == CODEC_OK && value == 0);
+    TEST_CHECK(reader_at_end(&reader));
+
+    // Le contenu annoncé dépasse les octets reçus
+    init_reader(&reader, writer.data, length - 1);
+    TEST_CHECK(reader_get_header(&reader, &version, &type) == CODEC_ERROR_TRUNCATED);
+    TEST_CHECK(!codec_is_binary("0 0123456789 -1\n", 16));
+    init_reader(&reader, "0 0123456789 -1\n", 16);
+    TEST_CHECK(reader_get_header(&reader, &version, &type) == CODEC_ERROR_SYNTAX);
+    free_writer(&writer);
+}
+
+/**
+ * @fn void test_overflow()
+ * @brief Un writer fixe qui déborde n'écrit plus rien, même les champs qui tiendraient encore
+ */
+void test_overflow() {
+    char storage[8];
+    writer_t writer;
+
+    init_writer(&writer, storage, sizeof(storage));
+    writer_put_string(&writer, "BELL");
+    writer_put_string(&writer, "TROP LONG");
+    TEST_CHECK(writer.overflow && writer.length == 4);
+    writer_put_char(&writer, '!');
+    writer_put_varint(&writer, 1);
+    TEST_CHECK(writer.length == 4 && strcmp(storage, "BELL") == 0);
+}
+
+int main() {
+    test_varints();
+    test_errors();
+    test_header();
+    test_overflow();
+    return TEST_END();
+}
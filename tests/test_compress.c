@@ -0,0 +1,153 @@
+/**
+ * @file test_compress.c
+ * @brief Tests de la compression : allers-retours RLE et LZ, blocs LZ tronqués et corrompus
+ * @version 1.0
+ * @author Lukas Grando
+ */
+#include "compress.h"
+#include "test.h"
+
+#define TEST_LZ_SIZE (200 * 1024) /*!< Taille des blocs LZ testés, plus grande que la fenêtre */
+#define TEST_LZ_MUTATIONS 2000 /*!< Nombre de blocs corrompus au hasard */
+
+/**
+ * @fn void fill_notes(char *data, size_t size)
+ * @brief Remplit un buffer d'octets qui ressemblent à des notes : des motifs répétés avec quelques variations
+ */
+void fill_notes(char *data, size_t size) {
+    size_t i;
+    for(i = 0; i < size; i++) data[i] = (char)((i % 12) + (i / 4096 % 3) * 16 + (rand() % 50 == 0 ? rand() : 0));
+}
+
+/**
+ * @fn int lz_round_trip(const char *data, size_t size)
+ * @brief Compresse puis décompresse un bloc
+ * @return 1 si le bloc relu est identique et terminé par '\0', 0 sinon
+ */
+int lz_round_trip(const char *data, size_t size) {
+    writer_t writer;
+    reader_t reader;
+    char *decoded;
+    size_t length;
+    int same;
+
+    init_writer(&writer, NULL, 0);
+    writer_put_lz(&writer, data, size);
+    init_reader(&reader, writer.data, writer.length);
+    same = reader_get_lz(&reader, size, &decoded, &length) == CODEC_OK && length == size
+        && memcmp(decoded, data, size) == 0 && decoded[size] == '\0' && reader_at_end(&reader);
+    buffer_pool_release(decoded);
+    free_writer(&writer);
+    return same;
+}
+
+/**
+ * @fn void test_rle()
+ * @brief Les valeurs d'une colonne RLE sont relues dans l'ordre, une colonne épuisée est une erreur
+ */
+void test_rle() {
+    unsigned long values[] = { 4, 4, 4, 4, 0, 0, 1, 200000, 200000, 4 }, value;
+    int nbValues = sizeof(values) / sizeof(values[0]), i;
+    rle_writer_t rle;
+    rle_reader_t reader;
+
+    init_rle_writer(&rle);
+    for(i = 0; i < nbValues; i++) rle_put(&rle, values[i]);
+    rle_flush(&rle);
+    init_rle_reader(&reader, rle.writer.data, rle.writer.length);
+    for(i = 0; i < nbValues; i++) {
+        TEST_CHECK(rle_get(&reader, ULONG_MAX, &value) == CODEC_OK && value == values[i]);
+    }
+    TEST_CHECK(rle_get(&reader, ULONG_MAX, &value) != CODEC_OK);
+    init_rle_reader(&reader, rle.writer.data, rle.writer.length);
+    TEST_CHECK(rle_get(&reader, 3, &value) == CODEC_ERROR_RANGE);
+    free_rle_writer(&rle);
+}
+
+/**
+ * @fn void test_lz_round_trip()
+ * @brief Les blocs vides, courts, répétitifs et aléatoires sont relus à l'identique
+ */
+void test_lz_round_trip() {
+    char *data = (char *) malloc(TEST_LZ_SIZE);
+    size_t i;
+    CHECK_ALLOC(data);
+
+    TEST_CHECK(lz_round_trip("", 0));
+    TEST_CHECK(lz_round_trip("abc", 3));
+    TEST_CHECK(lz_round_trip("abcabcabcabcabcabcabcabc", 24));
+    memset(data, 0, TEST_LZ_SIZE);
+    TEST_CHECK(lz_round_trip(data, TEST_LZ_SIZE));
+    fill_notes(data, TEST_LZ_SIZE);
+    TEST_CHECK(lz_round_trip(data, TEST_LZ_SIZE));
+    for(i = 0; i < TEST_LZ_SIZE; i++) data[i] = (char) rand();
+    TEST_CHECK(lz_round_trip(data, TEST_LZ_SIZE));
+    free(data);
+}
+
+/**
+ * @fn void test_lz_corrupt()
+ * @brief Un bloc LZ tronqué, trop grand ou dont une référence sort du bloc est refusé sans lire ni écrire hors des
+ * buffers ; un bloc corrompu au hasard ne donne jamais plus que la taille acceptée
+ */
+void test_lz_corrupt() {
+    // 8 octets annoncés, puis un jeton sans littéral dont la référence remonte avant le début du bloc
+    const char before[] = { 8, 0x00, 5 };
+    // 4 littéraux puis une référence à distance 5
+    const char after[] = { 8, 0x40, 'a', 'b', 'c', 'd', 5 };
+    // 4 littéraux annoncés mais 2 présents
+    const char missing[] = { 4, 0x40, 'a', 'b' };
+    char *data = (char *) malloc(TEST_LZ_SIZE), *decoded, *corrupt;
+    size_t length, cut;
+    writer_t writer;
+    reader_t reader;
+    codec_error_t error;
+    int i;
+    CHECK_ALLOC(data);
+
+    init_reader(&reader, before, sizeof(before));
+    TEST_CHECK(reader_get_lz(&reader, 64, &decoded, &length) == CODEC_ERROR_RANGE && decoded == NULL);
+    init_reader(&reader, after, sizeof(after));
+    TEST_CHECK(reader_get_lz(&reader, 64, &decoded, &length) == CODEC_ERROR_RANGE && decoded == NULL);
+    init_reader(&reader, missing, sizeof(missing));
+    TEST_CHECK(reader_get_lz(&reader, 64, &decoded, &length) == CODEC_ERROR_TRUNCATED && decoded == NULL);
+
+    fill_notes(data, TEST_LZ_SIZE);
+    init_writer(&writer, NULL, 0);
+    writer_put_lz(&writer, data, TEST_LZ_SIZE);
+
+    // La taille annoncée dépasse le maximum : rien n'est alloué
+    init_reader(&reader, writer.data, writer.length);
+    TEST_CHECK(reader_get_lz(&reader, TEST_LZ_SIZE - 1, &decoded, &length) == CODEC_ERROR_RANGE && decoded == NULL);
+
+    // Chaque coupure du bloc est une erreur
+    for(cut = 0; cut < writer.length; cut += cut < 64 ? 1 : 97) {
+        init_reader(&reader, writer.data, cut);
+        error = reader_get_lz(&reader, TEST_LZ_SIZE, &decoded, &length);
+        TEST_CHECK(error != CODEC_OK && decoded == NULL);
+    }
+
+    // Des octets changés au hasard : erreur, ou un bloc qui tient dans la taille acceptée
+    corrupt = (char *) malloc(writer.length);
+    CHECK_ALLOC(corrupt);
+    for(i = 0; i < TEST_LZ_MUTATIONS; i++) {
+        memcpy(corrupt, writer.data, writer.length);
+        corrupt[rand() % writer.length] = (char) rand();
+        if(i % 2) corrupt[rand() % writer.length] = (char) rand();
+        init_reader(&reader, corrupt, writer.length);
+        error = reader_get_lz(&reader, TEST_LZ_SIZE, &decoded, &length);
+        TEST_CHECK(error == CODEC_OK ? decoded != NULL && length <= TEST_LZ_SIZE && decoded[length] == '\0' : decoded == NULL);
+        buffer_pool_release(decoded);
+    }
+    free(corrupt);
+    free_writer(&writer);
+    free(data);
+}
+
+int main() {
+    srand(49);
+    test_rle();
+    test_lz_round_trip();
+    test_lz_corrupt();
+    return TEST_END();
+}
@@ -0,0 +1,154 @@
+/**
+ * @file test_data.c
+ * @brief Tests du cadrage des messages sur une paire de sockets : gros messages binaires, messages texte MPP 1.0
+ * sans cadre et connexions fermées en cours de message
+ * @version 1.0
+ * @author Lukas Grando
+ */
+#include <pthread.h>
+#include "data.h"
+#include "mysyscall.h"
+#include "test.h"
+
+#define TEST_MESSAGE_VALUES (1 << 20) /*!< Nombre de valeurs du gros message, plus que MAX_BUFF et que les tampons des sockets */
+
+/**
+ * @fn int encode_values(writer_t *writer, generic_t data)
+ * @brief Encode un message binaire de TEST_MESSAGE_VALUES valeurs, dont beaucoup d'octets nuls
+ */
+int encode_values(writer_t *writer, generic_t data) {
+    size_t header = writer_begin_message(writer, 2, 1);
+    unsigned long i;
+    (void)data;
+    for(i = 0; i < TEST_MESSAGE_VALUES; i++) writer_put_varint(writer, i % 3 == 0 ? 0 : i);
+    writer_end_message(writer, header);
+    return writer->overflow ? -1 : 0;
+}
+
+/**
+ * @fn codec_error_t decode_values(reader_t *reader, generic_t data)
+ * @brief Décode un message écrit par encode_values
+ * @param data Reçoit le nombre de valeurs correctes (int)
+ */
+codec_error_t decode_values(reader_t *reader, generic_t data) {
+    int *nbValid = (int *) data, version, type;
+    unsigned long i, value;
+    *nbValid = 0;
+    reader_get_header(reader, &version, &type);
+    for(i = 0; i < TEST_MESSAGE_VALUES && reader->error == CODEC_OK; i++) {
+        if(reader_get_varint(reader, ULONG_MAX, &value) == CODEC_OK && value == (i % 3 == 0 ? 0 : i)) (*nbValid)++;
+    }
+    if(reader->error == CODEC_OK && !reader_at_end(reader)) reader->error = CODEC_ERROR_SYNTAX;
+    return reader->error;
+}
+
+/**
+ * @fn int encode_text(writer_t *writer, generic_t data)
+ * @brief Encode un message texte (une chaîne)
+ */
+int encode_text(writer_t *writer, generic_t data) {
+    writer_put_string(writer, (char *) data);
+    return writer->overflow ? -1 : 0;
+}
+
+/**
+ * @fn codec_error_t decode_text(reader_t *reader, generic_t data)
+ * @brief Décode le premier mot d'un message texte
+ * @param data Reçoit le mot (16 caractères au plus)
+ */
+codec_error_t decode_text(reader_t *reader, generic_t data) {
+    return reader_get_word(reader, (char *) data, 16);
+}
+
+/**
+ * @fn void *send_values(void *args)
+ * @brief Thread qui envoie le gros message, pendant que l'autre bout le reçoit
+ */
+void *send_values(void *args) {
+    send_message((socket_t *) args, NULL, encode_values);
+    return NULL;
+}
+
+/**
+ * @fn void open_pair(socket_t **first, socket_t **second)
+ * @brief Ouvre une paire de sockets stream connectées
+ */
+void open_pair(socket_t **first, socket_t **second) {
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), "socketpair");
+    *first = initSocket(SOCK_STREAM, fds[0]);
+    *second = initSocket(SOCK_STREAM, fds[1]);
+}
+
+/**
+ * @fn void test_large_message()
+ * @brief Un message de plusieurs Mo, plein d'octets nuls, arrive en entier malgré les lectures partielles
+ */
+void test_large_message() {
+    socket_t *sender, *receiver;
+    pthread_t thread;
+    int nbValid = 0;
+
+    open_pair(&sender, &receiver);
+    pthread_create(&thread, NULL, send_values, sender);
+    TEST_CHECK(recv_message(receiver, &nbValid, decode_values) == CODEC_OK);
+    TEST_CHECK(nbValid == TEST_MESSAGE_VALUES);
+    TEST_CHECK(receiver->framed);
+    pthread_join(thread, NULL);
+    freeSocket(sender);
+    freeSocket(receiver);
+}
+
+/**
+ * @fn void test_legacy_text()
+ * @brief Des messages texte sans cadre, même plus courts que l'en-tête, sont lus un par un jusqu'à leur '\0'
+ * et la réponse part sans cadre
+ */
+void test_legacy_text() {
+    socket_t *client, *server;
+    char word[16], reply[8];
+
+    open_pair(&client, &server);
+    // Deux messages collés : le second doit rester sur la socket après la lecture du premier
+    writeBytesToSocket(client, "ok", 3);
+    writeBytesToSocket(client, "1 BELL\n", 8);
+    TEST_CHECK(recv_message(server, word, decode_text) == CODEC_OK && strcmp(word, "ok") == 0);
+    TEST_CHECK(!server->framed);
+    TEST_CHECK(recv_message(server, word, decode_text) == CODEC_OK && strcmp(word, "1") == 0);
+
+    TEST_CHECK(send_message(server, "pong", encode_text) == 0);
+    TEST_CHECK(readAllFromSocket(client, reply, 5) == 5 && memcmp(reply, "pong", 5) == 0);
+    freeSocket(client);
+    freeSocket(server);
+}
+
+/**
+ * @fn void test_closed_connection()
+ * @brief Une connexion fermée avant la fin du message annoncé donne CODEC_ERROR_TRUNCATED
+ */
+void test_closed_connection() {
+    const char header[MESSAGE_HEADER_SIZE] = { 0, 0, 0, 100 };
+    socket_t *sender, *receiver;
+    char word[16];
+
+    open_pair(&sender, &receiver);
+    writeBytesToSocket(sender, (char *) header, MESSAGE_HEADER_SIZE);
+    writeBytesToSocket(sender, "incomplet", 10);
+    freeSocket(sender);
+    TEST_CHECK(recv_message(receiver, word, decode_text) == CODEC_ERROR_TRUNCATED);
+    freeSocket(receiver);
+
+    // Un message texte sans '\0' final
+    open_pair(&sender, &receiver);
+    writeBytesToSocket(sender, "ok", 2);
+    freeSocket(sender);
+    TEST_CHECK(recv_message(receiver, word, decode_text) == CODEC_ERROR_TRUNCATED);
+    freeSocket(receiver);
+}
+
+int main() {
+    test_large_message();
+    test_legacy_text();
+    test_closed_connection();
+    return TEST_END();
+}
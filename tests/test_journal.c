@@ -0,0 +1,154 @@
+/**
+ * @file test_journal.c
+ * @brief Tests du journal des éditions : annuler et rétablir par action, tampon circulaire plein, lignes à
+ * sauvegarder et motifs liés
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+#include "journal.h"
+#include "test.h"
+
+#define TEST_RING_DELTAS 8 /*!< Taille du petit tampon, plein après quelques actions */
+#define TEST_RING_GROUPS 5 /*!< Nombre d'actions de trois notes écrites dans le petit tampon */
+
+/**
+ * @fn note_t test_note(int line)
+ * @brief Note non vide qui dépend de sa ligne
+ */
+note_t test_note(int line) {
+    return create_note(1 + line % 12, line / 12 % 9, INSTRUMENT_NA, TIME_NOIRE);
+}
+
+/**
+ * @fn int line_is(const music_t *music, int line, note_t note)
+ * @brief Vérifie la note d'une ligne de la première channel
+ */
+int line_is(const music_t *music, int line, note_t note) {
+    return pack_note(get_channel_note(&music->channels[0], line)) == pack_note(note);
+}
+
+/**
+ * @fn void test_undo_redo()
+ * @brief Une action est annulée et rétablie d'un coup, une nouvelle édition oublie les actions annulées, et les
+ * lignes modifiées depuis la sauvegarde sont suivies
+ */
+void test_undo_redo() {
+    journal_t *journal = create_journal(0);
+    note_t empty = unpack_note(PACKED_NOTE_EMPTY);
+    music_t music;
+
+    init_music(&music, 120);
+    TEST_CHECK(journal->capacity == JOURNAL_DEFAULT_DELTAS);
+    journal_begin(journal);
+    journal_set_note(journal, &music, 0, 1, test_note(1));
+    journal_set_note(journal, &music, 0, 2, test_note(2));
+    // Une note qui ne change pas ne laisse pas de delta
+    journal_set_note(journal, &music, 0, 2, test_note(2));
+    journal_set_note(journal, &music, 1, 70, test_note(70));
+    journal_begin(journal);
+    journal_set_note(journal, &music, 0, 1, test_note(100));
+    TEST_CHECK(journal->count == 4 && journal->nbDirty == 3);
+    TEST_CHECK(journal_next_dirty(journal, 0, 0) == 1 && journal_next_dirty(journal, 0, 2) == 2 && journal_next_dirty(journal, 0, 3) == -1);
+    TEST_CHECK(journal_next_dirty(journal, 1, 0) == 70);
+
+    journal_mark_saved(journal);
+    TEST_CHECK(journal->nbDirty == 0 && journal_next_dirty(journal, 0, 0) == -1);
+    TEST_CHECK(journal_undo(journal, &music) == 1 && line_is(&music, 1, test_note(1)));
+    // Une annulation après la sauvegarde est à sauvegarder
+    TEST_CHECK(journal->nbDirty == 1 && journal_next_dirty(journal, 0, 0) == 1);
+    TEST_CHECK(journal_undo(journal, &music) == 3 && line_is(&music, 1, empty) && line_is(&music, 2, empty));
+    TEST_CHECK(music.channels[0].nbNotes == 0 && music.channels[1].nbNotes == 0);
+    TEST_CHECK(journal_undo(journal, &music) == 0);
+
+    TEST_CHECK(journal_redo(journal, &music) == 3 && line_is(&music, 2, test_note(2)) && music.channels[1].nbNotes == 71);
+    TEST_CHECK(journal_redo(journal, &music) == 1 && line_is(&music, 1, test_note(100)));
+    TEST_CHECK(journal_redo(journal, &music) == 0);
+
+    // Une édition après une annulation oublie l'action annulée
+    journal_undo(journal, &music);
+    journal_begin(journal);
+    journal_set_note(journal, &music, 0, 5, test_note(5));
+    TEST_CHECK(journal_redo(journal, &music) == 0 && line_is(&music, 1, test_note(1)));
+    TEST_CHECK(journal_undo(journal, &music) == 1 && line_is(&music, 5, empty));
+
+    clear_journal(journal);
+    TEST_CHECK(journal_undo(journal, &music) == 0 && journal_redo(journal, &music) == 0);
+    free_journal(journal);
+    free_music(&music);
+}
+
+/**
+ * @fn void test_ring()
+ * @brief Un tampon plein oublie les actions les plus anciennes en entier, et une action plus grande que le tampon
+ * ne peut pas être annulée mais ses lignes restent à sauvegarder
+ */
+void test_ring() {
+    journal_t *journal = create_journal(TEST_RING_DELTAS);
+    packed_note_t notes[2 * TEST_RING_DELTAS];
+    music_t music;
+    int group, i;
+
+    init_music(&music, 120);
+    for(group = 0; group < TEST_RING_GROUPS; group++) {
+        journal_begin(journal);
+        for(i = 0; i < 3; i++) journal_set_note(journal, &music, 0, group * 10 + i, test_note(group * 10 + i));
+    }
+    // Seules les deux dernières actions tiennent dans le tampon
+    TEST_CHECK(journal->count == 6);
+    TEST_CHECK(journal_undo(journal, &music) == 3 && journal_undo(journal, &music) == 3);
+    TEST_CHECK(journal_undo(journal, &music) == 0);
+    TEST_CHECK(line_is(&music, (TEST_RING_GROUPS - 3) * 10 + 2, test_note((TEST_RING_GROUPS - 3) * 10 + 2)));
+    TEST_CHECK(is_channel_note_empty(&music.channels[0], (TEST_RING_GROUPS - 2) * 10));
+    TEST_CHECK(journal_redo(journal, &music) == 3 && journal_redo(journal, &music) == 3);
+    TEST_CHECK(line_is(&music, (TEST_RING_GROUPS - 1) * 10 + 2, test_note((TEST_RING_GROUPS - 1) * 10 + 2)));
+    TEST_CHECK(journal->nbDirty == 3 * TEST_RING_GROUPS);
+
+    // Une action plus grande que le tampon
+    for(i = 0; i < 2 * TEST_RING_DELTAS; i++) notes[i] = pack_note(test_note(200 + i));
+    journal_begin(journal);
+    TEST_CHECK(journal_set_range(journal, &music, 0, 200, 2 * TEST_RING_DELTAS, notes) == 2 * TEST_RING_DELTAS);
+    TEST_CHECK(journal_undo(journal, &music) == 0 && line_is(&music, 200, test_note(200)));
+    TEST_CHECK(journal->nbDirty == 3 * TEST_RING_GROUPS + 2 * TEST_RING_DELTAS);
+    TEST_CHECK(journal_next_dirty(journal, 0, 100) == 200);
+
+    // Le journal reprend normalement à l'action suivante
+    journal_begin(journal);
+    journal_set_note(journal, &music, 0, 300, test_note(300));
+    TEST_CHECK(journal_undo(journal, &music) == 1 && is_channel_note_empty(&music.channels[0], 300));
+    free_journal(journal);
+    free_music(&music);
+}
+
+/**
+ * @fn void test_pattern_undo()
+ * @brief Annuler un motif lié remet les anciennes notes dans un bloc à part, sans toucher au motif
+ */
+void test_pattern_undo() {
+    journal_t *journal = create_journal(0);
+    channel_t *channel;
+    music_t music;
+    int i;
+
+    init_music(&music, 120);
+    channel = &music.channels[0];
+    journal_begin(journal);
+    for(i = 0; i < NOTE_BLOCK_SIZE; i++) journal_set_note(journal, &music, 0, i, test_note(i));
+    journal_set_note(journal, &music, 0, NOTE_BLOCK_SIZE + 3, test_note(1000));
+    journal_begin(journal);
+    TEST_CHECK(journal_link_pattern(journal, &music, 0, NOTE_BLOCK_SIZE, 0) == NOTE_BLOCK_SIZE);
+    TEST_CHECK(channel->blocks[1] == channel->blocks[0] && get_channel_pattern_line(channel, NOTE_BLOCK_SIZE + 3) == 3);
+
+    TEST_CHECK(journal_undo(journal, &music) == NOTE_BLOCK_SIZE);
+    TEST_CHECK(channel->blocks[1] != channel->blocks[0] && get_channel_pattern_line(channel, NOTE_BLOCK_SIZE + 3) == NOTE_BLOCK_SIZE + 3);
+    TEST_CHECK(line_is(&music, NOTE_BLOCK_SIZE + 3, test_note(1000)) && is_channel_note_empty(channel, NOTE_BLOCK_SIZE + 4));
+    TEST_CHECK(line_is(&music, 3, test_note(3)) && channel->nbNotes == NOTE_BLOCK_SIZE + 4);
+    free_journal(journal);
+    free_music(&music);
+}
+
+int main() {
+    test_undo_redo();
+    test_ring();
+    test_pattern_undo();
+    return TEST_END();
+}
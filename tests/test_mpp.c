@@ -0,0 +1,302 @@
+/**
+ * @file test_mpp.c
+ * @brief Tests des messages MPP : musiques et motifs répétés relus dans chaque version, patchs relus et patchs hors
+ * bornes refusés, sauvegardes entières refusées sur une révision dépassée
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+#include "mpp.h"
+#include "test.h"
+
+#define TEST_MUSIC_LINES 5000 /*!< Nombre de lignes de la première channel de la musique testée */
+#define TEST_DB_USER "TESTMPP" /*!< Utilisateur dont le dossier est créé dans la base de données le temps d'un test */
+
+// Fonctions privées de mpp.c, testées directement sur des patchs écrits à la main et sur les fichiers enregistrés
+void encode_music_patch(writer_t *writer, music_patch_t *patch);
+codec_error_t decode_music_patch(reader_t *reader, music_patch_t *patch);
+unsigned long read_music_revision(const char *filename);
+
+/**
+ * @fn void fill_music(music_t *music)
+ * @brief Remplit une musique de notes variées, avec des lignes vides et des instruments chargés
+ */
+void fill_music(music_t *music) {
+    time_duration_t times[] = { TIME_CROCHE_DOUBLE, TIME_CROCHE, TIME_NOIRE, TIME_BLANCHE, TIME_RONDE };
+    int line;
+    init_music(music, 133);
+    for(line = 0; line < TEST_MUSIC_LINES; line++) {
+        if(line % 7 == 3) continue;
+        set_channel_note(&music->channels[0], line, create_note(1 + line % 12, line / 100 % 9, (instrument_t)(line % 5 == 0 ? INSTRUMENT_NB + 1 : line % INSTRUMENT_NB), times[line / 16 % 5]));
+        update_channel_nbNotes(&music->channels[0], line);
+    }
+    set_channel_note(&music->channels[2], 40, create_note(12, 8, INSTRUMENT_NB - 1, TIME_RONDE));
+    update_channel_nbNotes(&music->channels[2], 40);
+}
+
+/**
+ * @fn int same_music(music_t *first, music_t *second)
+ * @brief Compare deux musiques ligne par ligne
+ * @return 1 si elles ont le même bpm et les mêmes notes, 0 sinon
+ */
+int same_music(music_t *first, music_t *second) {
+    int i, line;
+    if(first->bpm != second->bpm) return 0;
+    for(i = 0; i < MUSIC_MAX_CHANNELS; i++) {
+        if(first->channels[i].nbNotes != second->channels[i].nbNotes) return 0;
+        for(line = 0; line < first->channels[i].nbNotes; line++) {
+            if(pack_note(get_channel_note(&first->channels[i], line)) != pack_note(get_channel_note(&second->channels[i], line))) return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @fn void test_music_versions()
+ * @brief Une musique envoyée dans chaque version de MPP est relue à l'identique
+ */
+void test_music_versions() {
+    mpp_request_t request, decoded;
+    music_t music;
+    writer_t writer;
+    reader_t reader;
+    int version;
+
+    fill_music(&music);
+    for(version = MPP_VERSION_TEXT; version <= MPP_VERSION; version++) {
+        request = create_mpp_request(MPP_ADD_MUSIC, "A1B2C3D4", &music, 1700000000);
+        request.version = version;
+        music.revision = 7;
+        init_writer(&writer, NULL, 0);
+        TEST_CHECK(encode_mpp_request(&writer, &request) == 0);
+        init_reader(&reader, writer.data, writer.length);
+        TEST_CHECK(decode_mpp_request(&reader, &decoded) == CODEC_OK);
+        TEST_CHECK(decoded.code == MPP_ADD_MUSIC && decoded.version == version && decoded.musicId == 1700000000);
+        TEST_CHECK(decoded.music != NULL && same_music(&music, decoded.music));
+        // Avant MPP 2.2, la musique n'a pas de révision et remplace toujours celle qui est enregistrée
+        TEST_CHECK(decoded.overwrite == (version < MPP_VERSION_DELTA));
+        TEST_CHECK(decoded.music == NULL || decoded.music->revision == (version < MPP_VERSION_DELTA ? 0 : 7));
+        if(decoded.music != NULL) {
+            free_music(decoded.music);
+            free(decoded.music);
+        }
+        free_writer(&writer);
+    }
+    free_music(&music);
+}
+
+/**
+ * @fn void test_pattern_versions()
+ * @brief Une musique aux motifs répétés, dont une variante, est relue dans chaque version de MPP avec les mêmes
+ * répétitions : le motif n'est rangé qu'une fois
+ */
+void test_pattern_versions() {
+    mpp_request_t request, decoded;
+    music_t music;
+    writer_t writer;
+    reader_t reader;
+    int version, line, samePatterns;
+
+    init_music(&music, 90);
+    for(line = 0; line < NOTE_BLOCK_SIZE; line++) {
+        set_channel_note(&music.channels[1], line, create_note(1 + line % 12, 4, INSTRUMENT_NA, TIME_CROCHE));
+        update_channel_nbNotes(&music.channels[1], line);
+    }
+    link_channel_pattern(&music.channels[1], 2 * NOTE_BLOCK_SIZE, 0);
+    link_channel_pattern(&music.channels[1], 3 * NOTE_BLOCK_SIZE, 0);
+    link_channel_pattern(&music.channels[1], 5 * NOTE_BLOCK_SIZE, 0);
+    // La répétition modifiée est une variante, relue comme un bloc à part
+    set_channel_note(&music.channels[1], 3 * NOTE_BLOCK_SIZE + 9, create_note(12, 6, INSTRUMENT_NA, TIME_RONDE));
+    for(version = MPP_VERSION_TEXT; version <= MPP_VERSION; version++) {
+        request = create_mpp_request(MPP_ADD_MUSIC, "A1B2C3D4", &music, 1700000000);
+        request.version = version;
+        init_writer(&writer, NULL, 0);
+        TEST_CHECK(encode_mpp_request(&writer, &request) == 0);
+        init_reader(&reader, writer.data, writer.length);
+        TEST_CHECK(decode_mpp_request(&reader, &decoded) == CODEC_OK);
+        TEST_CHECK(decoded.music != NULL && same_music(&music, decoded.music));
+        if(decoded.music != NULL) {
+            samePatterns = 1;
+            for(line = 0; line < music.channels[1].nbNotes; line++) {
+                if(get_channel_pattern_line(&decoded.music->channels[1], line) != get_channel_pattern_line(&music.channels[1], line)) samePatterns = 0;
+            }
+            TEST_CHECK(samePatterns);
+            // Chaque position compte ses notes, mais les répétitions désignent le même bloc
+            TEST_CHECK(count_channel_notes(&decoded.music->channels[1]) == 4 * NOTE_BLOCK_SIZE);
+            TEST_CHECK(decoded.music->channels[1].blocks[5] == decoded.music->channels[1].blocks[0]);
+            TEST_CHECK(decoded.music->channels[1].blocks[3] != decoded.music->channels[1].blocks[0]);
+            free_music(decoded.music);
+            free(decoded.music);
+        }
+        free_writer(&writer);
+    }
+    free_music(&music);
+}
+
+/**
+ * @fn void test_patch_round_trip()
+ * @brief Un patch relu donne les mêmes lignes, et l'appliquer à la musique d'origine donne la musique modifiée
+ */
+void test_patch_round_trip() {
+    music_t music, edited;
+    music_patch_t patch, decoded;
+    writer_t writer;
+    reader_t reader;
+    int i;
+
+    fill_music(&music);
+    fill_music(&edited);
+    init_music_patch(&patch, &music);
+    // Les lignes modifiées sont ajoutées par channel puis par ligne
+    set_channel_note(&edited.channels[0], 3, create_note(5, 4, INSTRUMENT_NB, TIME_NOIRE));
+    add_music_patch_note(&patch, 0, 3, pack_note(get_channel_note(&edited.channels[0], 3)));
+    set_channel_note(&edited.channels[0], 4000, create_note(NOTE_NA_ID, 0, INSTRUMENT_NA, TIME_NOIRE));
+    add_music_patch_note(&patch, 0, 4000, pack_note(get_channel_note(&edited.channels[0], 4000)));
+    set_channel_note(&edited.channels[1], 0, create_note(1, 3, INSTRUMENT_NA, TIME_CROCHE));
+    update_channel_nbNotes(&edited.channels[1], 0);
+    add_music_patch_note(&patch, 1, 0, pack_note(get_channel_note(&edited.channels[1], 0)));
+    for(i = 0; i < MUSIC_MAX_CHANNELS; i++) patch.nbNotes[i] = edited.channels[i].nbNotes;
+
+    init_writer(&writer, NULL, 0);
+    encode_music_patch(&writer, &patch);
+    init_reader(&reader, writer.data, writer.length);
+    TEST_CHECK(decode_music_patch(&reader, &decoded) == CODEC_OK && reader_at_end(&reader));
+    TEST_CHECK(decoded.size == patch.size && decoded.bpm == patch.bpm && decoded.base == patch.base);
+    for(i = 0; i < patch.size && i < decoded.size; i++) {
+        TEST_CHECK(decoded.notes[i].channel == patch.notes[i].channel && decoded.notes[i].line == patch.notes[i].line && decoded.notes[i].note == patch.notes[i].note);
+    }
+    TEST_CHECK(apply_music_patch(&music, &decoded) == 0 && same_music(&music, &edited));
+
+    // Le même patch sur une musique qui a perdu des lignes ne correspond plus
+    free_music(&music);
+    init_music(&music, 133);
+    TEST_CHECK(apply_music_patch(&music, &decoded) == -1);
+
+    free_music_patch(&decoded);
+    free_music_patch(&patch);
+    free_writer(&writer);
+    free_music(&music);
+    free_music(&edited);
+}
+
+/**
+ * @fn codec_error_t decode_patch(unsigned long channels, unsigned long count, unsigned long written, const unsigned long *gaps, const packed_note_t *notes)
+ * @brief Ecrit à la main un patch sur la première channel puis le relit
+ * @param channels Le nombre de channels annoncé
+ * @param count Le nombre de lignes modifiées annoncé
+ * @param written Le nombre de lignes vraiment écrites (moins que count pour un patch tronqué)
+ * @param gaps L'écart de chaque ligne avec la précédente (written valeurs)
+ * @param notes La note encodée de chaque ligne (written valeurs)
+ * @return L'erreur de decode_music_patch
+ */
+codec_error_t decode_patch(unsigned long channels, unsigned long count, unsigned long written, const unsigned long *gaps, const packed_note_t *notes) {
+    music_patch_t patch;
+    writer_t writer;
+    reader_t reader;
+    codec_error_t error;
+    unsigned long i;
+
+    init_writer(&writer, NULL, 0);
+    writer_put_varint(&writer, 7);
+    writer_put_varint(&writer, 120);
+    writer_put_varint(&writer, channels);
+    writer_put_varint(&writer, 10);
+    writer_put_varint(&writer, count);
+    for(i = 0; i < written; i++) {
+        writer_put_varint(&writer, gaps[i]);
+        writer_put_varint(&writer, notes[i]);
+    }
+    init_reader(&reader, writer.data, writer.length);
+    error = decode_music_patch(&reader, &patch);
+    // Les lignes hors bornes ne sont jamais gardées
+    for(i = 0; i < (unsigned long) patch.size; i++) {
+        if(patch.notes[i].line > MPP_MAX_LINE || patch.notes[i].channel >= MUSIC_MAX_CHANNELS) error = CODEC_ERROR_SYNTAX;
+    }
+    free_music_patch(&patch);
+    free_writer(&writer);
+    return error;
+}
+
+/**
+ * @fn void test_patch_out_of_range()
+ * @brief Les patchs dont une ligne, une note, le nombre de lignes ou de channels sortent des bornes sont refusés
+ */
+void test_patch_out_of_range() {
+    packed_note_t note = pack_note(create_note(1, 4, INSTRUMENT_NA, TIME_NOIRE));
+    packed_note_t notes[] = { note, note };
+    unsigned long lastLine[] = { MPP_MAX_LINE };
+    unsigned long afterLast[] = { MPP_MAX_LINE, 0 };
+    unsigned long tooFar[] = { MPP_MAX_LINE + 1 };
+    unsigned long near[] = { 0 };
+    packed_note_t badNote[] = { pack_note(create_note(1, 4, INSTRUMENT_NA, TIME_NOIRE)) | ((packed_note_t) PACKED_NOTE_ID_MASK << PACKED_NOTE_ID_SHIFT) };
+
+    TEST_CHECK(decode_patch(1, 1, 1, lastLine, notes) == CODEC_OK);
+    TEST_CHECK(decode_patch(1, 2, 2, afterLast, notes) == CODEC_ERROR_RANGE);
+    TEST_CHECK(decode_patch(1, 1, 1, tooFar, notes) == CODEC_ERROR_RANGE);
+    TEST_CHECK(decode_patch(1, 1, 1, near, badNote) == CODEC_ERROR_RANGE);
+    TEST_CHECK(decode_patch(MUSIC_MAX_CHANNELS + 1, 0, 0, NULL, NULL) == CODEC_ERROR_RANGE);
+    // Le nombre de lignes est refusé avant toute allocation
+    TEST_CHECK(decode_patch(1, MPP_MAX_PATCH_NOTES + 1, 0, NULL, NULL) == CODEC_ERROR_RANGE);
+    TEST_CHECK(decode_patch(1, 2, 1, near, notes) == CODEC_ERROR_TRUNCATED);
+}
+
+/**
+ * @fn void test_save_write_error()
+ * @brief Une musique dont le fichier ne peut pas être écrit n'est pas ajoutée et garde sa révision
+ */
+void test_save_write_error() {
+    unsigned long revision;
+    music_t music;
+
+    init_music(&music, 133);
+    music.date.tv_sec = 1700000000;
+    music.revision = 3;
+    // L'utilisateur n'a pas de dossier : ni le fichier de la musique ni sa liste ne peuvent être écrits
+    TEST_CHECK(add_music_to_db(&music, "ABSENT0", 1, &revision) == MPP_RESPONSE_NOK && music.revision == 3);
+    free_music(&music);
+}
+
+/**
+ * @fn void test_stale_full_save()
+ * @brief Une musique entière modifiée sur une révision dépassée ou supprimée depuis n'écrase rien, sauf si
+ * l'utilisateur le demande
+ */
+void test_stale_full_save() {
+    char folder[255], filename[255];
+    unsigned long revision;
+    music_t music;
+
+    sprintf(folder, "%s/%s/%s", MPP_DB_FOLDER, MPP_DB_MUSIC_FOLDER, TEST_DB_USER);
+    mkdir(folder, 0777);
+    sprintf(filename, "%s/%ld.mipi", folder, 1700000000L);
+    init_music(&music, 133);
+    music.date.tv_sec = 1700000000;
+
+    TEST_CHECK(add_music_to_db(&music, TEST_DB_USER, 0, &revision) == MPP_RESPONSE_MUSIC_CREATED && revision == 1 && music.revision == 1);
+    TEST_CHECK(add_music_to_db(&music, TEST_DB_USER, 0, &revision) == MPP_RESPONSE_MUSIC_CREATED && revision == 2);
+    // Un autre client a gardé la révision 1
+    music.revision = 1;
+    TEST_CHECK(add_music_to_db(&music, TEST_DB_USER, 0, &revision) == MPP_RESPONSE_CONFLICT && revision == 2 && music.revision == 1);
+    TEST_CHECK(read_music_revision(filename) == 2);
+    TEST_CHECK(add_music_to_db(&music, TEST_DB_USER, 1, &revision) == MPP_RESPONSE_MUSIC_CREATED && revision == 3);
+
+    // La musique a été supprimée depuis sa révision
+    remove(filename);
+    TEST_CHECK(add_music_to_db(&music, TEST_DB_USER, 0, &revision) == MPP_RESPONSE_NOT_FOUND);
+    TEST_CHECK(add_music_to_db(&music, TEST_DB_USER, 1, &revision) == MPP_RESPONSE_MUSIC_CREATED && revision == 1);
+
+    free_music(&music);
+    remove(filename);
+    sprintf(filename, "%s/%s", folder, MPP_DB_MUSIC_FILE);
+    remove(filename);
+    rmdir(folder);
+}
+
+int main() {
+    test_music_versions();
+    test_pattern_versions();
+    test_patch_round_trip();
+    test_patch_out_of_range();
+    test_save_write_error();
+    test_stale_full_save();
+    return TEST_END();
+}
@@ -0,0 +1,264 @@
+/**
+ * @file test_note.c
+ * @brief Tests des channels : blocs de 64 lignes, mot d'occupation, motifs répétés et variantes, copies partagées
+ * et index des durées
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+#include "note.h"
+#include "test.h"
+
+#define TEST_TIMELINE_LINES 1000 /*!< Nombre de lignes du channel dont on vérifie l'index des durées */
+
+/**
+ * @fn note_t test_note(int line)
+ * @brief Note non vide qui dépend de sa ligne, pour reconnaître les lignes relues
+ */
+note_t test_note(int line) {
+    time_duration_t times[] = { TIME_CROCHE_DOUBLE, TIME_CROCHE, TIME_NOIRE, TIME_BLANCHE, TIME_RONDE };
+    return create_note(1 + line % 12, line / 12 % 9, (instrument_t)(line % INSTRUMENT_NB), times[line / 3 % 5]);
+}
+
+/**
+ * @fn void fill_block(channel_t *channel, int block)
+ * @brief Ecrit une note sur chaque ligne d'un bloc
+ */
+void fill_block(channel_t *channel, int block) {
+    int i;
+    for(i = 0; i < NOTE_BLOCK_SIZE; i++) {
+        set_channel_note(channel, block * NOTE_BLOCK_SIZE + i, test_note(block * NOTE_BLOCK_SIZE + i));
+        update_channel_nbNotes(channel, block * NOTE_BLOCK_SIZE + i);
+    }
+}
+
+/**
+ * @fn int same_line(const channel_t *channel, int first, int second)
+ * @brief Compare deux lignes d'un channel
+ * @return 1 si elles contiennent la même note, 0 sinon
+ */
+int same_line(const channel_t *channel, int first, int second) {
+    return pack_note(get_channel_note(channel, first)) == pack_note(get_channel_note(channel, second));
+}
+
+/**
+ * @fn int line_class(const channel_t *channel, int line)
+ * @brief Classe de durée d'une ligne, recalculée depuis sa note
+ */
+int line_class(const channel_t *channel, int line) {
+    int time = get_channel_note(channel, line).time, class = 0;
+    while(class < NOTE_TIME_CLASSES - 1 && (1 << class) < time) class++;
+    return class;
+}
+
+/**
+ * @fn void test_blocks()
+ * @brief Seuls les blocs écrits sont alloués, les autres lignes sont vides et sautées par les recherches
+ */
+void test_blocks() {
+    channel_t channel;
+    int far = 3 * NOTE_BLOCK_SIZE + 5;
+
+    init_channel(&channel, 0);
+    // Une ligne vide écrite dans un bloc absent n'alloue rien
+    set_channel_note(&channel, 10, unpack_note(PACKED_NOTE_EMPTY));
+    TEST_CHECK(channel.nbBlocks == 0);
+
+    set_channel_note(&channel, 0, test_note(0));
+    update_channel_nbNotes(&channel, 0);
+    set_channel_note(&channel, far, test_note(far));
+    update_channel_nbNotes(&channel, far);
+    TEST_CHECK(channel.nbBlocks > far / NOTE_BLOCK_SIZE && channel.nbNotes == far + 1);
+    TEST_CHECK(channel.blocks[0] != NULL && channel.blocks[1] == NULL && channel.blocks[2] == NULL && channel.blocks[3] != NULL);
+    TEST_CHECK(pack_note(get_channel_note(&channel, far)) == pack_note(test_note(far)));
+    TEST_CHECK(pack_note(get_channel_note(&channel, NOTE_BLOCK_SIZE + 1)) == PACKED_NOTE_EMPTY);
+    TEST_CHECK(pack_note(get_channel_note(&channel, 100 * NOTE_BLOCK_SIZE)) == PACKED_NOTE_EMPTY);
+    TEST_CHECK(count_channel_notes(&channel) == 2);
+    TEST_CHECK(next_channel_note(&channel, 1) == far && next_channel_note(&channel, far + 1) == -1);
+    TEST_CHECK(prev_channel_note(&channel, far - 1) == 0 && prev_channel_note(&channel, -1) == -1);
+
+    // Vider la dernière note ramène nbNotes à la précédente
+    set_channel_note(&channel, far, unpack_note(PACKED_NOTE_EMPTY));
+    update_channel_nbNotes(&channel, far);
+    TEST_CHECK(channel.nbNotes == 1);
+    free_channel(&channel);
+    TEST_CHECK(channel.nbBlocks == 0 && channel.blocks == NULL);
+}
+
+/**
+ * @fn void test_occupancy()
+ * @brief Le mot d'occupation d'un bloc a un bit par ligne non vide, y compris la dernière ligne du bloc
+ */
+void test_occupancy() {
+    channel_t channel;
+    uint64_t expected = ((uint64_t)1 << 0) | ((uint64_t)1 << 5) | ((uint64_t)1 << (NOTE_BLOCK_SIZE - 1));
+
+    init_channel(&channel, 0);
+    set_channel_note(&channel, 0, test_note(0));
+    set_channel_note(&channel, 5, test_note(5));
+    set_channel_note(&channel, NOTE_BLOCK_SIZE - 1, test_note(NOTE_BLOCK_SIZE - 1));
+    TEST_CHECK(channel.blocks[0]->used == expected);
+    // Changer une note déjà présente ne change pas l'occupation
+    set_channel_note(&channel, 5, test_note(6));
+    TEST_CHECK(channel.blocks[0]->used == expected);
+    // Une note sans identifiant vide sa ligne, même avec un instrument
+    set_channel_note(&channel, 5, create_note(NOTE_NA_ID, 4, INSTRUMENT_NB - 1, TIME_RONDE));
+    TEST_CHECK(channel.blocks[0]->used == (expected & ~((uint64_t)1 << 5)));
+    TEST_CHECK(is_channel_note_empty(&channel, 5) && !is_channel_note_empty(&channel, NOTE_BLOCK_SIZE - 1));
+    TEST_CHECK(is_channel_note_empty(&channel, NOTE_BLOCK_SIZE));
+    TEST_CHECK(count_channel_notes(&channel) == 2);
+    TEST_CHECK(next_channel_note(&channel, 1) == NOTE_BLOCK_SIZE - 1);
+    free_channel(&channel);
+}
+
+/**
+ * @fn void test_patterns()
+ * @brief Un bloc lié à un motif le partage ; modifier une répétition en fait une variante sans toucher aux
+ * autres, modifier la première occurrence passe le rôle à la répétition suivante
+ */
+void test_patterns() {
+    channel_t channel;
+    int i, copied = 1;
+
+    init_channel(&channel, 0);
+    fill_block(&channel, 0);
+    TEST_CHECK(link_channel_pattern(&channel, 2 * NOTE_BLOCK_SIZE, 3) == NOTE_BLOCK_SIZE);
+    TEST_CHECK(link_channel_pattern(&channel, 3 * NOTE_BLOCK_SIZE + 10, 0) == NOTE_BLOCK_SIZE);
+    TEST_CHECK(link_channel_pattern(&channel, 1, 2) == -1);
+    // Lier un bloc à son propre motif ne change rien
+    TEST_CHECK(link_channel_pattern(&channel, 2 * NOTE_BLOCK_SIZE, 0) == 0);
+    TEST_CHECK(channel.blocks[2] == channel.blocks[0] && channel.blocks[3] == channel.blocks[0]);
+    TEST_CHECK(channel.repeats[0] == 2 && channel.patterns[2] == 0 && channel.patterns[3] == 0);
+    TEST_CHECK(channel.nbNotes == 4 * NOTE_BLOCK_SIZE);
+    for(i = 0; i < NOTE_BLOCK_SIZE; i++) {
+        if(get_channel_pattern_line(&channel, 2 * NOTE_BLOCK_SIZE + i) != i || !same_line(&channel, 2 * NOTE_BLOCK_SIZE + i, i)) copied = 0;
+    }
+    TEST_CHECK(copied);
+    // Le motif n'est rangé qu'une fois, mais ses notes comptent à chaque position
+    TEST_CHECK(count_channel_notes(&channel) == 3 * NOTE_BLOCK_SIZE && channel.blocks[0]->refs == 3);
+
+    // Une répétition modifiée devient une variante
+    set_channel_note(&channel, 2 * NOTE_BLOCK_SIZE + 7, test_note(1000));
+    TEST_CHECK(channel.blocks[2] != channel.blocks[0] && channel.blocks[0]->refs == 2);
+    TEST_CHECK(get_channel_pattern_line(&channel, 2 * NOTE_BLOCK_SIZE + 7) == 2 * NOTE_BLOCK_SIZE + 7);
+    TEST_CHECK(same_line(&channel, 2 * NOTE_BLOCK_SIZE + 8, 8) && !same_line(&channel, 2 * NOTE_BLOCK_SIZE + 7, 7));
+    TEST_CHECK(pack_note(get_channel_note(&channel, 7)) == pack_note(test_note(7)));
+    TEST_CHECK(get_channel_pattern_line(&channel, 3 * NOTE_BLOCK_SIZE + 7) == 7 && channel.repeats[0] == 1);
+
+    // La première occurrence modifiée : la répétition suivante devient la première
+    set_channel_note(&channel, 4, test_note(2000));
+    TEST_CHECK(channel.blocks[3] != channel.blocks[0] && channel.blocks[3]->refs == 1);
+    TEST_CHECK(get_channel_pattern_line(&channel, 3 * NOTE_BLOCK_SIZE + 4) == 3 * NOTE_BLOCK_SIZE + 4);
+    TEST_CHECK(pack_note(get_channel_note(&channel, 3 * NOTE_BLOCK_SIZE + 4)) == pack_note(test_note(4)));
+    TEST_CHECK(channel.repeats[0] == 0 && channel.repeats[3] == 0);
+
+    // Lier à un bloc vide vide le bloc et raccourcit le channel
+    TEST_CHECK(link_channel_pattern(&channel, 3 * NOTE_BLOCK_SIZE, 5 * NOTE_BLOCK_SIZE) == NOTE_BLOCK_SIZE);
+    TEST_CHECK(channel.blocks[3] == NULL && channel.nbNotes == 3 * NOTE_BLOCK_SIZE);
+    free_channel(&channel);
+}
+
+/**
+ * @fn void test_shared_music()
+ * @brief Une copie partage les blocs de la musique ; une écriture d'un côté ne duplique que le bloc modifié et
+ * l'autre côté n'est jamais modifié
+ */
+void test_shared_music() {
+    music_t music, copy;
+    packed_note_t before;
+
+    init_music(&music, 120);
+    fill_block(&music.channels[0], 0);
+    fill_block(&music.channels[0], 1);
+    link_channel_pattern(&music.channels[0], 2 * NOTE_BLOCK_SIZE, 0);
+    share_music(&copy, &music);
+    TEST_CHECK(copy.bpm == 120 && copy.channels[0].nbNotes == music.channels[0].nbNotes);
+    TEST_CHECK(copy.channels[0].blocks[0] == music.channels[0].blocks[0] && copy.channels[0].blocks[1] == music.channels[0].blocks[1]);
+    TEST_CHECK(copy.channels[0].timeline == NULL && copy.channels[1].nbBlocks == 0);
+
+    // Une écriture dans la musique ne se voit pas dans la copie
+    before = pack_note(get_channel_note(&music.channels[0], 3));
+    set_channel_note(&music.channels[0], 3, test_note(3000));
+    TEST_CHECK(pack_note(get_channel_note(&copy.channels[0], 3)) == before);
+    TEST_CHECK(music.channels[0].blocks[0] != copy.channels[0].blocks[0] && music.channels[0].blocks[1] == copy.channels[0].blocks[1]);
+    // La copie garde son motif répété
+    TEST_CHECK(get_channel_pattern_line(&copy.channels[0], 2 * NOTE_BLOCK_SIZE + 3) == 3);
+    TEST_CHECK(pack_note(get_channel_note(&copy.channels[0], 2 * NOTE_BLOCK_SIZE + 3)) == before);
+
+    // Et une écriture dans la copie ne se voit pas dans la musique
+    set_channel_note(&copy.channels[0], NOTE_BLOCK_SIZE + 1, test_note(4000));
+    TEST_CHECK(pack_note(get_channel_note(&music.channels[0], NOTE_BLOCK_SIZE + 1)) == pack_note(test_note(NOTE_BLOCK_SIZE + 1)));
+    TEST_CHECK(music.channels[0].blocks[1]->refs == 1 && copy.channels[0].blocks[1]->refs == 1);
+
+    free_music(&copy);
+    TEST_CHECK(pack_note(get_channel_note(&music.channels[0], 2 * NOTE_BLOCK_SIZE + 5)) == pack_note(test_note(5)));
+    free_music(&music);
+}
+
+/**
+ * @fn int check_timeline(const channel_t *channel, const size_t classFrames[NOTE_TIME_CLASSES])
+ * @brief Compare l'index des durées d'un channel avec un parcours ligne par ligne
+ * @return Le nombre de lignes ou d'instants où l'index se trompe
+ */
+int check_timeline(const channel_t *channel, const size_t classFrames[NOTE_TIME_CLASSES]) {
+    int counts[NOTE_TIME_CLASSES], expected[NOTE_TIME_CLASSES] = { 0 }, line, c, errors = 0;
+    size_t start = 0, frame, lineStart;
+
+    for(line = 0; line <= TEST_TIMELINE_LINES + 2 * NOTE_BLOCK_SIZE; line++) {
+        get_channel_time_counts(channel, line, counts);
+        for(c = 0; c < NOTE_TIME_CLASSES; c++) {
+            if(counts[c] != expected[c]) errors++;
+        }
+        // Chaque instant de la ligne est retrouvé dans la ligne, avec son début
+        for(frame = start; frame < start + classFrames[line_class(channel, line)]; frame += 3) {
+            if(find_channel_line(channel, frame, classFrames, &lineStart) != line || lineStart != start) errors++;
+        }
+        start += classFrames[line_class(channel, line)];
+        expected[line_class(channel, line)]++;
+    }
+    return errors;
+}
+
+/**
+ * @fn void test_timeline()
+ * @brief L'index des durées (arbre de Fenwick) donne les mêmes comptes et les mêmes lignes qu'un parcours, après
+ * des modifications, des motifs liés et sur une copie qui n'a pas d'index
+ */
+void test_timeline() {
+    const size_t classFrames[NOTE_TIME_CLASSES] = { 10, 20, 40, 80, 160 };
+    channel_t *channel;
+    music_t music, copy;
+    int line;
+
+    init_music(&music, 120);
+    channel = &music.channels[0];
+    for(line = 0; line < TEST_TIMELINE_LINES; line++) {
+        if(line % 5 == 2 || (line / NOTE_BLOCK_SIZE) % 4 == 2) continue;
+        set_channel_note(channel, line, test_note(line));
+        update_channel_nbNotes(channel, line);
+    }
+    TEST_CHECK(channel->timeline != NULL);
+    TEST_CHECK(check_timeline(channel, classFrames) == 0);
+
+    // Changer la durée d'une note décale toutes les lignes suivantes
+    set_channel_note(channel, 100, create_note(3, 3, INSTRUMENT_NA, TIME_RONDE));
+    set_channel_note(channel, 101, create_note(3, 3, INSTRUMENT_NA, TIME_CROCHE_DOUBLE));
+    TEST_CHECK(check_timeline(channel, classFrames) == 0);
+    link_channel_pattern(channel, 5 * NOTE_BLOCK_SIZE, NOTE_BLOCK_SIZE);
+    // Un bloc lié à un bloc jamais écrit devient vide
+    link_channel_pattern(channel, 7 * NOTE_BLOCK_SIZE, 2 * NOTE_BLOCK_SIZE);
+    TEST_CHECK(check_timeline(channel, classFrames) == 0);
+
+    share_music(&copy, &music);
+    TEST_CHECK(copy.channels[0].timeline == NULL && check_timeline(&copy.channels[0], classFrames) == 0);
+    free_music(&copy);
+    free_music(&music);
+}
+
+int main() {
+    test_blocks();
+    test_occupancy();
+    test_patterns();
+    test_shared_music();
+    test_timeline();
+    return TEST_END();
+}
@@ -0,0 +1,79 @@
+/**
+ * @file test_snapshot.c
+ * @brief Tests des versions figées d'une musique : isolation des éditions, références et boîte d'un lecteur
+ * @version 1.0
+ * @author Tomas Salvado Robalo & Lukas Grando
+ */
+#include "snapshot.h"
+#include "test.h"
+
+/**
+ * @fn void test_frozen()
+ * @brief Une version ne voit pas les éditions faites après elle et survit à la musique éditée
+ */
+void test_frozen() {
+    music_snapshot_t *snapshot;
+    music_t music;
+    packed_note_t note = pack_note(create_note(3, 4, INSTRUMENT_NA, TIME_NOIRE));
+
+    init_music(&music, 120);
+    set_channel_note(&music.channels[0], 10, unpack_note(note));
+    update_channel_nbNotes(&music.channels[0], 10);
+    snapshot = create_snapshot(&music);
+    TEST_CHECK(snapshot->refs == 1 && snapshot->music.channels[0].blocks[0] == music.channels[0].blocks[0]);
+
+    set_channel_note(&music.channels[0], 10, create_note(7, 2, INSTRUMENT_NA, TIME_RONDE));
+    set_channel_note(&music.channels[1], 500, create_note(7, 2, INSTRUMENT_NA, TIME_RONDE));
+    update_channel_nbNotes(&music.channels[1], 500);
+    TEST_CHECK(pack_note(get_channel_note(&snapshot->music.channels[0], 10)) == note);
+    TEST_CHECK(snapshot->music.channels[1].nbNotes == 0 && is_channel_note_empty(&snapshot->music.channels[1], 500));
+
+    // La version reste lisible après la libération de la musique éditée
+    free_music(&music);
+    TEST_CHECK(pack_note(get_channel_note(&snapshot->music.channels[0], 10)) == note);
+    TEST_CHECK(retain_snapshot(snapshot) == snapshot && snapshot->refs == 2);
+    release_snapshot(snapshot);
+    TEST_CHECK(snapshot->refs == 1);
+    release_snapshot(snapshot);
+    release_snapshot(NULL);
+}
+
+/**
+ * @fn void test_mailbox()
+ * @brief Le lecteur prend la dernière version déposée ; une version remplacée avant d'être prise est rendue
+ */
+void test_mailbox() {
+    snapshot_mailbox_t mailbox = { NULL };
+    music_snapshot_t *first, *second, *third, *current;
+    music_t music;
+
+    init_music(&music, 120);
+    first = create_snapshot(&music);
+    TEST_CHECK(update_snapshot(&mailbox, first) == first);
+
+    // Le séquenceur garde une référence sur chaque version pour la vérifier
+    second = create_snapshot(&music);
+    third = create_snapshot(&music);
+    publish_snapshot(&mailbox, retain_snapshot(second));
+    publish_snapshot(&mailbox, retain_snapshot(third));
+    TEST_CHECK(second->refs == 1 && third->refs == 2);
+    retain_snapshot(first);
+    current = update_snapshot(&mailbox, first);
+    TEST_CHECK(current == third && first->refs == 1 && mailbox.latest == NULL);
+    TEST_CHECK(update_snapshot(&mailbox, current) == third);
+
+    publish_snapshot(&mailbox, retain_snapshot(second));
+    clear_mailbox(&mailbox);
+    TEST_CHECK(mailbox.latest == NULL && second->refs == 1);
+    release_snapshot(current);
+    release_snapshot(first);
+    release_snapshot(second);
+    release_snapshot(third);
+    free_music(&music);
+}
+
+int main() {
+    test_frozen();
+    test_mailbox();
+    return TEST_END();
+}